@@ -153,6 +153,9 @@ static int print_deref( LDAP *ld, LDAPControl *ctrl );
 #ifdef LDAP_CONTROL_X_WHATFAILED
 static int print_whatfailed( LDAP *ld, LDAPControl *ctrl );
 #endif
+#ifdef LDAP_CONTROL_X_COUNT
+static int print_count( LDAP *ld, LDAPControl *ctrl );
+#endif
 
 static struct tool_ctrls_t {
 	const char	*oid;
@@ -176,6 +179,9 @@ static struct tool_ctrls_t {
 #endif
 #ifdef LDAP_CONTROL_X_WHATFAILED
 	{ LDAP_CONTROL_X_WHATFAILED,			TOOL_ALL,	print_whatfailed },
+#endif
+#ifdef LDAP_CONTROL_X_COUNT
+	{ LDAP_CONTROL_X_COUNT,				TOOL_SEARCH,	print_count },
 #endif
 	{ NULL,						0,		NULL }
 };
@@ -2200,7 +2206,7 @@ print_vlv( LDAP *ld, LDAPControl *ctrl )
 			ber_memfree( bv.bv_val );
 
 		tool_write_ldif( ldif ? LDIF_PUT_COMMENT : LDIF_PUT_VALUE,
-			ldif ? "vlvResult" : "vlvResult", buf, rc );
+			ldif ? "vlvResult: " : "vlvResult", buf, rc );
 	}
 
 	return rc;
@@ -2330,6 +2336,43 @@ print_whatfailed( LDAP *ld, LDAPControl *ctrl )
 }
 #endif
 
+#ifdef LDAP_CONTROL_X_COUNT
+static int
+print_count( LDAP *ld, LDAPControl *ctrl )
+{
+	BerElement *ber;
+	ber_tag_t tag;
+	ber_len_t len;
+	ber_int_t count, estimated = 0;
+	char buf[ BUFSIZ ];
+	int n;
+
+	/* Create a BerElement from the berval returned in the control. */
+	ber = ber_init( &ctrl->ldctl_value );
+
+	if ( ber == NULL ) {
+		return LDAP_NO_MEMORY;
+	}
+
+	tag = ber_scanf( ber, "{i", &count );
+	if ( tag != LBER_ERROR && ber_peek_tag( ber, &len ) == LBER_BOOLEAN ) {
+		tag = ber_scanf( ber, "b", &estimated );
+	}
+	ber_free( ber, 1 );
+
+	if ( tag == LBER_ERROR ) {
+		return LDAP_DECODING_ERROR;
+	}
+
+	n = snprintf( buf, sizeof(buf), "%d%s", count,
+		estimated ? _(" (estimated)") : "" );
+	tool_write_ldif( ldif ? LDIF_PUT_COMMENT : LDIF_PUT_VALUE,
+		ldif ? "count: " : "count", buf, n );
+
+	return 0;
+}
+#endif
+
 #ifdef LDAP_CONTROL_AUTHZID_RESPONSE
 static int
 print_authzid( LDAP *ld, LDAPControl *ctrl )
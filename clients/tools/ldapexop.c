@@ -46,6 +46,7 @@ usage( void )
 	fprintf( stderr, _("       %s [options] whoami\n"), prog);
 	fprintf( stderr, _("       %s [options] cancel <id>\n"), prog);
 	fprintf( stderr, _("       %s [options] refresh <DN> [<ttl>]\n"), prog);
+	fprintf( stderr, _("       %s [options] backup <DN> <file> [compact|since=<txnid>]\n"), prog);
 	tool_common_usage();
 	exit( EXIT_FAILURE );
 }
@@ -76,6 +77,8 @@ main( int argc, char *argv[] )
 	LDAPControl **ctrls = NULL;
 	int		id, code;
 	LDAPMessage	*res = NULL;
+	FILE		*backup = NULL;
+	unsigned long	backup_size = 0;
 
 	tool_init( TOOL_EXOP );
 	prog = lutil_progname( "ldapexop", argc, argv );
@@ -161,6 +164,75 @@ main( int argc, char *argv[] )
 			goto skip;
 		}
 
+	} else if ( strcasecmp( argv[ 0 ], "backup" ) == 0 ) {
+		BerElement	*ber;
+		struct berval	reqdata;
+		int		flags = 0;
+		char		*since = NULL;
+
+		switch ( argc ) {
+		case 4:
+			if ( strncasecmp( argv[ 3 ], "since=", STRLENOF( "since=" ) ) == 0 ) {
+				since = argv[ 3 ] + STRLENOF( "since=" );
+				if ( *since == '\0' ) {
+					usage();
+				}
+			} else if ( strcasecmp( argv[ 3 ], "compact" ) == 0 ) {
+				flags |= LDAP_BACKUP_COMPACT;
+			} else {
+				usage();
+			}
+			/* fallthru */
+		case 3:
+			break;
+
+		default:
+			fprintf( stderr, _("need DN and file\n\n") );
+			usage();
+		}
+
+		if ( strcmp( argv[ 2 ], "-" ) == 0 ) {
+			backup = stdout;
+		} else {
+			backup = fopen( argv[ 2 ], "wb" );
+			if ( backup == NULL ) {
+				perror( argv[ 2 ] );
+				tool_exit( ld, EXIT_FAILURE );
+			}
+		}
+
+		ber = ber_alloc_t( LBER_USE_DER );
+		if ( ber == NULL ) {
+			tool_exit( ld, EXIT_FAILURE );
+		}
+		if ( since ) {
+			rc = ber_printf( ber, "{tsts}",
+				LDAP_TAG_EXOP_BACKUP_REQ_DN, argv[ 1 ],
+				LDAP_TAG_EXOP_BACKUP_REQ_SINCE, since );
+		} else if ( flags ) {
+			rc = ber_printf( ber, "{tsti}",
+				LDAP_TAG_EXOP_BACKUP_REQ_DN, argv[ 1 ],
+				LDAP_TAG_EXOP_BACKUP_REQ_FLAGS, flags );
+		} else {
+			rc = ber_printf( ber, "{ts}",
+				LDAP_TAG_EXOP_BACKUP_REQ_DN, argv[ 1 ] );
+		}
+		if ( rc < 0 || ber_flatten2( ber, &reqdata, 0 ) < 0 ) {
+			ber_free( ber, 1 );
+			tool_perror( "ber_printf", LDAP_ENCODING_ERROR, NULL, NULL, NULL, NULL );
+			tool_exit( ld, EXIT_FAILURE );
+		}
+
+		tool_server_controls( ld, NULL, 0 );
+
+		rc = ldap_extended_operation( ld, LDAP_EXOP_X_BACKUP, &reqdata, NULL, NULL, &id );
+		ber_free( ber, 1 );
+		if ( rc != LDAP_SUCCESS ) {
+			tool_perror( "ldap_extended_operation", rc, NULL, NULL, NULL, NULL );
+			rc = EXIT_FAILURE;
+			goto skip;
+		}
+
 	} else {
 		char *p;
 
@@ -219,13 +291,45 @@ main( int argc, char *argv[] )
 		tv.tv_sec = 0;
 		tv.tv_usec = 100000;
 
-		rc = ldap_result( ld, LDAP_RES_ANY, LDAP_MSG_ALL, &tv, &res );
+		/* a backup comes in intermediate responses, write each out */
+		rc = ldap_result( ld, LDAP_RES_ANY,
+			backup ? LDAP_MSG_ONE : LDAP_MSG_ALL, &tv, &res );
 		if ( rc < 0 ) {
 			tool_perror( "ldap_result", rc, NULL, NULL, NULL, NULL );
 			rc = EXIT_FAILURE;
 			goto skip;
 		}
 
+		if ( rc == LDAP_RES_INTERMEDIATE && backup ) {
+			struct berval	*retdata = NULL;
+
+			rc = ldap_parse_intermediate( ld, res, NULL, &retdata, NULL, 1 );
+			res = NULL;
+			if ( rc != LDAP_SUCCESS ) {
+				tool_perror( "ldap_parse_intermediate", rc, NULL, NULL, NULL, NULL );
+				rc = EXIT_FAILURE;
+				goto skip;
+			}
+			if ( retdata != NULL ) {
+				if ( fwrite( retdata->bv_val, 1, retdata->bv_len, backup )
+					!= retdata->bv_len )
+				{
+					perror( argv[ 2 ] );
+					ber_bvfree( retdata );
+					tool_exit( ld, EXIT_FAILURE );
+				}
+				if ( verbose && backup != stdout &&
+					( backup_size ^ ( backup_size + retdata->bv_len )) >> 24 )
+				{
+					fprintf( stderr, _("%lu bytes\n"),
+						backup_size + retdata->bv_len );
+				}
+				backup_size += retdata->bv_len;
+				ber_bvfree( retdata );
+			}
+			continue;
+		}
+
 		if ( rc != 0 ) {
 			break;
 		}
@@ -286,6 +390,16 @@ main( int argc, char *argv[] )
 
 		printf( "newttl=%d\n", newttl );
 
+	} else if ( strcasecmp( argv[ 0 ], "backup" ) == 0 ) {
+		if ( backup != stdout ) {
+			if ( fclose( backup ) != 0 ) {
+				perror( argv[ 2 ] );
+				rc = EXIT_FAILURE;
+				goto skip;
+			}
+			printf( "size=%lu\n", backup_size );
+		}
+
 	} else if ( tool_is_oid( argv[ 0 ] ) ) {
 		char		*retoid = NULL;
 		struct berval	*retdata = NULL;
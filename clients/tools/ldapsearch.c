@@ -126,6 +126,9 @@ usage( void )
 	fprintf( stderr, _("  -c         continuous operation mode (do not stop on errors)\n"));
 	fprintf( stderr, _("  -E [!]<ext>[=<extparam>] search extensions (! indicates criticality)\n"));
 	fprintf( stderr, _("             [!]domainScope              (domain scope)\n"));
+#ifdef LDAP_CONTROL_X_COUNT
+	fprintf( stderr, _("             [!]count                    (count entries only)\n"));
+#endif
 	fprintf( stderr, _("             !dontUseCopy                (Don't Use Copy)\n"));
 	fprintf( stderr, _("             [!]mv=<filter>              (RFC 3876 matched values filter)\n"));
 	fprintf( stderr, _("             [!]pr=<size>[/prompt|noprompt] (RFC 2696 paged results/prompt)\n"));
@@ -210,6 +213,10 @@ static int dontUseCopy = 0;
 
 static int domainScope = 0;
 
+#ifdef LDAP_CONTROL_X_COUNT
+static int countOnly = 0;
+#endif
+
 static int sss = 0;
 static LDAPSortKey **sss_keys = NULL;
 
@@ -465,6 +472,22 @@ handle_private_option( int i )
 
 			domainScope = 1 + crit;
 
+#ifdef LDAP_CONTROL_X_COUNT
+		} else if ( strcasecmp( control, "count" ) == 0 ) {
+			if( countOnly ) {
+				fprintf( stderr,
+					_("count control previously specified\n"));
+				exit( EXIT_FAILURE );
+			}
+			if( cvalue != NULL ) {
+				fprintf( stderr,
+			         _("count: no control value expected\n") );
+				usage();
+			}
+
+			countOnly = 1 + crit;
+#endif
+
 		} else if ( strcasecmp( control, "sss" ) == 0 ) {
 			char *keyp;
 			if( sss ) {
@@ -922,6 +945,9 @@ getNextPage:
 		|| derefcrit
 #endif
 		|| domainScope
+#ifdef LDAP_CONTROL_X_COUNT
+		|| countOnly
+#endif
 		|| pagedResults
 		|| ldapsync
 		|| sss
@@ -956,6 +982,20 @@ getNextPage:
 			i++;
 		}
 
+#ifdef LDAP_CONTROL_X_COUNT
+		if ( countOnly ) {
+			if ( ctrl_add() ) {
+				tool_exit( ld, EXIT_FAILURE );
+			}
+
+			c[i].ldctl_oid = LDAP_CONTROL_X_COUNT;
+			c[i].ldctl_value.bv_val = NULL;
+			c[i].ldctl_value.bv_len = 0;
+			c[i].ldctl_iscritical = countOnly > 1;
+			i++;
+		}
+#endif
+
 		if ( subentries ) {
 			if ( ctrl_add() ) {
 				tool_exit( ld, EXIT_FAILURE );
@@ -1187,6 +1227,12 @@ getNextPage:
 			printf(_("\n# with noop %scontrol"),
 				noop > 1 ? _("critical ") : "" );
 		}
+#ifdef LDAP_CONTROL_X_COUNT
+		if ( countOnly ) {
+			printf(_("\n# with count %scontrol"),
+				countOnly > 1 ? _("critical ") : "" );
+		}
+#endif
 		if ( subentries ) {
 			printf(_("\n# with subentries %scontrol: %s"),
 				subentries < 0 ? _("critical ") : "",
@@ -1301,7 +1347,8 @@ getNextPage:
 		int	i, moreEntries;
 
 		/* Loop to get the next window when 
-		 * enter is pressed on the terminal.
+		 * enter is pressed on the terminal,
+		 * until the end of the input.
 		 */
 		printf( _("Press [before/after(/offset/count|:value)] Enter for the next window.\n"));
 		i = 0;
@@ -1318,6 +1365,8 @@ getNextPage:
 			i = parse_vlv( strdup( buf ));
 			if ( i )
 				tool_exit( ld, EXIT_FAILURE );
+		} else if ( moreEntries == EOF ) {
+			vlv = 0;
 		} else {
 			vlvInfo.ldvlv_attrvalue = NULL;
 			vlvInfo.ldvlv_count = vlvCount;
@@ -1328,7 +1377,8 @@ getNextPage:
 			ber_bvfree( vlvInfo.ldvlv_context );
 		vlvInfo.ldvlv_context = vlvContext;
 
-		goto getNextPage;
+		if ( vlv )
+			goto getNextPage;
 	}
 
 	if ( base != NULL ) {
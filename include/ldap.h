@@ -320,6 +320,7 @@ typedef struct ldapcontrol {
 #define LDAP_CONTROL_VALSORT			"1.3.6.1.4.1.4203.666.5.14"
 #define	LDAP_CONTROL_X_DEREF			"1.3.6.1.4.1.4203.666.5.16"
 #define	LDAP_CONTROL_X_WHATFAILED		"1.3.6.1.4.1.4203.666.5.17"
+#define	LDAP_CONTROL_X_COUNT			"1.3.6.1.4.1.4203.666.5.19"
 
 /* LDAP Chaining Behavior Control *//* work in progress */
 /* <draft-sermersheim-ldap-chaining>;
@@ -400,6 +401,13 @@ typedef struct ldapcontrol {
 #define LDAP_TAG_EXOP_VERIFY_CREDENTIALS_SCREDS	 ((ber_tag_t) 0x81U)
 #define LDAP_TAG_EXOP_VERIFY_CREDENTIALS_CONTROLS ((ber_tag_t) 0xa2U) /* context specific + constructed + 2 */
 
+/* stream a copy of the database holding the DN, see slapd-mdb(5) */
+#define LDAP_EXOP_X_BACKUP		"1.3.6.1.4.1.4203.666.6.21"
+#define LDAP_TAG_EXOP_BACKUP_REQ_DN	((ber_tag_t) 0x80U)
+#define LDAP_TAG_EXOP_BACKUP_REQ_FLAGS	((ber_tag_t) 0x81U)
+#define LDAP_TAG_EXOP_BACKUP_REQ_SINCE	((ber_tag_t) 0x82U)
+#define LDAP_BACKUP_COMPACT		0x01	/* omit free pages, renumber */
+
 #define LDAP_EXOP_WHO_AM_I		"1.3.6.1.4.1.4203.1.11.3"		/* RFC 4532 */
 #define LDAP_EXOP_X_WHO_AM_I	LDAP_EXOP_WHO_AM_I
 
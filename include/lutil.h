@@ -356,6 +356,29 @@ lutil_unparse_time( char *buf, size_t buflen, unsigned long t );
 	} while ( 0 );
 #endif /* ! timermul */
 
+/* Sorted sets of IDs */
+/* idset.c */
+
+#define LUTIL_IDSET_AUTO	-1
+#define LUTIL_IDSET_SCALAR	0
+#define LUTIL_IDSET_SSE4	1
+#define LUTIL_IDSET_AVX2	2
+
+LDAP_LUTIL_F (int)
+lutil_idset_select( int impl );
+
+LDAP_LUTIL_F (unsigned long)
+lutil_idset_intersect( unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb );
+
+LDAP_LUTIL_F (unsigned long)
+lutil_idset_difference( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out );
+
+LDAP_LUTIL_F (unsigned long)
+lutil_idset_merge( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out );
+
 LDAP_END_DECL
 
 #endif /* _LUTIL_H */
@@ -48,6 +48,11 @@ int ldif_debug = 0;
 #define RIGHT4			0x0f
 #define CONTINUED_LINE_MARKER	'\r'
 
+#if defined(__SSE2__) && ( defined(__GNUC__) || defined(__clang__) )
+#define LDIF_SSE2	1
+#include <emmintrin.h>
+#endif
+
 #ifdef CSRIMALLOC
 #define ber_memalloc malloc
 #define ber_memcalloc calloc
@@ -177,8 +182,11 @@ ldif_parse_line2(
 		s++;
 	}
 
-	/* check for continued line markers that should be deleted */
-	for ( p = s, d = s; *p; p++ ) {
+	/* check for continued line markers that should be deleted; the
+	 * bytes before the first are left where they are */
+	for ( p = s; *p && *p != CONTINUED_LINE_MARKER; p++ )
+		;
+	for ( d = p; *p; p++ ) {
 		if ( *p != CONTINUED_LINE_MARKER )
 			*d++ = *p;
 	}
@@ -501,6 +509,80 @@ ldif_sput(
 	ldif_sput_wrap( out, type, name, val, vlen, LDIF_LINE_WIDTH+LDIF_KLUDGE );
 }
 
+/* The length of the leading printable ASCII characters of val,
+ * which can be written without base64.
+ */
+static ber_len_t
+ldif_text_len( const unsigned char *val, ber_len_t vlen )
+{
+	ber_len_t i = 0;
+
+#ifdef LDIF_SSE2
+	const __m128i sp = _mm_set1_epi8( 0x20 ), del = _mm_set1_epi8( 0x7f );
+
+	/* as signed bytes, those above 0x7f are below 0x20 too */
+	for ( ; i + 16 <= vlen; i += 16 ) {
+		__m128i x = _mm_loadu_si128( (const __m128i *)( val + i ));
+		int m = _mm_movemask_epi8( _mm_or_si128(
+			_mm_cmplt_epi8( x, sp ), _mm_cmpeq_epi8( x, del )));
+		if ( m )
+			return i + __builtin_ctz( m );
+	}
+#endif
+	for ( ; i < vlen; i++ ) {
+		if ( !isascii( val[i] ) || !isprint( val[i] ))
+			break;
+	}
+	return i;
+}
+
+/* Put the base64 digits of val from the n-th up to the m-th at out */
+static void
+ldif_b64_put(
+	char *out,
+	const unsigned char *val,
+	ber_len_t vlen,
+	ber_len_t n,
+	ber_len_t m )
+{
+	const unsigned char *byte;
+	unsigned long bits;
+	ber_len_t k;
+	char digits[4];
+
+	while ( n < m ) {
+		byte = val + n / 4 * 3;
+		k = vlen - n / 4 * 3;
+		if ( n % 4 == 0 && m - n >= 4 && k >= 3 ) {
+			/* whole groups */
+			k /= 3;
+			if ( k > ( m - n ) / 4 )
+				k = ( m - n ) / 4;
+			for ( n += 4 * k; k--; byte += 3, out += 4 ) {
+				bits = (unsigned long) byte[0] << 16 | byte[1] << 8 | byte[2];
+				out[0] = nib2b64[ bits >> 18 ];
+				out[1] = nib2b64[ ( bits >> 12 ) & 0x3f ];
+				out[2] = nib2b64[ ( bits >> 6 ) & 0x3f ];
+				out[3] = nib2b64[ bits & 0x3f ];
+			}
+			continue;
+		}
+
+		/* a group cut by a line end, or the padded last one */
+		bits = (unsigned long) byte[0] << 16;
+		if ( k > 1 )
+			bits |= byte[1] << 8;
+		if ( k > 2 )
+			bits |= byte[2];
+		digits[0] = nib2b64[ bits >> 18 ];
+		digits[1] = nib2b64[ ( bits >> 12 ) & 0x3f ];
+		digits[2] = k > 1 ? nib2b64[ ( bits >> 6 ) & 0x3f ] : '=';
+		digits[3] = k > 2 ? nib2b64[ bits & 0x3f ] : '=';
+		for ( k = n % 4; k < 4 && n < m; k++, n++ )
+			*out++ = digits[k];
+	}
+}
+
 void
 ldif_sput_wrap(
 	char **out,
@@ -510,16 +592,12 @@ ldif_sput_wrap(
 	ber_len_t vlen,
         ber_len_t wrap )
 {
-	const unsigned char *byte, *stop;
-	unsigned char	buf[3];
-	unsigned long	bits;
 	char		*save;
-	int		pad;
 	int		namelen = 0;
 
 	ber_len_t savelen;
 	ber_len_t len=0;
-	ber_len_t i;
+	ber_len_t i, n, b64len;
 
 	if ( !wrap )
 		wrap = LDIF_LINE_WIDTH+LDIF_KLUDGE;
@@ -613,11 +691,10 @@ ldif_sput_wrap(
 	*(*out)++ = ' ';
 	len++;
 
-	stop = (const unsigned char *) (val + vlen);
-
 	if ( type == LDIF_PUT_VALUE
 		&& isgraph( (unsigned char) val[0] ) && val[0] != ':' && val[0] != '<'
 		&& isgraph( (unsigned char) val[vlen-1] )
+		&& ldif_text_len( (const unsigned char *) val, vlen ) == vlen
 #ifndef LDAP_BINARY_DEBUG
 		&& strstr( name, ";binary" ) == NULL
 #endif
@@ -625,27 +702,21 @@ ldif_sput_wrap(
 		&& !ldif_must_b64_encode( name )
 #endif
 	) {
-		int b64 = 0;
-
-		for ( byte = (const unsigned char *) val; byte < stop;
-		    byte++, len++ )
-		{
-			if ( !isascii( *byte ) || !isprint( *byte ) ) {
-				b64 = 1;
-				break;
-			}
+		/* the value as is, a line at a time */
+		for ( i = 0; i < vlen; i += n, len += n ) {
 			if ( len >= wrap ) {
 				*(*out)++ = '\n';
 				*(*out)++ = ' ';
 				len = 1;
 			}
-			*(*out)++ = *byte;
-		}
-
-		if( !b64 ) {
-			*(*out)++ = '\n';
-			return;
+			n = wrap > len ? wrap - len : 1;
+			if ( n > vlen - i )
+				n = vlen - i;
+			AC_MEMCPY( *out, val + i, n );
+			*out += n;
 		}
+		*(*out)++ = '\n';
+		return;
 	}
 
 	*out = save;
@@ -653,54 +724,19 @@ ldif_sput_wrap(
 	*(*out)++ = ' ';
 	len = savelen + 2;
 
-	/* convert to base 64 (3 bytes => 4 base 64 digits) */
-	for ( byte = (const unsigned char *) val;
-		byte < stop - 2;
-	    byte += 3 )
-	{
-		bits = (byte[0] & 0xff) << 16;
-		bits |= (byte[1] & 0xff) << 8;
-		bits |= (byte[2] & 0xff);
-
-		for ( i = 0; i < 4; i++, len++, bits <<= 6 ) {
-			if ( len >= wrap ) {
-				*(*out)++ = '\n';
-				*(*out)++ = ' ';
-				len = 1;
-			}
-
-			/* get b64 digit from high order 6 bits */
-			*(*out)++ = nib2b64[ (bits & 0xfc0000L) >> 18 ];
-		}
-	}
-
-	/* add padding if necessary */
-	if ( byte < stop ) {
-		for ( i = 0; byte + i < stop; i++ ) {
-			buf[i] = byte[i];
-		}
-		for ( pad = 0; i < 3; i++, pad++ ) {
-			buf[i] = '\0';
-		}
-		byte = buf;
-		bits = (byte[0] & 0xff) << 16;
-		bits |= (byte[1] & 0xff) << 8;
-		bits |= (byte[2] & 0xff);
-
-		for ( i = 0; i < 4; i++, len++, bits <<= 6 ) {
-			if ( len >= wrap ) {
-				*(*out)++ = '\n';
-				*(*out)++ = ' ';
-				len = 1;
-			}
-
-			if( i + pad < 4 ) {
-				/* get b64 digit from low order 6 bits */
-				*(*out)++ = nib2b64[ (bits & 0xfc0000L) >> 18 ];
-			} else {
-				*(*out)++ = '=';
-			}
+	/* convert to base 64 (3 bytes => 4 base 64 digits), a line at a time */
+	b64len = ( vlen + 2 ) / 3 * 4;
+	for ( i = 0; i < b64len; i += n, len += n ) {
+		if ( len >= wrap ) {
+			*(*out)++ = '\n';
+			*(*out)++ = ' ';
+			len = 1;
 		}
+		n = wrap > len ? wrap - len : 1;
+		if ( n > b64len - i )
+			n = b64len - i;
+		ldif_b64_put( *out, (const unsigned char *) val, vlen, i, i + n );
+		*out += n;
 	}
 	*(*out)++ = '\n';
 }
@@ -826,8 +862,9 @@ ldif_read_record(
 	for ( stop = 0;  !stop;  last_ch = line[len-1] ) {
 		/* If we're at the end of this file, see if we should pop
 		 * back to a previous file. (return from an include)
+		 * The end is only seen once fgets fails, so pop on that.
 		 */
-		while ( feof( lfp->fp )) {
+		while ( fgets( line, sizeof( line ), lfp->fp ) == NULL ) {
 			if ( lfp->prev ) {
 				LDIFFP *tmp = lfp->prev;
 				fclose( lfp->fp );
@@ -838,14 +875,7 @@ ldif_read_record(
 				break;
 			}
 		}
-		if ( !stop ) {
-			if ( fgets( line, sizeof( line ), lfp->fp ) == NULL ) {
-				stop = 1;
-				len = 0;
-			} else {
-				len = strlen( line );
-			}
-		}
+		len = stop ? 0 : strlen( line );
 
 		if ( stop ) {
 			/* Add \n in case the file does not end with newline */
@@ -0,0 +1,472 @@
+/* ldiftest.c -- Check the LDIF and base64 encoders */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+/*
+ * ldif_sput_wrap() and lutil_b64_ntop() write whole lines and blocks
+ * at once, with vector instructions where the CPU has them. Their
+ * output is compared with that of the plain encoders they replaced,
+ * for values of every length up to a few lines, at wrap widths that
+ * fold them at every position of a base64 group, and with the bytes
+ * that make a value base64 at the start, the end and in between.
+ * lutil_b64_pton() must give the values back.
+ *
+ * Usage: ldiftest [-n values] [-s seed]
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/ctype.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/unistd.h>
+
+#include <ldap.h>
+
+#include "ldif.h"
+#include "lutil.h"
+
+#define LDIF_KLUDGE	2	/* as in ldif.c */
+
+static const char nib2b64[0x40] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int
+ref_must_b64_encode( LDAP_CONST char *s )
+{
+	return strcasecmp( s, "userPassword" ) == 0 ||
+		strcmp( s, "2.5.4.35" ) == 0;
+}
+
+/* ldif_sput_wrap() as it was, one byte at a time */
+
+static void
+ref_sput_wrap(
+	char **out,
+	int type,
+	LDAP_CONST char *name,
+	LDAP_CONST char *val,
+	ber_len_t vlen,
+        ber_len_t wrap )
+{
+	const unsigned char *byte, *stop;
+	unsigned char	buf[3];
+	unsigned long	bits;
+	char		*save;
+	int		pad;
+	int		namelen = 0;
+
+	ber_len_t savelen;
+	ber_len_t len=0;
+	ber_len_t i;
+
+	if ( !wrap )
+		wrap = LDIF_LINE_WIDTH+LDIF_KLUDGE;
+
+	/* prefix */
+	switch( type ) {
+	case LDIF_PUT_COMMENT:
+		*(*out)++ = '#';
+		len++;
+
+		if( vlen ) {
+			*(*out)++ = ' ';
+			len++;
+		}
+
+		break;
+
+	case LDIF_PUT_SEP:
+		*(*out)++ = '\n';
+		return;
+	}
+
+	/* name (attribute type) */
+	if( name != NULL ) {
+		/* put the name + ":" */
+		namelen = strlen(name);
+		strcpy(*out, name);
+		*out += namelen;
+		len += namelen;
+
+		if( type != LDIF_PUT_COMMENT ) {
+			*(*out)++ = ':';
+			len++;
+		}
+
+	}
+
+	if( vlen == 0 ) {
+		*(*out)++ = '\n';
+		return;
+	}
+
+	switch( type ) {
+	case LDIF_PUT_NOVALUE:
+		*(*out)++ = '\n';
+		return;
+
+	case LDIF_PUT_URL: /* url value */
+		*(*out)++ = '<';
+		len++;
+		break;
+
+	case LDIF_PUT_B64: /* base64 value */
+		*(*out)++ = ':';
+		len++;
+		break;
+	}
+
+	switch( type ) {
+	case LDIF_PUT_TEXT:
+	case LDIF_PUT_URL:
+	case LDIF_PUT_B64:
+		*(*out)++ = ' ';
+		len++;
+		/* fall-thru */
+
+	case LDIF_PUT_COMMENT:
+		/* pre-encoded names */
+		for ( i=0; i < vlen; i++ ) {
+			if ( len > wrap ) {
+				*(*out)++ = '\n';
+				*(*out)++ = ' ';
+				len = 1;
+			}
+
+			*(*out)++ = val[i];
+			len++;
+		}
+		*(*out)++ = '\n';
+		return;
+	}
+
+	save = *out;
+	savelen = len;
+
+	*(*out)++ = ' ';
+	len++;
+
+	stop = (const unsigned char *) (val + vlen);
+
+	if ( type == LDIF_PUT_VALUE
+		&& isgraph( (unsigned char) val[0] ) && val[0] != ':' && val[0] != '<'
+		&& isgraph( (unsigned char) val[vlen-1] )
+#ifndef LDAP_BINARY_DEBUG
+		&& strstr( name, ";binary" ) == NULL
+#endif
+#ifndef LDAP_PASSWD_DEBUG
+		&& !ref_must_b64_encode( name )
+#endif
+	) {
+		int b64 = 0;
+
+		for ( byte = (const unsigned char *) val; byte < stop;
+		    byte++, len++ )
+		{
+			if ( !isascii( *byte ) || !isprint( *byte ) ) {
+				b64 = 1;
+				break;
+			}
+			if ( len >= wrap ) {
+				*(*out)++ = '\n';
+				*(*out)++ = ' ';
+				len = 1;
+			}
+			*(*out)++ = *byte;
+		}
+
+		if( !b64 ) {
+			*(*out)++ = '\n';
+			return;
+		}
+	}
+
+	*out = save;
+	*(*out)++ = ':';
+	*(*out)++ = ' ';
+	len = savelen + 2;
+
+	/* convert to base 64 (3 bytes => 4 base 64 digits) */
+	for ( byte = (const unsigned char *) val;
+		byte < stop - 2;
+	    byte += 3 )
+	{
+		bits = (byte[0] & 0xff) << 16;
+		bits |= (byte[1] & 0xff) << 8;
+		bits |= (byte[2] & 0xff);
+
+		for ( i = 0; i < 4; i++, len++, bits <<= 6 ) {
+			if ( len >= wrap ) {
+				*(*out)++ = '\n';
+				*(*out)++ = ' ';
+				len = 1;
+			}
+
+			/* get b64 digit from high order 6 bits */
+			*(*out)++ = nib2b64[ (bits & 0xfc0000L) >> 18 ];
+		}
+	}
+
+	/* add padding if necessary */
+	if ( byte < stop ) {
+		for ( i = 0; byte + i < stop; i++ ) {
+			buf[i] = byte[i];
+		}
+		for ( pad = 0; i < 3; i++, pad++ ) {
+			buf[i] = '\0';
+		}
+		byte = buf;
+		bits = (byte[0] & 0xff) << 16;
+		bits |= (byte[1] & 0xff) << 8;
+		bits |= (byte[2] & 0xff);
+
+		for ( i = 0; i < 4; i++, len++, bits <<= 6 ) {
+			if ( len >= wrap ) {
+				*(*out)++ = '\n';
+				*(*out)++ = ' ';
+				len = 1;
+			}
+
+			if( i + pad < 4 ) {
+				/* get b64 digit from low order 6 bits */
+				*(*out)++ = nib2b64[ (bits & 0xfc0000L) >> 18 ];
+			} else {
+				*(*out)++ = '=';
+			}
+		}
+	}
+	*(*out)++ = '\n';
+}
+
+/* lutil_b64_ntop() as it was, one group at a time */
+static int
+ref_b64_ntop( const unsigned char *src, size_t srclength, char *target,
+	size_t targsize )
+{
+	size_t n = 0;
+	unsigned long bits;
+
+	for ( ; srclength > 2; srclength -= 3, src += 3 ) {
+		if ( n + 4 > targsize )
+			return -1;
+		bits = (unsigned long) src[0] << 16 | src[1] << 8 | src[2];
+		target[n++] = nib2b64[ bits >> 18 ];
+		target[n++] = nib2b64[ ( bits >> 12 ) & 0x3f ];
+		target[n++] = nib2b64[ ( bits >> 6 ) & 0x3f ];
+		target[n++] = nib2b64[ bits & 0x3f ];
+	}
+	if ( srclength ) {
+		if ( n + 4 > targsize )
+			return -1;
+		bits = (unsigned long) src[0] << 16;
+		if ( srclength > 1 )
+			bits |= src[1] << 8;
+		target[n++] = nib2b64[ bits >> 18 ];
+		target[n++] = nib2b64[ ( bits >> 12 ) & 0x3f ];
+		target[n++] = srclength > 1 ? nib2b64[ ( bits >> 6 ) & 0x3f ] : '=';
+		target[n++] = '=';
+	}
+	if ( n >= targsize )
+		return -1;
+	target[n] = '\0';
+	return n;
+}
+
+#define MAXLEN	300
+
+static const char *names[] = {
+	"cn", "description", "userPassword", "jpegPhoto;binary", NULL
+};
+
+static const ber_len_t wraps[] = {
+	0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 15, 16, 17, 31, 32, 33,
+	LDIF_LINE_WIDTH - 1, LDIF_LINE_WIDTH, LDIF_LINE_WIDTH + 1,
+	LDIF_LINE_WIDTH + 2, LDIF_LINE_WIDTH_MAX, (ber_len_t)-1
+};
+
+static const int types[] = {
+	LDIF_PUT_VALUE, LDIF_PUT_TEXT, LDIF_PUT_B64, LDIF_PUT_URL,
+	LDIF_PUT_COMMENT, -1
+};
+
+/* Fill val with printable bytes, and then make it need base64 by
+ * putting a byte that isn't at position at, unless it is vlen.
+ */
+static void
+mkval( unsigned char *val, ber_len_t vlen, ber_len_t at, int how )
+{
+	ber_len_t i;
+
+	for ( i = 0; i < vlen; i++ )
+		val[i] = ' ' + 1 + random() % ( '~' - ' ' );
+	if ( at < vlen ) {
+		switch ( how ) {
+		case 0:	val[at] = 0x80 + random() % 0x80; break;
+		case 1:	val[at] = ' '; break;
+		case 2:	val[at] = '\n'; break;
+		case 3:	val[at] = '\0'; break;
+		case 4:	val[at] = 0x7f; break;
+		}
+	}
+}
+
+static int
+check_ldif( const unsigned char *val, ber_len_t vlen, char *buf1,
+	char *buf2 )
+{
+	int i, j, t, bad = 0;
+
+	for ( i = 0; names[i]; i++ ) {
+		for ( j = 0; wraps[j] != (ber_len_t)-1; j++ ) {
+			for ( t = 0; types[t] >= 0; t++ ) {
+				const char *name = types[t] == LDIF_PUT_COMMENT ?
+					NULL : names[i];
+				char *p1 = buf1, *p2 = buf2;
+
+				ldif_sput_wrap( &p1, types[t], name,
+					(const char *) val, vlen, wraps[j] );
+				ref_sput_wrap( &p2, types[t], name,
+					(const char *) val, vlen, wraps[j] );
+				if ( p1 - buf1 != p2 - buf2 ||
+					memcmp( buf1, buf2, p2 - buf2 ))
+				{
+					printf( "ldif_sput_wrap: type %d name %s "
+						"length %lu wrap %lu differs\n",
+						types[t], name ? name : "(none)",
+						(unsigned long) vlen,
+						(unsigned long) wraps[j] );
+					bad++;
+				}
+			}
+		}
+	}
+	return bad;
+}
+
+static int
+check_b64( const unsigned char *val, ber_len_t vlen, char *buf1,
+	char *buf2, unsigned char *dec )
+{
+	size_t need = ( vlen + 2 ) / 3 * 4 + 1, size;
+	int n1, n2, bad = 0;
+	char *p, *q;
+
+	/* too small, just right and a lot bigger */
+	for ( size = need - 1; size <= need + 64; size += size == need ? 64 : 1 ) {
+		n1 = lutil_b64_ntop( val, vlen, buf1, size );
+		n2 = ref_b64_ntop( val, vlen, buf2, size );
+		if ( n1 != n2 || ( n2 >= 0 && memcmp( buf1, buf2, n2 + 1 ))) {
+			printf( "lutil_b64_ntop: length %lu size %lu differs\n",
+				(unsigned long) vlen, (unsigned long) size );
+			bad++;
+		}
+	}
+	n2 = ref_b64_ntop( val, vlen, buf2, need );
+
+	if ( lutil_b64_pton( buf2, dec, vlen + 16 ) != (int) vlen ||
+		memcmp( dec, val, vlen ))
+	{
+		printf( "lutil_b64_pton: length %lu differs\n",
+			(unsigned long) vlen );
+		bad++;
+	}
+
+	/* folded as in LDIF */
+	for ( p = buf2, q = buf1; *p; p++ ) {
+		if ( p > buf2 && ( p - buf2 ) % 19 == 0 ) {
+			*q++ = '\n';
+			*q++ = ' ';
+		}
+		*q++ = *p;
+	}
+	*q = '\0';
+	if ( lutil_b64_pton( buf1, dec, vlen + 16 ) != (int) vlen ||
+		memcmp( dec, val, vlen ))
+	{
+		printf( "lutil_b64_pton: folded length %lu differs\n",
+			(unsigned long) vlen );
+		bad++;
+	}
+
+	/* a digit that isn't one */
+	if ( n2 > 0 ) {
+		p = buf2 + random() % n2;
+		if ( *p != '=' ) {
+			*p = '!';
+			if ( lutil_b64_pton( buf2, dec, vlen + 16 ) != -1 ) {
+				printf( "lutil_b64_pton: length %lu took a bad digit\n",
+					(unsigned long) vlen );
+				bad++;
+			}
+		}
+	}
+	return bad;
+}
+
+int
+main( int argc, char **argv )
+{
+	unsigned char val[MAXLEN], dec[MAXLEN + 16];
+	char *buf1, *buf2;
+	ber_len_t vlen, at;
+	size_t size;
+	int c, i, how, values = 4, bad = 0;
+	unsigned seed = 1;
+
+	while (( c = getopt( argc, argv, "n:s:" )) != EOF ) {
+		switch ( c ) {
+		case 'n':
+			values = atoi( optarg );
+			break;
+		case 's':
+			seed = atoi( optarg );
+			break;
+		default:
+			fprintf( stderr, "usage: %s [-n values] [-s seed]\n", argv[0] );
+			return 1;
+		}
+	}
+	srandom( seed );
+
+	/* the narrowest wrap folds most */
+	size = LDIF_SIZE_NEEDED_WRAP( sizeof( "jpegPhoto;binary" ), MAXLEN, 2 );
+	buf1 = malloc( size );
+	buf2 = malloc( size );
+
+	for ( vlen = 0; vlen < MAXLEN; vlen++ ) {
+		for ( i = 0; i < values; i++ ) {
+			/* all text, and the other bytes at either end */
+			mkval( val, vlen, vlen, 0 );
+			bad += check_ldif( val, vlen, buf1, buf2 );
+			bad += check_b64( val, vlen, buf1, buf2, dec );
+			for ( how = 0; how < 5 && vlen; how++ ) {
+				at = i & 1 ? vlen - 1 : 0;
+				if ( i > 1 )
+					at = random() % vlen;
+				mkval( val, vlen, at, how );
+				bad += check_ldif( val, vlen, buf1, buf2 );
+				bad += check_b64( val, vlen, buf1, buf2, dec );
+			}
+		}
+	}
+
+	free( buf1 );
+	free( buf2 );
+	if ( !bad )
+		printf( "ldiftest: all values encoded alike\n" );
+	return bad ? 1 : 0;
+}
@@ -297,6 +297,8 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_NORDAHEAD	0x800000
 	/** don't initialize malloc'd memory before writing to datafile */
 #define MDB_NOMEMINIT	0x1000000
+	/** keep track of the pages each txn writes, for incremental copies */
+#define MDB_TRACKPAGES	0x2000000
 /** @} */
 
 /**	@defgroup	mdb_dbi_open	Database Flags
@@ -604,6 +606,16 @@ int  mdb_env_create(MDB_env **env);
 	 *		caller is expected to overwrite all of the memory that was
 	 *		reserved in that case.
 	 *		This flag may be changed at any time using #mdb_env_set_flags().
+	 *	<li>#MDB_TRACKPAGES
+	 *		Record the ID of the transaction that last wrote each page, so
+	 *		that #mdb_env_copyfd_incr() can copy only the pages written since
+	 *		an earlier copy. The IDs are kept in the file track.mdb (or the
+	 *		data file's name with "-track" appended, with #MDB_NOSUBDIR),
+	 *		and are complete from the first write transaction with this flag
+	 *		on. That transaction marks the environment, and from then on
+	 *		every writer records its pages, with this flag or without; with
+	 *		#MDB_NOSYNC, records lost in a system crash show as pages that
+	 *		were not written. Not supported on Windows.
 	 * </ul>
 	 * @param[in] mode The UNIX permissions to set on created files and semaphores.
 	 * This parameter is ignored on Windows.
@@ -694,6 +706,62 @@ int  mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags);
 	 */
 int  mdb_env_copyfd2(MDB_env *env, mdb_filehandle_t fd, unsigned int flags);
 
+	/** @brief Copy the pages of an LMDB environment written since a txn
+	 *	to the specified file descriptor.
+	 *
+	 * The copy holds the pages written by transactions after \b since
+	 * and the meta pages, and #mdb_env_apply_incr() brings a copy of
+	 * the environment as of \b since, or of any later txn before the
+	 * one copied, up to date with it. The environment must have been
+	 * opened with #MDB_TRACKPAGES, by some process, since the txn \b since:
+	 * from then on, every writer records the ID of the txn that last
+	 * wrote each page in a file of its own, track.mdb, which is synced
+	 * along with the data. A writer built without page tracking leaves
+	 * the pages it writes unrecorded, and the pages are then only tracked
+	 * from the next txn of a writer that records them. A copy made with
+	 * #MDB_CP_COMPACT can not be brought up to date. Not supported on
+	 * Windows.
+	 * @note This call can trigger significant file size growth if run in
+	 * parallel with write transactions, because it employs a read-only
+	 * transaction. See long-lived transactions under @ref caveats_sec.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] fd The filedescriptor to write the copy to. It must
+	 * have already been opened for Write access.
+	 * @param[in] since The ID of the last txn of the copy to be brought
+	 * up to date, as #MDB_envinfo.me_last_txnid shows it.
+	 * @return A non-zero error value on failure and 0 on success. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>#MDB_INCOMPATIBLE - pages are not tracked as far back as \b since,
+	 *	or the last txn didn't record the pages it wrote.
+	 * </ul>
+	 */
+int  mdb_env_copyfd_incr(MDB_env *env, mdb_filehandle_t fd, size_t since);
+
+	/** @brief Apply an incremental copy to a copy of an LMDB environment.
+	 *
+	 * The pages of the incremental copy made by #mdb_env_copyfd_incr()
+	 * are written to the environment at \b path, and its meta pages
+	 * last, so that it turns into a copy of the environment as of the
+	 * txn the incremental copy was made in. The environment must not
+	 * be open; if this call fails after it began to write pages, it
+	 * can not be used any more, so it should be applied to a copy.
+	 * Not supported on Windows.
+	 * @param[in] path The directory of the environment, or its data file
+	 * with #MDB_NOSUBDIR.
+	 * @param[in] fd The filedescriptor to read the incremental copy from.
+	 * @param[in] flags 0 or #MDB_NOSUBDIR.
+	 * @return A non-zero error value on failure and 0 on success. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>#MDB_INVALID - the incremental copy is damaged or cut short.
+	 *	<li>#MDB_INCOMPATIBLE - the environment is older than the txn the
+	 *	incremental copy is since, or not older than its own.
+	 * </ul>
+	 */
+int  mdb_env_apply_incr(const char *path, mdb_filehandle_t fd, unsigned int flags);
+
 	/** @brief Return statistics about the LMDB environment.
 	 *
 	 * @param[in] env An environment handle returned by #mdb_env_create()
@@ -1243,6 +1243,8 @@ struct MDB_env {
 	unsigned int	me_maxkey;	/**< max size of a key */
 #endif
 	int		me_live_reader;		/**< have liveness lock in reader table */
+	txnid_t		*me_track;		/**< the memory map of the track file, or NULL */
+	pgno_t		me_trackmax;	/**< number of pages #me_track covers */
 #ifdef _WIN32
 	int		me_pidquery;		/**< Used in OpenProcess */
 #endif
@@ -2472,6 +2474,11 @@ mdb_env_sync(MDB_env *env, int force)
 			if (MDB_FDATASYNC(env->me_fd))
 				rc = ErrCode();
 		}
+		/* The stamps of the pages must be on disk before their meta */
+		if (!rc && env->me_track && MDB_MSYNC(env->me_track,
+			env->me_trackmax * sizeof(txnid_t),
+			((env->me_flags & MDB_MAPASYNC) && !force) ? MS_ASYNC : MS_SYNC))
+			rc = ErrCode();
 	}
 	return rc;
 }
@@ -2609,6 +2616,160 @@ mdb_reader_pid(MDB_env *env, enum Pidlock_op op, MDB_PID_T pid)
 #endif
 }
 
+/** @defgroup track	Page tracking
+ *	@ingroup internal
+ *	With #MDB_TRACKPAGES the ID of the txn that last wrote each page is
+ *	kept in a file of its own, an array of #txnid_t indexed by page
+ *	number, so that #mdb_env_copyfd_incr() can copy just the pages
+ *	written since a given txn. The first #MDB_TRACK_SLOTS slots hold
+ *	#MDB_TRACK_MAGIC, the txn after which the stamps are complete and
+ *	the last txn that stamped its pages. Once a txn has committed with
+ *	it, the environment keeps #MDB_TRACKING in its meta flags and every
+ *	writer stamps the pages it writes; the stamps are synced along with
+ *	the data, before the meta page.
+ *
+ *	A writer that doesn't know of the track file keeps the meta flag
+ *	but stamps nothing, and leaves the last stamped txn behind the meta
+ *	page. Stamps are then only complete again from the next txn that
+ *	does stamp, and copies since an earlier txn are refused.
+ *	@{
+ */
+	/** The name of the track file in the DB environment */
+#define TRACKNAME	"/track.mdb"
+	/** The suffix of the track file when no subdir is used */
+#define TRACKSUFF	"-track"
+	/** Stamp in slot 0 of the track file */
+#define MDB_TRACK_MAGIC	0xBEEFC0E1
+	/** Slot of the txn after which the stamps are complete */
+#define MDB_TRACK_START	1
+	/** Slot of the last txn that stamped the pages it wrote */
+#define MDB_TRACK_LAST	2
+	/** Number of slots before the stamps of the pages */
+#define MDB_TRACK_SLOTS	3
+	/** Slot of the stamp of page \b pg, which is not a meta page */
+#define MDB_TRACK_SLOT(pg)	((pg) - NUM_METAS + MDB_TRACK_SLOTS)
+	/** Meta flag: writers keep the track file up to date */
+#define MDB_TRACKING	0x1000
+
+#ifndef _WIN32
+	/** Return the malloc'd path of the track file, or NULL. */
+static char * ESECT
+mdb_track_path(MDB_env *env)
+{
+	size_t len = strlen(env->me_path) + sizeof(TRACKNAME);
+	char *path = malloc(len);
+
+	if (path)
+		sprintf(path, (env->me_flags & MDB_NOSUBDIR) ? "%s" TRACKSUFF :
+			"%s" TRACKNAME, env->me_path);
+	return path;
+}
+
+	/** Map the track file of an environment, creating it if needed.
+	 * @param[in] env the environment
+	 * @param[in] write map it for writing, and make it cover #me_maxpg
+	 * @param[out] track the map
+	 * @param[in,out] size the size of the map, at least this on entry
+	 * @return 0 on success, non-zero on failure.
+	 */
+static int ESECT
+mdb_track_map(MDB_env *env, int write, txnid_t **track, size_t *size)
+{
+	struct stat st;
+	char *path;
+	void *map;
+	int fd, rc = MDB_SUCCESS;
+
+	if (!(path = mdb_track_path(env)))
+		return ENOMEM;
+	if (fstat(env->me_fd, &st)) {
+		rc = ErrCode();
+		free(path);
+		return rc;
+	}
+	fd = open(path, write ? O_RDWR|O_CREAT : O_RDONLY, st.st_mode & 0777);
+	free(path);
+	if (fd < 0)
+		return write ? ErrCode() : MDB_INCOMPATIBLE;
+	if (fstat(fd, &st)) {
+		rc = ErrCode();
+	} else if ((size_t)st.st_size < *size) {
+		if (!write)
+			rc = MDB_INCOMPATIBLE;
+		else if (ftruncate(fd, *size))
+			rc = ErrCode();
+	} else {
+		*size = st.st_size;
+	}
+	if (!rc) {
+		map = mmap(NULL, *size, write ? PROT_READ|PROT_WRITE : PROT_READ,
+			MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED)
+			rc = ErrCode();
+		else
+			*track = map;
+	}
+	close(fd);
+	return rc;
+}
+#endif
+
+	/** Set up page tracking for a write txn, as the meta flags or
+	 * #MDB_TRACKPAGES ask for.
+	 * @param[in] txn the write txn, just begun
+	 * @return 0 on success, non-zero on failure.
+	 */
+static int
+mdb_track_begin(MDB_txn *txn)
+{
+	MDB_env *env = txn->mt_env;
+	int on = txn->mt_dbs[FREE_DBI].md_flags & MDB_TRACKING;
+
+	if (!on && !(env->me_flags & MDB_TRACKPAGES))
+		return MDB_SUCCESS;
+#ifdef _WIN32
+	return MDB_INCOMPATIBLE;
+#else
+	if (!env->me_track || env->me_trackmax < MDB_TRACK_SLOT(env->me_maxpg)) {
+		size_t size = (MDB_TRACK_SLOT(env->me_maxpg) * sizeof(txnid_t) +
+			env->me_os_psize - 1) & ~(size_t)(env->me_os_psize - 1);
+		txnid_t *track;
+		int rc = mdb_track_map(env, 1, &track, &size);
+		if (rc)
+			return rc;
+		if (env->me_track)
+			munmap((void *)env->me_track, env->me_trackmax * sizeof(txnid_t));
+		env->me_track = track;
+		env->me_trackmax = size / sizeof(txnid_t);
+	}
+	if (!on || env->me_track[0] != MDB_TRACK_MAGIC ||
+		env->me_track[MDB_TRACK_LAST] != txn->mt_txnid - 1) {
+		/* Stamps are complete from this txn on. Pages still stamped
+		 * from an earlier time were not written since then either.
+		 * The same goes when the last txn didn't stamp its pages.
+		 */
+		env->me_track[0] = MDB_TRACK_MAGIC;
+		env->me_track[MDB_TRACK_START] = txn->mt_txnid - 1;
+		env->me_track[MDB_TRACK_LAST] = txn->mt_txnid - 1;
+		txn->mt_dbs[FREE_DBI].md_flags |= MDB_TRACKING;
+		txn->mt_flags |= MDB_TXN_DIRTY;
+	}
+	return MDB_SUCCESS;
+#endif
+}
+
+	/** Stamp a page, and any overflow pages after it, as written by a txn. */
+static void
+mdb_track_stamp(MDB_txn *txn, pgno_t pgno, MDB_page *dp)
+{
+	txnid_t *track = txn->mt_env->me_track + MDB_TRACK_SLOT(pgno);
+	pgno_t n = IS_OVERFLOW(dp) ? dp->mp_pages : 1;
+
+	while (n--)
+		*track++ = txn->mt_txnid;
+}
+/** @} */
+
 /** Common code for #mdb_txn_begin() and #mdb_txn_renew().
  * @param[in] txn the transaction handle to initialize
  * @return 0 on success, non-zero on failure.
@@ -2738,7 +2899,7 @@ mdb_txn_renew0(MDB_txn *txn)
 		rc = MDB_PANIC;
 	} else if (env->me_maxpg < txn->mt_next_pgno) {
 		rc = MDB_MAP_RESIZED;
-	} else {
+	} else if (flags || !(rc = mdb_track_begin(txn))) {
 		return MDB_SUCCESS;
 	}
 	mdb_txn_end(txn, new_notls /*0 or MDB_END_SLOT*/ | MDB_END_FAIL_BEGIN);
@@ -3235,6 +3396,8 @@ mdb_page_flush(MDB_txn *txn, int keep)
 				continue;
 			}
 			dp->mp_flags &= ~P_DIRTY;
+			if (env->me_track)
+				mdb_track_stamp(txn, dl[i].mid, dp);
 		}
 		goto done;
 	}
@@ -3252,6 +3415,8 @@ mdb_page_flush(MDB_txn *txn, int keep)
 			pgno = dl[i].mid;
 			/* clear dirty flag */
 			dp->mp_flags &= ~P_DIRTY;
+			if (env->me_track)
+				mdb_track_stamp(txn, pgno, dp);
 			pos = pgno * psize;
 			size = psize;
 			if (IS_OVERFLOW(dp)) size *= dp->mp_pages;
@@ -3564,8 +3729,11 @@ mdb_txn_commit(MDB_txn *txn)
 	mdb_audit(txn);
 #endif
 
-	if ((rc = mdb_page_flush(txn, 0)) ||
-		(rc = mdb_env_sync(env, 0)) ||
+	if ((rc = mdb_page_flush(txn, 0)))
+		goto fail;
+	if (env->me_track)
+		env->me_track[MDB_TRACK_LAST] = txn->mt_txnid;
+	if ((rc = mdb_env_sync(env, 0)) ||
 		(rc = mdb_env_write_meta(txn)))
 		goto fail;
 	end_mode = MDB_END_COMMITTED|MDB_END_UPDATE;
@@ -4683,7 +4851,7 @@ fail:
 	 */
 #define	CHANGEABLE	(MDB_NOSYNC|MDB_NOMETASYNC|MDB_MAPASYNC|MDB_NOMEMINIT)
 #define	CHANGELESS	(MDB_FIXEDMAP|MDB_NOSUBDIR|MDB_RDONLY| \
-	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD)
+	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD|MDB_TRACKPAGES)
 
 #if VALID_FLAGS & PERSISTENT_FLAGS & (CHANGEABLE|CHANGELESS)
 # error "Persistent DB flags & env flags overlap, but both go in mm_flags"
@@ -4885,6 +5053,10 @@ mdb_env_close0(MDB_env *env, int excl)
 	if (env->me_map) {
 		munmap(env->me_map, env->me_mapsize);
 	}
+	if (env->me_track) {
+		munmap((void *)env->me_track, env->me_trackmax * sizeof(txnid_t));
+		env->me_track = NULL;
+	}
 	if (env->me_mfd != env->me_fd && env->me_mfd != INVALID_HANDLE_VALUE)
 		(void) close(env->me_mfd);
 	if (env->me_fd != INVALID_HANDLE_VALUE)
@@ -9259,6 +9431,289 @@ mdb_env_copyfd2(MDB_env *env, HANDLE fd, unsigned int flags)
 		return mdb_env_copyfd0(env, fd);
 }
 
+/** @addtogroup track
+ *	An incremental copy is a header, #MDB_incr, followed by runs of
+ *	pages: an #MDB_incr_run and the pages it counts. The pages with
+ *	stamps after the txn it is since come first, then a run of the
+ *	meta pages with page number 0, and a run of no pages ends it.
+ *	@{
+ */
+	/** Stamp in the header of an incremental copy */
+#define MDB_INCR_MAGIC	0xBEEFC0DF
+
+	/** The header of an incremental copy */
+typedef struct MDB_incr {
+	uint32_t	mi_magic;		/**< #MDB_INCR_MAGIC */
+	uint32_t	mi_version;		/**< #MDB_DATA_VERSION */
+	uint32_t	mi_psize;		/**< page size */
+	uint32_t	mi_pad;
+	txnid_t		mi_since;		/**< pages written after this txn */
+	txnid_t		mi_txnid;		/**< txn of the copy */
+	pgno_t		mi_last_pg;		/**< last used page in the copy */
+} MDB_incr;
+
+	/** A run of pages in an incremental copy */
+typedef struct MDB_incr_run {
+	pgno_t		mr_pgno;		/**< first page */
+	pgno_t		mr_count;		/**< number of pages */
+} MDB_incr_run;
+
+#ifndef _WIN32
+	/** Write all of a buffer to a file descriptor. */
+static int ESECT
+mdb_fd_write(HANDLE fd, const char *ptr, size_t size)
+{
+	ssize_t len;
+
+	while (size > 0) {
+		len = write(fd, ptr, size > MAX_WRITE ? MAX_WRITE : size);
+		if (len < 0) {
+			if (ErrCode() == EINTR)
+				continue;
+			return ErrCode();
+		}
+		if (len == 0)
+			return EIO;
+		ptr += len;
+		size -= len;
+	}
+	return MDB_SUCCESS;
+}
+
+	/** Read all of a buffer from a file descriptor.
+	 * @return 0 on success, #MDB_INVALID if the file ends first.
+	 */
+static int ESECT
+mdb_fd_read(HANDLE fd, char *ptr, size_t size)
+{
+	ssize_t len;
+
+	while (size > 0) {
+		len = read(fd, ptr, size);
+		if (len < 0) {
+			if (ErrCode() == EINTR)
+				continue;
+			return ErrCode();
+		}
+		if (len == 0)
+			return MDB_INVALID;
+		ptr += len;
+		size -= len;
+	}
+	return MDB_SUCCESS;
+}
+#endif
+
+int ESECT
+mdb_env_copyfd_incr(MDB_env *env, HANDLE fd, size_t since)
+{
+#ifdef _WIN32
+	return MDB_INCOMPATIBLE;
+#else
+	MDB_txn *txn = NULL;
+	mdb_mutexref_t wmutex = NULL;
+	MDB_incr hdr;
+	MDB_incr_run run;
+	txnid_t *track = NULL, *stamps;
+	size_t tsize = 0, psize = env->me_psize;
+	char *metas;
+	pgno_t pg, n;
+	int rc;
+
+	metas = malloc(psize * NUM_METAS);
+	if (!metas)
+		return ENOMEM;
+
+	/* Take the meta pages and start the read txn together, as
+	 * mdb_env_copyfd0() does.
+	 */
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc)
+		goto leave;
+	if (env->me_txns) {
+		mdb_txn_end(txn, MDB_END_RESET_TMP);
+		wmutex = env->me_wmutex;
+		if (LOCK_MUTEX(rc, env, wmutex))
+			goto leave;
+		rc = mdb_txn_renew0(txn);
+		if (rc) {
+			UNLOCK_MUTEX(wmutex);
+			goto leave;
+		}
+	}
+	memcpy(metas, env->me_map, psize * NUM_METAS);
+	if (wmutex)
+		UNLOCK_MUTEX(wmutex);
+
+	if (!(txn->mt_dbs[FREE_DBI].md_flags & MDB_TRACKING)) {
+		rc = MDB_INCOMPATIBLE;
+		goto leave;
+	}
+	tsize = MDB_TRACK_SLOT(txn->mt_next_pgno) * sizeof(txnid_t);
+	rc = mdb_track_map(env, 0, &track, &tsize);
+	if (rc)
+		goto leave;
+	/* Pages stamped later can't be live in this txn, and pages
+	 * it can see can't be written again while it lasts. The txn
+	 * began with the writer locked out, so it must be the last one
+	 * stamped unless a writer that doesn't stamp came after it, or
+	 * one that does has already begun again.
+	 */
+	if (track[0] != MDB_TRACK_MAGIC || since < track[MDB_TRACK_START] ||
+		track[MDB_TRACK_LAST] < txn->mt_txnid) {
+		rc = MDB_INCOMPATIBLE;
+		goto leave;
+	}
+	stamps = track + MDB_TRACK_SLOT(0);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.mi_magic = MDB_INCR_MAGIC;
+	hdr.mi_version = MDB_DATA_VERSION;
+	hdr.mi_psize = psize;
+	hdr.mi_since = since;
+	hdr.mi_txnid = txn->mt_txnid;
+	hdr.mi_last_pg = txn->mt_next_pgno - 1;
+	rc = mdb_fd_write(fd, (char *)&hdr, sizeof(hdr));
+
+	for (pg = NUM_METAS; !rc && pg < txn->mt_next_pgno; pg += n) {
+		if (stamps[pg] <= since) {
+			n = 1;
+			continue;
+		}
+		for (n = 1; pg + n < txn->mt_next_pgno && stamps[pg + n] > since; n++) ;
+		run.mr_pgno = pg;
+		run.mr_count = n;
+		if (!(rc = mdb_fd_write(fd, (char *)&run, sizeof(run))))
+			rc = mdb_fd_write(fd, env->me_map + pg * psize, n * psize);
+	}
+	if (!rc) {
+		run.mr_pgno = 0;
+		run.mr_count = NUM_METAS;
+		if (!(rc = mdb_fd_write(fd, (char *)&run, sizeof(run))))
+			rc = mdb_fd_write(fd, metas, psize * NUM_METAS);
+	}
+	if (!rc) {
+		run.mr_count = 0;
+		rc = mdb_fd_write(fd, (char *)&run, sizeof(run));
+	}
+
+leave:
+	if (track)
+		munmap((void *)track, tsize);
+	mdb_txn_abort(txn);
+	free(metas);
+	return rc;
+#endif
+}
+
+int ESECT
+mdb_env_apply_incr(const char *path, HANDLE fd, unsigned int flags)
+{
+#ifdef _WIN32
+	return MDB_INCOMPATIBLE;
+#else
+	MDB_env base;
+	MDB_meta meta;
+	MDB_incr hdr;
+	MDB_incr_run run;
+	char *dpath, *buf = NULL, *metas = NULL;
+	size_t psize, fsize = 0, n, chunk;
+	off_t off;
+	int rc;
+
+	if (flags & ~MDB_NOSUBDIR)
+		return EINVAL;
+	dpath = malloc(strlen(path) + sizeof(DATANAME));
+	if (!dpath)
+		return ENOMEM;
+	sprintf(dpath, (flags & MDB_NOSUBDIR) ? "%s" : "%s" DATANAME, path);
+	memset(&base, 0, sizeof(base));
+	base.me_fd = open(dpath, O_RDWR);
+	free(dpath);
+	if (base.me_fd == INVALID_HANDLE_VALUE)
+		return ErrCode();
+
+	if ((rc = mdb_env_read_header(&base, &meta)) ||
+		(rc = mdb_fd_read(fd, (char *)&hdr, sizeof(hdr))))
+		goto leave;
+	if (hdr.mi_magic != MDB_INCR_MAGIC || hdr.mi_version != MDB_DATA_VERSION) {
+		rc = MDB_INVALID;
+		goto leave;
+	}
+	/* The copy must have all the pages written since the base */
+	if (hdr.mi_psize != meta.mm_psize || meta.mm_txnid < hdr.mi_since ||
+		meta.mm_txnid >= hdr.mi_txnid) {
+		rc = MDB_INCOMPATIBLE;
+		goto leave;
+	}
+	psize = hdr.mi_psize;
+	chunk = psize * MDB_COMMIT_PAGES;
+	buf = malloc(chunk);
+	metas = calloc(NUM_METAS, psize);
+	if (!buf || !metas) {
+		rc = ENOMEM;
+		goto leave;
+	}
+
+	/* The meta pages come last, and are only written if all else is */
+	for (;;) {
+		if ((rc = mdb_fd_read(fd, (char *)&run, sizeof(run))))
+			goto leave;
+		if (!run.mr_count)
+			break;
+		if (run.mr_pgno == 0) {
+			if (run.mr_count != NUM_METAS) {
+				rc = MDB_INVALID;
+				goto leave;
+			}
+			if ((rc = mdb_fd_read(fd, metas, psize * NUM_METAS)))
+				goto leave;
+			continue;
+		}
+		if (run.mr_pgno < NUM_METAS || run.mr_count > hdr.mi_last_pg + 1 ||
+			run.mr_pgno > hdr.mi_last_pg + 1 - run.mr_count) {
+			rc = MDB_INVALID;
+			goto leave;
+		}
+		off = (off_t)run.mr_pgno * psize;
+		for (n = run.mr_count * psize; n > 0; n -= fsize, off += fsize) {
+			fsize = n < chunk ? n : chunk;
+			if ((rc = mdb_fd_read(fd, buf, fsize)))
+				goto leave;
+			if (pwrite(base.me_fd, buf, fsize, off) != (ssize_t)fsize) {
+				rc = ErrCode();
+				goto leave;
+			}
+		}
+	}
+	if (!F_ISSET(((MDB_page *)metas)->mp_flags, P_META)) {
+		rc = MDB_INVALID;
+		goto leave;
+	}
+
+	/* Free pages past the end of the base need not be in the copy */
+	if ((rc = mdb_fsize(base.me_fd, &fsize)))
+		goto leave;
+	if (fsize < (hdr.mi_last_pg + 1) * psize &&
+		ftruncate(base.me_fd, (hdr.mi_last_pg + 1) * psize)) {
+		rc = ErrCode();
+		goto leave;
+	}
+	if (MDB_FDATASYNC(base.me_fd) ||
+		pwrite(base.me_fd, metas, psize * NUM_METAS, 0) !=
+			(ssize_t)(psize * NUM_METAS) ||
+		MDB_FDATASYNC(base.me_fd))
+		rc = ErrCode();
+
+leave:
+	free(metas);
+	free(buf);
+	close(base.me_fd);
+	return rc;
+#endif
+}
+/** @} */
+
 int ESECT
 mdb_env_copyfd(MDB_env *env, HANDLE fd)
 {
@@ -16,7 +16,10 @@
 #define	MDB_STDOUT	GetStdHandle(STD_OUTPUT_HANDLE)
 #else
 #define	MDB_STDOUT	1
+#include <fcntl.h>
+#include <unistd.h>
 #endif
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -34,12 +37,24 @@ int main(int argc,char * argv[])
 	const char *progname = argv[0], *act;
 	unsigned flags = MDB_RDONLY;
 	unsigned cpflags = 0;
+	int incr = 0;
+	size_t since = 0;
+	char *end;
 
 	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
 		if (argv[1][1] == 'n' && argv[1][2] == '\0')
 			flags |= MDB_NOSUBDIR;
 		else if (argv[1][1] == 'c' && argv[1][2] == '\0')
 			cpflags |= MDB_CP_COMPACT;
+		else if (argv[1][1] == 'i' && argv[1][2] == '\0' && argc > 2) {
+			since = strtoul(argv[2], &end, 10);
+			if (*end || end == argv[2])
+				argc = 0;
+			else {
+				incr = 1;
+				argc--; argv++;
+			}
+		}
 		else if (argv[1][1] == 'V' && argv[1][2] == '\0') {
 			printf("%s\n", MDB_VERSION_STRING);
 			exit(0);
@@ -47,8 +62,8 @@ int main(int argc,char * argv[])
 			argc = 0;
 	}
 
-	if (argc<2 || argc>3) {
-		fprintf(stderr, "usage: %s [-V] [-c] [-n] srcpath [dstpath]\n", progname);
+	if (argc<2 || argc>3 || (incr && cpflags)) {
+		fprintf(stderr, "usage: %s [-V] [-c] [-n] [-i txnid] srcpath [dstpath]\n", progname);
 		exit(EXIT_FAILURE);
 	}
 
@@ -68,7 +83,25 @@ int main(int argc,char * argv[])
 	}
 	if (rc == MDB_SUCCESS) {
 		act = "copying";
-		if (argc == 2)
+		if (incr) {
+			mdb_filehandle_t fd = MDB_STDOUT;
+#ifndef _WIN32
+			if (argc == 3 && (fd = open(argv[2],
+				O_WRONLY|O_CREAT|O_EXCL, 0600)) < 0) {
+				act = "creating";
+				rc = errno;
+			} else
+#endif
+			rc = mdb_env_copyfd_incr(env, fd, since);
+#ifndef _WIN32
+			if (argc == 3 && fd >= 0) {
+				if (close(fd) && !rc)
+					rc = errno;
+				if (rc)
+					unlink(argv[2]);
+			}
+#endif
+		} else if (argc == 2)
 			rc = mdb_env_copyfd2(env, MDB_STDOUT, cpflags);
 		else
 			rc = mdb_env_copy2(env, argv[2], cpflags);
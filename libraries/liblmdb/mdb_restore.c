@@ -0,0 +1,84 @@
+/* mdb_restore.c - memory-mapped database incremental restore tool */
+/*
+ * Copyright 2012-2015 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+#ifdef _WIN32
+#include <windows.h>
+#define	MDB_STDIN	GetStdHandle(STD_INPUT_HANDLE)
+#else
+#define	MDB_STDIN	0
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lmdb.h"
+
+int main(int argc,char * argv[])
+{
+	int i, rc = 0;
+	const char *progname = argv[0], *act = "applying", *name = "stdin";
+	unsigned flags = 0;
+	char *dstpath;
+
+	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+		if (argv[1][1] == 'n' && argv[1][2] == '\0')
+			flags |= MDB_NOSUBDIR;
+		else if (argv[1][1] == 'V' && argv[1][2] == '\0') {
+			printf("%s\n", MDB_VERSION_STRING);
+			exit(0);
+		} else
+			argc = 0;
+	}
+
+	if (argc<2) {
+		fprintf(stderr, "usage: %s [-V] [-n] dstpath [file ...]\n", progname);
+		exit(EXIT_FAILURE);
+	}
+	dstpath = argv[1];
+
+	/* Apply each incremental copy in turn, or the one on stdin */
+	if (argc == 2)
+		rc = mdb_env_apply_incr(dstpath, MDB_STDIN, flags);
+	for (i = 2; !rc && i < argc; i++) {
+		mdb_filehandle_t fd;
+
+		name = argv[i];
+#ifdef _WIN32
+		fd = CreateFileA(argv[i], GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (fd == INVALID_HANDLE_VALUE) {
+			act = "opening";
+			rc = GetLastError();
+			break;
+		}
+		rc = mdb_env_apply_incr(dstpath, fd, flags);
+		CloseHandle(fd);
+#else
+		fd = open(argv[i], O_RDONLY);
+		if (fd < 0) {
+			act = "opening";
+			rc = errno;
+			break;
+		}
+		rc = mdb_env_apply_incr(dstpath, fd, flags);
+		close(fd);
+#endif
+	}
+	if (rc)
+		fprintf(stderr, "%s: %s %s failed, error %d (%s)\n",
+			progname, act, name, rc, mdb_strerror(rc));
+
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
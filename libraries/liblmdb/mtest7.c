@@ -0,0 +1,212 @@
+/* mtest7.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2015 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for incremental copies of an environment with tracked pages */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define EXPECT(err, expr) CHECK((rc = (expr)) == (err), #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+#define DIR	"./testdb"
+
+/* Put count random keys, some with values spanning overflow pages,
+ * and delete every tenth of the ones there, in one txn. */
+static void
+churn(MDB_env *env, int count)
+{
+	MDB_txn *txn;
+	MDB_dbi dbi;
+	MDB_cursor *cursor;
+	MDB_val key, data;
+	char kval[16], sval[8192];
+	int i, rc;
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_dbi_open(txn, "incr", MDB_CREATE, &dbi));
+	for (i = 0; i < count; i++) {
+		sprintf(kval, "%08x", rand() % 4096);
+		memset(sval, 'a' + i % 26, sizeof(sval));
+		key.mv_size = strlen(kval);
+		key.mv_data = kval;
+		data.mv_size = i % 50 ? (size_t)(32 + i % 100) : sizeof(sval);
+		data.mv_data = sval;
+		E(mdb_put(txn, dbi, &key, &data, 0));
+	}
+	E(mdb_cursor_open(txn, dbi, &cursor));
+	for (i = 0; (rc = mdb_cursor_get(cursor, &key, &data, MDB_NEXT)) == 0; i++)
+		if (i % 10 == 0)
+			E(mdb_cursor_del(cursor, 0));
+	CHECK(rc == MDB_NOTFOUND, "mdb_cursor_get");
+	mdb_cursor_close(cursor);
+	E(mdb_txn_commit(txn));
+}
+
+static size_t
+last_txnid(MDB_env *env)
+{
+	MDB_envinfo info;
+	int rc;
+
+	E(mdb_env_info(env, &info));
+	return info.me_last_txnid;
+}
+
+/* Copy the pages written since a txn into the file incr */
+static int
+copy_incr(MDB_env *env, size_t since)
+{
+	int fd, rc = 0;
+
+	fd = open(DIR "/incr", O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	CHECK(fd >= 0, "open");
+	rc = mdb_env_copyfd_incr(env, fd, since);
+	close(fd);
+	return rc;
+}
+
+static MDB_env *
+open_env(const char *path, unsigned int flags)
+{
+	MDB_env *env;
+	int rc;
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_mapsize(env, 10485760));
+	E(mdb_env_set_maxdbs(env, 4));
+	E(mdb_env_open(env, path, flags, 0664));
+	return env;
+}
+
+/* The contents and the last txn of two environments must be the same */
+static void
+compare(const char *path1, const char *path2)
+{
+	MDB_env *env1, *env2;
+	MDB_txn *txn1, *txn2;
+	MDB_dbi dbi1, dbi2;
+	MDB_cursor *c1, *c2;
+	MDB_val k1, d1, k2, d2;
+	int rc = 0, rc2, n = 0;
+
+	env1 = open_env(path1, MDB_RDONLY);
+	env2 = open_env(path2, MDB_RDONLY);
+	CHECK(last_txnid(env1) == last_txnid(env2), "last txnid");
+
+	E(mdb_txn_begin(env1, NULL, MDB_RDONLY, &txn1));
+	E(mdb_txn_begin(env2, NULL, MDB_RDONLY, &txn2));
+	E(mdb_dbi_open(txn1, "incr", 0, &dbi1));
+	E(mdb_dbi_open(txn2, "incr", 0, &dbi2));
+	E(mdb_cursor_open(txn1, dbi1, &c1));
+	E(mdb_cursor_open(txn2, dbi2, &c2));
+	for (;;) {
+		rc = mdb_cursor_get(c1, &k1, &d1, MDB_NEXT);
+		rc2 = mdb_cursor_get(c2, &k2, &d2, MDB_NEXT);
+		CHECK(rc == rc2, "entry count");
+		if (rc == MDB_NOTFOUND)
+			break;
+		CHECK(rc == 0, "mdb_cursor_get");
+		CHECK(k1.mv_size == k2.mv_size && d1.mv_size == d2.mv_size &&
+			!memcmp(k1.mv_data, k2.mv_data, k1.mv_size) &&
+			!memcmp(d1.mv_data, d2.mv_data, d1.mv_size), "entry");
+		n++;
+	}
+	CHECK(n > 0, "entries");
+	mdb_cursor_close(c1);
+	mdb_cursor_close(c2);
+	mdb_txn_abort(txn1);
+	mdb_txn_abort(txn2);
+	mdb_env_close(env1);
+	mdb_env_close(env2);
+	printf("%s and %s hold the same %d entries\n", path1, path2, n);
+}
+
+int main(int argc,char * argv[])
+{
+	MDB_env *env;
+	size_t since, stamped;
+	int i, fd, rc = 0;
+
+	srand(time(NULL));
+
+	env = open_env(DIR "/env", MDB_TRACKPAGES);
+	churn(env, 2000);
+
+	/* copy, write, then bring the copy up to date */
+	E(mdb_env_copy(env, DIR "/base"));
+	since = last_txnid(env);
+	for (i = 0; i < 5; i++)
+		churn(env, 300);
+	E(copy_incr(env, since));
+	E(mdb_env_copy(env, DIR "/full"));
+
+	fd = open(DIR "/incr", O_RDONLY);
+	CHECK(fd >= 0, "open");
+	E(mdb_env_apply_incr(DIR "/base", fd, 0));
+	close(fd);
+	compare(DIR "/base", DIR "/full");
+
+	/* an increment applies to any copy from since on, but not to
+	 * one as new as itself */
+	churn(env, 300);
+	E(copy_incr(env, since));
+	E(mdb_env_copy(env, DIR "/next"));
+	for (i = 0; i < 2; i++) {
+		fd = open(DIR "/incr", O_RDONLY);
+		CHECK(fd >= 0, "open");
+		if (i)
+			EXPECT(MDB_INCOMPATIBLE, mdb_env_apply_incr(DIR "/base", fd, 0));
+		else
+			E(mdb_env_apply_incr(DIR "/base", fd, 0));
+		close(fd);
+	}
+	compare(DIR "/base", DIR "/next");
+
+	/* A writer that doesn't track pages commits without recording
+	 * its txn in slot 2 of the track file; play one by moving that
+	 * back to the txn before the last. */
+	since = last_txnid(env);
+	churn(env, 300);
+	fd = open(DIR "/env/track.mdb", O_WRONLY);
+	CHECK(fd >= 0, "open");
+	stamped = since;
+	CHECK(pwrite(fd, &stamped, sizeof(stamped), 2 * sizeof(size_t)) ==
+		sizeof(stamped), "pwrite");
+	close(fd);
+	EXPECT(MDB_INCOMPATIBLE, copy_incr(env, since));
+
+	/* the next writer that tracks pages starts over from there */
+	E(mdb_env_copy(env, DIR "/base2"));
+	since = last_txnid(env);
+	churn(env, 300);
+	EXPECT(MDB_INCOMPATIBLE, copy_incr(env, since - 1));
+	E(copy_incr(env, since));
+	E(mdb_env_copy(env, DIR "/full2"));
+	fd = open(DIR "/incr", O_RDONLY);
+	CHECK(fd >= 0, "open");
+	E(mdb_env_apply_incr(DIR "/base2", fd, 0));
+	close(fd);
+	compare(DIR "/base2", DIR "/full2");
+
+	mdb_env_close(env);
+
+	return 0;
+}
@@ -47,6 +47,13 @@
 
 #include "lutil.h"
 
+#if defined(__x86_64__) && !defined(_WIN32) && \
+	( defined(__clang__) || __GNUC__ > 4 || \
+	( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ))
+#define B64_X86	1
+#include <immintrin.h>
+#endif
+
 static const char Base64[] =
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 static const char Pad64 = '=';
@@ -114,6 +121,245 @@ static const char Pad64 = '=';
 	   characters followed by one "=" padding character.
    */
 
+/* Encoders of whole blocks of 3-byte groups; they return the number
+ * of bytes of src they encoded, into 4/3 as many digits at target.
+ */
+typedef size_t (b64_enc_func)( u_char const *src, size_t srclength,
+	char *target, size_t targsize );
+
+/* Decoders of whole blocks of digits, up to the first that is not in
+ * the alphabet; they return the number of digits of src they decoded,
+ * into 3/4 as many bytes at target.
+ */
+typedef size_t (b64_dec_func)( char const *src, size_t srclength,
+	u_char *target, size_t targsize );
+
+static size_t
+b64_enc_none( u_char const *src, size_t srclength, char *target,
+	size_t targsize )
+{
+	return 0;
+}
+
+static size_t
+b64_dec_none( char const *src, size_t srclength, u_char *target,
+	size_t targsize )
+{
+	return 0;
+}
+
+#ifdef B64_X86
+/*
+ * Each 3 bytes are spread over the 4 bytes of a 32-bit lane, their
+ * 6-bit fields moved to the low bits of each byte with multiplies, and
+ * the fields turned into digits by adding the offset of their range
+ * of the alphabet, looked up with a shuffle.
+ */
+
+__attribute__((target("ssse3")))
+static __m128i
+b64_enc_digits_ssse3( __m128i in )
+{
+	__m128i t0, t1, idx, r, less;
+
+	in = _mm_shuffle_epi8( in, _mm_set_epi8(
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1 ));
+	t0 = _mm_and_si128( in, _mm_set1_epi32( 0x0fc0fc00 ));
+	t0 = _mm_mulhi_epu16( t0, _mm_set1_epi32( 0x04000040 ));
+	t1 = _mm_and_si128( in, _mm_set1_epi32( 0x003f03f0 ));
+	t1 = _mm_mullo_epi16( t1, _mm_set1_epi32( 0x01000010 ));
+	idx = _mm_or_si128( t0, t1 );
+
+	/* 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12 */
+	r = _mm_subs_epu8( idx, _mm_set1_epi8( 51 ));
+	less = _mm_cmpgt_epi8( _mm_set1_epi8( 26 ), idx );
+	r = _mm_or_si128( r, _mm_and_si128( less, _mm_set1_epi8( 13 )));
+	r = _mm_shuffle_epi8( _mm_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		'/' - 63, 'A', 0, 0 ), r );
+	return _mm_add_epi8( r, idx );
+}
+
+__attribute__((target("ssse3")))
+static size_t
+b64_enc_ssse3( u_char const *src, size_t srclength, char *target,
+	size_t targsize )
+{
+	size_t i = 0, j = 0;
+
+	/* 12 bytes are used of the 16 loaded */
+	while ( i + 16 <= srclength && j + 16 <= targsize ) {
+		__m128i in = _mm_loadu_si128( (const __m128i *)( src + i ));
+		_mm_storeu_si128( (__m128i *)( target + j ),
+			b64_enc_digits_ssse3( in ));
+		i += 12;
+		j += 16;
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t
+b64_enc_avx2( u_char const *src, size_t srclength, char *target,
+	size_t targsize )
+{
+	size_t i = 0, j = 0;
+	__m256i in, t0, t1, idx, r, less;
+
+	/* 12 bytes into each half */
+	while ( i + 28 <= srclength && j + 32 <= targsize ) {
+		in = _mm256_inserti128_si256( _mm256_castsi128_si256(
+			_mm_loadu_si128( (const __m128i *)( src + i ))),
+			_mm_loadu_si128( (const __m128i *)( src + i + 12 )), 1 );
+		in = _mm256_shuffle_epi8( in, _mm256_set_epi8(
+			10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+			10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1 ));
+		t0 = _mm256_and_si256( in, _mm256_set1_epi32( 0x0fc0fc00 ));
+		t0 = _mm256_mulhi_epu16( t0, _mm256_set1_epi32( 0x04000040 ));
+		t1 = _mm256_and_si256( in, _mm256_set1_epi32( 0x003f03f0 ));
+		t1 = _mm256_mullo_epi16( t1, _mm256_set1_epi32( 0x01000010 ));
+		idx = _mm256_or_si256( t0, t1 );
+
+		r = _mm256_subs_epu8( idx, _mm256_set1_epi8( 51 ));
+		less = _mm256_cmpgt_epi8( _mm256_set1_epi8( 26 ), idx );
+		r = _mm256_or_si256( r, _mm256_and_si256( less,
+			_mm256_set1_epi8( 13 )));
+		r = _mm256_shuffle_epi8( _mm256_setr_epi8(
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+			'/' - 63, 'A', 0, 0,
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+			'/' - 63, 'A', 0, 0 ), r );
+		_mm256_storeu_si256( (__m256i *)( target + j ),
+			_mm256_add_epi8( r, idx ));
+		i += 24;
+		j += 32;
+	}
+	return i;
+}
+
+/*
+ * The decoders check each digit with two shuffles, of the low and
+ * the high nibble, whose bits only have no overlap for the digits of
+ * the alphabet; spaces, pads and NULs end the block. The offset of
+ * the range of each digit is looked up by its high nibble, and the
+ * 6-bit values are packed back into bytes with multiply-adds.
+ */
+
+__attribute__((target("ssse3")))
+static size_t
+b64_dec_ssse3( char const *src, size_t srclength, u_char *target,
+	size_t targsize )
+{
+	size_t i = 0, j = 0;
+	const __m128i lut_lo = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a );
+	const __m128i lut_hi = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 );
+	const __m128i lut_roll = _mm_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+	const __m128i nib = _mm_set1_epi8( 0x0f );
+	__m128i in, hi, lo, bad, roll;
+
+	/* 16 digits into 12 bytes, of the 16 stored */
+	while ( i + 16 <= srclength && j + 16 <= targsize ) {
+		in = _mm_loadu_si128( (const __m128i *)( src + i ));
+		hi = _mm_and_si128( _mm_srli_epi32( in, 4 ), nib );
+		lo = _mm_and_si128( in, nib );
+		bad = _mm_and_si128( _mm_shuffle_epi8( lut_lo, lo ),
+			_mm_shuffle_epi8( lut_hi, hi ));
+		if ( _mm_movemask_epi8( _mm_cmpeq_epi8( bad,
+				_mm_setzero_si128() )) != 0xffff )
+			break;
+		roll = _mm_shuffle_epi8( lut_roll, _mm_add_epi8(
+			_mm_cmpeq_epi8( in, _mm_set1_epi8( '/' )), hi ));
+		in = _mm_add_epi8( in, roll );
+		in = _mm_maddubs_epi16( in, _mm_set1_epi32( 0x01400140 ));
+		in = _mm_madd_epi16( in, _mm_set1_epi32( 0x00011000 ));
+		in = _mm_shuffle_epi8( in, _mm_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 ));
+		_mm_storeu_si128( (__m128i *)( target + j ), in );
+		i += 16;
+		j += 12;
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t
+b64_dec_avx2( char const *src, size_t srclength, u_char *target,
+	size_t targsize )
+{
+	size_t i = 0, j = 0;
+	const __m256i lut_lo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a );
+	const __m256i lut_hi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 );
+	const __m256i lut_roll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+	const __m256i nib = _mm256_set1_epi8( 0x0f );
+	__m256i in, hi, lo, roll;
+
+	/* 32 digits into 24 bytes, of the 32 stored */
+	while ( i + 32 <= srclength && j + 32 <= targsize ) {
+		in = _mm256_loadu_si256( (const __m256i *)( src + i ));
+		hi = _mm256_and_si256( _mm256_srli_epi32( in, 4 ), nib );
+		lo = _mm256_and_si256( in, nib );
+		if ( !_mm256_testz_si256( _mm256_shuffle_epi8( lut_lo, lo ),
+				_mm256_shuffle_epi8( lut_hi, hi )))
+			break;
+		roll = _mm256_shuffle_epi8( lut_roll, _mm256_add_epi8(
+			_mm256_cmpeq_epi8( in, _mm256_set1_epi8( '/' )), hi ));
+		in = _mm256_add_epi8( in, roll );
+		in = _mm256_maddubs_epi16( in, _mm256_set1_epi32( 0x01400140 ));
+		in = _mm256_madd_epi16( in, _mm256_set1_epi32( 0x00011000 ));
+		in = _mm256_shuffle_epi8( in, _mm256_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 ));
+		in = _mm256_permutevar8x32_epi32( in,
+			_mm256_setr_epi32( 0, 1, 2, 4, 5, 6, 3, 7 ));
+		_mm256_storeu_si256( (__m256i *)( target + j ), in );
+		i += 32;
+		j += 24;
+	}
+	return i;
+}
+
+static b64_enc_func *b64_enc = b64_enc_none;
+static b64_dec_func *b64_dec = b64_dec_none;
+
+/* The kernels are picked once as the program starts, before it can
+ * have threads that use them.
+ */
+__attribute__((constructor))
+static void
+b64_select( void )
+{
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" )) {
+		b64_enc = b64_enc_avx2;
+		b64_dec = b64_dec_avx2;
+	} else if ( __builtin_cpu_supports( "ssse3" )) {
+		b64_enc = b64_enc_ssse3;
+		b64_dec = b64_dec_ssse3;
+	}
+}
+#else
+#define b64_enc	b64_enc_none
+#define b64_dec	b64_dec_none
+#endif /* B64_X86 */
+
 int
 lutil_b64_ntop(
 	u_char const *src,
@@ -126,6 +372,11 @@ lutil_b64_ntop(
 	u_char output[4];
 	size_t i;
 
+	i = b64_enc( src, srclength, target, targsize );
+	src += i;
+	srclength -= i;
+	datalength = i / 3 * 4;
+
 	while (2 < srclength) {
 		input[0] = *src++;
 		input[1] = *src++;
@@ -193,10 +444,18 @@ lutil_b64_pton(
 {
 	int tarindex, state, ch;
 	char *pos;
+	size_t i;
 
 	state = 0;
 	tarindex = 0;
 
+	/* the leading digits without spaces go through the kernel */
+	if (target) {
+		i = b64_dec(src, strlen(src), target, targsize);
+		src += i;
+		tarindex = i / 4 * 3;
+	}
+
 	while ((ch = *src++) != '\0') {
 		if (isascii(ch) && isspace(ch))	/* Skip whitespace anywhere. */
 			continue;
@@ -0,0 +1,488 @@
+/* idset.c - operations on sorted sets of IDs */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * The sets are arrays of distinct IDs in ascending order, as kept in
+ * the ID lists of the database backends.  The intersection and
+ * difference compare a block of IDs of one set against a block of the
+ * other at once where the CPU can.  Whether that beats the plain merge
+ * depends on the CPU, so a block kernel is only used once it has been
+ * timed faster, see lutil_idset_select().  When one set is much smaller
+ * than the other, its IDs are looked up in the bigger one instead of
+ * walking both.
+ */
+
+#include "portable.h"
+
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "lutil.h"
+
+#if defined(__x86_64__) && !defined(_WIN32) && \
+	( defined(__clang__) || __GNUC__ > 4 || \
+	( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ))
+#define IDSET_X86	1
+#include <immintrin.h>
+#endif
+
+/* walk both sets unless one is this many times bigger */
+#define IDSET_GALLOP	32
+
+typedef unsigned long (idset_func)( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out );
+
+/* First position at or after j in b that isn't below x,
+ * probing 1, 2, 4... ahead before a binary search.
+ */
+static unsigned long
+idset_seek( const unsigned long *b, unsigned long nb, unsigned long j,
+	unsigned long x )
+{
+	unsigned long lo = j, hi, step = 1;
+
+	if ( j >= nb || b[j] >= x )
+		return j;
+	while ( j + step < nb && b[j + step] < x ) {
+		lo = j + step;
+		step <<= 1;
+	}
+	hi = j + step < nb ? j + step : nb;
+	/* b[lo] < x, and b[hi] >= x or hi == nb */
+	while ( hi - lo > 1 ) {
+		unsigned long mid = lo + (( hi - lo ) >> 1 );
+		if ( b[mid] < x )
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return hi;
+}
+
+/* The IDs of the small set a that are in the big set b.
+ * out may be either of them.
+ */
+static unsigned long
+idset_gallop( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out )
+{
+	unsigned long i, j = 0, k = 0, x;
+
+	for ( i = 0; i < na && j < nb; i++ ) {
+		x = a[i];
+		j = idset_seek( b, nb, j, x );
+		if ( j < nb && b[j] == x ) {
+			out[k++] = x;
+			j++;
+		}
+	}
+	return k;
+}
+
+static unsigned long
+idset_intersect_scalar( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out )
+{
+	unsigned long i = 0, j = 0, k = 0;
+
+	while ( i < na && j < nb ) {
+		if ( a[i] < b[j] ) {
+			i++;
+		} else if ( a[i] > b[j] ) {
+			j++;
+		} else {
+			out[k++] = a[i];
+			i++;
+			j++;
+		}
+	}
+	return k;
+}
+
+/* The IDs of a that are not in b; out may be a. The IDs of a from
+ * position i on whose bits are set in seen are known to be in b.
+ */
+static unsigned long
+idset_difference_tail( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out,
+	unsigned long i, unsigned long j, unsigned long k, unsigned seen )
+{
+	unsigned long x, i0 = i;
+
+	for ( ; i < na; i++ ) {
+		x = a[i];
+		if ( i - i0 < 8 && ( seen & ( 1U << ( i - i0 ))))
+			continue;
+		while ( j < nb && b[j] < x )
+			j++;
+		if ( j < nb && b[j] == x ) {
+			j++;
+			continue;
+		}
+		out[k++] = x;
+	}
+	return k;
+}
+
+static unsigned long
+idset_difference_scalar( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out )
+{
+	return idset_difference_tail( a, na, b, nb, out, 0, 0, 0, 0 );
+}
+
+#ifdef IDSET_X86
+/*
+ * A block of a is compared with every rotation of a block of b, which
+ * finds all the IDs the two blocks have in common. Then the block that
+ * ends lower is done with, or both if they end with the same ID.
+ */
+
+__attribute__((target("sse4.1")))
+static unsigned long
+idset_intersect_sse4( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out )
+{
+	unsigned long i = 0, j = 0, k = 0, amax, bmax, x;
+	unsigned mask;
+
+	while ( i + 2 <= na && j + 2 <= nb ) {
+		__m128i va = _mm_loadu_si128( (const __m128i *)( a + i ));
+		__m128i vb = _mm_loadu_si128( (const __m128i *)( b + j ));
+		__m128i m = _mm_cmpeq_epi64( va, vb );
+		vb = _mm_shuffle_epi32( vb, 0x4e );
+		m = _mm_or_si128( m, _mm_cmpeq_epi64( va, vb ));
+		mask = _mm_movemask_pd( _mm_castsi128_pd( m ));
+		amax = a[i + 1];
+		bmax = b[j + 1];
+		while ( mask ) {
+			x = a[i + __builtin_ctz( mask )];
+			out[k++] = x;
+			mask &= mask - 1;
+		}
+		if ( amax <= bmax )
+			i += 2;
+		if ( bmax <= amax )
+			j += 2;
+	}
+	return k + idset_intersect_scalar( a + i, na - i, b + j, nb - j, out + k );
+}
+
+__attribute__((target("avx2")))
+static unsigned long
+idset_intersect_avx2( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out )
+{
+	unsigned long i = 0, j = 0, k = 0, amax, bmax, x;
+	unsigned mask;
+
+	while ( i + 4 <= na && j + 4 <= nb ) {
+		__m256i va = _mm256_loadu_si256( (const __m256i *)( a + i ));
+		__m256i vb = _mm256_loadu_si256( (const __m256i *)( b + j ));
+		__m256i m = _mm256_cmpeq_epi64( va, vb );
+		vb = _mm256_permute4x64_epi64( vb, 0x39 );
+		m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, vb ));
+		vb = _mm256_permute4x64_epi64( vb, 0x39 );
+		m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, vb ));
+		vb = _mm256_permute4x64_epi64( vb, 0x39 );
+		m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, vb ));
+		mask = _mm256_movemask_pd( _mm256_castsi256_pd( m ));
+		amax = a[i + 3];
+		bmax = b[j + 3];
+		while ( mask ) {
+			x = a[i + __builtin_ctz( mask )];
+			out[k++] = x;
+			mask &= mask - 1;
+		}
+		if ( amax <= bmax )
+			i += 4;
+		if ( bmax <= amax )
+			j += 4;
+	}
+	return k + idset_intersect_scalar( a + i, na - i, b + j, nb - j, out + k );
+}
+
+/* The IDs of a block of a found in any block of b are collected in
+ * seen until the block of a is done with; the rest are output then.
+ */
+
+__attribute__((target("sse4.1")))
+static unsigned long
+idset_difference_sse4( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out )
+{
+	unsigned long i = 0, j = 0, k = 0, amax, bmax, x;
+	unsigned mask, seen = 0;
+
+	while ( i + 2 <= na && j + 2 <= nb ) {
+		__m128i va = _mm_loadu_si128( (const __m128i *)( a + i ));
+		__m128i vb = _mm_loadu_si128( (const __m128i *)( b + j ));
+		__m128i m = _mm_cmpeq_epi64( va, vb );
+		vb = _mm_shuffle_epi32( vb, 0x4e );
+		m = _mm_or_si128( m, _mm_cmpeq_epi64( va, vb ));
+		seen |= _mm_movemask_pd( _mm_castsi128_pd( m ));
+		amax = a[i + 1];
+		bmax = b[j + 1];
+		if ( amax <= bmax ) {
+			for ( mask = ~seen & 3; mask; mask &= mask - 1 ) {
+				x = a[i + __builtin_ctz( mask )];
+				out[k++] = x;
+			}
+			seen = 0;
+			i += 2;
+		}
+		if ( bmax <= amax )
+			j += 2;
+	}
+	return idset_difference_tail( a, na, b, nb, out, i, j, k, seen );
+}
+
+__attribute__((target("avx2")))
+static unsigned long
+idset_difference_avx2( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out )
+{
+	unsigned long i = 0, j = 0, k = 0, amax, bmax, x;
+	unsigned mask, seen = 0;
+
+	while ( i + 4 <= na && j + 4 <= nb ) {
+		__m256i va = _mm256_loadu_si256( (const __m256i *)( a + i ));
+		__m256i vb = _mm256_loadu_si256( (const __m256i *)( b + j ));
+		__m256i m = _mm256_cmpeq_epi64( va, vb );
+		vb = _mm256_permute4x64_epi64( vb, 0x39 );
+		m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, vb ));
+		vb = _mm256_permute4x64_epi64( vb, 0x39 );
+		m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, vb ));
+		vb = _mm256_permute4x64_epi64( vb, 0x39 );
+		m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, vb ));
+		seen |= _mm256_movemask_pd( _mm256_castsi256_pd( m ));
+		amax = a[i + 3];
+		bmax = b[j + 3];
+		if ( amax <= bmax ) {
+			for ( mask = ~seen & 0xf; mask; mask &= mask - 1 ) {
+				x = a[i + __builtin_ctz( mask )];
+				out[k++] = x;
+			}
+			seen = 0;
+			i += 4;
+		}
+		if ( bmax <= amax )
+			j += 4;
+	}
+	return idset_difference_tail( a, na, b, nb, out, i, j, k, seen );
+}
+#endif /* IDSET_X86 */
+
+static idset_func *idset_intersect_fn, *idset_difference_fn;
+
+#ifdef IDSET_X86
+static struct {
+	idset_func *intersect, *difference;
+} idset_kernels[] = {
+	{ idset_intersect_scalar, idset_difference_scalar },
+	{ idset_intersect_sse4, idset_difference_sse4 },
+	{ idset_intersect_avx2, idset_difference_avx2 }
+};
+
+static int
+idset_has( int impl )
+{
+	switch ( impl ) {
+	case LUTIL_IDSET_SSE4:
+		return __builtin_cpu_supports( "sse4.1" );
+	case LUTIL_IDSET_AVX2:
+		return __builtin_cpu_supports( "avx2" );
+	}
+	return 0;
+}
+
+/* the sets a kernel is timed on, and how often */
+#define IDSET_TIME_SIZE		4096
+#define IDSET_TIME_ROUNDS	16
+#define IDSET_TIME_TRIES	3
+
+/* Microseconds the kernels of impl take on two sets that have about
+ * half their IDs in common, the best of a few tries
+ */
+static long
+idset_time( int impl, unsigned long *a, unsigned long *b,
+	unsigned long *out )
+{
+	struct timeval start, end;
+	long t, best = -1;
+	int i, r;
+
+	for ( i = 0; i < IDSET_TIME_TRIES; i++ ) {
+		gettimeofday( &start, NULL );
+		for ( r = 0; r < IDSET_TIME_ROUNDS; r++ ) {
+			idset_kernels[impl].intersect( a, IDSET_TIME_SIZE,
+				b, IDSET_TIME_SIZE, out );
+			idset_kernels[impl].difference( a, IDSET_TIME_SIZE,
+				b, IDSET_TIME_SIZE, out );
+		}
+		gettimeofday( &end, NULL );
+		t = ( end.tv_sec - start.tv_sec ) * 1000000L +
+			end.tv_usec - start.tv_usec;
+		if ( best < 0 || t < best )
+			best = t;
+	}
+	return best;
+}
+
+/* The fastest kernel of the CPU; a block kernel must take a tenth
+ * less time than the plain merge to be picked.
+ */
+static int
+idset_fastest( void )
+{
+	unsigned long *a, *b, *out, x = 1;
+	unsigned long seed = 1;
+	long t, best;
+	int i, impl = LUTIL_IDSET_SCALAR;
+
+	a = malloc( 3 * IDSET_TIME_SIZE * sizeof( *a ));
+	if ( !a )
+		return impl;
+	b = a + IDSET_TIME_SIZE;
+	out = b + IDSET_TIME_SIZE;
+
+	/* each ID goes to a, b or both */
+	for ( i = 0; i < IDSET_TIME_SIZE; i++ ) {
+		seed = seed * 1103515245 + 12345;
+		a[i] = x;
+		b[i] = ( seed >> 16 ) & 1 ? x : x + 1;
+		x += 2;
+	}
+
+	best = idset_time( LUTIL_IDSET_SCALAR, a, b, out ) * 9 / 10;
+	for ( i = LUTIL_IDSET_SSE4; i <= LUTIL_IDSET_AVX2; i++ ) {
+		if ( !idset_has( i ))
+			continue;
+		t = idset_time( i, a, b, out );
+		if ( t < best ) {
+			best = t;
+			impl = i;
+		}
+	}
+	free( a );
+	return impl;
+}
+#endif /* IDSET_X86 */
+
+/* Pick the kernels to use, or with LUTIL_IDSET_AUTO the fastest ones
+ * of the CPU, which takes a millisecond or so. Returns the kernel
+ * picked, or LUTIL_IDSET_SCALAR if the CPU doesn't have the one asked
+ * for. This is done on the first use of the sets if it wasn't before;
+ * a program with several threads should call it before they start.
+ */
+int
+lutil_idset_select( int impl )
+{
+#ifdef IDSET_X86
+	__builtin_cpu_init();
+	if ( impl == LUTIL_IDSET_AUTO )
+		impl = idset_fastest();
+	if ( idset_has( impl )) {
+		idset_intersect_fn = idset_kernels[impl].intersect;
+		idset_difference_fn = idset_kernels[impl].difference;
+		return impl;
+	}
+#endif
+	idset_intersect_fn = idset_intersect_scalar;
+	idset_difference_fn = idset_difference_scalar;
+	return LUTIL_IDSET_SCALAR;
+}
+
+/* Intersect a with b, in place; returns the number of IDs left in a */
+unsigned long
+lutil_idset_intersect( unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb )
+{
+	if ( na == 0 || nb == 0 )
+		return 0;
+	if ( na / IDSET_GALLOP > nb )
+		return idset_gallop( b, nb, a, na, a );
+	if ( nb / IDSET_GALLOP > na )
+		return idset_gallop( a, na, b, nb, a );
+
+	if ( !idset_intersect_fn )
+		lutil_idset_select( LUTIL_IDSET_AUTO );
+	return idset_intersect_fn( a, na, b, nb, a );
+}
+
+/* Store the IDs of a that are not in b in out, which may be a;
+ * returns how many there are.
+ */
+unsigned long
+lutil_idset_difference( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out )
+{
+	unsigned long i, j, k;
+
+	if ( nb == 0 || na == 0 || a[na-1] < b[0] || b[nb-1] < a[0] ) {
+		if ( out != a )
+			AC_MEMCPY( out, a, na * sizeof( *a ));
+		return na;
+	}
+
+	if ( nb / IDSET_GALLOP > na ) {
+		/* look up the few IDs of a in b */
+		for ( i = 0, j = 0, k = 0; i < na; i++ ) {
+			j = idset_seek( b, nb, j, a[i] );
+			if ( j < nb && b[j] == a[i] )
+				j++;
+			else
+				out[k++] = a[i];
+		}
+		return k;
+	}
+	if ( na / IDSET_GALLOP > nb ) {
+		/* copy the runs of a between the few IDs of b */
+		for ( i = 0, j = 0, k = 0; j < nb; j++ ) {
+			unsigned long e = idset_seek( a, na, i, b[j] );
+			AC_MEMCPY( out + k, a + i, ( e - i ) * sizeof( *a ));
+			k += e - i;
+			i = ( e < na && a[e] == b[j] ) ? e + 1 : e;
+		}
+		AC_MEMCPY( out + k, a + i, ( na - i ) * sizeof( *a ));
+		return k + na - i;
+	}
+
+	if ( !idset_difference_fn )
+		lutil_idset_select( LUTIL_IDSET_AUTO );
+	return idset_difference_fn( a, na, b, nb, out );
+}
+
+/* Merge the disjoint sets a and b into out, which must be neither */
+unsigned long
+lutil_idset_merge( const unsigned long *a, unsigned long na,
+	const unsigned long *b, unsigned long nb, unsigned long *out )
+{
+	unsigned long i = 0, j = 0, k = 0;
+
+	while ( i < na && j < nb ) {
+		/* no branch on which one is taken */
+		int t = a[i] < b[j];
+		out[k++] = t ? a[i] : b[j];
+		i += t;
+		j += !t;
+	}
+	AC_MEMCPY( out + k, a + i, ( na - i ) * sizeof( *a ));
+	k += na - i;
+	AC_MEMCPY( out + k, b + j, ( nb - j ) * sizeof( *b ));
+	return k + nb - j;
+}
@@ -0,0 +1,186 @@
+/* testidset.c - Check and time the ID set kernels */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * For each pair of set sizes, sets are drawn from a range of IDs a
+ * few times bigger than the bigger set, the way index keys of one
+ * database overlap. Every kernel the CPU has must agree with the plain
+ * merge; the time per operation is printed for each, after the kernel
+ * that lutil_idset_select() picks.
+ *
+ * Usage: testidset [-n rounds] [-s seed]
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/time.h>
+#include <ac/unistd.h>
+
+#include "lutil.h"
+
+static struct {
+	unsigned long small, big;
+} sizes[] = {
+	{ 16, 16 },
+	{ 1000, 1000 },
+	{ 65535, 65535 },
+	{ 1000, 4000 },
+	{ 10000, 160000 },
+	{ 1000, 64000 },
+	{ 100, 100000 },
+	{ 10, 131071 },
+	{ 0, 0 }
+};
+
+static const char *impls[] = { "scalar", "sse4", "avx2" };
+
+/* count distinct random IDs below max, sorted */
+static void
+mkset( unsigned long *s, unsigned long count, unsigned long max,
+	unsigned char *used )
+{
+	unsigned long i, n = 0, id;
+
+	memset( used, 0, max );
+	while ( n < count ) {
+		id = (unsigned long)random() % max;
+		if ( !used[id] ) {
+			used[id] = 1;
+			n++;
+		}
+	}
+	for ( i = 0, n = 0; i < max; i++ )
+		if ( used[i] )
+			s[n++] = i + 1;
+}
+
+static double
+now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int
+main( int argc, char **argv )
+{
+	unsigned long *a, *b, *out, *ref, max, n, nref, i;
+	unsigned char *used;
+	int c, rounds = 200, impl, best, r, bad = 0;
+	unsigned seed = 1;
+	double t0;
+
+	while (( c = getopt( argc, argv, "n:s:" )) != EOF ) {
+		switch ( c ) {
+		case 'n':
+			rounds = atoi( optarg );
+			break;
+		case 's':
+			seed = atoi( optarg );
+			break;
+		default:
+			fprintf( stderr, "usage: %s [-n rounds] [-s seed]\n", argv[0] );
+			return 1;
+		}
+	}
+	srandom( seed );
+
+	best = lutil_idset_select( LUTIL_IDSET_AUTO );
+	printf( "picked: %s\n", impls[best] );
+	printf( "%-14s %-6s %12s %12s\n", "sizes", "kernel",
+		"intersect/us", "difference/us" );
+
+	for ( i = 0; sizes[i].small; i++ ) {
+		max = sizes[i].big * 4;
+		/* ref holds the intersection and then the merge */
+		a = malloc( 5 * sizes[i].big * sizeof( *a ) + max );
+		b = a + sizes[i].big;
+		out = b + sizes[i].big;
+		ref = out + sizes[i].big;
+		used = (unsigned char *)( ref + 2 * sizes[i].big );
+
+		mkset( a, sizes[i].small, max, used );
+		mkset( b, sizes[i].big, max, used );
+
+		/* the plain merge gives the reference */
+		lutil_idset_select( LUTIL_IDSET_SCALAR );
+		memcpy( ref, a, sizes[i].small * sizeof( *a ));
+		nref = lutil_idset_intersect( ref, sizes[i].small, b, sizes[i].big );
+
+		for ( impl = LUTIL_IDSET_SCALAR; impl <= LUTIL_IDSET_AVX2; impl++ ) {
+			double ti, td;
+
+			if ( lutil_idset_select( impl ) != impl )
+				continue;
+
+			/* intersection, both ways round */
+			t0 = now();
+			for ( r = 0; r < rounds; r++ ) {
+				memcpy( out, a, sizes[i].small * sizeof( *a ));
+				n = lutil_idset_intersect( out, sizes[i].small,
+					b, sizes[i].big );
+			}
+			ti = ( now() - t0 ) * 1e6 / rounds;
+			if ( n != nref || memcmp( out, ref, n * sizeof( *a ))) {
+				printf( "intersect %lu/%lu: %s differs\n",
+					sizes[i].small, sizes[i].big, impls[impl] );
+				bad++;
+			}
+			memcpy( out, b, sizes[i].big * sizeof( *b ));
+			n = lutil_idset_intersect( out, sizes[i].big, a, sizes[i].small );
+			if ( n != nref || memcmp( out, ref, n * sizeof( *a ))) {
+				printf( "intersect %lu/%lu: %s differs\n",
+					sizes[i].big, sizes[i].small, impls[impl] );
+				bad++;
+			}
+
+			/* the bigger set minus the smaller one, in place */
+			t0 = now();
+			for ( r = 0; r < rounds; r++ ) {
+				memcpy( out, b, sizes[i].big * sizeof( *b ));
+				n = lutil_idset_difference( out, sizes[i].big,
+					a, sizes[i].small, out );
+			}
+			td = ( now() - t0 ) * 1e6 / rounds;
+			if ( n + nref != sizes[i].big ) {
+				printf( "difference %lu/%lu: %s has %lu\n",
+					sizes[i].big, sizes[i].small, impls[impl], n );
+				bad++;
+			}
+			/* which merged with the intersection is the bigger set */
+			n = lutil_idset_merge( out, n, ref, nref, ref + nref );
+			if ( n != sizes[i].big ||
+				memcmp( ref + nref, b, n * sizeof( *b )))
+			{
+				printf( "difference %lu/%lu: %s differs\n",
+					sizes[i].big, sizes[i].small, impls[impl] );
+				bad++;
+			}
+
+			printf( "%6lu/%-7lu %-6s %12.1f %12.1f\n", sizes[i].small,
+				sizes[i].big, impls[impl], ti, td );
+		}
+		free( a );
+	}
+
+	return bad ? 1 : 0;
+}
@@ -68,6 +68,8 @@ static slap_control_t slap_acl_mask(
 	AccessControlState *state,
 	slap_access_t access );
 
+static int acl_index_cache_flags( AccessControl *a );
+
 static int	regex_matches(
 	struct berval *pat, char *str,
 	struct berval *dn_matches, struct berval *val_matches,
@@ -120,6 +122,331 @@ slap_access_always_allowed(
 	return 1;
 }
 
+/*
+ * Cache of access decisions, kept per connection
+ *
+ * Clients tend to run the same searches over the same entries again
+ * and again under the same identity, and every time the same ACL
+ * decisions are made.  When aclcachesize is set, value-independent
+ * decisions are remembered per connection, keyed by the entry ID,
+ * attribute and access level.  A decision is reused only if
+ *
+ * - it was made for the same authorization identity and security
+ *   factors as the current operation;
+ * - the entry still has the same entryCSN (so nothing is cached for
+ *   databases with lastmod off);
+ * - no ACL was changed since;
+ * - if group membership was involved, no entry was changed since.
+ *
+ * Decisions involving sets, dynamic ACLs or non-static groups depend
+ * on data that cannot be tracked this way and are never cached.
+ */
+
+typedef struct AclCacheSlot {
+	BackendDB		*acs_be;
+	ID			acs_id;
+	AttributeDescription	*acs_desc;
+	slap_access_t		acs_access;
+	unsigned long		acs_aclgen;
+	unsigned long		acs_wgen;	/* 0 if independent of other entries */
+	slap_mask_t		acs_mask;
+	int			acs_ret;
+	ber_len_t		acs_csnlen;
+	char			acs_csn[ LDAP_PVT_CSNSTR_BUFSIZE ];
+} AclCacheSlot;
+
+typedef struct AclCache {
+	ldap_pvt_thread_mutex_t	ac_mutex;
+
+	/* identity the cached decisions were made for */
+	struct berval		ac_ndn;
+	struct berval		ac_realndn;
+	slap_ssf_t		ac_ssf;
+	slap_ssf_t		ac_transport_ssf;
+	slap_ssf_t		ac_tls_ssf;
+	slap_ssf_t		ac_sasl_ssf;
+
+	unsigned int		ac_nslots;
+	AclCacheSlot		*ac_slots;
+} AclCache;
+
+/* slots per connection, 0 disables the cache */
+unsigned int slap_aclcache_size;
+
+/* the generations are read far more often than they change */
+static ldap_pvt_thread_rdwr_t	acl_cache_rwlock;
+static int			acl_cache_inited;
+static unsigned long		acl_cache_aclgen = 1;
+static unsigned long		acl_cache_wgen = 1;
+
+#define ACL_CACHE_GROUPS	0x1	/* depends on group membership */
+#define ACL_CACHE_NEVER		0x2	/* depends on other data */
+
+int
+acl_cache_init( void )
+{
+	ldap_pvt_thread_rdwr_init( &acl_cache_rwlock );
+	acl_cache_inited = 1;
+
+	return 0;
+}
+
+void
+acl_cache_destroy( void )
+{
+	if ( acl_cache_inited ) {
+		acl_cache_inited = 0;
+		ldap_pvt_thread_rdwr_destroy( &acl_cache_rwlock );
+	}
+}
+
+/*
+ * Called whenever ACLs are added or removed
+ */
+void
+acl_cache_acls_changed( void )
+{
+	if ( !acl_cache_inited )
+		return;
+
+	ldap_pvt_thread_rdwr_wlock( &acl_cache_rwlock );
+	acl_cache_aclgen++;
+	ldap_pvt_thread_rdwr_wunlock( &acl_cache_rwlock );
+}
+
+/*
+ * Called after each write operation, since it may have changed
+ * group membership; must be called after the changes are visible
+ * to readers and before the client is told about them.
+ */
+void
+acl_cache_entries_changed( void )
+{
+	if ( !slap_aclcache_size )
+		return;
+
+	ldap_pvt_thread_rdwr_wlock( &acl_cache_rwlock );
+	acl_cache_wgen++;
+	ldap_pvt_thread_rdwr_wunlock( &acl_cache_rwlock );
+}
+
+static unsigned long
+acl_cache_aclgen_get( void )
+{
+	unsigned long aclgen;
+
+	ldap_pvt_thread_rdwr_rlock( &acl_cache_rwlock );
+	aclgen = acl_cache_aclgen;
+	ldap_pvt_thread_rdwr_runlock( &acl_cache_rwlock );
+
+	return aclgen;
+}
+
+/*
+ * Remember the write generation an operation started at; any entry
+ * read by the operation is at least as recent as that.
+ */
+void
+acl_cache_op_init( Operation *op )
+{
+	ldap_pvt_thread_rdwr_rlock( &acl_cache_rwlock );
+	op->o_acl_wgen = acl_cache_wgen;
+	ldap_pvt_thread_rdwr_runlock( &acl_cache_rwlock );
+}
+
+/*
+ * What caching the decisions made by an acl involves; computed once
+ * when the list is indexed
+ */
+static int
+acl_cache_flags( AccessControl *a )
+{
+	Access *b;
+	int flags = 0;
+
+	for ( b = a->acl_access; b != NULL; b = b->a_next ) {
+		if ( !BER_BVISEMPTY( &b->a_set_pat ) ) {
+			return ACL_CACHE_NEVER;
+		}
+#ifdef SLAP_DYNACL
+		if ( b->a_dynacl != NULL ) {
+			return ACL_CACHE_NEVER;
+		}
+#endif /* SLAP_DYNACL */
+		if ( !BER_BVISEMPTY( &b->a_group_pat ) ) {
+			if ( b->a_group_oc == NULL || (
+				b->a_group_oc != oc_find( "groupOfNames" ) &&
+				b->a_group_oc != oc_find( "groupOfUniqueNames" )))
+			{
+				return ACL_CACHE_NEVER;
+			}
+			flags |= ACL_CACHE_GROUPS;
+		}
+	}
+
+	return flags;
+}
+
+void
+acl_cache_free( Connection *c )
+{
+	AclCache *ac = c->c_aclcache;
+
+	if ( ac == NULL )
+		return;
+
+	c->c_aclcache = NULL;
+	ldap_pvt_thread_mutex_destroy( &ac->ac_mutex );
+	ch_free( ac->ac_ndn.bv_val );
+	ch_free( ac->ac_realndn.bv_val );
+	ch_free( ac->ac_slots );
+	ch_free( ac );
+}
+
+/*
+ * Give a new connection its cache; connections opened while
+ * aclcachesize was 0 don't cache decisions.
+ */
+void
+acl_cache_alloc( Connection *c )
+{
+	AclCache *ac;
+
+	assert( c->c_aclcache == NULL );
+
+	ac = ch_calloc( 1, sizeof( AclCache ));
+	ldap_pvt_thread_mutex_init( &ac->ac_mutex );
+	for ( ac->ac_nslots = 16; ac->ac_nslots < slap_aclcache_size; )
+		ac->ac_nslots <<= 1;
+	ac->ac_slots = ch_calloc( ac->ac_nslots, sizeof( AclCacheSlot ));
+	c->c_aclcache = ac;
+}
+
+static int
+acl_cache_same_identity( AclCache *ac, Operation *op )
+{
+	return bvmatch( &ac->ac_ndn, &op->o_ndn )
+		&& bvmatch( &ac->ac_realndn, &op->o_conn->c_ndn )
+		&& ac->ac_ssf == op->o_ssf
+		&& ac->ac_transport_ssf == op->o_transport_ssf
+		&& ac->ac_tls_ssf == op->o_tls_ssf
+		&& ac->ac_sasl_ssf == op->o_sasl_ssf;
+}
+
+static AclCacheSlot *
+acl_cache_slot( AclCache *ac, Operation *op, Entry *e,
+	AttributeDescription *desc, slap_access_t access )
+{
+	unsigned long h;
+
+	h = e->e_id * 2654435761UL;
+	h ^= (unsigned long)desc >> 4;
+	h += access;
+	h ^= (unsigned long)op->o_bd->bd_self >> 4;
+
+	return &ac->ac_slots[ h & ( ac->ac_nslots - 1 ) ];
+}
+
+/*
+ * Return the entryCSN of e if its decisions may be cached; with
+ * lastmod off writes leave the entryCSN alone, so none are.
+ */
+static Attribute *
+acl_cache_csn( Operation *op, Entry *e, struct berval *val )
+{
+	Attribute *csn;
+
+	if ( !slap_aclcache_size || val != NULL || op->o_conn == NULL
+		|| op->o_conn->c_aclcache == NULL || op->o_bd == NULL
+		|| SLAP_NOLASTMOD( op->o_bd ) || e->e_id == NOID || e->e_id == 0 )
+	{
+		return NULL;
+	}
+
+	csn = attr_find( e->e_attrs, slap_schema.si_ad_entryCSN );
+	if ( csn == NULL || csn->a_nvals[0].bv_len >= LDAP_PVT_CSNSTR_BUFSIZE )
+		return NULL;
+
+	return csn;
+}
+
+static int
+acl_cache_lookup(
+	Operation		*op,
+	Entry			*e,
+	Attribute		*csn,
+	AttributeDescription	*desc,
+	slap_access_t		access,
+	unsigned long		aclgen,
+	slap_mask_t		*maskp )
+{
+	AclCache *ac = op->o_conn->c_aclcache;
+	AclCacheSlot *acs;
+	int rc = -1;
+
+	ldap_pvt_thread_mutex_lock( &ac->ac_mutex );
+	acs = acl_cache_slot( ac, op, e, desc, access );
+	if ( acs->acs_id == e->e_id
+		&& acs->acs_be == op->o_bd->bd_self
+		&& acs->acs_desc == desc
+		&& acs->acs_access == access
+		&& acs->acs_aclgen == aclgen
+		&& ( acs->acs_wgen == 0 || acs->acs_wgen == op->o_acl_wgen )
+		&& acs->acs_csnlen == csn->a_nvals[0].bv_len
+		&& memcmp( acs->acs_csn, csn->a_nvals[0].bv_val, acs->acs_csnlen ) == 0
+		&& acl_cache_same_identity( ac, op ))
+	{
+		ACL_PRIV_ASSIGN( *maskp, acs->acs_mask );
+		rc = acs->acs_ret;
+	}
+	ldap_pvt_thread_mutex_unlock( &ac->ac_mutex );
+
+	return rc;
+}
+
+static void
+acl_cache_store(
+	Operation		*op,
+	Entry			*e,
+	Attribute		*csn,
+	AttributeDescription	*desc,
+	slap_access_t		access,
+	unsigned long		aclgen,
+	unsigned long		wgen,
+	int			ret,
+	slap_mask_t		mask )
+{
+	AclCache *ac = op->o_conn->c_aclcache;
+	AclCacheSlot *acs;
+
+	ldap_pvt_thread_mutex_lock( &ac->ac_mutex );
+	if ( !acl_cache_same_identity( ac, op ) ) {
+		/* the connection was rebound, or the operation is proxied */
+		memset( ac->ac_slots, 0, ac->ac_nslots * sizeof( AclCacheSlot ));
+		ch_free( ac->ac_ndn.bv_val );
+		ch_free( ac->ac_realndn.bv_val );
+		ber_dupbv( &ac->ac_ndn, &op->o_ndn );
+		ber_dupbv( &ac->ac_realndn, &op->o_conn->c_ndn );
+		ac->ac_ssf = op->o_ssf;
+		ac->ac_transport_ssf = op->o_transport_ssf;
+		ac->ac_tls_ssf = op->o_tls_ssf;
+		ac->ac_sasl_ssf = op->o_sasl_ssf;
+	}
+
+	acs = acl_cache_slot( ac, op, e, desc, access );
+	acs->acs_be = op->o_bd->bd_self;
+	acs->acs_id = e->e_id;
+	acs->acs_desc = desc;
+	acs->acs_access = access;
+	acs->acs_aclgen = aclgen;
+	acs->acs_wgen = wgen;
+	acs->acs_ret = ret;
+	ACL_PRIV_ASSIGN( acs->acs_mask, mask );
+	acs->acs_csnlen = csn->a_nvals[0].bv_len;
+	AC_MEMCPY( acs->acs_csn, csn->a_nvals[0].bv_val, acs->acs_csnlen );
+	ldap_pvt_thread_mutex_unlock( &ac->ac_mutex );
+}
+
 #define MATCHES_DNMAXCOUNT(m) 					\
 	( sizeof ( (m)->dn_data ) / sizeof( *(m)->dn_data ) )
 #define MATCHES_VALMAXCOUNT(m) 					\
@@ -155,6 +482,9 @@ slap_access_allowed(
 	AclRegexMatches			matches;
 	AccessControlState		acl_state = ACL_STATE_INIT;
 	static AccessControlState	state_init = ACL_STATE_INIT;
+	Attribute			*csn = NULL;
+	unsigned long			aclgen = 0;
+	int				cflags = 0;
 
 	assert( op != NULL );
 	assert( e != NULL );
@@ -235,6 +565,20 @@ slap_access_allowed(
 		a = NULL;
 		count = 0;
 		ACL_PRIV_ASSIGN( mask, *maskp );
+
+		if ( *maskp == ACL_PRIV_NONE
+			&& ( csn = acl_cache_csn( op, e, val )) != NULL )
+		{
+			aclgen = acl_cache_aclgen_get();
+			ret = acl_cache_lookup( op, e, csn, desc, access, aclgen, &mask );
+			if ( ret != -1 ) {
+				Debug( LDAP_DEBUG_ACL,
+					"=> slap_access_allowed: %s access %s (cached)\n",
+					access2str( access ), ret ? "granted" : "denied", 0 );
+				goto done;
+			}
+			ret = 0;
+		}
 	}
 
 	MATCHES_MEMSET( &matches );
@@ -285,6 +629,10 @@ slap_access_allowed(
 			Debug( LDAP_DEBUG_ACL, "\n", 0, 0, 0 );
 		}
 
+		if ( csn != NULL ) {
+			cflags |= acl_index_cache_flags( a );
+		}
+
 		control = slap_acl_mask( a, prev, &mask, op,
 			e, desc, val, &matches, count, state, access );
 
@@ -302,11 +650,13 @@ slap_access_allowed(
 			e->e_dn, attr, 0 );
 		ACL_PRIV_ASSIGN( mask, *maskp );
 
+		csn = NULL;
+
 	} else if ( control == ACL_BREAK ) {
 		Debug( LDAP_DEBUG_ACL,
 			"=> slap_access_allowed: no more rules\n", 0, 0, 0 );
 
-		goto done;
+		goto store;
 	}
 
 	ret = ACL_GRANT( mask, access );
@@ -316,6 +666,15 @@ slap_access_allowed(
 		access2str( access ), ret ? "granted" : "denied",
 		accessmask2str( mask, accessmaskbuf, 1 ) );
 
+store:
+	if ( csn != NULL && !( cflags & ACL_CACHE_NEVER )
+		&& !state->as_vd_acl_present
+		&& ( op->o_acl_wgen != 0 || !( cflags & ACL_CACHE_GROUPS )))
+	{
+		acl_cache_store( op, e, csn, desc, access, aclgen,
+			( cflags & ACL_CACHE_GROUPS ) ? op->o_acl_wgen : 0, ret, mask );
+	}
+
 done:
 	ACL_PRIV_ASSIGN( *maskp, mask );
 	return ret;
@@ -489,6 +848,555 @@ done:
 }
 
 
+/*
+ * Compiled ACL lists
+ *
+ * Every rule of a list is tested in turn against the target entry and
+ * attribute until one applies; with hundreds of rules most of the time
+ * goes into rules that could never apply.  acl_index_build() compiles
+ * the list into a lookup structure that yields, for a given entry and
+ * attribute, a bitmap of the candidate rules:
+ *
+ * - base/one/subtree/children targets are kept in a tree keyed by the
+ *   pattern DN; only the suffixes of the entry DN that start at an RDN
+ *   boundary need to be looked up;
+ * - regex targets are always candidates, but the literal text that an
+ *   anchored regex must end with is extracted, so that most
+ *   non-matching DNs are rejected without running regexec();
+ * - the attribute list of each rule is evaluated once per attribute
+ *   description and remembered as a bitmap.
+ *
+ * The candidates are then evaluated exactly as before, in order, so
+ * the result is the same as a linear scan of the list.
+ */
+
+#define ACL_INDEX_BITS		( sizeof( unsigned long ) * CHAR_BIT )
+#define ACL_INDEX_WORDS(n)	( ( (n) + ACL_INDEX_BITS - 1 ) / ACL_INDEX_BITS )
+#define ACL_INDEX_SET(m, i)	( (m)[ (i) / ACL_INDEX_BITS ] |= 1UL << ( (i) % ACL_INDEX_BITS ) )
+#define ACL_INDEX_ISSET(m, i)	( (m)[ (i) / ACL_INDEX_BITS ] & ( 1UL << ( (i) % ACL_INDEX_BITS ) ) )
+
+/* candidate bitmaps up to this size live on the stack */
+#define ACL_INDEX_STACK_WORDS	16
+
+typedef struct AclSuffix {
+	struct berval	as_pat;
+	unsigned long	as_rules[1];	/* actually ai_nwords */
+} AclSuffix;
+
+typedef struct AclAttrMask {
+	AttributeDescription	*am_desc;
+	unsigned long		am_rules[1];	/* actually ai_nwords */
+} AclAttrMask;
+
+typedef struct AclIndex {
+	int		ai_nrules;
+	int		ai_nwords;
+	AccessControl	**ai_rules;
+
+	/* rules whose target DN is not indexed by suffix */
+	unsigned long	*ai_dn_any;
+	Avlnode		*ai_suffixes;
+
+	/* literal text a regex target must end with, if any */
+	struct berval	*ai_tails;
+
+	/* how the decisions of each rule may be cached */
+	unsigned char	*ai_cache;
+
+	/* rules whose attribute list cannot be evaluated in advance */
+	unsigned long	*ai_attr_dyn;
+	ldap_pvt_thread_rdwr_t	ai_attr_rwlock;
+	Avlnode		*ai_attrs;
+} AclIndex;
+
+static int
+acl_suffix_cmp( const void *v1, const void *v2 )
+{
+	const AclSuffix *s1 = v1, *s2 = v2;
+
+	return ber_bvcmp( &s1->as_pat, &s2->as_pat );
+}
+
+static int
+acl_attrmask_cmp( const void *v1, const void *v2 )
+{
+	const AclAttrMask *m1 = v1, *m2 = v2;
+
+	if ( m1->am_desc < m2->am_desc )
+		return -1;
+	return m1->am_desc > m2->am_desc;
+}
+
+/*
+ * How the decisions made by rule a may be cached
+ */
+static int
+acl_index_cache_flags( AccessControl *a )
+{
+	if ( a->acl_index == NULL )
+		return ACL_CACHE_NEVER;
+
+	return a->acl_index->ai_cache[ a->acl_pos ];
+}
+
+/*
+ * Return the literal text that every string matched by the regex must
+ * end with; empty when the regex is not anchored with a '$' or its
+ * tail cannot be determined simply. Only plain ASCII characters are
+ * considered, since the patterns are compiled with REG_ICASE.
+ */
+static void
+acl_regex_tail( struct berval *pat, struct berval *tail )
+{
+	char *end, *p;
+
+	BER_BVZERO( tail );
+
+	if ( pat->bv_len < 2 || pat->bv_val[ pat->bv_len - 1 ] != '$' )
+		return;
+
+	/* any alternative may end differently */
+	if ( strchr( pat->bv_val, '|' ) != NULL )
+		return;
+
+	end = &pat->bv_val[ pat->bv_len - 1 ];
+	for ( p = end; p > pat->bv_val; p-- ) {
+		unsigned char c = p[-1];
+
+		if ( c & 0x80 || strchr( "\\^$.[]()*+?{}", c ) != NULL )
+			break;
+	}
+
+	/* the first character was escaped, or the '$' itself */
+	if ( p > pat->bv_val && p[-1] == '\\' )
+		p++;
+
+	if ( p < end ) {
+		tail->bv_val = p;
+		tail->bv_len = end - p;
+	}
+}
+
+static void
+acl_attrmask_free( void *v )
+{
+	ch_free( v );
+}
+
+static void
+acl_suffix_free( void *v )
+{
+	ch_free( v );
+}
+
+void
+acl_index_free( AclIndex *ai )
+{
+	if ( ai == NULL )
+		return;
+
+	acl_cache_acls_changed();
+
+	avl_free( ai->ai_suffixes, acl_suffix_free );
+	avl_free( ai->ai_attrs, acl_attrmask_free );
+	ldap_pvt_thread_rdwr_destroy( &ai->ai_attr_rwlock );
+	ch_free( ai->ai_tails );
+	ch_free( ai->ai_cache );
+	ch_free( ai->ai_attr_dyn );
+	ch_free( ai->ai_dn_any );
+	ch_free( ai->ai_rules );
+	ch_free( ai );
+}
+
+/*
+ * (Re)build the lookup structure of the list starting at a; must be
+ * called whenever rules are added to or removed from the list.
+ */
+void
+acl_index_build( AccessControl *a )
+{
+	AclIndex *ai;
+	AccessControl *l;
+	int i, n;
+
+	if ( a == NULL )
+		return;
+
+	acl_cache_acls_changed();
+
+	for ( l = a; l != NULL; l = l->acl_next ) {
+		if ( l->acl_index != NULL ) {
+			acl_index_free( l->acl_index );
+			break;
+		}
+	}
+
+	for ( n = 0, l = a; l != NULL; l = l->acl_next )
+		n++;
+
+	ai = ch_calloc( 1, sizeof( AclIndex ));
+	ai->ai_nrules = n;
+	ai->ai_nwords = ACL_INDEX_WORDS( n );
+	ai->ai_rules = ch_malloc( n * sizeof( AccessControl * ));
+	ai->ai_dn_any = ch_calloc( ai->ai_nwords, sizeof( unsigned long ));
+	ai->ai_attr_dyn = ch_calloc( ai->ai_nwords, sizeof( unsigned long ));
+	ai->ai_tails = ch_calloc( n, sizeof( struct berval ));
+	ai->ai_cache = ch_malloc( n );
+	ldap_pvt_thread_rdwr_init( &ai->ai_attr_rwlock );
+
+	for ( i = 0, l = a; l != NULL; i++, l = l->acl_next ) {
+		l->acl_index = ai;
+		l->acl_pos = i;
+		ai->ai_rules[i] = l;
+		ai->ai_cache[i] = acl_cache_flags( l );
+
+		switch ( l->acl_dn_style ) {
+		case ACL_STYLE_BASE:
+		case ACL_STYLE_ONE:
+		case ACL_STYLE_SUBTREE:
+		case ACL_STYLE_CHILDREN:
+			if ( !BER_BVISEMPTY( &l->acl_dn_pat ) ) {
+				AclSuffix *as, *tmp;
+
+				as = ch_calloc( 1, sizeof( AclSuffix )
+					+ ( ai->ai_nwords - 1 ) * sizeof( unsigned long ));
+				as->as_pat = l->acl_dn_pat;
+				if ( avl_insert( &ai->ai_suffixes, (caddr_t)as,
+					acl_suffix_cmp, avl_dup_error ))
+				{
+					tmp = as;
+					as = avl_find( ai->ai_suffixes, tmp, acl_suffix_cmp );
+					ch_free( tmp );
+				}
+				ACL_INDEX_SET( as->as_rules, i );
+				break;
+			}
+			/* FALLTHRU */
+
+		default:
+			ACL_INDEX_SET( ai->ai_dn_any, i );
+			if ( l->acl_dn_style == ACL_STYLE_REGEX
+				&& !BER_BVISEMPTY( &l->acl_dn_pat ) )
+			{
+				acl_regex_tail( &l->acl_dn_pat, &ai->ai_tails[i] );
+			}
+			break;
+		}
+
+		if ( l->acl_attrs != NULL ) {
+			AttributeName *an;
+
+			for ( an = l->acl_attrs; !BER_BVISNULL( &an->an_name ); an++ ) {
+				/* objectClass-based lists are resolved lazily */
+				if ( an->an_desc == NULL
+					&& !ber_bvccmp( &an->an_name, '*' )
+					&& !ber_bvccmp( &an->an_name, '+' ) )
+				{
+					ACL_INDEX_SET( ai->ai_attr_dyn, i );
+					break;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Bitmap of the rules whose attribute list may include desc
+ */
+static unsigned long *
+acl_index_attrs( AclIndex *ai, AttributeDescription *desc )
+{
+	AclAttrMask *am, tmp;
+	int i;
+
+	tmp.am_desc = desc;
+
+	ldap_pvt_thread_rdwr_rlock( &ai->ai_attr_rwlock );
+	am = avl_find( ai->ai_attrs, &tmp, acl_attrmask_cmp );
+	ldap_pvt_thread_rdwr_runlock( &ai->ai_attr_rwlock );
+	if ( am != NULL )
+		return am->am_rules;
+
+	am = ch_calloc( 1, sizeof( AclAttrMask )
+		+ ( ai->ai_nwords - 1 ) * sizeof( unsigned long ));
+	am->am_desc = desc;
+	for ( i = 0; i < ai->ai_nrules; i++ ) {
+		AccessControl *a = ai->ai_rules[i];
+
+		if ( a->acl_attrs == NULL
+			|| ACL_INDEX_ISSET( ai->ai_attr_dyn, i )
+			|| ad_inlist( desc, a->acl_attrs ) )
+		{
+			ACL_INDEX_SET( am->am_rules, i );
+		}
+	}
+
+	ldap_pvt_thread_rdwr_wlock( &ai->ai_attr_rwlock );
+	if ( avl_insert( &ai->ai_attrs, (caddr_t)am,
+		acl_attrmask_cmp, avl_dup_error ))
+	{
+		ch_free( am );
+		am = avl_find( ai->ai_attrs, &tmp, acl_attrmask_cmp );
+	}
+	ldap_pvt_thread_rdwr_wunlock( &ai->ai_attr_rwlock );
+
+	return am->am_rules;
+}
+
+/*
+ * Fill cand with the rules that may apply to entry e, attribute desc
+ */
+static void
+acl_index_candidates(
+	AclIndex *ai,
+	Entry *e,
+	AttributeDescription *desc,
+	unsigned long *cand )
+{
+	unsigned long *attrs;
+	AclSuffix *as, tmp;
+	char *p, *end;
+	int i;
+
+	AC_MEMCPY( cand, ai->ai_dn_any, ai->ai_nwords * sizeof( unsigned long ));
+
+	if ( ai->ai_suffixes != NULL ) {
+		end = e->e_nname.bv_val + e->e_nname.bv_len;
+		p = e->e_nname.bv_val;
+		while ( p < end ) {
+			tmp.as_pat.bv_val = p;
+			tmp.as_pat.bv_len = end - p;
+			as = avl_find( ai->ai_suffixes, &tmp, acl_suffix_cmp );
+			if ( as != NULL ) {
+				for ( i = 0; i < ai->ai_nwords; i++ )
+					cand[i] |= as->as_rules[i];
+			}
+			for ( ; p < end && !DN_SEPARATOR( *p ); p++ )
+				;
+			p++;
+		}
+	}
+
+	attrs = acl_index_attrs( ai, desc );
+	for ( i = 0; i < ai->ai_nwords; i++ )
+		cand[i] &= attrs[i];
+}
+
+/*
+ * Position of the first candidate at or after i, or ai_nrules
+ */
+static int
+acl_index_next( AclIndex *ai, unsigned long *cand, int i )
+{
+	int w = i / ACL_INDEX_BITS;
+	unsigned long bits;
+
+	if ( i >= ai->ai_nrules )
+		return ai->ai_nrules;
+
+	bits = cand[w] & ( ~0UL << ( i % ACL_INDEX_BITS ));
+	while ( bits == 0 ) {
+		if ( ++w >= ai->ai_nwords )
+			return ai->ai_nrules;
+		bits = cand[w];
+	}
+
+	for ( i = w * ACL_INDEX_BITS; !( bits & 1UL ); bits >>= 1 )
+		i++;
+
+	return i < ai->ai_nrules ? i : ai->ai_nrules;
+}
+
+/*
+ * slap_acl_test - check whether acl a applies to entry e, attribute
+ * desc and value val; count is the position of a in the evaluation
+ * order, and prev the acl evaluated before it.  If attr_checked is
+ * set, the caller already knows desc matches the acl's attributes.
+ */
+
+static int
+slap_acl_test(
+	AccessControl	*a,
+	AccessControl	*prev,
+	int		count,
+	Operation	*op,
+	Entry		*e,
+	AttributeDescription *desc,
+	struct berval	*val,
+	AclRegexMatches	*matches,
+	slap_mask_t	*mask,
+	AccessControlState *state,
+	int		attr_checked )
+{
+	ber_len_t dnlen = e->e_nname.bv_len;
+
+	if ( a->acl_dn_pat.bv_len || ( a->acl_dn_style != ACL_STYLE_REGEX )) {
+		if ( a->acl_dn_style == ACL_STYLE_REGEX ) {
+			Debug( LDAP_DEBUG_ACL, "=> dnpat: [%d] %s nsub: %d\n", 
+				count, a->acl_dn_pat.bv_val, (int) a->acl_dn_re.re_nsub );
+			if ( a->acl_index != NULL ) {
+				struct berval *tail = &a->acl_index->ai_tails[ a->acl_pos ];
+
+				if ( dnlen < tail->bv_len || strncasecmp( tail->bv_val,
+					e->e_ndn + dnlen - tail->bv_len, tail->bv_len ) != 0 )
+					return 0;
+			}
+			if ( regexec ( &a->acl_dn_re, 
+				       e->e_ndn, 
+			 	       matches->dn_count, 
+				       matches->dn_data, 0 ) )
+				return 0;
+
+		} else {
+			ber_len_t patlen;
+
+			Debug( LDAP_DEBUG_ACL, "=> dn: [%d] %s\n", 
+				count, a->acl_dn_pat.bv_val, 0 );
+			patlen = a->acl_dn_pat.bv_len;
+			if ( dnlen < patlen )
+				return 0;
+
+			if ( a->acl_dn_style == ACL_STYLE_BASE ) {
+				/* base dn -- entire object DN must match */
+				if ( dnlen != patlen )
+					return 0;
+
+			} else if ( a->acl_dn_style == ACL_STYLE_ONE ) {
+				ber_len_t	rdnlen = 0;
+				ber_len_t	sep = 0;
+
+				if ( dnlen <= patlen )
+					return 0;
+
+				if ( patlen > 0 ) {
+					if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
+						return 0;
+					sep = 1;
+				}
+
+				rdnlen = dn_rdnlen( NULL, &e->e_nname );
+				if ( rdnlen + patlen + sep != dnlen )
+					return 0;
+
+			} else if ( a->acl_dn_style == ACL_STYLE_SUBTREE ) {
+				if ( dnlen > patlen && !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
+					return 0;
+
+			} else if ( a->acl_dn_style == ACL_STYLE_CHILDREN ) {
+				if ( dnlen <= patlen )
+					return 0;
+				if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
+					return 0;
+			}
+
+			if ( strcmp( a->acl_dn_pat.bv_val, e->e_ndn + dnlen - patlen ) != 0 )
+				return 0;
+		}
+
+		Debug( LDAP_DEBUG_ACL, "=> acl_get: [%d] matched\n",
+			count, 0, 0 );
+	}
+
+	if ( a->acl_attrs && !attr_checked && !ad_inlist( desc, a->acl_attrs ) ) {
+		matches->dn_data[0].rm_so = -1;
+		matches->dn_data[0].rm_eo = -1;
+		matches->val_data[0].rm_so = -1;
+		matches->val_data[0].rm_eo = -1;
+		return 0;
+	}
+
+	/* Is this ACL only for a specific value? */
+	if ( a->acl_attrval.bv_val ) {
+		if ( val == NULL ) {
+			return 0;
+		}
+
+		if ( !state->as_vd_acl_present ) {
+			state->as_vd_acl_present = 1;
+			state->as_vd_acl = prev;
+			state->as_vd_acl_count = count - 1;
+			ACL_PRIV_ASSIGN ( state->as_vd_mask, *mask );
+		}
+
+		if ( a->acl_attrval_style == ACL_STYLE_REGEX ) {
+			Debug( LDAP_DEBUG_ACL,
+				"acl_get: valpat %s\n",
+				a->acl_attrval.bv_val, 0, 0 );
+			if ( regexec ( &a->acl_attrval_re, 
+					    val->bv_val, 
+					    matches->val_count, 
+					    matches->val_data, 0 ) )
+			{
+				return 0;
+			}
+
+		} else {
+			int match = 0;
+			const char *text;
+			Debug( LDAP_DEBUG_ACL,
+				"acl_get: val %s\n",
+				a->acl_attrval.bv_val, 0, 0 );
+
+			if ( a->acl_attrs[0].an_desc->ad_type->sat_syntax != slap_schema.si_syn_distinguishedName ) {
+				if (value_match( &match, desc,
+					a->acl_attrval_mr, 0,
+					val, &a->acl_attrval, &text ) != LDAP_SUCCESS ||
+						match )
+					return 0;
+				
+			} else {
+				ber_len_t	patlen, vdnlen;
+
+				patlen = a->acl_attrval.bv_len;
+				vdnlen = val->bv_len;
+
+				if ( vdnlen < patlen )
+					return 0;
+
+				if ( a->acl_attrval_style == ACL_STYLE_BASE ) {
+					if ( vdnlen > patlen )
+						return 0;
+
+				} else if ( a->acl_attrval_style == ACL_STYLE_ONE ) {
+					ber_len_t	rdnlen = 0;
+
+					if ( !DN_SEPARATOR( val->bv_val[vdnlen - patlen - 1] ) )
+						return 0;
+
+					rdnlen = dn_rdnlen( NULL, val );
+					if ( rdnlen + patlen + 1 != vdnlen )
+						return 0;
+
+				} else if ( a->acl_attrval_style == ACL_STYLE_SUBTREE ) {
+					if ( vdnlen > patlen && !DN_SEPARATOR( val->bv_val[vdnlen - patlen - 1] ) )
+						return 0;
+
+				} else if ( a->acl_attrval_style == ACL_STYLE_CHILDREN ) {
+					if ( vdnlen <= patlen )
+						return 0;
+
+					if ( !DN_SEPARATOR( val->bv_val[vdnlen - patlen - 1] ) )
+						return 0;
+				}
+
+				if ( strcmp( a->acl_attrval.bv_val, val->bv_val + vdnlen - patlen ) )
+					return 0;
+			}
+		}
+	}
+
+	if ( a->acl_filter != NULL ) {
+		ber_int_t rc = test_filter( NULL, e, a->acl_filter );
+		if ( rc != LDAP_COMPARE_TRUE ) {
+			return 0;
+		}
+	}
+
+	Debug( LDAP_DEBUG_ACL, "=> acl_get: [%d] attr %s\n",
+	       count, desc->ad_cname.bv_val, 0);
+	return 1;
+}
+
 /*
  * slap_acl_get - return the acl applicable to entry e, attribute
  * attr.  the acl returned is suitable for use in subsequent calls to
@@ -508,7 +1416,6 @@ slap_acl_get(
 	AccessControlState *state )
 {
 	const char *attr;
-	ber_len_t dnlen;
 	AccessControl *prev;
 
 	assert( e != NULL );
@@ -536,173 +1443,68 @@ slap_acl_get(
 		a = a->acl_next;
 	}
 
-	dnlen = e->e_nname.bv_len;
-
  retry:
-	for ( ; a != NULL; prev = a, a = a->acl_next ) {
-		(*count) ++;
-
-		if ( a != frontendDB->be_acl && state->as_fe_done )
-			state->as_fe_done++;
-
-		if ( a->acl_dn_pat.bv_len || ( a->acl_dn_style != ACL_STYLE_REGEX )) {
-			if ( a->acl_dn_style == ACL_STYLE_REGEX ) {
-				Debug( LDAP_DEBUG_ACL, "=> dnpat: [%d] %s nsub: %d\n", 
-					*count, a->acl_dn_pat.bv_val, (int) a->acl_dn_re.re_nsub );
-				if ( regexec ( &a->acl_dn_re, 
-					       e->e_ndn, 
-				 	       matches->dn_count, 
-					       matches->dn_data, 0 ) )
-					continue;
-
-			} else {
-				ber_len_t patlen;
-
-				Debug( LDAP_DEBUG_ACL, "=> dn: [%d] %s\n", 
-					*count, a->acl_dn_pat.bv_val, 0 );
-				patlen = a->acl_dn_pat.bv_len;
-				if ( dnlen < patlen )
-					continue;
-
-				if ( a->acl_dn_style == ACL_STYLE_BASE ) {
-					/* base dn -- entire object DN must match */
-					if ( dnlen != patlen )
-						continue;
-
-				} else if ( a->acl_dn_style == ACL_STYLE_ONE ) {
-					ber_len_t	rdnlen = 0;
-					ber_len_t	sep = 0;
-
-					if ( dnlen <= patlen )
-						continue;
-
-					if ( patlen > 0 ) {
-						if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
-							continue;
-						sep = 1;
-					}
-
-					rdnlen = dn_rdnlen( NULL, &e->e_nname );
-					if ( rdnlen + patlen + sep != dnlen )
-						continue;
-
-				} else if ( a->acl_dn_style == ACL_STYLE_SUBTREE ) {
-					if ( dnlen > patlen && !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
-						continue;
-
-				} else if ( a->acl_dn_style == ACL_STYLE_CHILDREN ) {
-					if ( dnlen <= patlen )
-						continue;
-					if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
-						continue;
+	if ( a != NULL && a->acl_index != NULL ) {
+		AclIndex *ai = a->acl_index;
+		unsigned long candbuf[ ACL_INDEX_STACK_WORDS ], *cand = candbuf;
+		int i, next;
+
+		if ( ai->ai_nwords > ACL_INDEX_STACK_WORDS ) {
+			cand = slap_sl_malloc( ai->ai_nwords * sizeof( unsigned long ),
+				op->o_tmpmemctx );
+		}
+		acl_index_candidates( ai, e, desc, cand );
+
+		for ( i = a->acl_pos; ; i = next + 1 ) {
+			next = acl_index_next( ai, cand, i );
+
+			/* account for the rules that were skipped */
+			if ( next > i ) {
+				*count += next - i;
+				if ( state->as_fe_done ) {
+					state->as_fe_done += next - i;
+					if ( i == 0 && ai->ai_rules[0] == frontendDB->be_acl )
+						state->as_fe_done--;
 				}
-
-				if ( strcmp( a->acl_dn_pat.bv_val, e->e_ndn + dnlen - patlen ) != 0 )
-					continue;
+				prev = ai->ai_rules[next - 1];
+			}
+			if ( next >= ai->ai_nrules ) {
+				a = NULL;
+				break;
 			}
 
-			Debug( LDAP_DEBUG_ACL, "=> acl_get: [%d] matched\n",
-				*count, 0, 0 );
-		}
+			a = ai->ai_rules[next];
+			(*count) ++;
 
-		if ( a->acl_attrs && !ad_inlist( desc, a->acl_attrs ) ) {
-			matches->dn_data[0].rm_so = -1;
-			matches->dn_data[0].rm_eo = -1;
-			matches->val_data[0].rm_so = -1;
-			matches->val_data[0].rm_eo = -1;
-			continue;
-		}
+			if ( a != frontendDB->be_acl && state->as_fe_done )
+				state->as_fe_done++;
 
-		/* Is this ACL only for a specific value? */
-		if ( a->acl_attrval.bv_val ) {
-			if ( val == NULL ) {
-				continue;
+			if ( slap_acl_test( a, prev, *count, op, e, desc, val,
+				matches, mask, state,
+				!ACL_INDEX_ISSET( ai->ai_attr_dyn, next ) ) )
+			{
+				break;
 			}
+			prev = a;
+		}
 
-			if ( !state->as_vd_acl_present ) {
-				state->as_vd_acl_present = 1;
-				state->as_vd_acl = prev;
-				state->as_vd_acl_count = *count - 1;
-				ACL_PRIV_ASSIGN ( state->as_vd_mask, *mask );
-			}
+		if ( cand != candbuf )
+			slap_sl_free( cand, op->o_tmpmemctx );
+		if ( a != NULL )
+			return a;
+	}
 
-			if ( a->acl_attrval_style == ACL_STYLE_REGEX ) {
-				Debug( LDAP_DEBUG_ACL,
-					"acl_get: valpat %s\n",
-					a->acl_attrval.bv_val, 0, 0 );
-				if ( regexec ( &a->acl_attrval_re, 
-						    val->bv_val, 
-						    matches->val_count, 
-						    matches->val_data, 0 ) )
-				{
-					continue;
-				}
+	for ( ; a != NULL; prev = a, a = a->acl_next ) {
+		(*count) ++;
 
-			} else {
-				int match = 0;
-				const char *text;
-				Debug( LDAP_DEBUG_ACL,
-					"acl_get: val %s\n",
-					a->acl_attrval.bv_val, 0, 0 );
-	
-				if ( a->acl_attrs[0].an_desc->ad_type->sat_syntax != slap_schema.si_syn_distinguishedName ) {
-					if (value_match( &match, desc,
-						a->acl_attrval_mr, 0,
-						val, &a->acl_attrval, &text ) != LDAP_SUCCESS ||
-							match )
-						continue;
-					
-				} else {
-					ber_len_t	patlen, vdnlen;
-	
-					patlen = a->acl_attrval.bv_len;
-					vdnlen = val->bv_len;
-	
-					if ( vdnlen < patlen )
-						continue;
-	
-					if ( a->acl_attrval_style == ACL_STYLE_BASE ) {
-						if ( vdnlen > patlen )
-							continue;
-	
-					} else if ( a->acl_attrval_style == ACL_STYLE_ONE ) {
-						ber_len_t	rdnlen = 0;
-	
-						if ( !DN_SEPARATOR( val->bv_val[vdnlen - patlen - 1] ) )
-							continue;
-	
-						rdnlen = dn_rdnlen( NULL, val );
-						if ( rdnlen + patlen + 1 != vdnlen )
-							continue;
-	
-					} else if ( a->acl_attrval_style == ACL_STYLE_SUBTREE ) {
-						if ( vdnlen > patlen && !DN_SEPARATOR( val->bv_val[vdnlen - patlen - 1] ) )
-							continue;
-	
-					} else if ( a->acl_attrval_style == ACL_STYLE_CHILDREN ) {
-						if ( vdnlen <= patlen )
-							continue;
-	
-						if ( !DN_SEPARATOR( val->bv_val[vdnlen - patlen - 1] ) )
-							continue;
-					}
-	
-					if ( strcmp( a->acl_attrval.bv_val, val->bv_val + vdnlen - patlen ) )
-						continue;
-				}
-			}
-		}
+		if ( a != frontendDB->be_acl && state->as_fe_done )
+			state->as_fe_done++;
 
-		if ( a->acl_filter != NULL ) {
-			ber_int_t rc = test_filter( NULL, e, a->acl_filter );
-			if ( rc != LDAP_COMPARE_TRUE ) {
-				continue;
-			}
+		if ( slap_acl_test( a, prev, *count, op, e, desc, val,
+			matches, mask, state, 0 ) )
+		{
+			return a;
 		}
-
-		Debug( LDAP_DEBUG_ACL, "=> acl_get: [%d] attr %s\n",
-		       *count, attr, 0);
-		return a;
 	}
 
 	if ( !state->as_fe_done ) {
@@ -2352,6 +2352,7 @@ access_append( Access **l, Access *a )
 void
 acl_append( AccessControl **l, AccessControl *a, int pos )
 {
+	AccessControl **head = l;
 	int i;
 
 	for (i=0 ; i != pos && *l != NULL; l = &(*l)->acl_next, i++ ) {
@@ -2360,6 +2361,8 @@ acl_append( AccessControl **l, AccessControl *a, int pos )
 	if ( *l && a )
 		a->acl_next = *l;
 	*l = a;
+
+	acl_index_build( *head );
 }
 
 static void
@@ -2449,6 +2452,10 @@ acl_destroy( AccessControl *a )
 {
 	AccessControl *n;
 
+	if ( a ) {
+		acl_index_free( a->acl_index );
+	}
+
 	for ( ; a; a = n ) {
 		n = a->acl_next;
 		acl_free( a );
@@ -258,6 +258,9 @@ at_delete( AttributeType *at )
 	LDAP_STAILQ_REMOVE(&attr_list, at, AttributeType, sat_next);
 
 	at_delete_names( at );
+
+	/* cached DNs may have been normalized using this type */
+	dn_cache_flush();
 }
 
 static void
@@ -582,6 +585,9 @@ at_insert(
 		LDAP_STAILQ_INSERT_TAIL( &attr_list, sat, sat_next );
 	}
 
+	/* DNs using this type may have been cached as undefined */
+	dn_cache_flush();
+
 	return 0;
 }
 
@@ -359,6 +359,7 @@ bdb_search( Operation *op, SlapReply *rs )
 	int		tentries = 0;
 	unsigned	nentries = 0;
 	int		idflag = 0;
+	FilterProgram	*fprog = NULL;
 
 	DB_LOCK		lock;
 	struct	bdb_op_info	*opinfo = NULL;
@@ -655,6 +656,8 @@ cand_retry:
 		tentries = BDB_IDL_N(candidates);
 	}
 
+	fprog = filter_compile( op, op->oq_search.rs_filter );
+
 	if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED ) {
 		PagedResultsState *ps = op->o_pagedresults_state;
 		/* deferred cookie parsing */
@@ -963,7 +966,7 @@ id_retry:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		rs->sr_err = test_filter_program( op, e, fprog );
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
@@ -1089,6 +1092,7 @@ nochange:
 	rs->sr_err = LDAP_SUCCESS;
 
 done:
+	filter_program_free( op, fprog );
 	if( rs->sr_v2ref ) {
 		ber_bvarray_free( rs->sr_v2ref );
 		rs->sr_v2ref = NULL;
@@ -52,6 +52,9 @@ mdb_add(Operation *op, SlapReply *rs )
 		return rs->sr_err;
 #endif
 
+	if ( mdb_group_usable( op, mdb ))
+		return mdb_group_op( op, rs, mdb_add );
+
 	ctrls[num_ctrls] = 0;
 
 	/* check entry's schema */
@@ -418,7 +421,9 @@ return_results:
 #endif
 	}
 
-	slap_graduate_commit_csn( op );
+	/* a group commit sends the result later */
+	if ( !( moi->moi_flag & MOI_GROUPED ))
+		slap_graduate_commit_csn( op );
 
 	if( postread_ctrl != NULL && (*postread_ctrl) != NULL ) {
 		slap_sl_free( (*postread_ctrl)->ldctl_value.bv_val, op->o_tmpmemctx );
@@ -87,6 +87,22 @@ mdb_attr_mask(
 	return i < 0 ? NULL : mdb->mi_attrs[i];
 }
 
+/* Find the index that uses a DB handle */
+AttrInfo *
+mdb_attr_dbi(
+	struct mdb_info	*mdb,
+	MDB_dbi dbi )
+{
+	int i;
+
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		if ( mdb->mi_attrs[i]->ai_dbi == dbi ||
+			( mdb->mi_attrs[i]->ai_ndbi && mdb->mi_attrs[i]->ai_ndbi == dbi ))
+			return mdb->mi_attrs[i];
+	}
+	return NULL;
+}
+
 /* Open all un-opened index DB handles */
 int
 mdb_attr_dbs_open(
@@ -120,6 +136,30 @@ mdb_attr_dbs_open(
 		flags |= MDB_CREATE;
 
 	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		rc = mdb_order_open( mdb, txn, mdb->mi_attrs[i] );
+		if ( rc ) {
+			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+				"ordering index of %s unavailable: %s (%d).",
+				be->be_suffix[0].bv_val,
+				mdb->mi_attrs[i]->ai_desc->ad_cname.bv_val,
+				mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_attr_dbs) ": %s\n",
+				cr->msg, 0, 0 );
+			break;
+		}
+		rc = mdb_ngram_open( mdb, txn, mdb->mi_attrs[i] );
+		if ( rc ) {
+			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+				"ngram index of %s unavailable: %s (%d).",
+				be->be_suffix[0].bv_val,
+				mdb->mi_attrs[i]->ai_desc->ad_cname.bv_val,
+				mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_attr_dbs) ": %s\n",
+				cr->msg, 0, 0 );
+			break;
+		}
 		if ( mdb->mi_attrs[i]->ai_dbi )	/* already open */
 			continue;
 		rc = mdb_dbi_open( txn, mdb->mi_attrs[i]->ai_desc->ad_type->sat_cname.bv_val,
@@ -138,6 +178,20 @@ mdb_attr_dbs_open(
 		/* Remember newly opened DBI handles */
 		if ( dbis )
 			dbis[i] = mdb->mi_attrs[i]->ai_dbi;
+		if ( !(slapMode & SLAP_TOOL_READONLY) ) {
+			rc = mdb_ixstat_open( mdb, txn, mdb->mi_attrs[i] );
+			if ( rc ) {
+				snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+					"key statistics of %s unavailable: %s (%d).",
+					be->be_suffix[0].bv_val,
+					mdb->mi_attrs[i]->ai_desc->ad_type->sat_cname.bv_val,
+					mdb_strerror(rc), rc );
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_attr_dbs) ": %s\n",
+					cr->msg, 0, 0 );
+				break;
+			}
+		}
 	}
 
 	/* Only commit if this is our txn */
@@ -177,11 +231,24 @@ mdb_attr_dbs_close(
 )
 {
 	int i;
-	for ( i=0; i<mdb->mi_nattrs; i++ )
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
 		if ( mdb->mi_attrs[i]->ai_dbi ) {
 			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_attrs[i]->ai_dbi );
 			mdb->mi_attrs[i]->ai_dbi = 0;
 		}
+		if ( mdb->mi_attrs[i]->ai_odbi ) {
+			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_attrs[i]->ai_odbi );
+			mdb->mi_attrs[i]->ai_odbi = 0;
+		}
+		if ( mdb->mi_attrs[i]->ai_cdbi ) {
+			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_attrs[i]->ai_cdbi );
+			mdb->mi_attrs[i]->ai_cdbi = 0;
+		}
+		if ( mdb->mi_attrs[i]->ai_ndbi ) {
+			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_attrs[i]->ai_ndbi );
+			mdb->mi_attrs[i]->ai_ndbi = 0;
+		}
+	}
 }
 
 int
@@ -372,6 +439,35 @@ fail:
 			goto fail;
 		}
 
+		/* ordering keys are the normalized values */
+		if( IS_SLAP_INDEX( mask, SLAP_INDEX_ORDERING ) &&
+			!ad->ad_type->sat_equality )
+		{
+			if (c_reply) {
+				snprintf(c_reply->msg, sizeof(c_reply->msg),
+					"ordering index of attribute \"%s\" disallowed", attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			goto fail;
+		}
+
+		/* ngrams are taken from the normalized values, and only
+		 * help substring assertions */
+		if( IS_SLAP_INDEX( mask, SLAP_INDEX_NGRAM ) && !(
+			ad->ad_type->sat_equality && ad->ad_type->sat_substr ) )
+		{
+			if (c_reply) {
+				snprintf(c_reply->msg, sizeof(c_reply->msg),
+					"ngram index of attribute \"%s\" disallowed", attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			goto fail;
+		}
+
 		Debug( LDAP_DEBUG_CONFIG, "index %s 0x%04lx\n",
 			ad->ad_cname.bv_val, mask, 0 ); 
 
@@ -384,6 +480,10 @@ fail:
 		a->ai_root = NULL;
 		a->ai_desc = ad;
 		a->ai_dbi = 0;
+		a->ai_odbi = 0;
+		a->ai_cdbi = 0;
+		a->ai_ndbi = 0;
+		a->ai_maxcount = NOID;
 
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			a->ai_indexmask = 0;
@@ -601,6 +701,19 @@ done:
 	return rc;
 }
 
+/* forget the attributes added by a txn that was aborted */
+void mdb_ad_unwind( struct mdb_info *mdb, int prev_ads )
+{
+	int i;
+
+	for ( i = mdb->mi_numads; i > prev_ads; i-- ) {
+		AttributeDescription *ad = mdb->mi_ads[i];
+		mdb->mi_ads[i] = NULL;
+		mdb->mi_adxs[ad->ad_index] = 0;
+	}
+	mdb->mi_numads = i;
+}
+
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad )
 {
 	int i, rc;
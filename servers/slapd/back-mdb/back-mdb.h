@@ -32,7 +32,9 @@ LDAP_BEGIN_DECL
 #define MDB_AD2ID		0
 #define MDB_DN2ID		1
 #define MDB_ID2ENTRY	2
-#define MDB_NDB			3
+#define MDB_IXSTAT		3
+#define MDB_BITMAP		4
+#define MDB_NDB			5
 
 /* The default search IDL stack cache depth */
 #define DEFAULT_SEARCH_STACK_DEPTH	16
@@ -40,6 +42,17 @@ LDAP_BEGIN_DECL
 /* The minimum we can function with */
 #define MINIMUM_SEARCH_STACK_DEPTH	8
 
+/* Once an AND has narrowed the candidates down to this many entries,
+ * the remaining components are checked on the entries themselves
+ * instead of by reading their index keys.
+ */
+#define MDB_FILTER_DIRECT	16
+
+/* ... or when reading the next component's keys would cost more
+ * than this many IDs per remaining candidate.
+ */
+#define MDB_FILTER_DIRECT_RATIO	64
+
 #define MDB_INDICES		128
 
 #define	MDB_MAXADS	65536
@@ -50,6 +63,32 @@ LDAP_BEGIN_DECL
 /* Most users will never see this */
 #define DEFAULT_RTXN_SIZE	10000
 
+/* Kbytes of index keys a bulk load keeps in memory */
+#define DEFAULT_BULK_MEM	(256*1024)
+
+/* Candidates handed to a search helper at a time, and the fewest
+ * candidates a search must have before helpers are used at all */
+#define MDB_PSEARCH_CHUNK	1024
+#define MDB_PSEARCH_MIN	(4*MDB_PSEARCH_CHUNK)
+
+/* Times a search opens the txns of its helpers before giving up on
+ * having them in its own snapshot */
+#define MDB_PSEARCH_TRIES	4
+
+/* IDs an online indexing helper gathers the keys of at a time, and
+ * the default number of helpers */
+#define MDB_OINDEX_CHUNK	512
+#define DEFAULT_INDEX_THREADS	2
+
+/* Seconds a paged search's cursor is kept between pages */
+#define DEFAULT_PCURSOR_IDLE	60
+
+/* Most writes a group commit takes at a time */
+#define DEFAULT_GROUP_MAX	64
+
+/* Slots of the entry cache's table of last write txns */
+#define MDB_CACHE_SLOTS	4096
+
 #define MDB_MONITOR_IDX
 
 typedef struct mdb_monitor_t {
@@ -60,6 +99,49 @@ typedef struct mdb_monitor_t {
 /* From ldap_rq.h */
 struct re_s;
 
+/* A decoded entry in the entry cache; its values follow it */
+typedef struct mdb_centry {
+	ID		ce_id;
+	size_t	ce_txnid;		/* txn the entry was read in */
+	size_t	ce_size;
+	int		ce_refcnt;
+	int		ce_flags;
+	struct mdb_cache	*ce_cache;
+	struct mdb_centry	*ce_next;	/* CLOCK ring */
+	struct mdb_centry	*ce_prev;
+	Entry	ce_entry;
+} mdb_centry;
+
+/* A paged search between pages: its candidates and the read txn
+ * they were found in, for the next page to resume from */
+typedef struct mdb_pcursor {
+	struct mdb_pcursor	*pc_next;	/* most recently used first */
+	unsigned long	pc_connid;
+	ID		pc_cookie;		/* last ID sent */
+	ID		pc_ncand;
+	int		pc_scope;
+	struct berval	pc_ndn;		/* requestor */
+	struct berval	pc_base;
+	struct berval	pc_filter;
+	MDB_txn	*pc_txn;
+	time_t	pc_time;		/* last used */
+	ID		*pc_ids;
+} mdb_pcursor;
+
+typedef struct mdb_cache {
+	ldap_pvt_thread_mutex_t	c_mutex;
+	Avlnode		*c_idtree;
+	mdb_centry	*c_hand;
+	unsigned long	c_maxsize;	/* bytes, 0 disables the cache */
+	unsigned long	c_cursize;
+	unsigned long	c_count;
+	unsigned long	c_hits;
+	unsigned long	c_misses;
+	unsigned long	c_evicts;
+	/* latest txn that wrote an entry, per slot of IDs */
+	size_t		c_lastmod[MDB_CACHE_SLOTS];
+} mdb_cache;
+
 struct mdb_info {
 	MDB_env		*mi_dbenv;
 
@@ -80,13 +162,51 @@ struct mdb_info {
 	int			mi_readers;
 
 	uint32_t	mi_rtxn_size;
+	uint32_t	mi_search_threads;
+	uint32_t	mi_index_threads;
+	uint32_t	mi_pcursor_max;
+	uint32_t	mi_pcursor_idle;
+	uint32_t	mi_backup_rate;		/* kbytes per second, 0 unlimited */
+	unsigned long	mi_bulk_mem;	/* kbytes, for slapadd */
+	uint32_t	mi_group_wait;		/* usecs, 0 commits each write alone */
+	uint32_t	mi_group_max;
 	int			mi_txn_cp;
 	uint32_t	mi_txn_cp_min;
 	uint32_t	mi_txn_cp_kbyte;
 	struct re_s		*mi_txn_cp_task;
 	struct re_s		*mi_index_task;
+	struct re_s		*mi_pcursor_task;
+
+	ldap_pvt_thread_mutex_t	mi_pcursor_mutex;
+	mdb_pcursor	*mi_pcursors;
+	int			mi_npcursors;
+	uint32_t	mi_pcursor_lim;	/* mi_pcursor_max, within the readers */
 
 	mdb_monitor_t	mi_monitor;
+	mdb_cache	mi_cache;
+
+	/* progress of the online indexer, for cn=Monitor */
+	ldap_pvt_thread_mutex_t	mi_oindex_mutex;
+	time_t		mi_oindex_start;	/* 0 when not running */
+	ID			mi_oindex_total;	/* entries when it started */
+	ID			mi_oindex_done;
+
+	/* progress of the online backup, one at a time */
+	ldap_pvt_thread_mutex_t	mi_backup_mutex;
+	time_t		mi_backup_start;	/* 0 when not running */
+	size_t		mi_backup_total;	/* estimate when it started */
+	size_t		mi_backup_sent;
+
+	/* writes waiting for a group commit, see group.c */
+	ldap_pvt_thread_mutex_t	mi_group_mutex;
+	ldap_pvt_thread_cond_t	mi_group_cond;
+	struct mdb_group_write	*mi_group_head;
+	struct mdb_group_write	*mi_group_tail;
+	int			mi_group_count;
+	int			mi_group_busy;		/* a leader is at work */
+
+	/* guards the ai_maxcount of the indexes, see ixstat.c */
+	ldap_pvt_thread_mutex_t	mi_ixstat_mutex;
 
 #ifdef MDB_MONITOR_IDX
 	ldap_pvt_thread_mutex_t	mi_idx_mutex;
@@ -99,6 +219,8 @@ struct mdb_info {
 #define	MDB_DEL_INDEX	0x08
 #define	MDB_RE_OPEN		0x10
 #define	MDB_NEED_UPGRADE	0x20
+#define	MDB_PCURSORS	0x40	/* opened with MDB_NOTLS, for paged search
+								 * cursors and the txns of search helpers */
 
 	int mi_numads;
 
@@ -110,6 +232,17 @@ struct mdb_info {
 #define mi_id2entry	mi_dbis[MDB_ID2ENTRY]
 #define mi_dn2id	mi_dbis[MDB_DN2ID]
 #define mi_ad2id	mi_dbis[MDB_AD2ID]
+#define mi_ixstat	mi_dbis[MDB_IXSTAT]
+#define mi_bitmap	mi_dbis[MDB_BITMAP]
+
+/* Which attributes to decode an entry with, by attribute index.
+ * Attributes added to the database after the map was made are
+ * always decoded.
+ */
+typedef struct mdb_attrmap {
+	int		am_numads;
+	unsigned char	am_want[1];
+} mdb_attrmap;
 
 typedef struct mdb_op_info {
 	OpExtra		moi_oe;
@@ -120,6 +253,7 @@ typedef struct mdb_op_info {
 #define MOI_READER	0x01
 #define MOI_FREEIT	0x02
 #define MOI_KEEPER	0x04
+#define MOI_GROUPED	0x08	/* in a group commit, see group.c */
 
 /* Copy an ID "src" to pointer "dst" in big-endian byte order */
 #define MDB_ID2DISK( src, dst )	\
@@ -153,8 +287,80 @@ typedef struct mdb_attrinfo {
 	MDB_cursor *ai_cursor;	/* for tools */
 	int ai_idx;	/* position in AI array */
 	MDB_dbi ai_dbi;
+	MDB_dbi ai_odbi;	/* ordering index */
+	MDB_dbi ai_cdbi;	/* its counts */
+	MDB_dbi ai_ndbi;	/* ngram index */
+	ID ai_maxcount;	/* upper bound on the IDs under any one key */
 } AttrInfo;
 
+/* An ordering index has a database of its own, named after the
+ * attribute description, whose keys are the normalized values of
+ * the attribute, cut to fit in a key of its counts, with the IDs of
+ * the entries holding them. Entries without the attribute are under
+ * a key that sorts after every value, as the sssvlv overlay sorts
+ * them.
+ *
+ * Its counts are a tree of blocks in another database, that gives
+ * the position of an index entry and the entry at a position in
+ * O(log n) steps. The key of a block is its level, then the ID and
+ * the index key of the entry it starts at; its data is the number
+ * of index entries and of blocks on the level below that it covers.
+ */
+#define MDB_ORDER_PREFIX	"ord:"
+#define MDB_ORDER_COUNTS	"ordc:"
+#define MDB_ORDER_VALUE	0x01	/* first byte of a value key */
+#define MDB_ORDER_ABSENT	0x02	/* the key of entries without a value */
+
+#define MDB_ORDER_BLOCK	128	/* items a block is split into two at */
+#define MDB_ORDER_HDR	(1 + sizeof(ID))	/* of a block key */
+
+/* candidates sparser than one in this many index entries are left
+ * to the caller to sort */
+#define MDB_ORDER_SPARSE	16
+
+typedef struct mdb_ordscan mdb_ordscan;
+
+/* An ngram index has a database of its own, named after the attribute
+ * description, whose keys are every run of MDB_NGRAM_LEN bytes in the
+ * normalized values, as they are, with the IDs of the entries holding
+ * them. A substring assertion selects the entries holding all the
+ * ngrams of its pieces; those are candidates that test_filter() still
+ * checks, as the ngrams need not be in the same value or order.
+ */
+#define MDB_NGRAM_PREFIX	"ngr:"
+#define MDB_NGRAM_LEN	3
+
+/* Key statistics of an index database, kept in the ixst database
+ * under the name of the index database and updated along with the
+ * index itself.
+ */
+#define MDB_IXSTAT_BUCKETS	32	/* log2 of the IDs under a key */
+#define MDB_IXSTAT_HEAVY	8	/* biggest keys remembered */
+#define MDB_IXSTAT_HEAVY_MIN	64	/* smallest key worth remembering */
+#define MDB_IXSTAT_KEYLEN	16
+
+typedef struct mdb_ixheavy {
+	ID ih_count;	/* NOID if the key is a range */
+	unsigned short ih_klen;
+	unsigned char ih_key[MDB_IXSTAT_KEYLEN];
+} mdb_ixheavy;
+
+typedef struct mdb_ixstat {
+	ID is_nkeys;
+	ID is_nranges;	/* keys that have collapsed into a range */
+	ID is_nids;		/* IDs under keys that are not ranges */
+	ID is_hist[MDB_IXSTAT_BUCKETS];
+	mdb_ixheavy is_heavy[MDB_IXSTAT_HEAVY];
+} mdb_ixstat;
+
+/* state of the statistics during one round of index updates */
+typedef struct mdb_ixupdate {
+	MDB_cursor *iu_cursor;
+	AttrInfo *iu_ai;
+	int iu_state;
+	mdb_ixstat iu_st;
+} mdb_ixupdate;
+
 /* tool threaded indexer state */
 typedef struct mdb_attrixinfo {
 	OpExtra ai_oe;
@@ -163,6 +369,31 @@ typedef struct mdb_attrixinfo {
 	AttrInfo *ai_ai;
 } AttrIxInfo;
 
+/* Keys that the indexer gathers for an online indexing helper or a
+ * bulk load instead of storing them, see mdb_online_index() and
+ * mdb_tool_bulk_flush(). Each is in ik_dbi for the entry ik_id; ik_ai
+ * is set for the keys of an ordering index. ik_key points into ix_buf
+ * once the keys are sorted.
+ */
+typedef struct mdb_ixkey {
+	AttrInfo *ik_ai;
+	MDB_dbi ik_dbi;
+	ID ik_id;
+	size_t ik_off;
+	unsigned ik_len;
+	char *ik_key;
+} mdb_ixkey;
+
+typedef struct mdb_ixkeys {
+	OpExtra ix_oe;
+	mdb_ixkey *ix_keys;
+	int ix_nkeys;
+	int ix_maxkeys;
+	char *ix_buf;
+	size_t ix_len;
+	size_t ix_size;
+} mdb_ixkeys;
+
 /* These flags must not clash with SLAP_INDEX flags or ops in slap.h! */
 #define	MDB_INDEX_DELETING	0x8000U	/* index is being modified */
 #define	MDB_INDEX_UPDATE_OP	0x03	/* performing an index update */
@@ -0,0 +1,440 @@
+/* backup.c - stream a copy of the database over LDAP */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+#include <ac/errno.h>
+#include <ac/unistd.h>
+#include <ac/time.h>
+
+#include "back-mdb.h"
+#include "lber_pvt.h"
+#include "lutil.h"
+
+/*
+ * The backup extended operation sends a copy of the LMDB environment
+ * of the database holding its DN, as mdb_env_copyfd2() writes it, in
+ * intermediate responses:
+ *
+ *	BackupRequest ::= SEQUENCE {
+ *		dn	[0] LDAPDN,
+ *		flags	[1] INTEGER OPTIONAL,
+ *		since	[2] OCTET STRING OPTIONAL }
+ *
+ * Each intermediate response has the OID of the request as its name
+ * and the next piece of the copy as its value; the result tells if
+ * the copy is complete. The copy is written from a read txn by a
+ * thread of its own into a pipe that the operation reads, so writers
+ * are not held up, and sending no faster than olcDbBackupRate holds
+ * the copy back as well. With LDAP_BACKUP_COMPACT the free pages are
+ * left out and the others renumbered, as by mdb_copy -c. With since,
+ * the decimal ID of the last txn in an earlier copy, only the pages
+ * written after it are sent, as by mdb_copy -i; the environment must
+ * have been opened with MDB_TRACKPAGES by then.
+ */
+
+#ifndef MDB_BACKUP_CHUNK
+#define MDB_BACKUP_CHUNK	(128*1024)
+#endif
+
+/* no since in the request, send a full copy */
+#define MDB_BACKUP_FULL	((unsigned long)-1)
+
+static struct berval backup_oid = BER_BVC(LDAP_EXOP_X_BACKUP);
+
+static int
+mdb_backup_parse(
+	struct berval	*in,
+	struct berval	*ndn,
+	int		*flags,
+	unsigned long	*since,
+	const char	**text,
+	void		*ctx )
+{
+	int			rc = LDAP_SUCCESS;
+	ber_tag_t		tag;
+	ber_len_t		len = -1;
+	BerElementBuffer	berbuf;
+	BerElement		*ber = (BerElement *)&berbuf;
+	struct berval		reqdata = BER_BVNULL;
+	ber_int_t		tmp = 0;
+	unsigned long		txnid = MDB_BACKUP_FULL;
+
+	*text = NULL;
+	if ( ndn ) {
+		BER_BVZERO( ndn );
+	}
+
+	if ( in == NULL || in->bv_len == 0 ) {
+		*text = "empty request data field in backup exop";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	ber_dupbv_x( &reqdata, in, ctx );
+
+	/* ber_init2 uses reqdata directly, doesn't allocate new buffers */
+	ber_init2( ber, &reqdata, 0 );
+
+	tag = ber_scanf( ber, "{" /*}*/ );
+	if ( tag == LBER_ERROR ) {
+		goto decoding_error;
+	}
+
+	tag = ber_peek_tag( ber, &len );
+	if ( tag != LDAP_TAG_EXOP_BACKUP_REQ_DN ) {
+		goto decoding_error;
+	}
+
+	if ( ndn ) {
+		struct berval	dn;
+
+		tag = ber_scanf( ber, "m", &dn );
+		if ( tag == LBER_ERROR ) {
+			goto decoding_error;
+		}
+
+		rc = dnNormalize( 0, NULL, NULL, &dn, ndn, ctx );
+		if ( rc != LDAP_SUCCESS ) {
+			*text = "invalid DN in backup exop request data";
+			goto done;
+		}
+
+	} else {
+		tag = ber_scanf( ber, "x" /* "m" */ );
+		if ( tag == LBER_DEFAULT ) {
+			goto decoding_error;
+		}
+	}
+
+	tag = ber_peek_tag( ber, &len );
+	if ( tag == LDAP_TAG_EXOP_BACKUP_REQ_FLAGS ) {
+		tag = ber_scanf( ber, "i", &tmp );
+		if ( tag == LBER_ERROR || ( tmp & ~LDAP_BACKUP_COMPACT )) {
+			goto decoding_error;
+		}
+		tag = ber_peek_tag( ber, &len );
+	}
+
+	if ( tag == LDAP_TAG_EXOP_BACKUP_REQ_SINCE ) {
+		struct berval	bv;
+		char		buf[ LDAP_PVT_INTTYPE_CHARS( unsigned long ) ];
+
+		tag = ber_scanf( ber, "m", &bv );
+		if ( tag == LBER_ERROR || bv.bv_len == 0 || bv.bv_len >= sizeof( buf ) ) {
+			goto decoding_error;
+		}
+		AC_MEMCPY( buf, bv.bv_val, bv.bv_len );
+		buf[ bv.bv_len ] = '\0';
+		if ( lutil_atoulx( &txnid, buf, 10 ) != 0 || txnid == MDB_BACKUP_FULL ) {
+			goto decoding_error;
+		}
+		if ( tmp & LDAP_BACKUP_COMPACT ) {
+			*text = "compact copy can not be incremental";
+			rc = LDAP_PROTOCOL_ERROR;
+			goto done;
+		}
+		tag = ber_peek_tag( ber, &len );
+	}
+
+	if ( flags ) {
+		*flags = tmp;
+	}
+	if ( since ) {
+		*since = txnid;
+	}
+
+	if ( tag != LBER_DEFAULT || len != 0 ) {
+decoding_error:;
+		Debug( LDAP_DEBUG_TRACE,
+			"mdb_backup_parse: decoding error, len=%ld\n",
+			(long)len, 0, 0 );
+		rc = LDAP_PROTOCOL_ERROR;
+		*text = "data decoding error";
+
+done:;
+		if ( ndn && !BER_BVISNULL( ndn ) ) {
+			slap_sl_free( ndn->bv_val, ctx );
+			BER_BVZERO( ndn );
+		}
+	}
+
+	if ( !BER_BVISNULL( &reqdata ) ) {
+		ber_memfree_x( reqdata.bv_val, ctx );
+	}
+
+	return rc;
+}
+
+/* Send the request to the database holding its DN */
+static int
+mdb_backup_exop( Operation *op, SlapReply *rs )
+{
+	BackendDB	*bd = op->o_bd;
+	int		flags;
+	unsigned long	since;
+
+	rs->sr_err = mdb_backup_parse( op->ore_reqdata, &op->o_req_ndn, &flags,
+		&since, &rs->sr_text, op->o_tmpmemctx );
+	if ( rs->sr_err != LDAP_SUCCESS ) {
+		return rs->sr_err;
+	}
+
+	if ( since == MDB_BACKUP_FULL ) {
+		Statslog( LDAP_DEBUG_STATS, "%s BACKUP dn=\"%s\" flags=%d\n",
+			op->o_log_prefix, op->o_req_ndn.bv_val, flags, 0, 0 );
+	} else {
+		Statslog( LDAP_DEBUG_STATS, "%s BACKUP dn=\"%s\" since=%lu\n",
+			op->o_log_prefix, op->o_req_ndn.bv_val, since, 0, 0 );
+	}
+	op->o_req_dn = op->o_req_ndn;
+
+	op->o_bd = select_backend( &op->o_req_ndn, 0 );
+	if ( op->o_bd == NULL ) {
+		rs->sr_err = LDAP_NO_SUCH_OBJECT;
+		rs->sr_text = "no global superior knowledge";
+		goto done;
+	}
+
+	rs->sr_err = backend_check_restrictions( op, rs, &backup_oid );
+	if ( rs->sr_err != LDAP_SUCCESS ) {
+		goto done;
+	}
+
+	if ( op->o_bd->be_extended == NULL ) {
+		rs->sr_err = LDAP_UNWILLING_TO_PERFORM;
+		rs->sr_text = "backend does not support extended operations";
+		goto done;
+	}
+
+	op->o_bd->be_extended( op, rs );
+
+done:;
+	if ( !BER_BVISNULL( &op->o_req_ndn ) ) {
+		op->o_tmpfree( op->o_req_ndn.bv_val, op->o_tmpmemctx );
+		BER_BVZERO( &op->o_req_ndn );
+		BER_BVZERO( &op->o_req_dn );
+	}
+	op->o_bd = bd;
+
+	return rs->sr_err;
+}
+
+int
+mdb_backup_init( void )
+{
+	int rc;
+
+	rc = load_extop2( &backup_oid, 0, mdb_backup_exop, 0 );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_backup_init: unable to register backup exop: %d\n",
+			rc, 0, 0 );
+	}
+	return rc;
+}
+
+#ifndef _WIN32
+
+typedef struct mdb_backup_copy {
+	MDB_env		*bc_env;
+	int			bc_fd;
+	unsigned	bc_flags;
+	unsigned long	bc_since;
+	int			bc_rc;
+} mdb_backup_copy;
+
+static void *
+mdb_backup_thread( void *arg )
+{
+	mdb_backup_copy *bc = arg;
+
+	if ( bc->bc_since == MDB_BACKUP_FULL )
+		bc->bc_rc = mdb_env_copyfd2( bc->bc_env, bc->bc_fd, bc->bc_flags );
+	else
+		bc->bc_rc = mdb_env_copyfd_incr( bc->bc_env, bc->bc_fd, bc->bc_since );
+	/* the reader sees the end of the copy */
+	close( bc->bc_fd );
+	return NULL;
+}
+
+/* microseconds since start */
+static long
+mdb_backup_elapsed( struct timeval *start )
+{
+	struct timeval now;
+
+	gettimeofday( &now, NULL );
+	return ( now.tv_sec - start->tv_sec ) * 1000000L +
+		now.tv_usec - start->tv_usec;
+}
+
+int
+mdb_backup( Operation *op, SlapReply *rs )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_backup_copy bc;
+	ldap_pvt_thread_t tid;
+	MDB_envinfo mei;
+	MDB_stat ms;
+	struct timeval start;
+	struct berval chunk;
+	SlapReply irs = { REP_INTERMEDIATE };
+	size_t sent = 0;
+	unsigned long since;
+	int fds[2], flags = 0, eof = 0;
+
+	rs->sr_err = mdb_backup_parse( op->ore_reqdata, NULL, &flags,
+		&since, &rs->sr_text, op->o_tmpmemctx );
+	if ( rs->sr_err != LDAP_SUCCESS ) {
+		return rs->sr_err;
+	}
+
+	/* the copy holds every entry of the database, whatever their ACLs */
+	if ( !be_isroot( op )) {
+		rs->sr_text = "backup requires the rootdn of the database";
+		return rs->sr_err = LDAP_INSUFFICIENT_ACCESS;
+	}
+
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	mdb_env_stat( mdb->mi_dbenv, &ms );
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_backup_mutex );
+	if ( mdb->mi_backup_start ) {
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_backup_mutex );
+		rs->sr_text = "a backup of the database is already running";
+		return rs->sr_err = LDAP_BUSY;
+	}
+	mdb->mi_backup_start = slap_get_time();
+	mdb->mi_backup_total = ( mei.me_last_pgno + 1 ) * ms.ms_psize;
+	mdb->mi_backup_sent = 0;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_backup_mutex );
+
+	if ( pipe( fds ) < 0 ) {
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "internal error";
+		goto done;
+	}
+	bc.bc_env = mdb->mi_dbenv;
+	bc.bc_fd = fds[1];
+	bc.bc_flags = ( flags & LDAP_BACKUP_COMPACT ) ? MDB_CP_COMPACT : 0;
+	bc.bc_since = since;
+	bc.bc_rc = 0;
+	if ( ldap_pvt_thread_create( &tid, 0, mdb_backup_thread, &bc )) {
+		close( fds[0] );
+		close( fds[1] );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "internal error";
+		goto done;
+	}
+
+	chunk.bv_val = ch_malloc( MDB_BACKUP_CHUNK );
+	irs.sr_rspoid = LDAP_EXOP_X_BACKUP;
+	irs.sr_rspdata = &chunk;
+	gettimeofday( &start, NULL );
+
+	while ( !eof ) {
+		uint32_t rate;
+		long ahead;
+		ssize_t n;
+
+		for ( chunk.bv_len = 0; chunk.bv_len < MDB_BACKUP_CHUNK;
+			chunk.bv_len += n )
+		{
+			n = read( fds[0], chunk.bv_val + chunk.bv_len,
+				MDB_BACKUP_CHUNK - chunk.bv_len );
+			if ( n <= 0 ) {
+				if ( n < 0 && errno == EINTR ) {
+					n = 0;
+					continue;
+				}
+				eof = 1;
+				break;
+			}
+		}
+		if ( op->o_abandon || !connection_valid( op->o_conn ))
+			break;
+		if ( chunk.bv_len ) {
+			irs.sr_err = LDAP_SUCCESS;
+			send_ldap_intermediate( op, &irs );
+			sent += chunk.bv_len;
+			ldap_pvt_thread_mutex_lock( &mdb->mi_backup_mutex );
+			mdb->mi_backup_sent = sent;
+			ldap_pvt_thread_mutex_unlock( &mdb->mi_backup_mutex );
+		}
+
+		/* keep to the rate, it may be changed while we run. This
+		 * thread stays out of the pool all the while, so sleep in
+		 * short steps and let the server pause in between.
+		 */
+		while ( !eof && ( rate = mdb->mi_backup_rate ) != 0 &&
+			!op->o_abandon )
+		{
+			ahead = (long)( (double)sent * 1000000.0 / ( rate * 1024.0 )) -
+				mdb_backup_elapsed( &start );
+			if ( ahead <= 0 )
+				break;
+			if ( ldap_pvt_thread_pool_pausing( &connection_pool ) > 0 ) {
+				ldap_pvt_thread_pool_pausecheck( &connection_pool );
+				continue;
+			}
+			usleep( ahead < 100000L ? ahead : 100000L );
+		}
+	}
+
+	ch_free( chunk.bv_val );
+
+	/* if we stopped early, the copy fails writing to the closed pipe */
+	close( fds[0] );
+	ldap_pvt_thread_join( tid, NULL );
+
+	if ( op->o_abandon ) {
+		rs->sr_err = SLAPD_ABANDON;
+	} else if ( bc.bc_rc == MDB_INCOMPATIBLE && since != MDB_BACKUP_FULL ) {
+		/* nothing was sent */
+		rs->sr_err = LDAP_UNWILLING_TO_PERFORM;
+		rs->sr_text = "pages written since that txn are not tracked";
+	} else if ( !eof || bc.bc_rc ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_backup: copy failed: %s (%d)\n",
+			mdb_strerror( bc.bc_rc ), bc.bc_rc, 0 );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "backup failed";
+	} else {
+		rs->sr_err = LDAP_SUCCESS;
+	}
+
+	Statslog( LDAP_DEBUG_STATS, "%s BACKUP sent=%lu err=%d\n",
+		op->o_log_prefix, (unsigned long)sent, rs->sr_err, 0, 0 );
+
+done:
+	ldap_pvt_thread_mutex_lock( &mdb->mi_backup_mutex );
+	mdb->mi_backup_start = 0;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_backup_mutex );
+
+	return rs->sr_err;
+}
+
+#else /* _WIN32 */
+
+int
+mdb_backup( Operation *op, SlapReply *rs )
+{
+	rs->sr_text = "backup is not supported on this platform";
+	return rs->sr_err = LDAP_UNWILLING_TO_PERFORM;
+}
+
+#endif /* _WIN32 */
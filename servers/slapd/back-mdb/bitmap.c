@@ -0,0 +1,1103 @@
+/* bitmap.c - compressed postings of big index keys */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/* See idl.h for the layout. Container contents are kept in byte
+ * order so that they can be used wherever LMDB happens to put them.
+ */
+
+#define BM_KEYSIZE	512	/* more than LMDB's largest key */
+
+#define BM_ISSET( bits, i )	((bits)[(i)>>3] & (1 << ((i) & 7)))
+#define BM_SET( bits, i )	((bits)[(i)>>3] |= 1 << ((i) & 7))
+#define BM_CLR( bits, i )	((bits)[(i)>>3] &= ~(1 << ((i) & 7)))
+
+#define BM_ARR_GET( p, i )	(((p)[2*(i)] << 8) | (p)[2*(i)+1])
+#define BM_ARR_SET( p, i, v )	((p)[2*(i)] = (v) >> 8, (p)[2*(i)+1] = (v) & 0xff)
+
+static unsigned
+bm_count( unsigned char *bits )
+{
+	unsigned i, n = 0, b;
+
+	for ( i = 0; i < MDB_BM_BYTES; i++ ) {
+		for ( b = bits[i]; b; b &= b-1 )
+			n++;
+	}
+	return n;
+}
+
+/* position of the first array entry not below v */
+static unsigned
+bm_arr_find( unsigned char *p, unsigned n, unsigned v )
+{
+	unsigned base = 0;
+
+	while ( n ) {
+		unsigned pivot = n >> 1;
+		if ( BM_ARR_GET( p, base + pivot ) < v ) {
+			base += pivot + 1;
+			n -= pivot + 1;
+		} else {
+			n = pivot;
+		}
+	}
+	return base;
+}
+
+/* Expand a container into a bitset */
+static void
+bm_bits( MDB_val *data, unsigned char *bits )
+{
+	unsigned char *p = data->mv_data;
+	unsigned i, n;
+
+	if ( data->mv_size == MDB_BM_BYTES ) {
+		memcpy( bits, p, MDB_BM_BYTES );
+	} else {
+		memset( bits, 0, MDB_BM_BYTES );
+		n = data->mv_size / 2;
+		for ( i = 0; i < n; i++ )
+			BM_SET( bits, BM_ARR_GET( p, i ));
+	}
+}
+
+/* Store a bitset of n IDs in whichever form is smaller */
+static int
+bm_put( MDB_txn *txn, MDB_dbi dbi, MDB_val *ckey, unsigned char *bits,
+	unsigned n )
+{
+	MDB_val data;
+	unsigned char *p;
+	unsigned i, j;
+	int rc;
+
+	if ( !n )
+		return mdb_del( txn, dbi, ckey, NULL );
+
+	if ( n > MDB_BM_ARRAY_MAX ) {
+		data.mv_size = MDB_BM_BYTES;
+		data.mv_data = bits;
+		return mdb_put( txn, dbi, ckey, &data, 0 );
+	}
+
+	data.mv_size = 2 * n;
+	rc = mdb_put( txn, dbi, ckey, &data, MDB_RESERVE );
+	if ( rc )
+		return rc;
+	p = data.mv_data;
+	for ( i = 0, j = 0; i < MDB_BM_CHUNK && j < n; i++ ) {
+		if ( !bits[i>>3] ) {
+			i |= 7;
+			continue;
+		}
+		if ( BM_ISSET( bits, i )) {
+			BM_ARR_SET( p, j, i );
+			j++;
+		}
+	}
+	return 0;
+}
+
+/* The name of the index database dbi of ai, and its terminating 0,
+ * that its container keys start with. Returns the length, or 0 if it
+ * doesn't fit in max bytes.
+ */
+static size_t
+bm_name( AttrInfo *ai, MDB_dbi dbi, unsigned char *buf, size_t max )
+{
+	struct berval *name;
+	size_t len = 0;
+
+	if ( ai->ai_ndbi && dbi == ai->ai_ndbi ) {
+		len = STRLENOF( MDB_NGRAM_PREFIX );
+		name = &ai->ai_desc->ad_cname;
+	} else {
+		name = &ai->ai_desc->ad_type->sat_cname;
+	}
+	if ( len + name->bv_len + 1 > max )
+		return 0;
+
+	memcpy( buf, MDB_NGRAM_PREFIX, len );
+	memcpy( buf + len, name->bv_val, name->bv_len );
+	len += name->bv_len;
+	buf[len++] = '\0';
+	return len;
+}
+
+/* Build the container key prefix for an index key */
+static int
+bm_prefix(
+	struct mdb_info *mdb,
+	MDB_dbi dbi,
+	MDB_val *key,
+	unsigned char *buf,
+	size_t *plen )
+{
+	AttrInfo *ai;
+	size_t nlen, len;
+
+	if ( !mdb->mi_bitmap || key->mv_size > 255 )
+		return MDB_BAD_VALSIZE;
+	ai = mdb_attr_dbi( mdb, dbi );
+	if ( !ai )
+		return MDB_BAD_VALSIZE;
+	nlen = bm_name( ai, dbi, buf, BM_KEYSIZE );
+	len = nlen + 1 + key->mv_size;
+	if ( !nlen ||
+		len + sizeof(ID) > (size_t)mdb_env_get_maxkeysize( mdb->mi_dbenv ) ||
+		len + sizeof(ID) > BM_KEYSIZE )
+		return MDB_BAD_VALSIZE;
+
+	buf[nlen] = key->mv_size;
+	memcpy( buf + nlen + 1, key->mv_data, key->mv_size );
+	*plen = len;
+	return 0;
+}
+
+static void
+bm_ckey( unsigned char *buf, size_t plen, ID chunk, MDB_val *ckey )
+{
+	MDB_ID2DISK( chunk, buf + plen );
+	ckey->mv_data = buf;
+	ckey->mv_size = plen + sizeof(ID);
+}
+
+/* Is the container key at ckey one of this prefix's? */
+static int
+bm_ours( MDB_val *ckey, unsigned char *buf, size_t plen, ID *chunk )
+{
+	if ( ckey->mv_size != plen + sizeof(ID) ||
+		memcmp( ckey->mv_data, buf, plen ))
+		return 0;
+	if ( chunk )
+		MDB_DISK2ID( (unsigned char *)ckey->mv_data + plen, chunk );
+	return 1;
+}
+
+/* The count of IDs of a key is kept under the bare prefix, ahead of
+ * its containers, rather than in the index where older versions would
+ * take it for an ID.
+ */
+static int
+bm_getcount( struct mdb_info *mdb, MDB_txn *txn, unsigned char *kbuf,
+	size_t plen, ID *count )
+{
+	MDB_val ckey, data;
+	int rc;
+
+	ckey.mv_data = kbuf;
+	ckey.mv_size = plen;
+	rc = mdb_get( txn, mdb->mi_bitmap, &ckey, &data );
+	if ( rc == 0 )
+		memcpy( count, data.mv_data, sizeof(ID) );
+	return rc;
+}
+
+static int
+bm_setcount( struct mdb_info *mdb, MDB_txn *txn, unsigned char *kbuf,
+	size_t plen, ID count )
+{
+	MDB_val ckey, data;
+
+	ckey.mv_data = kbuf;
+	ckey.mv_size = plen;
+	if ( !count )
+		return mdb_del( txn, mdb->mi_bitmap, &ckey, NULL );
+	data.mv_data = &count;
+	data.mv_size = sizeof(ID);
+	return mdb_put( txn, mdb->mi_bitmap, &ckey, &data, 0 );
+}
+
+/* Store n sorted IDs in the containers of the prefix in kbuf, along
+ * with any the containers already have, and count them. bits is a
+ * scratch bitset.
+ */
+static int
+bm_load(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	unsigned char *kbuf,
+	size_t plen,
+	ID *ids,
+	size_t n,
+	unsigned char *bits )
+{
+	MDB_val ckey, data;
+	ID chunk, count;
+	size_t i = 0;
+	unsigned nbits;
+	int rc;
+
+	rc = bm_getcount( mdb, txn, kbuf, plen, &count );
+	if ( rc == MDB_NOTFOUND ) {
+		count = 0;
+		rc = 0;
+	}
+
+	while ( i < n && rc == 0 ) {
+		chunk = ids[i] >> MDB_BM_SHIFT;
+		bm_ckey( kbuf, plen, chunk, &ckey );
+		rc = mdb_get( txn, mdb->mi_bitmap, &ckey, &data );
+		if ( rc == 0 ) {
+			bm_bits( &data, bits );
+			nbits = bm_count( bits );
+		} else if ( rc == MDB_NOTFOUND ) {
+			memset( bits, 0, MDB_BM_BYTES );
+			nbits = 0;
+			rc = 0;
+		} else {
+			break;
+		}
+		for ( ; i < n && ids[i] >> MDB_BM_SHIFT == chunk; i++ ) {
+			if ( !BM_ISSET( bits, ids[i] & (MDB_BM_CHUNK-1) )) {
+				BM_SET( bits, ids[i] & (MDB_BM_CHUNK-1) );
+				nbits++;
+				count++;
+			}
+		}
+		rc = bm_put( txn, mdb->mi_bitmap, &ckey, bits, nbits );
+	}
+	if ( rc == 0 )
+		rc = bm_setcount( mdb, txn, kbuf, plen, count );
+	return rc;
+}
+
+/* Add an ID to the bitmap of a key, and return how many it has now.
+ * Returns MDB_KEYEXIST if it was already there.
+ */
+int
+mdb_bitmap_add(
+	BackendDB *be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	MDB_val *key,
+	ID id,
+	ID *count )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	unsigned char kbuf[BM_KEYSIZE], cbuf[MDB_BM_BYTES], *p;
+	unsigned lo = id & (MDB_BM_CHUNK-1), n, i;
+	MDB_val ckey, data;
+	size_t plen;
+	int rc;
+
+	rc = bm_prefix( mdb, dbi, key, kbuf, &plen );
+	if ( rc )
+		return rc;
+	bm_ckey( kbuf, plen, id >> MDB_BM_SHIFT, &ckey );
+
+	rc = mdb_get( txn, mdb->mi_bitmap, &ckey, &data );
+	if ( rc == MDB_NOTFOUND ) {
+		BM_ARR_SET( cbuf, 0, lo );
+		data.mv_size = 2;
+	} else if ( rc ) {
+		return rc;
+	} else if ( data.mv_size == MDB_BM_BYTES ) {
+		if ( BM_ISSET( (unsigned char *)data.mv_data, lo ))
+			return MDB_KEYEXIST;
+		memcpy( cbuf, data.mv_data, MDB_BM_BYTES );
+		BM_SET( cbuf, lo );
+	} else {
+		p = data.mv_data;
+		n = data.mv_size / 2;
+		i = bm_arr_find( p, n, lo );
+		if ( i < n && BM_ARR_GET( p, i ) == lo )
+			return MDB_KEYEXIST;
+		if ( n < MDB_BM_ARRAY_MAX ) {
+			memcpy( cbuf, p, 2*i );
+			BM_ARR_SET( cbuf, i, lo );
+			memcpy( cbuf + 2*i + 2, p + 2*i, 2*(n-i) );
+			data.mv_size = 2 * (n+1);
+		} else {
+			/* too many for an array */
+			bm_bits( &data, cbuf );
+			BM_SET( cbuf, lo );
+			data.mv_size = MDB_BM_BYTES;
+		}
+	}
+	data.mv_data = cbuf;
+	rc = mdb_put( txn, mdb->mi_bitmap, &ckey, &data, 0 );
+	if ( rc == 0 )
+		rc = bm_getcount( mdb, txn, kbuf, plen, count );
+	if ( rc == 0 )
+		rc = bm_setcount( mdb, txn, kbuf, plen, ++*count );
+	return rc;
+}
+
+/* Remove an ID from the bitmap of a key, and return how many it has
+ * left. Returns MDB_NOTFOUND if it wasn't there.
+ */
+int
+mdb_bitmap_del(
+	BackendDB *be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	MDB_val *key,
+	ID id,
+	ID *count )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	unsigned char kbuf[BM_KEYSIZE], cbuf[MDB_BM_BYTES], *p;
+	unsigned lo = id & (MDB_BM_CHUNK-1), n, i;
+	MDB_val ckey, data;
+	size_t plen;
+	int rc;
+
+	rc = bm_prefix( mdb, dbi, key, kbuf, &plen );
+	if ( rc )
+		return rc;
+	bm_ckey( kbuf, plen, id >> MDB_BM_SHIFT, &ckey );
+
+	rc = mdb_get( txn, mdb->mi_bitmap, &ckey, &data );
+	if ( rc )
+		return rc;
+	if ( data.mv_size == MDB_BM_BYTES ) {
+		if ( !BM_ISSET( (unsigned char *)data.mv_data, lo ))
+			return MDB_NOTFOUND;
+		memcpy( cbuf, data.mv_data, MDB_BM_BYTES );
+		BM_CLR( cbuf, lo );
+		n = bm_count( cbuf );
+		/* only go back to an array well below the limit, so a
+		 * container near it doesn't keep switching forms
+		 */
+		if ( n > MDB_BM_ARRAY_MAX / 2 ) {
+			data.mv_data = cbuf;
+			rc = mdb_put( txn, mdb->mi_bitmap, &ckey, &data, 0 );
+		} else {
+			rc = bm_put( txn, mdb->mi_bitmap, &ckey, cbuf, n );
+		}
+	} else {
+		p = data.mv_data;
+		n = data.mv_size / 2;
+		i = bm_arr_find( p, n, lo );
+		if ( i >= n || BM_ARR_GET( p, i ) != lo )
+			return MDB_NOTFOUND;
+		if ( n == 1 ) {
+			rc = mdb_del( txn, mdb->mi_bitmap, &ckey, NULL );
+		} else {
+			memcpy( cbuf, p, 2*i );
+			memcpy( cbuf + 2*i, p + 2*i + 2, 2*(n-i-1) );
+			data.mv_data = cbuf;
+			data.mv_size = 2 * (n-1);
+			rc = mdb_put( txn, mdb->mi_bitmap, &ckey, &data, 0 );
+		}
+	}
+	if ( rc == 0 )
+		rc = bm_getcount( mdb, txn, kbuf, plen, count );
+	if ( rc == 0 )
+		rc = bm_setcount( mdb, txn, kbuf, plen, --*count );
+	return rc;
+}
+
+/* Copy the IDs of the key at the cursor into a new bitmap. The caller
+ * replaces the IDs in the index with the bitmap's marker afterwards.
+ */
+int
+mdb_bitmap_create(
+	BackendDB *be,
+	MDB_cursor *mc,
+	MDB_val *key,
+	ID *count )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_txn *txn = mdb_cursor_txn( mc );
+	unsigned char kbuf[BM_KEYSIZE], *bits;
+	MDB_val data;
+	ID *ids;
+	size_t plen, n, i;
+	int rc;
+
+	rc = bm_prefix( mdb, mdb_cursor_dbi( mc ), key, kbuf, &plen );
+	if ( rc )
+		return rc;
+	rc = mdb_cursor_count( mc, &n );
+	if ( rc )
+		return rc;
+
+	/* read them all before writing anything */
+	ids = ch_malloc( n * sizeof(ID) + MDB_BM_BYTES );
+	bits = (unsigned char *)(ids + n);
+	i = 0;
+	rc = mdb_cursor_get( mc, key, &data, MDB_GET_MULTIPLE );
+	while ( rc == 0 ) {
+		size_t len = data.mv_size / sizeof(ID);
+		if ( i + len > n )
+			len = n - i;
+		memcpy( ids + i, data.mv_data, len * sizeof(ID) );
+		i += len;
+		rc = mdb_cursor_get( mc, key, &data, MDB_NEXT_MULTIPLE );
+	}
+	if ( rc != MDB_NOTFOUND )
+		goto done;
+	n = i;
+	rc = bm_load( mdb, txn, kbuf, plen, ids, n, bits );
+	if ( rc == 0 )
+		rc = bm_getcount( mdb, txn, kbuf, plen, count );
+
+done:
+	ch_free( ids );
+	return rc;
+}
+
+/* Add n sorted IDs to the bitmap of a key, for a bulk load. Returns
+ * MDB_BAD_VALSIZE if the key can't have one.
+ */
+int
+mdb_bitmap_load(
+	BackendDB *be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	MDB_val *key,
+	ID *ids,
+	size_t n )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	unsigned char kbuf[BM_KEYSIZE], bits[MDB_BM_BYTES];
+	size_t plen;
+	int rc;
+
+	rc = bm_prefix( mdb, dbi, key, kbuf, &plen );
+	if ( rc == 0 )
+		rc = bm_load( mdb, txn, kbuf, plen, ids, n, bits );
+	return rc;
+}
+
+/* How many IDs the bitmap of a key has */
+int
+mdb_bitmap_count(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	MDB_val *key,
+	ID *count )
+{
+	unsigned char kbuf[BM_KEYSIZE];
+	size_t plen;
+	int rc;
+
+	rc = bm_prefix( mdb, dbi, key, kbuf, &plen );
+	if ( rc == 0 )
+		rc = bm_getcount( mdb, txn, kbuf, plen, count );
+	return rc;
+}
+
+/* Remove the bitmaps of the index database dbi of ai, that was emptied */
+int
+mdb_bitmap_drop(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	MDB_dbi dbi )
+{
+	unsigned char name[BM_KEYSIZE];
+	MDB_cursor *mc;
+	MDB_val key, data;
+	size_t len;
+	int rc;
+
+	if ( !mdb->mi_bitmap )
+		return 0;
+	len = bm_name( ai, dbi, name, sizeof( name ));
+	if ( !len )
+		return 0;
+	rc = mdb_cursor_open( txn, mdb->mi_bitmap, &mc );
+	if ( rc )
+		return rc;
+
+	for (;;) {
+		key.mv_data = name;
+		key.mv_size = len;
+		rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+		if ( rc || key.mv_size <= len ||
+			memcmp( key.mv_data, name, len ))
+			break;
+		rc = mdb_cursor_del( mc, 0 );
+		if ( rc )
+			break;
+	}
+	mdb_cursor_close( mc );
+
+	return rc == MDB_NOTFOUND ? 0 : rc;
+}
+
+/* Read the IDs of a bitmap key into ids, which must hold an IDL of
+ * MDB_IDL_UM_SIZE. If there are more IDs than that, return the range
+ * they span instead.
+ */
+int
+mdb_bitmap_fetch(
+	BackendDB *be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	MDB_val *key,
+	ID *ids )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	unsigned char kbuf[BM_KEYSIZE], *p;
+	MDB_cursor *mc;
+	MDB_val ckey, data;
+	ID chunk, count, lo = 0;
+	size_t plen;
+	unsigned i, n;
+	int rc;
+
+	rc = bm_prefix( mdb, dbi, key, kbuf, &plen );
+	if ( rc == 0 )
+		rc = bm_getcount( mdb, txn, kbuf, plen, &count );
+	if ( rc )
+		return rc;
+	rc = mdb_cursor_open( txn, mdb->mi_bitmap, &mc );
+	if ( rc )
+		return rc;
+
+	bm_ckey( kbuf, plen, 0, &ckey );
+	rc = mdb_cursor_get( mc, &ckey, &data, MDB_SET_RANGE );
+	if ( rc == 0 && !bm_ours( &ckey, kbuf, plen, &chunk ))
+		rc = MDB_NOTFOUND;
+
+	if ( rc == 0 && count > MDB_IDL_UM_MAX ) {
+		/* first ID of the first container */
+		p = data.mv_data;
+		if ( data.mv_size == MDB_BM_BYTES ) {
+			for ( i = 0; !BM_ISSET( p, i ); i++ ) ;
+		} else {
+			i = BM_ARR_GET( p, 0 );
+		}
+		lo = chunk << MDB_BM_SHIFT | i;
+		goto range;
+	}
+
+	ids[0] = 0;
+	while ( rc == 0 ) {
+		p = data.mv_data;
+		if ( data.mv_size == MDB_BM_BYTES ) {
+			for ( i = 0; i < MDB_BM_CHUNK; i++ ) {
+				if ( !p[i>>3] ) {
+					i |= 7;
+					continue;
+				}
+				if ( BM_ISSET( p, i )) {
+					if ( ids[0] == MDB_IDL_UM_MAX )
+						goto overflow;
+					ids[++ids[0]] = chunk << MDB_BM_SHIFT | i;
+				}
+			}
+		} else {
+			n = data.mv_size / 2;
+			for ( i = 0; i < n; i++ ) {
+				if ( ids[0] == MDB_IDL_UM_MAX )
+					goto overflow;
+				ids[++ids[0]] = chunk << MDB_BM_SHIFT | BM_ARR_GET( p, i );
+			}
+		}
+		rc = mdb_cursor_get( mc, &ckey, &data, MDB_NEXT );
+		if ( rc == 0 && !bm_ours( &ckey, kbuf, plen, &chunk ))
+			rc = MDB_NOTFOUND;
+	}
+	goto done;
+
+overflow:
+	/* more IDs than its count said */
+	lo = ids[1];
+
+range:
+	/* the last ID of the last container */
+	bm_ckey( kbuf, plen, NOID, &ckey );
+	rc = mdb_cursor_get( mc, &ckey, &data, MDB_SET_RANGE );
+	if ( rc == 0 )
+		rc = mdb_cursor_get( mc, &ckey, &data, MDB_PREV );
+	else if ( rc == MDB_NOTFOUND )
+		rc = mdb_cursor_get( mc, &ckey, &data, MDB_LAST );
+	if ( rc == 0 && !bm_ours( &ckey, kbuf, plen, &chunk ))
+		rc = MDB_NOTFOUND;
+	if ( rc == 0 ) {
+		p = data.mv_data;
+		if ( data.mv_size == MDB_BM_BYTES ) {
+			for ( i = MDB_BM_CHUNK-1; !BM_ISSET( p, i ); i-- ) ;
+		} else {
+			i = BM_ARR_GET( p, data.mv_size / 2 - 1 );
+		}
+		MDB_IDL_RANGE( ids, lo, chunk << MDB_BM_SHIFT | i );
+	}
+
+done:
+	mdb_cursor_close( mc );
+	return rc == MDB_NOTFOUND && ( ids[0] || lo ) ? 0 : rc;
+}
+
+/*
+ * Intersections and unions of keys are computed one container's worth
+ * of IDs at a time, whatever form each key is stored in.
+ */
+
+typedef struct bm_src {
+	int bs_type;
+#define BS_EMPTY	0
+#define BS_LIST		1	/* plain IDs in the index */
+#define BS_RANGE	2
+#define BS_BITMAP	3
+#define BS_IDL		4	/* an IDL in memory */
+	ID bs_count;
+	ID bs_lo, bs_hi;
+	ID *bs_ids;
+	MDB_cursor *bs_mc;
+	MDB_val bs_key;
+	size_t bs_plen;
+	unsigned char bs_kbuf[BM_KEYSIZE];
+} bm_src;
+
+static int
+bm_src_open(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	MDB_val *key,
+	bm_src *bs )
+{
+	MDB_val data;
+	ID first, marker[2];
+	size_t n;
+	int rc;
+
+	bs->bs_type = BS_EMPTY;
+	bs->bs_mc = NULL;
+	bs->bs_key = *key;
+	rc = mdb_cursor_open( txn, dbi, &bs->bs_mc );
+	if ( rc )
+		return rc;
+	rc = mdb_cursor_get( bs->bs_mc, key, &data, MDB_SET );
+	if ( rc == MDB_NOTFOUND ) {
+		bs->bs_type = BS_EMPTY;
+		bs->bs_count = 0;
+		return 0;
+	}
+	if ( rc )
+		return rc;
+
+	memcpy( &first, data.mv_data, sizeof(ID) );
+	if ( first ) {
+		rc = mdb_cursor_count( bs->bs_mc, &n );
+		bs->bs_type = BS_LIST;
+		bs->bs_count = n;
+		return rc;
+	}
+
+	rc = mdb_cursor_get( bs->bs_mc, key, &data, MDB_NEXT_DUP );
+	if ( rc == 0 ) {
+		memcpy( &marker[0], data.mv_data, sizeof(ID) );
+		rc = mdb_cursor_get( bs->bs_mc, key, &data, MDB_NEXT_DUP );
+	}
+	if ( rc )
+		return rc;
+	memcpy( &marker[1], data.mv_data, sizeof(ID) );
+	mdb_cursor_close( bs->bs_mc );
+	bs->bs_mc = NULL;
+
+	if ( marker[1] != NOID ) {
+		bs->bs_type = BS_RANGE;
+		bs->bs_lo = marker[0];
+		bs->bs_hi = marker[1];
+		bs->bs_count = marker[1] - marker[0] + 1;
+		return 0;
+	}
+
+	bs->bs_type = BS_BITMAP;
+	rc = bm_prefix( mdb, dbi, key, bs->bs_kbuf, &bs->bs_plen );
+	if ( rc == 0 )
+		rc = bm_getcount( mdb, txn, bs->bs_kbuf, bs->bs_plen,
+			&bs->bs_count );
+	if ( rc == 0 )
+		rc = mdb_cursor_open( txn, mdb->mi_bitmap, &bs->bs_mc );
+	return rc;
+}
+
+/* The first container at or after chunk c that has any IDs */
+static int
+bm_src_next( bm_src *bs, ID c, ID *next )
+{
+	MDB_val key, data;
+	ID id;
+	unsigned i;
+	int rc;
+
+	switch ( bs->bs_type ) {
+	case BS_LIST:
+		id = c << MDB_BM_SHIFT;
+		key = bs->bs_key;
+		data.mv_data = &id;
+		data.mv_size = sizeof(ID);
+		rc = mdb_cursor_get( bs->bs_mc, &key, &data, MDB_GET_BOTH_RANGE );
+		if ( rc )
+			return rc;
+		memcpy( &id, data.mv_data, sizeof(ID) );
+		*next = id >> MDB_BM_SHIFT;
+		return 0;
+
+	case BS_RANGE:
+		if ( bs->bs_hi >> MDB_BM_SHIFT < c )
+			return MDB_NOTFOUND;
+		*next = bs->bs_lo >> MDB_BM_SHIFT;
+		if ( *next < c )
+			*next = c;
+		return 0;
+
+	case BS_BITMAP:
+		bm_ckey( bs->bs_kbuf, bs->bs_plen, c, &key );
+		rc = mdb_cursor_get( bs->bs_mc, &key, &data, MDB_SET_RANGE );
+		if ( rc == 0 && !bm_ours( &key, bs->bs_kbuf, bs->bs_plen, next ))
+			rc = MDB_NOTFOUND;
+		return rc;
+
+	case BS_IDL:
+		i = mdb_idl_search( bs->bs_ids, c << MDB_BM_SHIFT );
+		if ( i > bs->bs_ids[0] )
+			return MDB_NOTFOUND;
+		*next = bs->bs_ids[i] >> MDB_BM_SHIFT;
+		return 0;
+	}
+	return MDB_NOTFOUND;
+}
+
+/* Set the bits of the IDs the source has in chunk c */
+static int
+bm_src_fill( bm_src *bs, ID c, unsigned char *bits )
+{
+	MDB_val key, data;
+	ID id, base = c << MDB_BM_SHIFT;
+	unsigned i;
+	int rc;
+
+	memset( bits, 0, MDB_BM_BYTES );
+	switch ( bs->bs_type ) {
+	case BS_LIST:
+		id = base;
+		key = bs->bs_key;
+		data.mv_data = &id;
+		data.mv_size = sizeof(ID);
+		rc = mdb_cursor_get( bs->bs_mc, &key, &data, MDB_GET_BOTH_RANGE );
+		while ( rc == 0 ) {
+			memcpy( &id, data.mv_data, sizeof(ID) );
+			if ( id >> MDB_BM_SHIFT != c )
+				break;
+			BM_SET( bits, id - base );
+			rc = mdb_cursor_get( bs->bs_mc, &key, &data, MDB_NEXT_DUP );
+		}
+		return rc == MDB_NOTFOUND ? 0 : rc;
+
+	case BS_RANGE:
+		i = bs->bs_lo > base ? bs->bs_lo - base : 0;
+		for ( ; i < MDB_BM_CHUNK && base + i <= bs->bs_hi; i++ )
+			BM_SET( bits, i );
+		return 0;
+
+	case BS_BITMAP:
+		bm_ckey( bs->bs_kbuf, bs->bs_plen, c, &key );
+		rc = mdb_get( mdb_cursor_txn( bs->bs_mc ),
+			mdb_cursor_dbi( bs->bs_mc ), &key, &data );
+		if ( rc == 0 )
+			bm_bits( &data, bits );
+		return rc == MDB_NOTFOUND ? 0 : rc;
+
+	case BS_IDL:
+		for ( i = mdb_idl_search( bs->bs_ids, base );
+			i <= bs->bs_ids[0] && bs->bs_ids[i] >> MDB_BM_SHIFT == c; i++ )
+			BM_SET( bits, bs->bs_ids[i] - base );
+		return 0;
+	}
+	return 0;
+}
+
+/* Clear the bits of the IDs the source doesn't have in chunk c;
+ * n is how many bits are set, and is updated.
+ */
+static int
+bm_src_and( bm_src *bs, ID c, unsigned char *bits, unsigned char *tmp,
+	unsigned *n )
+{
+	MDB_val key, data;
+	ID id, base = c << MDB_BM_SHIFT;
+	unsigned i;
+	int rc;
+
+	if ( bs->bs_type == BS_LIST && *n <= 64 ) {
+		/* just look up the few that are left */
+		for ( i = 0; i < MDB_BM_CHUNK; i++ ) {
+			if ( !bits[i>>3] ) {
+				i |= 7;
+				continue;
+			}
+			if ( !BM_ISSET( bits, i ))
+				continue;
+			id = base + i;
+			key = bs->bs_key;
+			data.mv_data = &id;
+			data.mv_size = sizeof(ID);
+			rc = mdb_cursor_get( bs->bs_mc, &key, &data, MDB_GET_BOTH );
+			if ( rc == MDB_NOTFOUND ) {
+				BM_CLR( bits, i );
+				--*n;
+			} else if ( rc ) {
+				return rc;
+			}
+		}
+		return 0;
+	}
+
+	rc = bm_src_fill( bs, c, tmp );
+	if ( rc )
+		return rc;
+	for ( i = 0; i < MDB_BM_BYTES; i++ )
+		bits[i] &= tmp[i];
+	*n = bm_count( bits );
+	return 0;
+}
+
+/* The highest ID of the source */
+static ID
+bm_src_last( bm_src *bs )
+{
+	MDB_val key, data;
+	ID id = NOID, chunk;
+	unsigned char *p;
+	unsigned i;
+	int rc;
+
+	switch ( bs->bs_type ) {
+	case BS_EMPTY:
+		return 0;
+	case BS_RANGE:
+		return bs->bs_hi;
+	case BS_IDL:
+		return bs->bs_ids[bs->bs_ids[0]];
+	case BS_LIST:
+		key = bs->bs_key;
+		rc = mdb_cursor_get( bs->bs_mc, &key, &data, MDB_SET );
+		if ( rc == 0 )
+			rc = mdb_cursor_get( bs->bs_mc, &key, &data, MDB_LAST_DUP );
+		if ( rc == 0 )
+			memcpy( &id, data.mv_data, sizeof(ID) );
+		return id;
+	case BS_BITMAP:
+		bm_ckey( bs->bs_kbuf, bs->bs_plen, NOID, &key );
+		rc = mdb_cursor_get( bs->bs_mc, &key, &data, MDB_SET_RANGE );
+		if ( rc == 0 )
+			rc = mdb_cursor_get( bs->bs_mc, &key, &data, MDB_PREV );
+		else if ( rc == MDB_NOTFOUND )
+			rc = mdb_cursor_get( bs->bs_mc, &key, &data, MDB_LAST );
+		if ( rc == 0 && bm_ours( &key, bs->bs_kbuf, bs->bs_plen, &chunk )) {
+			p = data.mv_data;
+			if ( data.mv_size == MDB_BM_BYTES ) {
+				for ( i = MDB_BM_CHUNK-1; !BM_ISSET( p, i ); i-- ) ;
+			} else {
+				i = BM_ARR_GET( p, data.mv_size / 2 - 1 );
+			}
+			id = chunk << MDB_BM_SHIFT | i;
+		}
+		return id;
+	}
+	return NOID;
+}
+
+static int
+bm_src_cmp( const void *v1, const void *v2 )
+{
+	const bm_src *s1 = v1, *s2 = v2;
+
+	if ( s1->bs_count != s2->bs_count )
+		return s1->bs_count < s2->bs_count ? -1 : 1;
+	return 0;
+}
+
+/* Append the IDs of a chunk, turning ids into a range once they
+ * no longer fit.
+ */
+static void
+bm_emit( ID *ids, ID c, unsigned char *bits, ID *last )
+{
+	ID base = c << MDB_BM_SHIFT;
+	unsigned i;
+
+	for ( i = 0; i < MDB_BM_CHUNK; i++ ) {
+		if ( !bits[i>>3] ) {
+			i |= 7;
+			continue;
+		}
+		if ( !BM_ISSET( bits, i ))
+			continue;
+		if ( ids[0] < MDB_IDL_UM_MAX )
+			ids[++ids[0]] = base + i;
+		else
+			*last = base + i;
+	}
+}
+
+/*
+ * Intersect (LDAP_FILTER_AND) or unite (LDAP_FILTER_OR) the IDs of n
+ * index keys into ids, which are included when withids is set. The
+ * result is exact as long as it fits in ids, otherwise it is the range
+ * the IDs span. tmp is scratch space for an IDL.
+ */
+int
+mdb_bitmap_combine(
+	BackendDB *be,
+	MDB_txn *txn,
+	int ftype,
+	int n,
+	MDB_dbi *dbis,
+	MDB_val *keys,
+	int withids,
+	ID *ids,
+	ID *tmp )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	bm_src *bs;
+	unsigned char *bits, *sbits;
+	unsigned nbits;
+	ID c, nc, last = 0;
+	int i, ns = 0, agree, rc = 0;
+
+	bs = ch_malloc( (n + 1) * sizeof(bm_src) + 2 * MDB_BM_BYTES );
+	bits = (unsigned char *)(bs + n + 1);
+	sbits = bits + MDB_BM_BYTES;
+
+	if ( withids ) {
+		if ( MDB_IDL_IS_RANGE( ids )) {
+			bs[0].bs_type = BS_RANGE;
+			bs[0].bs_lo = ids[1];
+			bs[0].bs_hi = ids[2];
+			bs[0].bs_count = ids[2] - ids[1] + 1;
+		} else {
+			MDB_IDL_CPY( tmp, ids );
+			bs[0].bs_type = BS_IDL;
+			bs[0].bs_ids = tmp;
+			bs[0].bs_count = tmp[0];
+		}
+		bs[0].bs_mc = NULL;
+		ns = 1;
+	}
+	for ( i = 0; i < n; i++, ns++ ) {
+		rc = bm_src_open( mdb, txn, dbis[i], &keys[i], &bs[ns] );
+		if ( rc ) {
+			ns++;
+			goto done;
+		}
+	}
+
+	ids[0] = 0;
+	if ( ftype == LDAP_FILTER_AND ) {
+		/* the smallest drives the others */
+		qsort( bs, ns, sizeof(bm_src), bm_src_cmp );
+		if ( ns == 0 || bs[0].bs_type == BS_EMPTY )
+			goto done;
+
+		c = 0;
+		for (;;) {
+			/* find the next chunk all of them have IDs in */
+			for ( i = 0, agree = 0; agree < ns; i = ( i + 1 ) % ns ) {
+				rc = bm_src_next( &bs[i], c, &nc );
+				if ( rc )
+					goto done;
+				if ( nc != c ) {
+					c = nc;
+					agree = 1;
+				} else {
+					agree++;
+				}
+			}
+
+			rc = bm_src_fill( &bs[0], c, bits );
+			if ( rc )
+				goto done;
+			nbits = bm_count( bits );
+			for ( i = 1; i < ns && nbits; i++ ) {
+				rc = bm_src_and( &bs[i], c, bits, sbits, &nbits );
+				if ( rc )
+					goto done;
+			}
+			if ( nbits )
+				bm_emit( ids, c, bits, &last );
+			if ( ++c > NOID >> MDB_BM_SHIFT )
+				break;
+		}
+
+	} else {
+		c = 0;
+		for (;;) {
+			/* the lowest chunk any of them has IDs in */
+			agree = 0;
+			for ( i = 0; i < ns; i++ ) {
+				rc = bm_src_next( &bs[i], c, &nc );
+				if ( rc == MDB_NOTFOUND )
+					continue;
+				if ( rc )
+					goto done;
+				if ( !agree++ || nc < last )
+					last = nc;
+			}
+			rc = 0;
+			if ( !agree )
+				break;
+			c = last;
+			last = 0;
+
+			memset( bits, 0, MDB_BM_BYTES );
+			for ( i = 0; i < ns; i++ ) {
+				unsigned j;
+
+				rc = bm_src_fill( &bs[i], c, sbits );
+				if ( rc )
+					goto done;
+				for ( j = 0; j < MDB_BM_BYTES; j++ )
+					bits[j] |= sbits[j];
+			}
+			bm_emit( ids, c, bits, &last );
+			if ( last )
+				break;
+			if ( ++c > NOID >> MDB_BM_SHIFT )
+				break;
+		}
+		if ( last ) {
+			/* too many; the range they span ends with the
+			 * highest ID of any of them
+			 */
+			for ( i = 0; i < ns; i++ ) {
+				nc = bm_src_last( &bs[i] );
+				if ( nc > last )
+					last = nc;
+			}
+		}
+	}
+
+done:
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	if ( rc == 0 && last )
+		MDB_IDL_RANGE( ids, ids[1], last );
+	for ( i = 0; i < ns; i++ ) {
+		if ( bs[i].bs_type != BS_IDL && bs[i].bs_mc )
+			mdb_cursor_close( bs[i].bs_mc );
+	}
+	ch_free( bs );
+	return rc;
+}
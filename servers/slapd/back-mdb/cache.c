@@ -0,0 +1,300 @@
+/* cache.c - routines to maintain an in-core cache of decoded entries */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+
+/*
+ * The cache keeps decoded entries, with their values copied out of
+ * the map, for readers to share. A cached entry is never changed;
+ * each user gets its own Entry header pointing at the cached
+ * attributes, and the entry is only freed once its last user has
+ * returned it.
+ *
+ * An entry decoded in snapshot S can be used by a reader in
+ * snapshot T if it was not written by any txn after the older of
+ * the two. Writers record their txn ID in the slot of each entry
+ * they write, slots being shared by many IDs, and drop the entry
+ * from the cache. Nothing is cached from a write txn, which may see
+ * its own uncommitted changes.
+ *
+ * The cache is limited by the bytes its entries take up; entries
+ * are evicted with the CLOCK algorithm, which gives every entry
+ * used since the hand last passed it another round.
+ */
+
+#define	CE_REFERENCED	0x01
+#define	CE_DEAD		0x02	/* not in the cache, free when unused */
+
+#define	CE_SLOT(id)	((id) & (MDB_CACHE_SLOTS-1))
+
+static int
+mdb_centry_cmp( const void *v1, const void *v2 )
+{
+	const mdb_centry *c1 = v1, *c2 = v2;
+
+	return c1->ce_id < c2->ce_id ? -1 : c1->ce_id > c2->ce_id;
+}
+
+/* entries can only be shared by readers */
+int
+mdb_cache_usable( Operation *op, struct mdb_info *mdb )
+{
+	OpExtra *oex;
+
+	if ( !mdb->mi_cache.c_maxsize || ( slapMode & SLAP_TOOL_MODE ))
+		return 0;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb )
+			return ((mdb_op_info *)oex)->moi_flag & MOI_READER;
+	}
+	return 0;
+}
+
+/* give the caller its own header for a cached entry */
+static Entry *
+mdb_cache_hand_out( Operation *op, mdb_centry *ce )
+{
+	Entry *e;
+
+	e = op->o_tmpalloc( sizeof( Entry ), op->o_tmpmemctx );
+	*e = ce->ce_entry;
+	e->e_id = ce->ce_id;
+	BER_BVZERO( &e->e_name );
+	BER_BVZERO( &e->e_nname );
+	e->e_private = ce;
+	return e;
+}
+
+/* take ce out of the cache; the caller holds the mutex */
+static void
+mdb_cache_unlink( mdb_cache *cache, mdb_centry *ce )
+{
+	avl_delete( &cache->c_idtree, ce, mdb_centry_cmp );
+	if ( ce->ce_next == ce ) {
+		cache->c_hand = NULL;
+	} else {
+		ce->ce_prev->ce_next = ce->ce_next;
+		ce->ce_next->ce_prev = ce->ce_prev;
+		if ( cache->c_hand == ce )
+			cache->c_hand = ce->ce_next;
+	}
+	cache->c_cursize -= ce->ce_size;
+	cache->c_count--;
+
+	if ( ce->ce_refcnt )
+		ce->ce_flags |= CE_DEAD;
+	else
+		ch_free( ce );
+}
+
+static void
+mdb_cache_evict( mdb_cache *cache )
+{
+	mdb_centry *ce;
+	unsigned long n;
+
+	/* two rounds clear every reference; entries still in use
+	 * after that are left over the limit */
+	for ( n = 2 * cache->c_count; n && cache->c_hand &&
+		cache->c_cursize > cache->c_maxsize; n-- )
+	{
+		ce = cache->c_hand;
+		cache->c_hand = ce->ce_next;
+		if ( ce->ce_refcnt || ( ce->ce_flags & CE_REFERENCED )) {
+			ce->ce_flags &= ~CE_REFERENCED;
+			continue;
+		}
+		mdb_cache_unlink( cache, ce );
+		cache->c_evicts++;
+	}
+}
+
+/*
+ * Find entry id for a reader in txn. Returns MDB_NOTFOUND if it is
+ * not cached, or not as this reader must see it.
+ */
+int
+mdb_cache_find(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	Entry **e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_cache *cache = &mdb->mi_cache;
+	mdb_centry key, *ce;
+	size_t txnid = mdb_txn_id( txn ), lastmod;
+
+	key.ce_id = id;
+	ldap_pvt_thread_mutex_lock( &cache->c_mutex );
+	ce = avl_find( cache->c_idtree, &key, mdb_centry_cmp );
+	if ( ce ) {
+		lastmod = cache->c_lastmod[CE_SLOT( id )];
+		if ( lastmod > ce->ce_txnid ) {
+			/* outdated for everyone */
+			mdb_cache_unlink( cache, ce );
+			ce = NULL;
+		} else if ( lastmod > txnid ) {
+			/* newer than this reader's snapshot */
+			ce = NULL;
+		}
+	}
+	if ( ce ) {
+		ce->ce_refcnt++;
+		ce->ce_flags |= CE_REFERENCED;
+		cache->c_hits++;
+	} else {
+		cache->c_misses++;
+	}
+	ldap_pvt_thread_mutex_unlock( &cache->c_mutex );
+
+	if ( !ce )
+		return MDB_NOTFOUND;
+
+	*e = mdb_cache_hand_out( op, ce );
+	return 0;
+}
+
+/*
+ * Decode entry id as read in txn, and cache it if it can be. The
+ * decoded entry is returned either way.
+ */
+int
+mdb_cache_add(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	MDB_val *data,
+	Entry **e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_cache *cache = &mdb->mi_cache;
+	mdb_centry *ce;
+	MDB_val copy;
+	size_t esize, size, txnid = mdb_txn_id( txn );
+	int rc;
+
+	esize = mdb_entry_decode_size( data );
+	size = offsetof( mdb_centry, ce_entry ) + esize + data->mv_size;
+
+	/* the values are kept right after the entry */
+	ce = ch_malloc( size );
+	copy.mv_size = data->mv_size;
+	copy.mv_data = (char *)&ce->ce_entry + esize;
+	AC_MEMCPY( copy.mv_data, data->mv_data, data->mv_size );
+	rc = mdb_entry_decode_to( mdb, txn, &copy, NULL, &ce->ce_entry );
+	if ( rc ) {
+		ch_free( ce );
+		return rc;
+	}
+	ce->ce_id = id;
+	ce->ce_entry.e_id = id;
+	ce->ce_txnid = txnid;
+	ce->ce_size = size;
+	ce->ce_refcnt = 1;
+	ce->ce_flags = 0;
+	ce->ce_cache = cache;
+
+	ldap_pvt_thread_mutex_lock( &cache->c_mutex );
+	/* a writer got here first, or another reader did; this
+	 * entry is for the caller alone then */
+	if ( size > cache->c_maxsize / 2 ||
+		cache->c_lastmod[CE_SLOT( id )] > txnid ||
+		avl_insert( &cache->c_idtree, ce, mdb_centry_cmp, avl_dup_error ))
+	{
+		ce->ce_flags = CE_DEAD;
+	} else {
+		if ( cache->c_hand ) {
+			ce->ce_next = cache->c_hand;
+			ce->ce_prev = cache->c_hand->ce_prev;
+			ce->ce_prev->ce_next = ce;
+			cache->c_hand->ce_prev = ce;
+		} else {
+			ce->ce_next = ce->ce_prev = ce;
+			cache->c_hand = ce;
+		}
+		cache->c_cursize += size;
+		cache->c_count++;
+		mdb_cache_evict( cache );
+	}
+	ldap_pvt_thread_mutex_unlock( &cache->c_mutex );
+
+	*e = mdb_cache_hand_out( op, ce );
+	return 0;
+}
+
+/* called by mdb_entry_return() */
+void
+mdb_cache_return( mdb_centry *ce )
+{
+	mdb_cache *cache = ce->ce_cache;
+	int dead;
+
+	ldap_pvt_thread_mutex_lock( &cache->c_mutex );
+	dead = !--ce->ce_refcnt && ( ce->ce_flags & CE_DEAD );
+	ldap_pvt_thread_mutex_unlock( &cache->c_mutex );
+
+	if ( dead )
+		ch_free( ce );
+}
+
+/* entry id is being written by txn */
+void
+mdb_cache_invalidate( struct mdb_info *mdb, MDB_txn *txn, ID id )
+{
+	mdb_cache *cache = &mdb->mi_cache;
+	mdb_centry key, *ce;
+	size_t txnid = mdb_txn_id( txn );
+
+	key.ce_id = id;
+	ldap_pvt_thread_mutex_lock( &cache->c_mutex );
+	if ( cache->c_lastmod[CE_SLOT( id )] < txnid )
+		cache->c_lastmod[CE_SLOT( id )] = txnid;
+	ce = avl_find( cache->c_idtree, &key, mdb_centry_cmp );
+	if ( ce )
+		mdb_cache_unlink( cache, ce );
+	ldap_pvt_thread_mutex_unlock( &cache->c_mutex );
+}
+
+void
+mdb_cache_init( mdb_cache *cache )
+{
+	ldap_pvt_thread_mutex_init( &cache->c_mutex );
+}
+
+/* drop everything; nobody may be using the entries any more */
+void
+mdb_cache_release_all( mdb_cache *cache )
+{
+	ldap_pvt_thread_mutex_lock( &cache->c_mutex );
+	while ( cache->c_hand )
+		mdb_cache_unlink( cache, cache->c_hand );
+	memset( cache->c_lastmod, 0, sizeof( cache->c_lastmod ));
+	ldap_pvt_thread_mutex_unlock( &cache->c_mutex );
+}
+
+void
+mdb_cache_destroy( mdb_cache *cache )
+{
+	mdb_cache_release_all( cache );
+	ldap_pvt_thread_mutex_destroy( &cache->c_mutex );
+}
@@ -39,10 +39,23 @@ enum {
 	MDB_MAXREADERS,
 	MDB_MAXSIZE,
 	MDB_MODE,
+	MDB_PAGEDCURSORS,
+	MDB_PAGEDIDLE,
+	MDB_SEARCHTHREADS,
 	MDB_SSTACK,
 };
 
 static ConfigTable mdbcfg[] = {
+	{ "backuprate", "kbytes", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_backup_rate),
+		"( OLcfgDbAt:12.11 NAME 'olcDbBackupRate' "
+		"DESC 'Kbytes per second an online backup may send' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "bulkmem", "kbytes", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_bulk_mem),
+		"( OLcfgDbAt:12.14 NAME 'olcDbBulkMem' "
+		"DESC 'Kbytes of index keys slapadd keeps in memory in a bulk load' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "directory", "dir", 2, 2, 0, ARG_STRING|ARG_MAGIC|MDB_DIRECTORY,
 		mdb_cf_gen, "( OLcfgDbAt:0.1 NAME 'olcDbDirectory' "
 			"DESC 'Directory for database content' "
@@ -56,16 +69,36 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:1.4 NAME 'olcDbNoSync' "
 			"DESC 'Disable synchronous database writes' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "entrycachesize", "bytes", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_cache.c_maxsize),
+		"( OLcfgDbAt:12.7 NAME 'olcDbEntryCacheSize' "
+		"DESC 'Size of the decoded entry cache in bytes' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "envflags", "flags", 2, 0, 0, ARG_MAGIC|MDB_ENVFLAGS,
 		mdb_cf_gen, "( OLcfgDbAt:12.3 NAME 'olcDbEnvFlags' "
 			"DESC 'Database environment flags' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "groupcommit", "usec", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_group_wait),
+		"( OLcfgDbAt:12.12 NAME 'olcDbGroupCommit' "
+		"DESC 'Microseconds a group commit waits for more writes' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "groupcommitmax", "num", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_group_max),
+		"( OLcfgDbAt:12.13 NAME 'olcDbGroupCommitMax' "
+		"DESC 'Most writes committed in one group' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "index", "attr> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
 		mdb_cf_gen, "( OLcfgDbAt:0.2 NAME 'olcDbIndex' "
 		"DESC 'Attribute index parameters' "
 		"EQUALITY caseIgnoreMatch "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "indexthreads", "num", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_index_threads),
+		"( OLcfgDbAt:12.10 NAME 'olcDbIndexThreads' "
+		"DESC 'Number of threads that help to index entries online' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "maxentrysize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_maxentrysize),
 		"( OLcfgDbAt:12.4 NAME 'olcDbMaxEntrySize' "
@@ -83,6 +116,14 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:0.3 NAME 'olcDbMode' "
 		"DESC 'Unix permissions of database files' "
 		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "pagedcursoridle", "seconds", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_PAGEDIDLE,
+		mdb_cf_gen, "( OLcfgDbAt:12.9 NAME 'olcDbPagedCursorIdle' "
+		"DESC 'Seconds a paged search may keep its snapshot between pages' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "pagedcursors", "num", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_PAGEDCURSORS,
+		mdb_cf_gen, "( OLcfgDbAt:12.8 NAME 'olcDbPagedCursors' "
+		"DESC 'Number of paged searches that may keep their snapshot between pages' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "rtxnsize", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_rtxn_size),
 		"( OLcfgDbAt:12.5 NAME 'olcDbRtxnSize' "
@@ -92,6 +133,10 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:1.9 NAME 'olcDbSearchStack' "
 		"DESC 'Depth of search stack in IDLs' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "searchthreads", "num", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_SEARCHTHREADS,
+		mdb_cf_gen, "( OLcfgDbAt:12.6 NAME 'olcDbSearchThreads' "
+		"DESC 'Number of threads that may help a large search' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -105,7 +150,10 @@ static ConfigOCs mdbocs[] = {
 		"MUST olcDbDirectory "
 		"MAY ( olcDbCheckpoint $ olcDbEnvFlags $ "
 		"olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize $ "
-		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize ) )",
+		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize $ "
+		"olcDbSearchThreads $ olcDbEntryCacheSize $ olcDbPagedCursors $ "
+		"olcDbPagedCursorIdle $ olcDbIndexThreads $ olcDbBackupRate $ "
+		"olcDbGroupCommit $ olcDbGroupCommitMax $ olcDbBulkMem ) )",
 		 	Cft_Database, mdbcfg },
 	{ NULL, 0, NULL }
 };
@@ -116,6 +164,7 @@ static slap_verbmasks mdb_envflags[] = {
 	{ BER_BVC("writemap"),	MDB_WRITEMAP },
 	{ BER_BVC("mapasync"),	MDB_MAPASYNC },
 	{ BER_BVC("nordahead"),	MDB_NORDAHEAD },
+	{ BER_BVC("trackpages"),	MDB_TRACKPAGES },
 	{ BER_BVNULL, 0 }
 };
 
@@ -133,6 +182,401 @@ mdb_checkpoint( void *ctx, void *arg )
 	return NULL;
 }
 
+/* Indexing entries on the fly, when indexes were added through
+ * cn=config. Helper tasks on the thread pool take chunks of the
+ * entries in ID order, and gather the keys of the new indexes for
+ * them in a read txn of their own; this task, the only writer, then
+ * stores the keys of each chunk, sorted, in one write txn. Entries
+ * may have changed since the helper read them: changes made since
+ * the task was started were indexed with the new mask already, so
+ * an entry that is gone is skipped, and one that is no longer as it
+ * was read is indexed again as it is now. Chunks no helper has
+ * started are indexed by the writer itself, so it never waits for a
+ * helper that may not get a thread.
+ *
+ * Searches only use the new indexes once every entry is indexed.
+ */
+enum {
+	OI_FREE = 0,	/* not started yet */
+	OI_BUSY,	/* a helper is reading it */
+	OI_DONE,	/* oc_keys and oc_data hold what it read */
+	OI_WRITER	/* must be indexed by the writer */
+};
+
+typedef struct oi_chunk {
+	ID		oc_first, oc_last;
+	int		oc_state;
+	mdb_ixkeys	oc_keys;
+	/* the entries as they were read, each an oi_edata and its bytes */
+	char	*oc_data;
+	size_t	oc_len, oc_size;
+} oi_chunk;
+
+typedef struct oi_edata {
+	ID		od_id;
+	size_t	od_size;
+} oi_edata;
+
+#define OI_ALIGN(n)	(((n) + sizeof(oi_edata) - 1) & ~(sizeof(oi_edata) - 1))
+
+typedef struct oindex {
+	Operation	oi_op;		/* template for the helpers */
+	Opheader	oi_hdr;
+	oi_chunk	*oi_chunks;
+	int		oi_nchunks;
+	int		oi_next;	/* next chunk to start */
+	int		oi_write;	/* chunk the writer is at */
+	int		oi_window;
+	int		oi_tasks;	/* helpers not finished yet */
+	int		oi_stop;
+	ldap_pvt_thread_mutex_t	oi_mutex;
+	ldap_pvt_thread_cond_t	oi_cond;
+} oindex;
+
+static void
+mdb_oindex_keep( oi_chunk *oc, ID id, MDB_val *data )
+{
+	oi_edata *od;
+	size_t len = sizeof( oi_edata ) + OI_ALIGN( data->mv_size );
+
+	if ( oc->oc_len + len > oc->oc_size ) {
+		oc->oc_size = oc->oc_size ? 2 * oc->oc_size : 65536;
+		if ( oc->oc_size < oc->oc_len + len )
+			oc->oc_size = oc->oc_len + len;
+		oc->oc_data = ch_realloc( oc->oc_data, oc->oc_size );
+	}
+	od = (oi_edata *)( oc->oc_data + oc->oc_len );
+	od->od_id = id;
+	od->od_size = data->mv_size;
+	memcpy( od + 1, data->mv_data, data->mv_size );
+	oc->oc_len += len;
+}
+
+static void
+mdb_oindex_clear( oi_chunk *oc )
+{
+	mdb_ixkeys_free( &oc->oc_keys );
+	ch_free( oc->oc_data );
+	oc->oc_data = NULL;
+	oc->oc_len = oc->oc_size = 0;
+}
+
+/* decode the entries of a chunk and gather their new keys */
+static int
+mdb_oindex_read( Operation *op, MDB_txn *txn, oi_chunk *oc )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	Entry *e;
+	ID id;
+	int rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mc );
+	if ( rc )
+		return rc;
+	mdb_ixkeys_start( op, &oc->oc_keys );
+
+	id = oc->oc_first;
+	key.mv_data = &id;
+	key.mv_size = sizeof(ID);
+	rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+	while ( rc == 0 ) {
+		memcpy( &id, key.mv_data, sizeof(ID) );
+		if ( id > oc->oc_last )
+			break;
+		/* stubs from missing parents */
+		if ( data.mv_size ) {
+			mdb_oindex_keep( oc, id, &data );
+			rc = mdb_entry_decode( op, txn, &data, &e );
+			if ( rc )
+				break;
+			e->e_id = id;
+			BER_BVZERO( &e->e_name );
+			BER_BVZERO( &e->e_nname );
+			rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+			mdb_entry_return( op, e );
+			if ( rc )
+				break;
+		}
+		rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT );
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+
+	mdb_ixkeys_stop( op, &oc->oc_keys );
+	mdb_cursor_close( mc );
+	if ( rc )
+		mdb_oindex_clear( oc );
+	return rc;
+}
+
+static void *
+mdb_oindex_task( void *ctx, void *arg )
+{
+	oindex *oi = arg;
+	struct mdb_info *mdb = (struct mdb_info *) oi->oi_op.o_bd->be_private;
+	Operation op = oi->oi_op;
+	Opheader hdr = oi->oi_hdr;
+	mdb_op_info opinfo = {{{0}}}, *moi = &opinfo;
+	oi_chunk *oc;
+	int rc;
+
+	op.o_hdr = &hdr;
+	op.o_threadctx = ctx;
+	op.o_tmpmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK,
+		ctx, 1 );
+	LDAP_SLIST_INIT( &op.o_extra );
+
+	rc = mdb_opinfo_get( &op, mdb, 1, &moi );
+
+	ldap_pvt_thread_mutex_lock( &oi->oi_mutex );
+	while ( rc == 0 ) {
+		while ( !oi->oi_stop && oi->oi_next < oi->oi_nchunks &&
+			oi->oi_next >= oi->oi_write + oi->oi_window )
+			ldap_pvt_thread_cond_wait( &oi->oi_cond, &oi->oi_mutex );
+		if ( oi->oi_stop || oi->oi_next >= oi->oi_nchunks ||
+			slapd_shutdown )
+			break;
+		oc = &oi->oi_chunks[oi->oi_next++];
+		oc->oc_state = OI_BUSY;
+		ldap_pvt_thread_mutex_unlock( &oi->oi_mutex );
+
+		/* a fresh snapshot for each chunk */
+		mdb_txn_reset( moi->moi_txn );
+		rc = mdb_txn_renew( moi->moi_txn );
+		if ( rc == 0 )
+			rc = mdb_oindex_read( &op, moi->moi_txn, oc );
+
+		ldap_pvt_thread_mutex_lock( &oi->oi_mutex );
+		oc->oc_state = rc ? OI_WRITER : OI_DONE;
+		ldap_pvt_thread_cond_broadcast( &oi->oi_cond );
+	}
+	ldap_pvt_thread_mutex_unlock( &oi->oi_mutex );
+
+	if ( moi == &opinfo ) {
+		if ( moi->moi_txn )
+			mdb_txn_reset( moi->moi_txn );
+		LDAP_SLIST_REMOVE( &op.o_extra, &moi->moi_oe, OpExtra, oe_next );
+	}
+
+	ldap_pvt_thread_mutex_lock( &oi->oi_mutex );
+	oi->oi_tasks--;
+	ldap_pvt_thread_cond_broadcast( &oi->oi_cond );
+	ldap_pvt_thread_mutex_unlock( &oi->oi_mutex );
+	return NULL;
+}
+
+static void
+mdb_oindex_helpers( oindex *oi, int n )
+{
+	ldap_pvt_thread_mutex_lock( &oi->oi_mutex );
+	oi->oi_stop = 0;
+	for ( ; n > 0; n-- ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			mdb_oindex_task, oi ))
+			break;
+		oi->oi_tasks++;
+	}
+	ldap_pvt_thread_mutex_unlock( &oi->oi_mutex );
+}
+
+/* stop the helpers, and drop what they read but was not stored */
+static void
+mdb_oindex_stop( oindex *oi )
+{
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &oi->oi_mutex );
+	oi->oi_stop = 1;
+	ldap_pvt_thread_cond_broadcast( &oi->oi_cond );
+	/* helpers that never got a thread won't get one now */
+	while ( oi->oi_tasks && ldap_pvt_thread_pool_retract( &connection_pool,
+		mdb_oindex_task, oi ) > 0 )
+		oi->oi_tasks--;
+	while ( oi->oi_tasks )
+		ldap_pvt_thread_cond_wait( &oi->oi_cond, &oi->oi_mutex );
+	ldap_pvt_thread_mutex_unlock( &oi->oi_mutex );
+
+	for ( i = oi->oi_write; i < oi->oi_next; i++ ) {
+		mdb_oindex_clear( &oi->oi_chunks[i] );
+		oi->oi_chunks[i].oc_state = OI_FREE;
+	}
+	oi->oi_next = oi->oi_write;
+}
+
+/* index the entries of a chunk no helper has read */
+static int
+mdb_oindex_entries( Operation *op, MDB_txn *txn, oi_chunk *oc, ID *n )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	Entry *e;
+	ID id;
+	int rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mc );
+	if ( rc )
+		return rc;
+	key.mv_size = sizeof(ID);
+	for ( id = oc->oc_first; id <= oc->oc_last; id++ ) {
+		key.mv_data = &id;
+		rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+		if ( rc )
+			break;
+		memcpy( &id, key.mv_data, sizeof(ID) );
+		if ( id > oc->oc_last )
+			break;
+		if ( !data.mv_size )
+			continue;
+		rc = mdb_entry_decode( op, txn, &data, &e );
+		if ( rc )
+			break;
+		e->e_id = id;
+		BER_BVZERO( &e->e_name );
+		BER_BVZERO( &e->e_nname );
+		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+		mdb_entry_return( op, e );
+		if ( rc )
+			break;
+		(*n)++;
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	mdb_cursor_close( mc );
+	return rc;
+}
+
+/* store the keys a helper gathered, for the entries it read as they are */
+static int
+mdb_oindex_store( Operation *op, MDB_txn *txn, oi_chunk *oc, ID *n )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	oi_edata *od;
+	Entry *e;
+	ID skip[MDB_OINDEX_CHUNK + 1];
+	size_t off;
+	int rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mc );
+	if ( rc )
+		return rc;
+	skip[0] = 0;
+	key.mv_size = sizeof(ID);
+	for ( off = 0; off < oc->oc_len;
+		off += sizeof( oi_edata ) + OI_ALIGN( od->od_size ))
+	{
+		od = (oi_edata *)( oc->oc_data + off );
+		key.mv_data = &od->od_id;
+		rc = mdb_cursor_get( mc, &key, &data, MDB_SET );
+		if ( rc == 0 && data.mv_size == od->od_size &&
+			!memcmp( data.mv_data, od + 1, od->od_size ))
+		{
+			(*n)++;
+			continue;
+		}
+		skip[++skip[0]] = od->od_id;
+		if ( rc == MDB_NOTFOUND || ( rc == 0 && !data.mv_size )) {
+			rc = 0;
+			continue;
+		}
+		if ( rc )
+			break;
+		rc = mdb_entry_decode( op, txn, &data, &e );
+		if ( rc )
+			break;
+		e->e_id = od->od_id;
+		BER_BVZERO( &e->e_name );
+		BER_BVZERO( &e->e_nname );
+		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+		mdb_entry_return( op, e );
+		if ( rc )
+			break;
+		(*n)++;
+	}
+	mdb_cursor_close( mc );
+	if ( rc == 0 )
+		rc = mdb_ixkeys_store( op, txn, &oc->oc_keys, skip );
+	return rc;
+}
+
+/* the new index settings the entries are being indexed for */
+static slap_mask_t *
+mdb_oindex_masks( struct mdb_info *mdb, int *n )
+{
+	slap_mask_t *masks;
+	int i;
+
+	*n = mdb->mi_nattrs;
+	masks = ch_malloc( ( *n + 1 ) * sizeof( slap_mask_t ));
+	for ( i = 0; i < *n; i++ )
+		masks[i] = mdb->mi_attrs[i]->ai_newmask;
+	return masks;
+}
+
+static int
+mdb_oindex_changed( struct mdb_info *mdb, slap_mask_t *masks, int n )
+{
+	int i;
+
+	if ( n != mdb->mi_nattrs )
+		return 1;
+	for ( i = 0; i < n; i++ ) {
+		if ( masks[i] != mdb->mi_attrs[i]->ai_newmask )
+			return 1;
+	}
+	return 0;
+}
+
+/* Set up the chunks of all entries that exist now */
+static int
+mdb_oindex_init( Operation *op, oindex *oi )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	MDB_stat ms;
+	ID last = 0;
+	int i, rc;
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+	if ( rc )
+		return rc;
+	rc = mdb_stat( txn, mdb->mi_id2entry, &ms );
+	if ( rc == 0 )
+		rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mc );
+	if ( rc == 0 ) {
+		rc = mdb_cursor_get( mc, &key, &data, MDB_LAST );
+		if ( rc == 0 )
+			memcpy( &last, key.mv_data, sizeof(ID) );
+		else if ( rc == MDB_NOTFOUND )
+			rc = 0;
+		mdb_cursor_close( mc );
+	}
+	mdb_txn_abort( txn );
+	if ( rc )
+		return rc;
+
+	oi->oi_nchunks = last ? ( last - 1 ) / MDB_OINDEX_CHUNK + 1 : 0;
+	oi->oi_chunks = ch_calloc( oi->oi_nchunks + 1, sizeof( oi_chunk ));
+	for ( i = 0; i < oi->oi_nchunks; i++ ) {
+		oi->oi_chunks[i].oc_first = (ID)i * MDB_OINDEX_CHUNK + 1;
+		oi->oi_chunks[i].oc_last = (ID)( i + 1 ) * MDB_OINDEX_CHUNK;
+	}
+	oi->oi_next = oi->oi_write = 0;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_oindex_mutex );
+	mdb->mi_oindex_start = slap_get_time();
+	mdb->mi_oindex_total = ms.ms_entries;
+	mdb->mi_oindex_done = 0;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_oindex_mutex );
+	return 0;
+}
+
 /* reindex entries on the fly */
 static void *
 mdb_online_index( void *ctx, void *arg )
@@ -145,88 +589,123 @@ mdb_online_index( void *ctx, void *arg )
 	OperationBuffer opbuf;
 	Operation *op;
 
-	MDB_cursor *curs;
-	MDB_val key, data;
 	MDB_txn *txn;
-	ID id;
-	Entry *e;
-	int rc, getnext = 1;
-	int i;
+	oindex oi = {{0}};
+	oi_chunk *oc;
+	slap_mask_t *masks;
+	ID n;
+	int rc, i, nmasks, helpers, stopped = 0;
 
 	connection_fake_init( &conn, &opbuf, ctx );
 	op = &opbuf.ob_op;
 
 	op->o_bd = be;
 
-	id = 1;
-	key.mv_size = sizeof(ID);
-
-	while ( 1 ) {
-		if ( slapd_shutdown )
-			break;
-
-		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
-		if ( rc )
-			break;
-		rc = mdb_cursor_open( txn, mdb->mi_id2entry, &curs );
-		if ( rc ) {
-			mdb_txn_abort( txn );
+	oi.oi_op = *op;
+	oi.oi_hdr = *op->o_hdr;
+	oi.oi_window = 4 * mdb->mi_index_threads;
+	ldap_pvt_thread_mutex_init( &oi.oi_mutex );
+	ldap_pvt_thread_cond_init( &oi.oi_cond );
+
+restart:
+	masks = mdb_oindex_masks( mdb, &nmasks );
+	rc = mdb_oindex_init( op, &oi );
+	helpers = mdb->mi_index_threads;
+	if ( helpers > oi.oi_nchunks )
+		helpers = oi.oi_nchunks;
+	mdb_oindex_helpers( &oi, helpers );
+
+	while ( rc == 0 && oi.oi_write < oi.oi_nchunks ) {
+		if ( slapd_shutdown ) {
+			stopped = 1;
 			break;
 		}
-		if ( getnext ) {
-			getnext = 0;
-			key.mv_data = &id;
-			rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
-			if ( rc ) {
-				mdb_txn_abort( txn );
-				if ( rc == MDB_NOTFOUND )
-					rc = 0;
-				break;
+
+		/* let the server pause, e.g. for another change of cn=config */
+		if ( ldap_pvt_thread_pool_pausing( &connection_pool ) > 0 ) {
+			mdb_oindex_stop( &oi );
+			ldap_pvt_thread_pool_pausecheck( &connection_pool );
+			if ( mdb_oindex_changed( mdb, masks, nmasks )) {
+				/* start over with the new settings */
+				for ( i = 0; i < oi.oi_nchunks; i++ )
+					mdb_oindex_clear( &oi.oi_chunks[i] );
+				ch_free( oi.oi_chunks );
+				oi.oi_chunks = NULL;
+				oi.oi_nchunks = 0;
+				ch_free( masks );
+				goto restart;
 			}
-			memcpy( &id, key.mv_data, sizeof( id ));
+			mdb_oindex_helpers( &oi, helpers );
 		}
 
-		rc = mdb_id2entry( op, curs, id, &e );
-		mdb_cursor_close( curs );
-		if ( rc ) {
-			mdb_txn_abort( txn );
-			if ( rc == MDB_NOTFOUND ) {
-				id++;
-				getnext = 1;
-				continue;
-			}
-			break;
+		oc = &oi.oi_chunks[oi.oi_write];
+		ldap_pvt_thread_mutex_lock( &oi.oi_mutex );
+		if ( oi.oi_next == oi.oi_write ) {
+			oi.oi_next++;
+			oc->oc_state = OI_WRITER;
 		}
-		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
-		mdb_entry_return( op, e );
+		while ( oc->oc_state == OI_BUSY )
+			ldap_pvt_thread_cond_wait( &oi.oi_cond, &oi.oi_mutex );
+		ldap_pvt_thread_mutex_unlock( &oi.oi_mutex );
+
+		n = 0;
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
 		if ( rc == 0 ) {
-			rc = mdb_txn_commit( txn );
-			txn = NULL;
-		} else {
-			mdb_txn_abort( txn );
-			txn = NULL;
+			if ( oc->oc_state == OI_DONE )
+				rc = mdb_oindex_store( op, txn, oc, &n );
+			else
+				rc = mdb_oindex_entries( op, txn, oc, &n );
+			if ( rc == 0 )
+				rc = mdb_txn_commit( txn );
+			else
+				mdb_txn_abort( txn );
 		}
-		if ( rc ) {
-			Debug( LDAP_DEBUG_ANY,
-				LDAP_XSTRING(mdb_online_index) ": database %s: "
-				"txn_commit failed: %s (%d)\n",
-				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		mdb_oindex_clear( oc );
+		if ( rc )
 			break;
-		}
-		id++;
-		getnext = 1;
+
+		ldap_pvt_thread_mutex_lock( &mdb->mi_oindex_mutex );
+		mdb->mi_oindex_done += n;
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_oindex_mutex );
+
+		ldap_pvt_thread_mutex_lock( &oi.oi_mutex );
+		oi.oi_write++;
+		ldap_pvt_thread_cond_broadcast( &oi.oi_cond );
+		ldap_pvt_thread_mutex_unlock( &oi.oi_mutex );
 	}
 
-	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
-		if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
-			|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
-		{
-			continue;
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_online_index) ": database %s: "
+			"indexing failed: %s (%d)\n",
+			be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+	}
+
+	mdb_oindex_stop( &oi );
+	for ( i = 0; i < oi.oi_nchunks; i++ )
+		mdb_oindex_clear( &oi.oi_chunks[i] );
+	ch_free( oi.oi_chunks );
+	ch_free( masks );
+	ldap_pvt_thread_cond_destroy( &oi.oi_cond );
+	ldap_pvt_thread_mutex_destroy( &oi.oi_mutex );
+
+	/* an index that is not complete is still only kept up to date */
+	if ( rc == 0 && !stopped ) {
+		for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+			if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
+				|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
+			{
+				continue;
+			}
+			mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
+			mdb->mi_attrs[ i ]->ai_newmask = 0;
 		}
-		mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
-		mdb->mi_attrs[ i ]->ai_newmask = 0;
 	}
 
+	ldap_pvt_thread_mutex_lock( &mdb->mi_oindex_mutex );
+	mdb->mi_oindex_start = 0;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_oindex_mutex );
+
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
 	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
 	mdb->mi_index_task = NULL;
@@ -346,6 +825,18 @@ mdb_cf_gen( ConfigArgs *c )
 		case MDB_MAXSIZE:
 			c->value_ulong = mdb->mi_mapsize;
 			break;
+
+		case MDB_PAGEDCURSORS:
+			c->value_uint = mdb->mi_pcursor_max;
+			break;
+
+		case MDB_PAGEDIDLE:
+			c->value_uint = mdb->mi_pcursor_idle;
+			break;
+
+		case MDB_SEARCHTHREADS:
+			c->value_uint = mdb->mi_search_threads;
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -363,6 +854,17 @@ mdb_cf_gen( ConfigArgs *c )
 		case MDB_SSTACK:
 		case MDB_MAXREADERS:
 		case MDB_MAXSIZE:
+		case MDB_PAGEDIDLE:
+			break;
+
+		case MDB_PAGEDCURSORS:
+			mdb->mi_pcursor_max = 0;
+			mdb->mi_pcursor_lim = 0;
+			mdb_pcursor_release_all( mdb );
+			break;
+
+		case MDB_SEARCHTHREADS:
+			mdb->mi_search_threads = 0;
 			break;
 
 		case MDB_CHKPT:
@@ -683,6 +1185,37 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_PAGEDCURSORS:
+		mdb->mi_pcursor_max = c->value_uint;
+		if ( mdb->mi_flags & MDB_IS_OPEN ) {
+			/* cursors need an environment opened with MDB_NOTLS */
+			if ( !( mdb->mi_flags & MDB_PCURSORS )) {
+				if ( mdb->mi_pcursor_max ) {
+					mdb->mi_flags |= MDB_RE_OPEN;
+					c->cleanup = mdb_cf_cleanup;
+				}
+			} else {
+				mdb_pcursor_clamp( c->be );
+			}
+		}
+		break;
+
+	case MDB_PAGEDIDLE:
+		mdb->mi_pcursor_idle = c->value_uint;
+		if ( mdb->mi_flags & MDB_IS_OPEN )
+			mdb_pcursor_schedule( c->be );
+		break;
+
+	case MDB_SEARCHTHREADS:
+		mdb->mi_search_threads = c->value_uint;
+		/* helpers use txns opened by the search, with MDB_NOTLS */
+		if (( mdb->mi_flags & MDB_IS_OPEN ) && mdb->mi_search_threads &&
+			!( mdb->mi_flags & MDB_PCURSORS )) {
+			mdb->mi_flags |= MDB_RE_OPEN;
+			c->cleanup = mdb_cf_cleanup;
+		}
+		break;
+
 	}
 	return 0;
 }
@@ -0,0 +1,293 @@
+/* count.c - count the entries a search matches from the indexes */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+#ifdef SLAP_CONTROL_X_COUNT
+
+/*
+ * A search with the count control gets the number of entries it
+ * matches in its result instead of the entries. The number is taken
+ * from the candidates and dn2id: it is exact when the indexes tell
+ * exactly which entries match the filter (see mdb_filter_exact()),
+ * and otherwise an upper bound flagged as an estimate. Candidates
+ * found through hashed equality keys are checked against the entries
+ * when they fit in an IDL, and their count is an estimate otherwise.
+ * Entry ACLs are not applied, so the count takes manage access to
+ * the search base.
+ *
+ * Referrals and glue entries, and subentries unless they are asked
+ * for, are not returned as entries by a search; the ones in scope are
+ * found through the objectClass index and taken off the count.
+ */
+
+static struct berval count_ocs[] = {
+	BER_BVC( "referral" ),
+	BER_BVC( "glue" ),
+	BER_BVC( "subentry" ),
+	BER_BVNULL
+};
+
+/* is id, a candidate in the search scope, below the base */
+static int
+count_inscope( Operation *op, IdScopes *isc, ID base, int all, ID id )
+{
+	if ( id == base )
+		return op->ors_scope == LDAP_SCOPE_SUBTREE;
+	if ( all )
+		return 1;
+	isc->id = id;
+	isc->nscope = 0;
+	return mdb_idscopes( op, isc ) == MDB_SUCCESS && isc->nscope;
+}
+
+/* is a plain entry, or the kind of entry asked for */
+static int
+count_visible( Operation *op, Entry *e )
+{
+	if ( !get_manageDSAit( op ) && is_entry_referral( e ))
+		return 0;
+	if ( is_entry_subentry( e )) {
+		if ( get_subentries( op ) && !get_subentries_visibility( op ))
+			return 0;
+	} else if ( get_subentries_visibility( op )) {
+		return 0;
+	}
+	return get_manageDSAit( op ) || !is_entry_glue( e );
+}
+
+static void
+count_oc_filter( Filter *f, AttributeAssertion *ava, struct berval *oc )
+{
+	f->f_choice = LDAP_FILTER_EQUALITY;
+	f->f_ava = ava;
+	f->f_av_desc = slap_schema.si_ad_objectClass;
+	f->f_av_value = *oc;
+	f->f_next = NULL;
+}
+
+/*
+ * Test the entry id against f, and if visible is set whether it is
+ * returned by the search at all. Returns -1 if it can't be read.
+ */
+static int
+count_test( Operation *op, MDB_cursor *mc, ID id, Filter *f, int visible )
+{
+	Entry *e;
+	int rc;
+
+	if ( mdb_id2entry( op, mc, id, &e ) != MDB_SUCCESS )
+		return -1;
+	rc = ( !visible || count_visible( op, e )) &&
+		test_filter( op, e, f ) == LDAP_COMPARE_TRUE;
+	mdb_entry_return( op, e );
+	return rc;
+}
+
+/*
+ * Count the special entries of objectClass oc in scope that are among
+ * the candidates, which are all entries if exact is 3. Returns NOID if
+ * they can't be told.
+ */
+static ID
+count_special(
+	Operation *op,
+	IdScopes *isc,
+	MDB_cursor *mc,
+	Entry *base,
+	int all,
+	struct berval *oc,
+	ID *ids,
+	int exact,
+	ID *stack )
+{
+	Filter f;
+	AttributeAssertion ava = ATTRIBUTEASSERTION_INIT;
+	ID *sids = stack, i, id, n = 0;
+	int rc;
+
+	count_oc_filter( &f, &ava, oc );
+	if ( !mdb_filter_exact( op, &f ))
+		return NOID;
+
+	if ( mdb_filter_candidates( op, isc->mt, &f, sids,
+			stack + MDB_IDL_UM_SIZE, stack + MDB_IDL_UM_SIZE ) ||
+		MDB_IDL_IS_RANGE( sids ))
+		return NOID;
+
+	for ( i = 1; i <= sids[0]; i++ ) {
+		id = sids[i];
+		if ( exact != 3 ) {
+			if ( MDB_IDL_IS_RANGE( ids )) {
+				/* can't tell if it's a candidate */
+				if ( count_inscope( op, isc, base->e_id, all, id ))
+					return NOID;
+				continue;
+			}
+			if ( ids[ mdb_idl_search( ids, id ) ] != id )
+				continue;
+		}
+		if ( !count_inscope( op, isc, base->e_id, all, id ))
+			continue;
+		/* the key is a hash of oc */
+		rc = count_test( op, mc, id, &f, 0 );
+		if ( rc < 0 )
+			return NOID;
+		n += rc;
+	}
+	return n;
+}
+
+/*
+ * Send the count of the entries matching the search, given its
+ * candidates as selected by mdb_search() and the number of entries in
+ * its scope.
+ */
+int
+mdb_search_count(
+	Operation *op,
+	SlapReply *rs,
+	MDB_cursor *mc,
+	Entry *base,
+	IdScopes *isc,
+	ID *ids,
+	ID nsubs,
+	ID *stack )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_stat ms;
+	Filter f;
+	AttributeAssertion ava = ATTRIBUTEASSERTION_INIT;
+	ID n = 0, i, sub;
+	int exact, all = 0, checked = 0, rc;
+
+	if ( rs->sr_err != LDAP_SUCCESS ) {
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "internal error";
+		goto send;
+	}
+
+	if ( !be_isroot( op ) && !access_allowed( op, base,
+		slap_schema.si_ad_entry, NULL, ACL_MANAGE, NULL ))
+	{
+		rs->sr_err = LDAP_INSUFFICIENT_ACCESS;
+		rs->sr_text = "counting requires manage access to the base";
+		goto send;
+	}
+
+	if ( op->ors_scope == LDAP_SCOPE_BASE ) {
+		n = count_visible( op, base ) &&
+			test_filter( op, base, op->ors_filter ) == LDAP_COMPARE_TRUE;
+		exact = 2;
+		goto done;
+	}
+
+	exact = mdb_filter_exact( op, op->ors_filter );
+	if ( get_subentries_visibility( op )) {
+		/* the candidates are the subentries among them */
+		count_oc_filter( &f, &ava, &count_ocs[2] );
+		rc = mdb_filter_exact( op, &f );
+		if ( rc < exact )
+			exact = rc;
+	}
+	/* entries are found through aliases too */
+	if ( op->ors_deref & LDAP_DEREF_SEARCHING )
+		exact = 0;
+
+	mdb_stat( isc->mt, mdb->mi_id2entry, &ms );
+	all = op->ors_scope != LDAP_SCOPE_ONELEVEL &&
+		( !base->e_id || nsubs >= ms.ms_entries );
+	if ( op->ors_scope == LDAP_SCOPE_CHILDREN && base->e_id )
+		nsubs--;
+
+	if ( exact == 3 ) {
+		n = nsubs;
+
+	} else if ( MDB_IDL_IS_RANGE( ids )) {
+		if ( exact && all && !get_subentries_visibility( op ) &&
+			mdb_filter_keycount( op, isc->mt, op->ors_filter, &n ) == 0 )
+		{
+			if ( base->e_id && op->ors_scope == LDAP_SCOPE_CHILDREN &&
+				test_filter( op, base, op->ors_filter ) == LDAP_COMPARE_TRUE )
+				n--;
+			/* too many to check for colliding values */
+			if ( exact == 1 )
+				exact = 0;
+		} else {
+			n = MDB_IDL_RANGE_LAST( ids ) - MDB_IDL_RANGE_FIRST( ids ) + 1;
+			exact = 0;
+		}
+		if ( n > nsubs )
+			n = nsubs;
+
+	} else {
+		/* the special entries are left out as they are checked */
+		checked = exact == 1;
+		for ( i = 1; i <= ids[0]; i++ ) {
+			if ( !count_inscope( op, isc, base->e_id, all, ids[i] ))
+				continue;
+			if ( checked ) {
+				rc = count_test( op, mc, ids[i], op->ors_filter, 1 );
+				if ( rc >= 0 ) {
+					n += rc;
+					continue;
+				}
+				checked = exact = 0;
+			}
+			n++;
+		}
+		if ( checked )
+			exact = 2;
+	}
+
+	if ( mdb->mi_search_stack_depth < 2 )
+		stack = ch_malloc( 2 * MDB_IDL_UM_SIZE * sizeof( ID ));
+	for ( i = 0; !checked && !BER_BVISNULL( &count_ocs[i] ); i++ ) {
+		if ( i < 2 ? get_manageDSAit( op ) :
+			get_subentries_visibility( op ))
+			continue;
+		sub = count_special( op, isc, mc, base, all, &count_ocs[i],
+			ids, exact, stack );
+		if ( sub == NOID ) {
+			exact = 0;
+		} else {
+			n -= sub < n ? sub : n;
+		}
+	}
+	if ( mdb->mi_search_stack_depth < 2 )
+		ch_free( stack );
+
+done:
+	Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_search_count)
+		": %ld entries%s\n", (long) n, exact ? "" : " (estimated)", 0 );
+
+	if ( n > LDAP_MAXINT )
+		n = LDAP_MAXINT;
+	rs->sr_err = slap_ctrl_count_add( op, rs, n, !exact );
+
+send:
+	send_ldap_result( op, rs );
+	rs->sr_text = NULL;
+	return rs->sr_err;
+}
+
+#endif /* SLAP_CONTROL_X_COUNT */
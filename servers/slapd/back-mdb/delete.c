@@ -51,6 +51,9 @@ mdb_delete( Operation *op, SlapReply *rs )
 		return rs->sr_err;
 #endif
 
+	if ( mdb_group_usable( op, mdb ))
+		return mdb_group_op( op, rs, mdb_delete );
+
 	ctrls[num_ctrls] = 0;
 
 	/* begin transaction */
@@ -362,6 +365,8 @@ mdb_delete( Operation *op, SlapReply *rs )
 			}
 			parent_is_leaf = 1;
 		}
+		/* don't let MDB_NOTFOUND leak into an outer txn's result */
+		rs->sr_err = 0;
 		mdb_entry_return( op, p );
 		p = NULL;
 	}
@@ -425,7 +430,9 @@ return_results:
 	}
 
 	send_ldap_result( op, rs );
-	slap_graduate_commit_csn( op );
+	/* a group commit sends the result later */
+	if ( !( moi->moi_flag & MOI_GROUPED ))
+		slap_graduate_commit_csn( op );
 
 	if( preread_ctrl != NULL && (*preread_ctrl) != NULL ) {
 		slap_sl_free( (*preread_ctrl)->ldctl_value.bv_val, op->o_tmpmemctx );
@@ -22,10 +22,13 @@
 #include "back-mdb.h"
 #include "lber_pvt.h"
 
+static struct berval backup_oid = BER_BVC(LDAP_EXOP_X_BACKUP);
+
 static struct exop {
 	struct berval *oid;
 	BI_op_extended	*extended;
 } exop_table[] = {
+	{ &backup_oid, mdb_backup },
 	{ NULL, NULL }
 };
 
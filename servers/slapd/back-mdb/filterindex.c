@@ -558,6 +558,414 @@ base:
 	return 0;
 }
 
+/*
+ * Estimate the number of entries matching an indexed assertion from
+ * the number of IDs stored under its keys; NOID if unknown.
+ */
+static ID
+keys_estimate(
+	Operation *op,
+	MDB_txn *rtxn,
+	AttributeDescription *desc,
+	int ftype,
+	MatchingRule *mr,
+	void *assertion )
+{
+	MDB_dbi dbi;
+	slap_mask_t mask;
+	struct berval prefix = BER_BVNULL, atname;
+	struct berval *keys = NULL;
+	AttrInfo *ai;
+	ID est = NOID, count;
+	int i;
+
+	if ( mdb_index_param( op->o_bd, desc, ftype,
+		&dbi, &mask, &prefix ) != LDAP_SUCCESS )
+	{
+		return NOID;
+	}
+
+	/* When the key statistics say no key of this index is big,
+	 * that bound is good enough and saves looking up the keys.
+	 */
+	ai = mdb_index_mask( op->o_bd, desc, &atname );
+	if ( ai && ( count = mdb_ixstat_maxcount(
+		(struct mdb_info *) op->o_bd->be_private, ai )) <= MDB_FILTER_DIRECT )
+		return count;
+
+	if ( ftype == LDAP_FILTER_PRESENT ) {
+		if ( prefix.bv_val != NULL &&
+			mdb_key_count( op->o_bd, rtxn, dbi, &prefix, &count, NULL ) == 0 )
+		{
+			est = count;
+		}
+		return est;
+	}
+
+	if ( mr == NULL || mr->smr_filter == NULL )
+		return NOID;
+
+	if ( mr->smr_filter( ftype, mask, desc->ad_type->sat_syntax, mr,
+		&prefix, assertion, &keys, op->o_tmpmemctx ) != LDAP_SUCCESS
+		|| keys == NULL )
+	{
+		return NOID;
+	}
+
+	/* the keys are intersected */
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+		if ( mdb_key_count( op->o_bd, rtxn, dbi, &keys[i], &count, NULL ) == 0
+			&& count < est )
+		{
+			est = count;
+			if ( est == 0 )
+				break;
+		}
+	}
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+
+	return est;
+}
+
+/*
+ * Estimate the number of candidates mdb_filter_candidates() would
+ * return for f; NOID if unknown or not bounded by an index.
+ */
+static ID
+filter_estimate(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f )
+{
+	ID est, sub;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return 0;
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		if ( f->f_result == LDAP_COMPARE_FALSE ||
+			f->f_result == SLAPD_COMPARE_UNDEFINED )
+			return 0;
+		return NOID;
+
+	case LDAP_FILTER_PRESENT:
+		if ( f->f_desc == slap_schema.si_ad_objectClass )
+			return NOID;
+		return keys_estimate( op, rtxn, f->f_desc, LDAP_FILTER_PRESENT,
+			NULL, NULL );
+
+	case LDAP_FILTER_EQUALITY:
+		if ( f->f_av_desc == slap_schema.si_ad_entryDN )
+			return 1;
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( f->f_av_desc ))
+			return NOID;
+#endif
+		return keys_estimate( op, rtxn, f->f_av_desc, LDAP_FILTER_EQUALITY,
+			f->f_av_desc->ad_type->sat_equality, &f->f_av_value );
+
+	case LDAP_FILTER_SUBSTRINGS:
+		est = mdb_ngram_estimate( op, rtxn, f->f_sub );
+		if ( est != NOID )
+			return est;
+		return keys_estimate( op, rtxn, f->f_sub_desc, LDAP_FILTER_SUBSTRINGS,
+			f->f_sub_desc->ad_type->sat_substr, f->f_sub );
+
+	case LDAP_FILTER_AND:
+		est = NOID;
+		for ( f = f->f_and; f != NULL && est > 0; f = f->f_next ) {
+			sub = filter_estimate( op, rtxn, f );
+			if ( sub < est )
+				est = sub;
+		}
+		return est;
+
+	case LDAP_FILTER_OR:
+		est = 0;
+		for ( f = f->f_or; f != NULL && est != NOID; f = f->f_next ) {
+			sub = filter_estimate( op, rtxn, f );
+			est = ( sub >= NOID - est ) ? NOID : est + sub;
+		}
+		return est;
+	}
+
+	return NOID;
+}
+
+typedef struct FilterPlan {
+	Filter	*fp_filter;
+	ID	fp_est;
+	int	fp_pos;
+	int	fp_done;
+} FilterPlan;
+
+/*
+ * If f is answered by the IDs of a single index key, return the key
+ * (to be freed with ber_bvarray_free_x) and its index.
+ */
+static BerVarray
+filter_key(
+	Operation *op,
+	Filter *f,
+	MDB_dbi *dbi )
+{
+	AttributeDescription *desc;
+	slap_mask_t mask;
+	struct berval prefix = BER_BVNULL;
+	BerVarray keys = NULL;
+	MatchingRule *mr;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_PRESENT:
+		desc = f->f_desc;
+		if ( desc == slap_schema.si_ad_objectClass )
+			return NULL;
+		break;
+	case LDAP_FILTER_EQUALITY:
+		desc = f->f_av_desc;
+		if ( desc == slap_schema.si_ad_entryDN )
+			return NULL;
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( desc ))
+			return NULL;
+#endif
+		break;
+	default:
+		return NULL;
+	}
+
+	if ( mdb_index_param( op->o_bd, desc, f->f_choice,
+		dbi, &mask, &prefix ) != LDAP_SUCCESS || prefix.bv_val == NULL )
+		return NULL;
+
+	if ( f->f_choice == LDAP_FILTER_PRESENT ) {
+		keys = op->o_tmpalloc( 2 * sizeof(struct berval), op->o_tmpmemctx );
+		ber_dupbv_x( &keys[0], &prefix, op->o_tmpmemctx );
+		BER_BVZERO( &keys[1] );
+		return keys;
+	}
+
+	mr = desc->ad_type->sat_equality;
+	if ( mr == NULL || mr->smr_filter == NULL ||
+		mr->smr_filter( LDAP_FILTER_EQUALITY, mask,
+			desc->ad_type->sat_syntax, mr, &prefix, &f->f_av_value,
+			&keys, op->o_tmpmemctx ) != LDAP_SUCCESS || keys == NULL )
+		return NULL;
+	if ( keys[0].bv_val == NULL || keys[1].bv_val != NULL ) {
+		ber_bvarray_free_x( keys, op->o_tmpmemctx );
+		return NULL;
+	}
+	return keys;
+}
+
+/*
+ * The values of desc are found under its index keys exactly as a
+ * filter on desc matches them: the index is its own, not that of a
+ * supertype, and takes in the values of its tagged and subtypes.
+ */
+static int
+index_exact( Operation *op, AttributeDescription *desc )
+{
+	AttrInfo *ai;
+	struct berval atname;
+
+	ai = mdb_index_mask( op->o_bd, desc, &atname );
+	return ai && ai->ai_desc == desc &&
+		!( ai->ai_indexmask & SLAP_INDEX_NOTAGS ) &&
+		desc->ad_type->sat_subtypes == NULL;
+}
+
+/*
+ * Tell whether mdb_filter_candidates() gives exactly the entries
+ * matching f when its candidates are not a range: 0 if they may be
+ * more, 2 if exact, 3 if f matches every entry. Equality keys are
+ * hashes, so a candidate may only have a value with the same hash:
+ * 1 if they are exact but for that, and have to be checked against
+ * the entries to be sure.
+ */
+int
+mdb_filter_exact(
+	Operation *op,
+	Filter *f )
+{
+	BerVarray keys;
+	MDB_dbi dbi;
+	int rc, sub, all;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return 2;
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		if ( f->f_result == LDAP_COMPARE_TRUE )
+			return 3;
+		return f->f_result != LDAP_SUCCESS ? 2 : 0;
+
+	case LDAP_FILTER_PRESENT:
+		if ( f->f_desc == slap_schema.si_ad_objectClass )
+			return 3;
+		if ( !index_exact( op, f->f_desc ))
+			return 0;
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+		if ( f->f_av_desc == slap_schema.si_ad_entryDN )
+			return 2;
+		if ( !index_exact( op, f->f_av_desc ))
+			return 0;
+		break;
+
+	case LDAP_FILTER_AND:
+		rc = 3;
+		for ( f = f->f_and; f != NULL; f = f->f_next ) {
+			sub = mdb_filter_exact( op, f );
+			if ( sub < rc )
+				rc = sub;
+		}
+		return rc;
+
+	case LDAP_FILTER_OR:
+		rc = 2;
+		all = 0;
+		for ( f = f->f_or; f != NULL; f = f->f_next ) {
+			sub = mdb_filter_exact( op, f );
+			if ( !sub )
+				return 0;
+			if ( sub == 3 )
+				all = 1;
+			else if ( sub < rc )
+				rc = sub;
+		}
+		return all ? 3 : rc;
+
+	default:
+		return 0;
+	}
+
+	/* a single key, or mdb_equality_candidates() intersects them */
+	keys = filter_key( op, f, &dbi );
+	if ( keys == NULL )
+		return 0;
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	return f->f_choice == LDAP_FILTER_EQUALITY ? 1 : 2;
+}
+
+/*
+ * Count the entries matching f if it is answered by a single index
+ * key, whose IDs need not fit in an IDL. Returns -1 otherwise. The
+ * count of an equality key may take in colliding values.
+ */
+int
+mdb_filter_keycount(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f,
+	ID *count )
+{
+	BerVarray keys;
+	MDB_dbi dbi;
+	int rc, range;
+
+	rc = mdb_filter_exact( op, f );
+	if ( rc == 0 || rc == 3 )
+		return -1;
+	keys = filter_key( op, f, &dbi );
+	if ( keys == NULL )
+		return -1;
+	rc = mdb_key_count( op->o_bd, rtxn, dbi, &keys[0], count, &range );
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	if ( rc == 0 && range )
+		rc = -1;
+	return rc;
+}
+
+/*
+ * Keys that hold more IDs than an IDL are read from the index as the
+ * range of IDs they span, which is useless to intersect.  So the big
+ * single-key components of a list, starting at plan[0], are combined
+ * straight from their compressed form, along with the candidates
+ * gathered so far unless first is set.  The small ones of an OR are
+ * taken along, as their union with a big one would be a range too.
+ * Returns -1 if that isn't worth doing.
+ */
+static int
+combine_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	FilterPlan *plan,
+	int n,
+	int ftype,
+	int first,
+	ID *ids,
+	ID *tmp )
+{
+	MDB_dbi dbibuf[8], *dbis;
+	struct berval keybuf[8], *keys;
+	BerVarray kv;
+	int i, nk = 0, rc = -1;
+
+	dbis = dbibuf;
+	keys = keybuf;
+	if ( n > (int)( sizeof( keybuf ) / sizeof( keybuf[0] ))) {
+		dbis = op->o_tmpalloc( n * sizeof(MDB_dbi), op->o_tmpmemctx );
+		keys = op->o_tmpalloc( n * sizeof(struct berval), op->o_tmpmemctx );
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		if ( plan[i].fp_done || plan[i].fp_est == NOID ||
+			( ftype == LDAP_FILTER_AND && plan[i].fp_est <= MDB_IDL_DB_MAX ))
+			continue;
+		kv = filter_key( op, plan[i].fp_filter, &dbis[nk] );
+		if ( kv == NULL )
+			continue;
+		keys[nk] = kv[0];
+		op->o_tmpfree( kv, op->o_tmpmemctx );
+		plan[i].fp_done = nk + 1;
+		nk++;
+	}
+
+	if ( nk + !first >= 2 ) {
+		rc = mdb_key_combine( op->o_bd, rtxn, ftype, nk, dbis, keys,
+			!first, ids, tmp );
+		Debug( LDAP_DEBUG_FILTER,
+			"<= mdb_list_candidates: combined %d keys, rc=%d\n",
+			nk, rc, 0 );
+	}
+	if ( rc ) {
+		/* leave them to the usual path */
+		for ( i = 0; i < n; i++ )
+			if ( plan[i].fp_done > 0 )
+				plan[i].fp_done = 0;
+	}
+
+	for ( i = 0; i < nk; i++ )
+		op->o_tmpfree( keys[i].bv_val, op->o_tmpmemctx );
+	if ( keys != keybuf ) {
+		op->o_tmpfree( dbis, op->o_tmpmemctx );
+		op->o_tmpfree( keys, op->o_tmpmemctx );
+	}
+	return rc;
+}
+
+static int
+filter_plan_cmp( const void *v1, const void *v2 )
+{
+	const FilterPlan *p1 = v1, *p2 = v2;
+
+	if ( p1->fp_est != p2->fp_est )
+		return p1->fp_est < p2->fp_est ? -1 : 1;
+	return p1->fp_pos - p2->fp_pos;
+}
+
+/*
+ * The components of an AND are evaluated most selective first, as
+ * estimated from the size of their index keys, and once few enough
+ * candidates remain the rest are left for test_filter() to check on
+ * the entries themselves.  Skipping a component only makes the
+ * candidate list larger, never smaller, so the result is unchanged.
+ * Counts are taken from the candidates, so nothing is skipped then.
+ */
 static int
 list_candidates(
 	Operation *op,
@@ -570,14 +978,73 @@ list_candidates(
 {
 	int rc = 0;
 	Filter	*f;
+	FilterPlan planbuf[8], *plan;
+	int i, n = 0, first = 1;
 
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_list_candidates 0x%x\n", ftype, 0, 0 );
-	for ( f = flist; f != NULL; f = f->f_next ) {
-		/* ignore precomputed scopes */
-		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
-		     f->f_result == LDAP_SUCCESS ) {
+
+	/* a precomputed scope in front has been loaded into ids already */
+	if ( flist != NULL && flist->f_choice == SLAPD_FILTER_COMPUTED &&
+		flist->f_result == LDAP_SUCCESS ) {
+		first = 0;
+	}
+
+	for ( f = flist; f != NULL; f = f->f_next )
+		n++;
+	plan = planbuf;
+	if ( n > (int)( sizeof( planbuf ) / sizeof( planbuf[0] )))
+		plan = op->o_tmpalloc( n * sizeof( FilterPlan ), op->o_tmpmemctx );
+
+	for ( i = 0, f = flist; f != NULL; i++, f = f->f_next ) {
+		plan[i].fp_filter = f;
+		plan[i].fp_pos = i;
+		plan[i].fp_est = NOID;
+		plan[i].fp_done = 0;
+		/* the components of an OR are only looked at for
+		 * big keys to combine
+		 */
+		if ( n > 1 && ( ftype == LDAP_FILTER_AND ||
+			f->f_choice == LDAP_FILTER_PRESENT ||
+			f->f_choice == LDAP_FILTER_EQUALITY ))
+			plan[i].fp_est = filter_estimate( op, rtxn, f );
+	}
+	if ( ftype == LDAP_FILTER_AND && n > 1 )
+		qsort( plan, n, sizeof( FilterPlan ), filter_plan_cmp );
+
+	for ( i = 0; i < n; i++ ) {
+		f = plan[i].fp_filter;
+
+		/* ignore precomputed scopes, and components already
+		 * combined
+		 */
+		if (( f->f_choice == SLAPD_FILTER_COMPUTED &&
+		     f->f_result == LDAP_SUCCESS ) || plan[i].fp_done ) {
 			continue;
 		}
+
+		if ( ftype == LDAP_FILTER_AND && !first && !MDB_IDL_IS_RANGE( ids ) &&
+			!get_count( op ) &&
+			( ids[0] <= MDB_FILTER_DIRECT ||
+			( plan[i].fp_est != NOID &&
+				plan[i].fp_est / MDB_FILTER_DIRECT_RATIO > ids[0] )))
+		{
+			Debug( LDAP_DEBUG_FILTER,
+				"<= mdb_list_candidates: %ld candidates left, "
+				"skipping %d components\n",
+				(long) ids[0], n - i, 0 );
+			break;
+		}
+
+		if ( plan[i].fp_est != NOID && plan[i].fp_est > MDB_IDL_DB_MAX &&
+			combine_candidates( op, rtxn, plan+i, n-i, ftype, first,
+				ids, tmp ) == 0 )
+		{
+			first = 0;
+			if ( ftype == LDAP_FILTER_AND && MDB_IDL_IS_ZERO( ids ))
+				break;
+			continue;
+		}
+
 		MDB_IDL_ZERO( save );
 		rc = mdb_filter_candidates( op, rtxn, f, save, tmp,
 			save+MDB_IDL_UM_SIZE );
@@ -592,22 +1059,27 @@ list_candidates(
 
 		
 		if ( ftype == LDAP_FILTER_AND ) {
-			if ( f == flist ) {
+			if ( first ) {
 				MDB_IDL_CPY( ids, save );
+				first = 0;
 			} else {
 				mdb_idl_intersection( ids, save );
 			}
 			if( MDB_IDL_IS_ZERO( ids ) )
 				break;
 		} else {
-			if ( f == flist ) {
+			if ( first ) {
 				MDB_IDL_CPY( ids, save );
+				first = 0;
 			} else {
 				mdb_idl_union( ids, save );
 			}
 		}
 	}
 
+	if ( plan != planbuf )
+		op->o_tmpfree( plan, op->o_tmpmemctx );
+
 	if( rc == LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_FILTER,
 			"<= mdb_list_candidates: id=%ld first=%ld last=%ld\n",
@@ -965,6 +1437,11 @@ substring_candidates(
 
 	MDB_IDL_ALL( ids );
 
+	/* an ngram index covers short pieces the hashed keys don't */
+	rc = mdb_ngram_candidates( op, rtxn, sub, ids, tmp );
+	if ( rc != LDAP_INAPPROPRIATE_MATCHING )
+		return rc;
+
 	rc = mdb_index_param( op->o_bd, sub->sa_desc, LDAP_FILTER_SUBSTRINGS,
 		&dbi, &mask, &prefix );
 
@@ -0,0 +1,333 @@
+/* group.c - commit concurrent write operations together */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+#include <ac/unistd.h>
+#include <ac/time.h>
+
+#include "back-mdb.h"
+
+/*
+ * With olcDbGroupCommit set, a write operation does not begin a txn
+ * of its own but joins a queue. The first writer to find no leader at
+ * work leads: it waits up to olcDbGroupCommit microseconds for more
+ * writers to join, takes up to olcDbGroupCommitMax of them, and runs
+ * each in a child txn of one write txn, in its own thread, as txn.c
+ * runs the operations of an LDAP transaction. A write that fails only
+ * aborts its child txn. The leader commits once, and then each writer
+ * sends its result, held back until then, from its own thread; so no
+ * result is sent before the write is as durable as dbnosync, envflags
+ * and the lazyCommit control ask for. LMDB has no nested txns with
+ * writemap, so it turns grouping off.
+ */
+
+/* microseconds the leader sleeps at a time while it waits */
+#ifndef MDB_GROUP_NAP
+#define MDB_GROUP_NAP	250
+#endif
+
+typedef struct mdb_group_write {
+	struct mdb_group_write	*go_next;
+	Operation	*go_op;
+	BI_op_func	*go_func;
+	mdb_op_info	go_moi;		/* with the child txn */
+	int			go_done;
+	int			go_caught;	/* the result was sent to us */
+	/* the result, held back until the group is committed */
+	ber_int_t	go_err;
+	const char	*go_text;
+	char		*go_matched;
+	BerVarray	go_ref;
+	LDAPControl	**go_ctrls;
+	char		go_textbuf[SLAP_TEXT_BUFLEN];
+} mdb_group_write;
+
+int
+mdb_group_usable( Operation *op, struct mdb_info *mdb )
+{
+	OpExtra *oex;
+
+	if ( !mdb->mi_group_wait || ( slapMode & SLAP_TOOL_MODE ) ||
+		op->o_noop || ( mdb->mi_dbenv_flags & MDB_WRITEMAP ))
+		return 0;
+
+	/* in an LDAP transaction, or being run by a leader */
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb )
+			return 0;
+	}
+	return 1;
+}
+
+/* Keep a copy of the result; what the handler points to goes away */
+static int
+mdb_group_response( Operation *op, SlapReply *rs )
+{
+	mdb_group_write *go = op->o_callback->sc_private;
+
+	if ( rs->sr_type != REP_RESULT )
+		return SLAP_CB_CONTINUE;
+
+	go->go_caught = 1;
+	go->go_err = rs->sr_err;
+	if ( rs->sr_text ) {
+		snprintf( go->go_textbuf, sizeof( go->go_textbuf ), "%s",
+			rs->sr_text );
+		go->go_text = go->go_textbuf;
+	}
+	if ( rs->sr_matched ) {
+		go->go_matched = ch_strdup( rs->sr_matched );
+	}
+	if ( rs->sr_ref ) {
+		ber_bvarray_dup_x( &go->go_ref, rs->sr_ref, NULL );
+	}
+	if ( rs->sr_ctrls ) {
+		int i, n;
+
+		for ( n = 0; rs->sr_ctrls[n]; n++ )
+			;
+		go->go_ctrls = op->o_tmpalloc( ( n + 1 ) * sizeof( LDAPControl * ),
+			op->o_tmpmemctx );
+		for ( i = 0; i < n; i++ ) {
+			LDAPControl *c = rs->sr_ctrls[i], *d;
+			size_t oidlen = strlen( c->ldctl_oid ) + 1;
+
+			/* in one piece, as slap_free_ctrls() frees them */
+			d = op->o_tmpalloc( sizeof( LDAPControl ) + oidlen +
+				c->ldctl_value.bv_len + 1, op->o_tmpmemctx );
+			d->ldctl_oid = (char *)&d[1];
+			AC_MEMCPY( d->ldctl_oid, c->ldctl_oid, oidlen );
+			d->ldctl_iscritical = c->ldctl_iscritical;
+			d->ldctl_value.bv_len = c->ldctl_value.bv_len;
+			if ( BER_BVISNULL( &c->ldctl_value )) {
+				d->ldctl_value.bv_val = NULL;
+			} else {
+				d->ldctl_value.bv_val = d->ldctl_oid + oidlen;
+				AC_MEMCPY( d->ldctl_value.bv_val, c->ldctl_value.bv_val,
+					c->ldctl_value.bv_len );
+				d->ldctl_value.bv_val[d->ldctl_value.bv_len] = '\0';
+			}
+			go->go_ctrls[i] = d;
+		}
+		go->go_ctrls[n] = NULL;
+	}
+
+	/* not now */
+	return rs->sr_err;
+}
+
+/* Run one write of the group in a child txn of txn */
+static void
+mdb_group_run(
+	Operation *op,
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	mdb_group_write *go,
+	slap_callback *cb )
+{
+	Operation *o = go->go_op;
+	slap_callback *sc = o->o_callback;
+	void *threadctx = o->o_threadctx;
+	ldap_pvt_thread_t tid = o->o_tid;
+	SlapReply rs = { REP_RESULT };
+	int prev_ads = mdb->mi_numads, rc;
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, txn, 0, &go->go_moi.moi_txn );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_group_run: txn_begin failed: %s (%d)\n",
+			mdb_strerror( rc ), rc, 0 );
+		go->go_err = LDAP_OTHER;
+		go->go_text = "internal error";
+		return;
+	}
+	go->go_moi.moi_oe.oe_key = mdb;
+	go->go_moi.moi_flag = MOI_GROUPED;
+	go->go_moi.moi_ref = 0;
+	LDAP_SLIST_INSERT_HEAD( &o->o_extra, &go->go_moi.moi_oe, oe_next );
+
+	/* only we see the result; the overlays get it when it is sent */
+	cb->sc_private = go;
+	o->o_callback = cb;
+	o->o_threadctx = op->o_threadctx;
+	o->o_tid = op->o_tid;
+	o->o_uncommitted = 1;
+
+	go->go_func( o, &rs );
+
+	o->o_uncommitted = 0;
+	o->o_callback = sc;
+	o->o_threadctx = threadctx;
+	o->o_tid = tid;
+	LDAP_SLIST_REMOVE( &o->o_extra, &go->go_moi.moi_oe, OpExtra, oe_next );
+
+	if ( !go->go_caught ) {
+		go->go_err = rs.sr_err;
+	}
+	if ( go->go_err == LDAP_SUCCESS ) {
+		rc = mdb_txn_commit( go->go_moi.moi_txn );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "mdb_group_run: txn_commit failed: %s (%d)\n",
+				mdb_strerror( rc ), rc, 0 );
+			mdb_ad_unwind( mdb, prev_ads );
+			go->go_err = LDAP_OTHER;
+			go->go_text = "commit failed";
+		}
+	} else {
+		mdb_txn_abort( go->go_moi.moi_txn );
+		mdb_ad_unwind( mdb, prev_ads );
+	}
+	go->go_moi.moi_txn = NULL;
+}
+
+/* Take a group off the queue, run it and commit it */
+static void
+mdb_group_lead( Operation *op, struct mdb_info *mdb )
+{
+	mdb_group_write *head, *go, **gp;
+	MDB_txn *txn;
+	slap_callback cb = { 0 };
+	struct timeval start, now;
+	int max = mdb->mi_group_max ? mdb->mi_group_max : 1;
+	int n, rc, prev_ads, flag = MDB_NOMETASYNC;
+
+	/* give more writers a moment to join */
+	gettimeofday( &start, NULL );
+	ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+	while ( mdb->mi_group_count < max ) {
+		long left;
+
+		gettimeofday( &now, NULL );
+		left = (long)mdb->mi_group_wait -
+			(( now.tv_sec - start.tv_sec ) * 1000000L +
+			now.tv_usec - start.tv_usec );
+		if ( left <= 0 )
+			break;
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+		usleep( left < MDB_GROUP_NAP ? left : MDB_GROUP_NAP );
+		ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+	}
+	gp = &mdb->mi_group_head;
+	for ( n = 0; *gp && n < max; n++ )
+		gp = &(*gp)->go_next;
+	head = mdb->mi_group_head;
+	mdb->mi_group_head = *gp;
+	if ( !mdb->mi_group_head )
+		mdb->mi_group_tail = NULL;
+	*gp = NULL;
+	mdb->mi_group_count -= n;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+
+	/* the commit is only lazy if every write asked for it */
+	for ( go = head; go; go = go->go_next ) {
+		if ( !get_lazyCommit( go->go_op ))
+			flag = 0;
+	}
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, flag, &txn );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_group_lead: txn_begin failed: %s (%d)\n",
+			mdb_strerror( rc ), rc, 0 );
+		for ( go = head; go; go = go->go_next ) {
+			go->go_err = LDAP_OTHER;
+			go->go_text = "internal error";
+		}
+	} else {
+		prev_ads = mdb->mi_numads;
+		cb.sc_response = mdb_group_response;
+		for ( go = head; go; go = go->go_next )
+			mdb_group_run( op, mdb, txn, go, &cb );
+
+		rc = mdb_txn_commit( txn );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "mdb_group_lead: txn_commit failed: %s (%d)\n",
+				mdb_strerror( rc ), rc, 0 );
+			mdb_ad_unwind( mdb, prev_ads );
+			for ( go = head; go; go = go->go_next ) {
+				if ( go->go_err == LDAP_SUCCESS ) {
+					go->go_err = LDAP_OTHER;
+					go->go_text = "commit failed";
+				}
+			}
+		}
+	}
+
+	Debug( LDAP_DEBUG_TRACE, "mdb_group_lead: %d writes, rc=%d\n",
+		n, rc, 0 );
+
+	/* let them all go */
+	ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+	for ( go = head; go; go = go->go_next )
+		go->go_done = 1;
+	mdb->mi_group_busy = 0;
+	ldap_pvt_thread_cond_broadcast( &mdb->mi_group_cond );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+}
+
+/* Queue a write for the next group commit and send its result */
+int
+mdb_group_op( Operation *op, SlapReply *rs, BI_op_func *func )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_group_write go;
+
+	memset( &go, 0, sizeof( go ));
+	go.go_op = op;
+	go.go_func = func;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+	if ( mdb->mi_group_tail )
+		mdb->mi_group_tail->go_next = &go;
+	else
+		mdb->mi_group_head = &go;
+	mdb->mi_group_tail = &go;
+	mdb->mi_group_count++;
+	while ( !go.go_done ) {
+		if ( mdb->mi_group_busy ) {
+			ldap_pvt_thread_cond_wait( &mdb->mi_group_cond,
+				&mdb->mi_group_mutex );
+		} else {
+			mdb->mi_group_busy = 1;
+			ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+			mdb_group_lead( op, mdb );
+			ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+
+	rs->sr_err = go.go_err;
+	rs->sr_text = go.go_text;
+	if ( go.go_matched ) {
+		rs->sr_matched = go.go_matched;
+		rs->sr_flags |= REP_MATCHED_MUSTBEFREED;
+	}
+	if ( go.go_ref ) {
+		rs->sr_ref = go.go_ref;
+		rs->sr_flags |= REP_REF_MUSTBEFREED;
+	}
+	if ( go.go_ctrls ) {
+		rs->sr_ctrls = go.go_ctrls;
+		rs->sr_flags |= REP_CTRLS_MUSTBEFREED;
+	}
+	send_ldap_result( op, rs );
+
+	/* the handler left this until the result was sent */
+	slap_graduate_commit_csn( op );
+
+	return rs->sr_err;
+}
@@ -66,6 +66,8 @@ static int mdb_id2entry_put(
 	if (mdb->mi_maxentrysize && ec.len > mdb->mi_maxentrysize)
 		return LDAP_ADMINLIMIT_EXCEEDED;
 
+	mdb_cache_invalidate( mdb, txn, e->e_id );
+
 again:
 	data.mv_size = ec.len;
 	if ( mc )
@@ -147,8 +149,17 @@ int mdb_id2entry(
 	MDB_val key, data;
 	int rc = 0;
 
+	int cache;
+
 	*e = NULL;
 
+	cache = mdb_cache_usable( op, mdb );
+	if ( cache ) {
+		rc = mdb_cache_find( op, mdb_cursor_txn( mc ), id, e );
+		if ( rc == MDB_SUCCESS )
+			return rc;
+	}
+
 	key.mv_data = &id;
 	key.mv_size = sizeof(ID);
 
@@ -191,7 +202,10 @@ int mdb_id2entry(
 		rc = MDB_NOTFOUND;
 	if ( rc ) return rc;
 
-	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, e );
+	if ( cache )
+		rc = mdb_cache_add( op, mdb_cursor_txn( mc ), id, &data, e );
+	else
+		rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, e );
 	if ( rc ) return rc;
 
 	(*e)->e_id = id;
@@ -214,6 +228,8 @@ int mdb_id2entry_delete(
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
 
+	mdb_cache_invalidate( mdb, tid, e->e_id );
+
 	/* delete from database */
 	rc = mdb_del( tid, dbi, &key, NULL );
 
@@ -248,6 +264,9 @@ int mdb_entry_return(
 	if ( !e )
 		return 0;
 	if ( e->e_private ) {
+		/* a header for an entry in the cache */
+		if ( e->e_private != e )
+			mdb_cache_return( e->e_private );
 		if ( op->o_hdr && op->o_tmpmfuncs ) {
 			op->o_tmpfree( e->e_nname.bv_val, op->o_tmpmemctx );
 			op->o_tmpfree( e->e_name.bv_val, op->o_tmpmemctx );
@@ -691,15 +710,52 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
  * Note: everything is stored in a single contiguous block, so
  * you can not free individual attributes or names from this
  * structure. Attempting to do so will likely corrupt memory.
+ *
+ * If a map is given, only the attributes it wants are decoded, and
+ * the others are left out of the entry altogether. The values are
+ * not copied either way; they point into the map of the database,
+ * and so are only valid until the txn ends.
  */
 
 int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, Entry **e)
+{
+	return mdb_entry_decode_map( op, txn, data, NULL, e );
+}
+
+int mdb_entry_decode_map(Operation *op, MDB_txn *txn, MDB_val *data,
+	mdb_attrmap *map, Entry **e)
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	unsigned int *lp = (unsigned int *)data->mv_data;
+	Entry *x;
+	int rc;
+
+	x = mdb_entry_alloc(op, lp[0], lp[1]);
+	rc = mdb_entry_decode_to(mdb, txn, data, map, x);
+	if (rc) {
+		op->o_tmpfree(x, op->o_tmpmemctx);
+		return rc;
+	}
+	*e = x;
+	return 0;
+}
+
+/* The size of the block mdb_entry_decode_to() needs for an entry */
+size_t mdb_entry_decode_size(MDB_val *data)
+{
+	unsigned int *lp = (unsigned int *)data->mv_data;
+
+	return sizeof(Entry) + lp[0] * sizeof(Attribute) +
+		lp[1] * sizeof(struct berval);
+}
+
+/* Decode into a block of mdb_entry_decode_size() bytes at x */
+int mdb_entry_decode_to(struct mdb_info *mdb, MDB_txn *txn, MDB_val *data,
+	mdb_attrmap *map, Entry *x)
+{
 	int i, j, nattrs, nvals;
 	int rc;
 	Attribute *a;
-	Entry *x;
 	const char *text;
 	AttributeDescription *ad;
 	unsigned int *lp = (unsigned int *)data->mv_data;
@@ -712,7 +768,13 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, Entry **e)
 
 	nattrs = *lp++;
 	nvals = *lp++;
-	x = mdb_entry_alloc(op, nattrs, nvals);
+	BER_BVZERO(&x->e_bv);
+	if (nattrs) {
+		x->e_attrs = (Attribute *)(x+1);
+		x->e_attrs->a_vals = (struct berval *)(x->e_attrs+nattrs);
+	} else {
+		x->e_attrs = NULL;
+	}
 	x->e_ocflags = *lp++;
 	if (!nvals) {
 		goto done;
@@ -730,6 +792,15 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, Entry **e)
 			i ^= HIGH_BIT;
 			a->a_flags |= SLAP_ATTR_SORTED_VALS;
 		}
+		if (map && i <= map->am_numads && !map->am_want[i]) {
+			/* skip the values, and their normalized forms */
+			j = *lp++;
+			if (j & HIGH_BIT)
+				j = (j ^ HIGH_BIT) * 2;
+			for (; j>0; j--)
+				ptr += *lp++ + 1;
+			continue;
+		}
 		if (i > mdb->mi_numads) {
 			rc = mdb_ad_read(mdb, txn);
 			if (rc)
@@ -789,11 +860,13 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, Entry **e)
 		a->a_next = a+1;
 		a = a->a_next;
 	}
-	a[-1].a_next = NULL;
+	if (a == x->e_attrs)
+		x->e_attrs = NULL;
+	else
+		a[-1].a_next = NULL;
 done:
 
 	Debug(LDAP_DEBUG_TRACE, "<= mdb_entry_decode\n",
 		0, 0, 0 );
-	*e = x;
 	return 0;
 }
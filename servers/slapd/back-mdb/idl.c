@@ -21,6 +21,7 @@
 
 #include "back-mdb.h"
 #include "idl.h"
+#include "lutil.h"
 
 #define IDL_MAX(x,y)	( (x) > (y) ? (x) : (y) )
 #define IDL_MIN(x,y)	( (x) < (y) ? (x) : (y) )
@@ -341,8 +342,18 @@ mdb_idl_fetch_key(
 		}
 		if ( rc == MDB_NOTFOUND ) rc = 0;
 		ids[0] = i - &ids[1];
-		/* On disk, a range is denoted by 0 in the first element */
-		if (ids[1] == 0) {
+		/* On disk, a range is denoted by 0 in the first element,
+		 * and a bitmap by a range ending in NOID
+		 */
+		if (ids[1] == 0 && ids[0] == MDB_IDL_RANGE_SIZE && ids[3] == NOID) {
+			rc = mdb_bitmap_fetch( be, txn, dbi, kptr, ids );
+			if ( rc != 0 ) {
+				Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_key: "
+					"bitmap failed: %s (%d)\n", mdb_strerror(rc), rc, 0 );
+				mdb_cursor_close( cursor );
+				return rc;
+			}
+		} else if (ids[1] == 0) {
 			if (ids[0] != MDB_IDL_RANGE_SIZE) {
 				Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_key: "
 					"range size mismatch: expected %d, got %ld\n",
@@ -389,6 +400,110 @@ mdb_idl_fetch_key(
 	return rc;
 }
 
+/*
+ * Number of IDs stored under key, without reading them; for a range
+ * this is the size of the range, and *range is set if given.
+ */
+int
+mdb_idl_count_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count,
+	int			*range )
+{
+	MDB_cursor *cursor;
+	MDB_val data;
+	ID lo, hi;
+	size_t n;
+	int rc;
+
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc != 0 )
+		return rc;
+
+	if ( range )
+		*range = 0;
+	rc = mdb_cursor_get( cursor, key, &data, MDB_SET );
+	if ( rc == 0 ) {
+		memcpy( &lo, data.mv_data, sizeof( ID ));
+		if ( lo == 0 ) {
+			/* On disk, a range is denoted by 0 in the first element */
+			rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_DUP );
+			if ( rc == 0 ) {
+				memcpy( &lo, data.mv_data, sizeof( ID ));
+				rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_DUP );
+			}
+			if ( rc == 0 ) {
+				memcpy( &hi, data.mv_data, sizeof( ID ));
+				/* or a bitmap, that keeps its own count */
+				if ( hi == NOID ) {
+					rc = mdb_bitmap_count( be->be_private, txn, dbi,
+						key, count );
+				} else {
+					*count = hi - lo + 1;
+					if ( range )
+						*range = 1;
+				}
+			}
+		} else {
+			rc = mdb_cursor_count( cursor, &n );
+			if ( rc == 0 )
+				*count = n;
+		}
+	} else if ( rc == MDB_NOTFOUND ) {
+		*count = 0;
+		rc = 0;
+	}
+
+	mdb_cursor_close( cursor );
+	return rc;
+}
+
+/*
+ * Move the IDs of a key that has outgrown the index into a bitmap,
+ * along with id. Returns MDB_BAD_VALSIZE if the key can't have one.
+ */
+static int
+mdb_idl_to_bitmap(
+	BackendDB	*be,
+	MDB_cursor	*cursor,
+	MDB_val		*skey,
+	ID			id,
+	ID			*count )
+{
+	MDB_val key = *skey, data;
+	ID marker[3], n;
+	int j, rc;
+
+	rc = mdb_bitmap_create( be, cursor, &key, &n );
+	if ( rc == 0 ) {
+		rc = mdb_bitmap_add( be, mdb_cursor_txn( cursor ),
+			mdb_cursor_dbi( cursor ), skey, id, &n );
+		if ( rc == MDB_KEYEXIST )
+			rc = 0;
+	}
+	if ( rc )
+		return rc;
+
+	/* replace the IDs with the marker */
+	key = *skey;
+	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
+	if ( rc == 0 )
+		rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+	marker[0] = 0;
+	marker[1] = 1;
+	marker[2] = NOID;
+	data.mv_size = sizeof(ID);
+	for ( j = 0; j < 3 && rc == 0; j++ ) {
+		data.mv_data = &marker[j];
+		rc = mdb_cursor_put( cursor, skey, &data, 0 );
+	}
+	*count = n;
+	return rc;
+}
+
 int
 mdb_idl_insert_keys(
 	BackendDB	*be,
@@ -397,11 +512,12 @@ mdb_idl_insert_keys(
 	ID			id )
 {
 	struct mdb_info *mdb = be->be_private;
-	MDB_val key, data;
-	ID lo, hi, *i;
+	MDB_val key, data, skey;
+	ID lo, hi, *i, ocount;
 	char *err;
 	int	rc = 0, k;
 	unsigned int flag = MDB_NODUPDATA;
+	mdb_ixupdate iu;
 #ifndef	MISALIGNED_OK
 	int kbuf[2];
 #endif
@@ -415,6 +531,7 @@ mdb_idl_insert_keys(
 
 	assert( id != NOID );
 
+	mdb_ixstat_begin( &iu, cursor );
 #ifndef MISALIGNED_OK
 	if (keys[0].bv_len & ALIGNER)
 		kbuf[1] = 0;
@@ -434,6 +551,7 @@ mdb_idl_insert_keys(
 		key.mv_size = keys[k].bv_len;
 		key.mv_data = keys[k].bv_val;
 	}
+	skey = key;
 	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
 	err = "c_get";
 	if ( rc == 0 ) {
@@ -447,8 +565,16 @@ mdb_idl_insert_keys(
 				err = "c_count";
 				goto fail;
 			}
-			if ( count >= MDB_IDL_DB_MAX ) {
-			/* No room, convert to a range */
+			if ( count >= MDB_IDL_DB_MAX && ( rc = mdb_idl_to_bitmap( be,
+				cursor, &skey, id, &ocount )) != MDB_BAD_VALSIZE ) {
+			/* No room, convert to a bitmap */
+				if ( rc != 0 ) {
+					err = "bitmap";
+					goto fail;
+				}
+				mdb_ixstat_update( be, &iu, &skey, count, ocount );
+			} else if ( count >= MDB_IDL_DB_MAX ) {
+			/* Key too long for a bitmap, convert to a range */
 				lo = *i;
 				rc = mdb_cursor_get( cursor, &key, &data, MDB_LAST_DUP );
 				if ( rc != 0 && rc != MDB_NOTFOUND ) {
@@ -490,12 +616,26 @@ mdb_idl_insert_keys(
 					err = "c_put hi";
 					goto fail;
 				}
+				mdb_ixstat_update( be, &iu, &skey, count, NOID );
 			} else {
 			/* There's room, just store it */
 				if (id == mdb->mi_nextid)
 					flag |= MDB_APPENDDUP;
+				ocount = count;
 				goto put1;
 			}
+		} else if ( i[2] == NOID ) {
+			/* It's a bitmap, add to it */
+			rc = mdb_bitmap_add( be, mdb_cursor_txn( cursor ),
+				mdb_cursor_dbi( cursor ), &skey, id, &ocount );
+			if ( rc == MDB_KEYEXIST ) {
+				rc = 0;
+			} else if ( rc != 0 ) {
+				err = "bitmap add";
+				goto fail;
+			} else {
+				mdb_ixstat_update( be, &iu, &skey, ocount-1, ocount );
+			}
 		} else {
 			/* It's a range, see if we need to rewrite
 			 * the boundaries
@@ -529,15 +669,18 @@ mdb_idl_insert_keys(
 		}
 	} else if ( rc == MDB_NOTFOUND ) {
 		flag &= ~MDB_APPENDDUP;
+		ocount = 0;
 put1:	data.mv_data = &id;
 		data.mv_size = sizeof(ID);
 		rc = mdb_cursor_put( cursor, &key, &data, flag );
 		/* Don't worry if it's already there */
-		if ( rc == MDB_KEYEXIST )
+		if ( rc == MDB_KEYEXIST ) {
 			rc = 0;
-		if ( rc ) {
+		} else if ( rc ) {
 			err = "c_put id";
 			goto fail;
+		} else {
+			mdb_ixstat_update( be, &iu, &skey, ocount, ocount+1 );
 		}
 	} else {
 		/* initial c_get failed, nothing was done */
@@ -547,6 +690,8 @@ fail:
 		break;
 	}
 	}
+	if ( rc == 0 )
+		rc = mdb_ixstat_end( be, &iu );
 	return rc;
 }
 
@@ -558,9 +703,10 @@ mdb_idl_delete_keys(
 	ID			id )
 {
 	int	rc = 0, k;
-	MDB_val key, data;
+	MDB_val key, data, skey;
 	ID lo, hi, tmp, *i;
 	char *err;
+	mdb_ixupdate iu;
 #ifndef	MISALIGNED_OK
 	int kbuf[2];
 #endif
@@ -573,6 +719,7 @@ mdb_idl_delete_keys(
 	}
 	assert( id != NOID );
 
+	mdb_ixstat_begin( &iu, cursor );
 #ifndef MISALIGNED_OK
 	if (keys[0].bv_len & ALIGNER)
 		kbuf[1] = 0;
@@ -592,6 +739,7 @@ mdb_idl_delete_keys(
 		key.mv_size = keys[k].bv_len;
 		key.mv_data = keys[k].bv_val;
 	}
+	skey = key;
 	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
 	err = "c_get";
 	if ( rc == 0 ) {
@@ -599,17 +747,43 @@ mdb_idl_delete_keys(
 		i = data.mv_data;
 		if ( tmp != 0 ) {
 			/* Not a range, just delete it */
+			size_t count;
 			data.mv_data = &id;
 			rc = mdb_cursor_get( cursor, &key, &data, MDB_GET_BOTH );
 			if ( rc != 0 ) {
 				err = "c_get id";
 				goto fail;
 			}
+			rc = mdb_cursor_count( cursor, &count );
+			if ( rc != 0 ) {
+				err = "c_count";
+				goto fail;
+			}
 			rc = mdb_cursor_del( cursor, 0 );
 			if ( rc != 0 ) {
 				err = "c_del id";
 				goto fail;
 			}
+			mdb_ixstat_update( be, &iu, &skey, count, count-1 );
+		} else if ( i[2] == NOID ) {
+			/* It's a bitmap, remove from it */
+			rc = mdb_bitmap_del( be, mdb_cursor_txn( cursor ),
+				mdb_cursor_dbi( cursor ), &skey, id, &hi );
+			if ( rc != 0 ) {
+				err = "bitmap del";
+				goto fail;
+			}
+			if ( !hi ) {
+				key = skey;
+				rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
+				if ( rc == 0 )
+					rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+				if ( rc != 0 ) {
+					err = "c_del bitmap";
+					goto fail;
+				}
+			}
+			mdb_ixstat_update( be, &iu, &skey, hi+1, hi );
 		} else {
 			/* It's a range, see if we need to rewrite
 			 * the boundaries
@@ -630,6 +804,7 @@ mdb_idl_delete_keys(
 						err = "c_del dup";
 						goto fail;
 					}
+					mdb_ixstat_update( be, &iu, &skey, NOID, 0 );
 				} else {
 					/* position on lo */
 					rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_DUP );
@@ -662,6 +837,8 @@ fail:
 		}
 	}
 	}
+	if ( rc == 0 )
+		rc = mdb_ixstat_end( be, &iu );
 	return rc;
 }
 
@@ -674,9 +851,8 @@ mdb_idl_intersection(
 	ID *a,
 	ID *b )
 {
-	ID ida, idb;
 	ID idmax, idmin;
-	ID cursora = 0, cursorb = 0, cursorc;
+	ID cursora, cursorb, cursorc;
 	int swap = 0;
 
 	if ( MDB_IDL_IS_ZERO( a ) || MDB_IDL_IS_ZERO( b ) ) {
@@ -726,26 +902,18 @@ mdb_idl_intersection(
 		goto done;
 	}
 
-	/* Fine, do the intersection one element at a time.
-	 * First advance to idmin in both IDLs.
-	 */
-	cursora = cursorb = idmin;
-	ida = mdb_idl_first( a, &cursora );
-	idb = mdb_idl_first( b, &cursorb );
-	cursorc = 0;
-
-	while( ida <= idmax || idb <= idmax ) {
-		if( ida == idb ) {
-			a[++cursorc] = ida;
-			ida = mdb_idl_next( a, &cursora );
-			idb = mdb_idl_next( b, &cursorb );
-		} else if ( ida < idb ) {
-			ida = mdb_idl_next( a, &cursora );
-		} else {
-			idb = mdb_idl_next( b, &cursorb );
-		}
+	if ( MDB_IDL_IS_RANGE( b ) ) {
+		/* Keep the part of the list within idmin to idmax */
+		cursora = mdb_idl_search( a, idmin );
+		cursorb = mdb_idl_search( a, idmax );
+		if ( cursorb > a[0] || a[cursorb] > idmax )
+			cursorb--;
+		cursorc = cursorb - cursora + 1;
+		AC_MEMCPY( a+1, a+cursora, cursorc * sizeof(ID) );
+		a[0] = cursorc;
+	} else {
+		a[0] = lutil_idset_intersect( a+1, a[0], b+1, b[0] );
 	}
-	a[0] = cursorc;
 done:
 	if (swap)
 		MDB_IDL_CPY( b, a );
@@ -783,6 +951,15 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 		return 0;
 	}
 
+	if ( a[0] + b[0] <= MDB_IDL_UM_MAX ) {
+		/* The distinct elements of a are cat'd to b,
+		 * then both are merged into a
+		 */
+		cursorc = lutil_idset_difference( a+1, a[0], b+1, b[0], b+b[0]+1 );
+		a[0] = lutil_idset_merge( b+1, b[0], b+b[0]+1, cursorc, a+1 );
+		return 0;
+	}
+
 	ida = mdb_idl_first( a, &cursora );
 	idb = mdb_idl_first( b, &cursorb );
 
@@ -826,7 +1003,6 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 }
 
 
-#if 0
 /*
  * mdb_idl_notin - return a intersection ~b (or a minus b)
  */
@@ -836,9 +1012,6 @@ mdb_idl_notin(
 	ID	*b,
 	ID *ids )
 {
-	ID ida, idb;
-	ID cursora = 0, cursorb = 0;
-
 	if( MDB_IDL_IS_ZERO( a ) ||
 		MDB_IDL_IS_ZERO( b ) ||
 		MDB_IDL_IS_RANGE( b ) )
@@ -852,33 +1025,10 @@ mdb_idl_notin(
 		return 0;
 	}
 
-	ida = mdb_idl_first( a, &cursora ),
-	idb = mdb_idl_first( b, &cursorb );
-
-	ids[0] = 0;
-
-	while( ida != NOID ) {
-		if ( idb == NOID ) {
-			/* we could shortcut this */
-			ids[++ids[0]] = ida;
-			ida = mdb_idl_next( a, &cursora );
-
-		} else if ( ida < idb ) {
-			ids[++ids[0]] = ida;
-			ida = mdb_idl_next( a, &cursora );
-
-		} else if ( ida > idb ) {
-			idb = mdb_idl_next( b, &cursorb );
-
-		} else {
-			ida = mdb_idl_next( a, &cursora );
-			idb = mdb_idl_next( b, &cursorb );
-		}
-	}
+	ids[0] = lutil_idset_difference( a+1, a[0], b+1, b[0], ids+1 );
 
 	return 0;
 }
-#endif
 
 ID mdb_idl_first( ID *ids, ID *cursor )
 {
@@ -61,6 +61,22 @@
 #define MDB_IDL_ID( mdb, ids, id ) MDB_IDL_RANGE( ids, id, NOID )
 #define MDB_IDL_ALL( ids ) MDB_IDL_RANGE( ids, 1, NOID )
 
+/* Keys that outgrow MDB_IDL_DB_MAX become compressed bitmaps. In the
+ * index they are denoted by the dups 0, 1, NOID, which versions without
+ * bitmaps read as a range of all IDs. The IDs are kept in the bmap
+ * database, one container per 2^16 IDs, keyed by
+ * <index name> 0 <key length> <key> <big-endian ID>>16, after the count
+ * of IDs keyed by <index name> 0 <key length> <key>.  A container holds
+ * either a sorted array of the big-endian low 16 bits of its IDs, or
+ * once it has more than MDB_BM_ARRAY_MAX IDs, a bitmap of them.
+ * Fetches and combinations are exact up to MDB_IDL_UM_MAX IDs, bigger
+ * ones come back as the range they span.
+ */
+#define MDB_BM_SHIFT		16
+#define MDB_BM_CHUNK		(1<<MDB_BM_SHIFT)	/* IDs per container */
+#define MDB_BM_BYTES		(MDB_BM_CHUNK/8)	/* size of a bitmap container */
+#define MDB_BM_ARRAY_MAX	4095	/* arrays are shorter than bitmaps */
+
 #define MDB_IDL_FIRST( ids )	( (ids)[1] )
 #define MDB_IDL_LLAST( ids )	( (ids)[(ids)[0]] )
 #define MDB_IDL_LAST( ids )		( MDB_IDL_IS_RANGE(ids) \
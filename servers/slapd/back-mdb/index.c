@@ -28,6 +28,9 @@
 static char presence_keyval[] = {0,0,0,0,0};
 static struct berval presence_key[2] = {BER_BVC(presence_keyval), BER_BVNULL};
 
+/* the OpExtra key of a key collector */
+static char ixkeys_key;
+
 AttrInfo *mdb_index_mask(
 	Backend *be,
 	AttributeDescription *desc,
@@ -161,6 +164,183 @@ done:
 	return LDAP_SUCCESS;
 }
 
+/* Gather the keys the indexer adds for op in ik instead of storing
+ * them, until mdb_ixkeys_stop().
+ */
+void
+mdb_ixkeys_start( Operation *op, mdb_ixkeys *ik )
+{
+	memset( ik, 0, sizeof( *ik ));
+	ik->ix_oe.oe_key = &ixkeys_key;
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &ik->ix_oe, oe_next );
+}
+
+mdb_ixkeys *
+mdb_ixkeys_get( Operation *op )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == &ixkeys_key )
+			return (mdb_ixkeys *)oex;
+	}
+	return NULL;
+}
+
+int
+mdb_ixkeys_add(
+	mdb_ixkeys *ik,
+	AttrInfo *ai,
+	MDB_dbi dbi,
+	struct berval *keys,
+	ID id )
+{
+	mdb_ixkey *k;
+	int i;
+
+	for ( i = 0; !BER_BVISNULL( &keys[i] ); i++ ) {
+		if ( ik->ix_nkeys == ik->ix_maxkeys ) {
+			ik->ix_maxkeys = ik->ix_maxkeys ? 2 * ik->ix_maxkeys : 1024;
+			ik->ix_keys = ch_realloc( ik->ix_keys,
+				ik->ix_maxkeys * sizeof( mdb_ixkey ));
+		}
+		if ( ik->ix_len + keys[i].bv_len > ik->ix_size ) {
+			ik->ix_size = ik->ix_size ? 2 * ik->ix_size : 16384;
+			if ( ik->ix_size < ik->ix_len + keys[i].bv_len )
+				ik->ix_size = ik->ix_len + keys[i].bv_len;
+			ik->ix_buf = ch_realloc( ik->ix_buf, ik->ix_size );
+		}
+		k = &ik->ix_keys[ik->ix_nkeys++];
+		k->ik_ai = ai;
+		k->ik_dbi = dbi;
+		k->ik_id = id;
+		k->ik_off = ik->ix_len;
+		k->ik_len = keys[i].bv_len;
+		memcpy( ik->ix_buf + ik->ix_len, keys[i].bv_val, keys[i].bv_len );
+		ik->ix_len += keys[i].bv_len;
+	}
+	return 0;
+}
+
+int
+mdb_ixkey_cmp( const void *v1, const void *v2 )
+{
+	const mdb_ixkey *k1 = v1, *k2 = v2;
+	unsigned len;
+	int rc;
+
+	if ( k1->ik_dbi != k2->ik_dbi )
+		return k1->ik_dbi < k2->ik_dbi ? -1 : 1;
+	len = k1->ik_len < k2->ik_len ? k1->ik_len : k2->ik_len;
+	rc = memcmp( k1->ik_key, k2->ik_key, len );
+	if ( rc )
+		return rc;
+	if ( k1->ik_len != k2->ik_len )
+		return k1->ik_len < k2->ik_len ? -1 : 1;
+	if ( k1->ik_id != k2->ik_id )
+		return k1->ik_id < k2->ik_id ? -1 : 1;
+	return 0;
+}
+
+/* Sort the keys gathered so far by database, key and ID */
+void
+mdb_ixkeys_sort( mdb_ixkeys *ik )
+{
+	int i;
+
+	for ( i = 0; i < ik->ix_nkeys; i++ )
+		ik->ix_keys[i].ik_key = ik->ix_buf + ik->ix_keys[i].ik_off;
+	if ( ik->ix_nkeys > 1 )
+		qsort( ik->ix_keys, ik->ix_nkeys, sizeof( mdb_ixkey ), mdb_ixkey_cmp );
+}
+
+/* Stop gathering, and sort the keys */
+void
+mdb_ixkeys_stop( Operation *op, mdb_ixkeys *ik )
+{
+	LDAP_SLIST_REMOVE( &op->o_extra, &ik->ix_oe, OpExtra, oe_next );
+	mdb_ixkeys_sort( ik );
+}
+
+/* Store the sorted keys, except those of the entries in the IDL skip */
+int
+mdb_ixkeys_store( Operation *op, MDB_txn *txn, mdb_ixkeys *ik, ID *skip )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc = NULL;
+	MDB_val key;
+	struct berval keys[2];
+	mdb_ixkey *k, *prev = NULL;
+	char *buf = NULL;
+	int i, rc = 0, maxkey = 0;
+
+	BER_BVZERO( &keys[1] );
+	for ( i = 0; i < ik->ix_nkeys; i++ ) {
+		k = &ik->ix_keys[i];
+		if ( skip[0] && skip[ mdb_idl_search( skip, k->ik_id ) ] == k->ik_id )
+			continue;
+		if ( prev && mdb_ixkey_cmp( prev, k ) == 0 )
+			continue;
+		if ( !prev || prev->ik_dbi != k->ik_dbi ) {
+			if ( mc )
+				mdb_cursor_close( mc );
+			rc = mdb_cursor_open( txn, k->ik_dbi, &mc );
+			if ( rc ) {
+				mc = NULL;
+				break;
+			}
+		}
+		prev = k;
+		if ( k->ik_ai ) {
+			if ( !buf ) {
+				maxkey = mdb_env_get_maxkeysize( mdb->mi_dbenv );
+				buf = op->o_tmpalloc( 3 * maxkey, op->o_tmpmemctx );
+			}
+			key.mv_data = k->ik_key;
+			key.mv_size = k->ik_len;
+			rc = mdb_order_put( txn, k->ik_ai, mc, &key, k->ik_id,
+				SLAP_INDEX_ADD_OP, buf, maxkey );
+		} else {
+			keys[0].bv_val = k->ik_key;
+			keys[0].bv_len = k->ik_len;
+			rc = mdb_idl_insert_keys( op->o_bd, mc, keys, k->ik_id );
+		}
+		if ( rc )
+			break;
+	}
+	if ( mc )
+		mdb_cursor_close( mc );
+	if ( buf )
+		op->o_tmpfree( buf, op->o_tmpmemctx );
+	return rc;
+}
+
+void
+mdb_ixkeys_free( mdb_ixkeys *ik )
+{
+	ch_free( ik->ix_keys );
+	ch_free( ik->ix_buf );
+	ik->ix_keys = NULL;
+	ik->ix_buf = NULL;
+	ik->ix_nkeys = ik->ix_maxkeys = 0;
+	ik->ix_len = ik->ix_size = 0;
+}
+
+static int
+indexer_keys(
+	Operation *op,
+	mdb_ixkeys *ik,
+	AttrInfo *ai,
+	MDB_cursor *mc,
+	mdb_idl_keyfunc *keyfunc,
+	struct berval *keys,
+	ID id )
+{
+	if ( ik )
+		return mdb_ixkeys_add( ik, NULL, ai->ai_dbi, keys, id );
+	return keyfunc( op->o_bd, mc, keys, id );
+}
+
 static int indexer(
 	Operation *op,
 	MDB_txn *txn,
@@ -176,11 +356,15 @@ static int indexer(
 	struct berval *keys;
 	MDB_cursor *mc = ai->ai_cursor;
 	mdb_idl_keyfunc *keyfunc;
+	mdb_ixkeys *ik = NULL;
 	char *err;
 
 	assert( mask != 0 );
 
-	if ( !mc ) {
+	if ( opid == SLAP_INDEX_ADD_OP )
+		ik = mdb_ixkeys_get( op );
+
+	if ( !mc && !ik ) {
 		err = "c_open";
 		rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
 		if ( rc ) goto done;
@@ -202,7 +386,7 @@ static int indexer(
 		keyfunc = mdb_idl_delete_keys;
 
 	if( IS_SLAP_INDEX( mask, SLAP_INDEX_PRESENT ) ) {
-		rc = keyfunc( op->o_bd, mc, presence_key, id );
+		rc = indexer_keys( op, ik, ai, mc, keyfunc, presence_key, id );
 		if( rc ) {
 			err = "presence";
 			goto done;
@@ -218,7 +402,7 @@ static int indexer(
 			atname, vals, &keys, op->o_tmpmemctx );
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
-			rc = keyfunc( op->o_bd, mc, keys, id );
+			rc = indexer_keys( op, ik, ai, mc, keyfunc, keys, id );
 			ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if ( rc ) {
 				err = "equality";
@@ -237,7 +421,7 @@ static int indexer(
 			atname, vals, &keys, op->o_tmpmemctx );
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
-			rc = keyfunc( op->o_bd, mc, keys, id );
+			rc = indexer_keys( op, ik, ai, mc, keyfunc, keys, id );
 			ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if ( rc ) {
 				err = "approx";
@@ -257,7 +441,7 @@ static int indexer(
 			atname, vals, &keys, op->o_tmpmemctx );
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
-			rc = keyfunc( op->o_bd, mc, keys, id );
+			rc = indexer_keys( op, ik, ai, mc, keyfunc, keys, id );
 			ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if( rc ) {
 				err = "substr";
@@ -268,6 +452,22 @@ static int indexer(
 		rc = LDAP_SUCCESS;
 	}
 
+	if( IS_SLAP_INDEX( mask, SLAP_INDEX_NGRAM ) ) {
+		rc = mdb_ngram_values( op, txn, ai, vals, id, opid );
+		if( rc ) {
+			err = "ngram";
+			goto done;
+		}
+	}
+
+	if( IS_SLAP_INDEX( mask, SLAP_INDEX_ORDERING ) ) {
+		rc = mdb_order_values( op, txn, ai, vals, id, opid );
+		if( rc ) {
+			err = "ordering";
+			goto done;
+		}
+	}
+
 done:
 	if ( !(slapMode & SLAP_TOOL_QUICK))
 		mdb_cursor_close( mc );
@@ -296,6 +496,7 @@ static int index_at_values(
 	slap_mask_t mask = 0;
 	int ixop = opid;
 	AttrInfo *ai = NULL;
+	AttributeDescription *desc = ad;	/* NULL for supertypes */
 
 	if ( opid == MDB_INDEX_UPDATE_OP )
 		ixop = SLAP_INDEX_ADD_OP;
@@ -335,6 +536,9 @@ static int index_at_values(
 			 * just use the old mask.
 			 */
 				mask = ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask;
+			/* only the attribute itself is sorted on */
+			if ( desc != ad )
+				mask &= ~SLAP_INDEX_ORDERING;
 			if( mask ) {
 				rc = indexer( op, txn, ai, ad, &type->sat_cname,
 					vals, id, ixop, mask );
@@ -345,19 +549,21 @@ static int index_at_values(
 	}
 
 	if( tags->bv_len ) {
-		AttributeDescription *desc;
+		AttributeDescription *tdesc;
 
-		desc = ad_find_tags( type, tags );
-		if( desc ) {
-			ai = mdb_attr_mask( op->o_bd->be_private, desc );
+		tdesc = ad_find_tags( type, tags );
+		if( tdesc ) {
+			ai = mdb_attr_mask( op->o_bd->be_private, tdesc );
 
 			if( ai ) {
 				if ( opid == MDB_INDEX_UPDATE_OP )
 					mask = ai->ai_newmask & ~ai->ai_indexmask;
 				else
 					mask = ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask;
+				if ( desc != tdesc )
+					mask &= ~SLAP_INDEX_ORDERING;
 				if ( mask ) {
-					rc = indexer( op, txn, ai, desc, &desc->ad_cname,
+					rc = indexer( op, txn, ai, tdesc, &tdesc->ad_cname,
 						vals, id, ixop, mask );
 
 					if( rc ) {
@@ -459,11 +665,14 @@ int mdb_index_recrun(
 		ir = ir0 + i;
 		if ( !ir->ir_ai ) continue;
 		while (( al = ir->ir_attrs )) {
+			slap_mask_t mask = ir->ir_ai->ai_indexmask;
 			ir->ir_attrs = al->next;
-			rc = indexer( op, txn, ir->ir_ai, ir->ir_ai->ai_desc,
-				&ir->ir_ai->ai_desc->ad_type->sat_cname,
-				al->attr->a_nvals, id, SLAP_INDEX_ADD_OP,
-				ir->ir_ai->ai_indexmask );
+			if ( al->attr->a_desc != ir->ir_ai->ai_desc )
+				mask &= ~SLAP_INDEX_ORDERING;
+			if ( mask )
+				rc = indexer( op, txn, ir->ir_ai, ir->ir_ai->ai_desc,
+					&ir->ir_ai->ai_desc->ad_type->sat_cname,
+					al->attr->a_nvals, id, SLAP_INDEX_ADD_OP, mask );
 			free( al );
 			if ( rc ) break;
 		}
@@ -569,6 +778,11 @@ mdb_index_entry(
 		}
 	}
 
+	/* and file it under each ordering it has no value for */
+	rc = mdb_order_entry( op, txn, opid, e );
+	if( rc != LDAP_SUCCESS )
+		return rc;
+
 	Debug( LDAP_DEBUG_TRACE, "<= index_entry_%s( %ld, \"%s\" ) success\n",
 		opid == SLAP_INDEX_DELETE_OP ? "del" : "add",
 		(long) e->e_id, e->e_dn ? e->e_dn : "" );
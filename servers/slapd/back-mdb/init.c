@@ -31,6 +31,8 @@ static const struct berval mdmi_databases[] = {
 	BER_BVC("ad2i"),
 	BER_BVC("dn2i"),
 	BER_BVC("id2e"),
+	BER_BVC("ixst"),
+	BER_BVC("bmap"),
 	BER_BVNULL
 };
 
@@ -63,6 +65,18 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_mapsize = DEFAULT_MAPSIZE;
 	mdb->mi_rtxn_size = DEFAULT_RTXN_SIZE;
+	mdb->mi_bulk_mem = DEFAULT_BULK_MEM;
+	mdb->mi_pcursor_idle = DEFAULT_PCURSOR_IDLE;
+	mdb->mi_index_threads = DEFAULT_INDEX_THREADS;
+	mdb->mi_group_max = DEFAULT_GROUP_MAX;
+
+	mdb_cache_init( &mdb->mi_cache );
+	ldap_pvt_thread_mutex_init( &mdb->mi_pcursor_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_oindex_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_backup_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_group_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_group_cond );
+	ldap_pvt_thread_mutex_init( &mdb->mi_ixstat_mutex );
 
 	be->be_private = mdb;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs;
@@ -172,6 +186,16 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 	if ( slapMode & SLAP_TOOL_READONLY)
 		flags |= MDB_RDONLY;
 
+	/* paged search cursors take their read txns from thread to thread,
+	 * and a search opens the read txns of its helpers */
+	if (( slapMode & SLAP_SERVER_MODE ) &&
+		( mdb->mi_pcursor_max || mdb->mi_search_threads ))
+		flags |= MDB_NOTLS;
+
+	/* one thread opens the read txns of a threaded slapcat */
+	if (( slapMode & SLAP_TOOL_READONLY ) && slap_tool_thread_max > 1 )
+		flags |= MDB_NOTLS;
+
 	rc = mdb_env_open( mdb->mi_dbenv, dbhome,
 			flags, mdb->mi_dbenv_mode );
 
@@ -198,6 +222,23 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		if( i == MDB_ID2ENTRY ) {
 			if ( !(slapMode & (SLAP_TOOL_READMAIN|SLAP_TOOL_READONLY) ))
 				flags |= MDB_CREATE;
+		} else if ( i == MDB_IXSTAT ) {
+			/* keyed by index name; only needed to update indexes */
+			flags = 0;
+			if ( slapMode & SLAP_TOOL_READONLY )
+				continue;
+			flags |= MDB_CREATE;
+		} else if ( i == MDB_BITMAP ) {
+			/* keyed by index name, key and ID. Only a database
+			 * that has no entries yet gets one, so that the
+			 * indices of an older database stay as it wrote them.
+			 */
+			MDB_stat st;
+			flags = 0;
+			if ( !(slapMode & SLAP_TOOL_READONLY) &&
+				mdb_stat( txn, mdb->mi_dbis[MDB_ID2ENTRY], &st ) == 0 &&
+				!st.ms_entries )
+				flags |= MDB_CREATE;
 		} else {
 			if ( i == MDB_DN2ID )
 				flags |= MDB_DUPSORT;
@@ -210,6 +251,12 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			flags,
 			&mdb->mi_dbis[i] );
 
+		/* written by a version without bitmaps */
+		if ( rc == MDB_NOTFOUND && i == MDB_BITMAP ) {
+			rc = 0;
+			continue;
+		}
+
 		if ( rc != 0 ) {
 			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
 				"mdb_dbi_open(%s/%s) failed: %s (%d).", 
@@ -292,6 +339,13 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	mdb_env_get_flags( mdb->mi_dbenv, &flags );
+	if ( flags & MDB_NOTLS ) {
+		mdb->mi_flags |= MDB_PCURSORS;
+		mdb_pcursor_clamp( be );
+		mdb_pcursor_schedule( be );
+	}
+
 	mdb->mi_flags |= MDB_IS_OPEN;
 
 	return 0;
@@ -310,7 +364,11 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 	/* monitor handling */
 	(void)mdb_monitor_db_close( be );
 
-	mdb->mi_flags &= ~MDB_IS_OPEN;
+	mdb->mi_flags &= ~(MDB_IS_OPEN|MDB_PCURSORS);
+
+	mdb_pcursor_schedule( be );
+	mdb_pcursor_release_all( mdb );
+	mdb_cache_release_all( &mdb->mi_cache );
 
 	if( mdb->mi_dbenv ) {
 		mdb_reader_flush( mdb->mi_dbenv );
@@ -367,6 +425,13 @@ mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 	if( mdb->mi_dbenv_home ) ch_free( mdb->mi_dbenv_home );
 
 	mdb_attr_index_destroy( mdb );
+	mdb_cache_destroy( &mdb->mi_cache );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_pcursor_mutex );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_oindex_mutex );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_backup_mutex );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_group_mutex );
+	ldap_pvt_thread_cond_destroy( &mdb->mi_group_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_ixstat_mutex );
 
 	ch_free( mdb );
 	be->be_private = NULL;
@@ -389,6 +454,9 @@ mdb_back_initialize(
 		LDAP_CONTROL_POST_READ,
 		LDAP_CONTROL_SUBENTRIES,
 		LDAP_CONTROL_X_PERMISSIVE_MODIFY,
+#ifdef SLAP_CONTROL_X_COUNT
+		LDAP_CONTROL_X_COUNT,
+#endif
 #ifdef LDAP_X_TXN
 		LDAP_CONTROL_X_TXN_SPEC,
 #endif
@@ -437,6 +505,9 @@ mdb_back_initialize(
 			": %s\n", version, 0, 0 );
 	}
 
+	/* time the ID set kernels before there are threads to share them */
+	lutil_idset_select( LUTIL_IDSET_AUTO );
+
 	bi->bi_open = 0;
 	bi->bi_close = 0;
 	bi->bi_config = 0;
@@ -460,6 +531,8 @@ mdb_back_initialize(
 	bi->bi_op_txn = mdb_txn;
 
 	bi->bi_extended = mdb_extended;
+	if ( mdb_backup_init() )
+		return -1;
 
 	bi->bi_chk_referrals = 0;
 	bi->bi_operational = mdb_operational;
@@ -483,9 +556,10 @@ mdb_back_initialize(
 	bi->bi_tool_dn2id_get = mdb_tool_dn2id_get;
 	bi->bi_tool_entry_modify = mdb_tool_entry_modify;
 	bi->bi_tool_entry_delete = mdb_tool_entry_delete;
+	bi->bi_tool_entry_range = mdb_tool_entry_range;
 
 	bi->bi_connection_init = 0;
-	bi->bi_connection_destroy = 0;
+	bi->bi_connection_destroy = mdb_connection_destroy;
 
 	rc = mdb_back_init_cf( bi );
 
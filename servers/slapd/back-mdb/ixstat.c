@@ -0,0 +1,376 @@
+/* ixstat.c - index key statistics for back-mdb */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/*
+ * Every index database has one record in the ixst database, keyed by
+ * the name of the index database.  It is rewritten in the same txn as
+ * the index keys it describes, so it is exactly as current as the
+ * index in any snapshot.  Databases created before the statistics
+ * existed get theirs collected by a scan the first time they're
+ * opened for writing.
+ */
+
+static void
+mdb_ixstat_name( AttrInfo *ai, MDB_val *key )
+{
+	key->mv_data = ai->ai_desc->ad_type->sat_cname.bv_val;
+	key->mv_size = ai->ai_desc->ad_type->sat_cname.bv_len;
+}
+
+static int
+mdb_ixstat_bucket( ID count )
+{
+	int b;
+
+	for ( b = 0; count > 1 && b < MDB_IXSTAT_BUCKETS-1; b++ )
+		count >>= 1;
+	return b;
+}
+
+/* The most IDs any single key of the index can hold */
+static ID
+mdb_ixstat_max( mdb_ixstat *st )
+{
+	int b;
+
+	if ( st->is_nranges )
+		return NOID;
+	for ( b = MDB_IXSTAT_BUCKETS-1; b >= 0; b-- ) {
+		if ( st->is_hist[b] ) {
+			if ( b == MDB_IXSTAT_BUCKETS-1 )
+				return NOID;
+			return ((ID)2 << b) - 1;
+		}
+	}
+	return 0;
+}
+
+static void
+mdb_ixstat_heavy( mdb_ixstat *st, MDB_val *key, ID count )
+{
+	mdb_ixheavy *ih, *min = NULL;
+	size_t klen = key->mv_size;
+	int i;
+
+	if ( klen > MDB_IXSTAT_KEYLEN )
+		klen = MDB_IXSTAT_KEYLEN;
+
+	for ( i = 0; i < MDB_IXSTAT_HEAVY; i++ ) {
+		ih = &st->is_heavy[i];
+		if ( ih->ih_count && ih->ih_klen == key->mv_size &&
+			!memcmp( ih->ih_key, key->mv_data, klen ))
+		{
+			ih->ih_count = count < MDB_IXSTAT_HEAVY_MIN ? 0 : count;
+			return;
+		}
+		/* free slots sort lowest, ranges highest */
+		if ( !min || ih->ih_count < min->ih_count )
+			min = ih;
+	}
+
+	if ( count >= MDB_IXSTAT_HEAVY_MIN && count > min->ih_count ) {
+		min->ih_count = count;
+		min->ih_klen = key->mv_size;
+		memset( min->ih_key, 0, sizeof( min->ih_key ));
+		memcpy( min->ih_key, key->mv_data, klen );
+	}
+}
+
+/* Account for a key going from ocount to ncount IDs.
+ * 0 means the key doesn't exist, NOID that it's a range.
+ * Bitmaps are counted like plain keys.
+ */
+static void
+mdb_ixstat_key( mdb_ixstat *st, MDB_val *key, ID ocount, ID ncount )
+{
+	int b;
+
+	if ( ocount == NOID ) {
+		if ( st->is_nranges )
+			st->is_nranges--;
+	} else if ( ocount ) {
+		b = mdb_ixstat_bucket( ocount );
+		if ( st->is_hist[b] )
+			st->is_hist[b]--;
+		st->is_nids -= ocount < st->is_nids ? ocount : st->is_nids;
+	}
+	if ( ncount == NOID ) {
+		st->is_nranges++;
+	} else if ( ncount ) {
+		st->is_hist[mdb_ixstat_bucket( ncount )]++;
+		st->is_nids += ncount;
+	}
+	if ( !ocount )
+		st->is_nkeys++;
+	else if ( !ncount && st->is_nkeys )
+		st->is_nkeys--;
+
+	if ( ocount >= MDB_IXSTAT_HEAVY_MIN || ncount >= MDB_IXSTAT_HEAVY_MIN )
+		mdb_ixstat_heavy( st, key, ncount );
+}
+
+int
+mdb_ixstat_get(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	mdb_ixstat *st )
+{
+	MDB_val key, data;
+	int rc;
+
+	if ( !mdb->mi_ixstat )
+		return MDB_NOTFOUND;
+
+	mdb_ixstat_name( ai, &key );
+	rc = mdb_get( txn, mdb->mi_ixstat, &key, &data );
+	if ( rc == 0 ) {
+		/* written by some other layout, recollect it */
+		if ( data.mv_size != sizeof( mdb_ixstat ))
+			return MDB_NOTFOUND;
+		memcpy( st, data.mv_data, sizeof( mdb_ixstat ));
+	}
+	return rc;
+}
+
+static int
+mdb_ixstat_put(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	mdb_ixstat *st )
+{
+	MDB_val key, data;
+
+	mdb_ixstat_name( ai, &key );
+	data.mv_data = st;
+	data.mv_size = sizeof( mdb_ixstat );
+	return mdb_put( txn, mdb->mi_ixstat, &key, &data, 0 );
+}
+
+/* Let the search code know how big keys may have become. The bound
+ * only ever grows while the database is open, so it also holds for
+ * readers on older snapshots.
+ */
+static void
+mdb_ixstat_bound( struct mdb_info *mdb, MDB_dbi dbi, ID max )
+{
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ixstat_mutex );
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		if ( mdb->mi_attrs[i]->ai_dbi == dbi &&
+			mdb->mi_attrs[i]->ai_maxcount < max )
+			mdb->mi_attrs[i]->ai_maxcount = max;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ixstat_mutex );
+}
+
+static void
+mdb_ixstat_setmax( struct mdb_info *mdb, AttrInfo *ai, ID max )
+{
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ixstat_mutex );
+	ai->ai_maxcount = max;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ixstat_mutex );
+}
+
+/* The most IDs any key of the index may have */
+ID
+mdb_ixstat_maxcount( struct mdb_info *mdb, AttrInfo *ai )
+{
+	ID max;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ixstat_mutex );
+	max = ai->ai_maxcount;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ixstat_mutex );
+
+	return max;
+}
+
+static int
+mdb_ixstat_scan( struct mdb_info *mdb, MDB_txn *txn, MDB_dbi dbi,
+	mdb_ixstat *st )
+{
+	MDB_cursor *mc;
+	MDB_val key, data;
+	ID first, count;
+	size_t n;
+	int rc;
+
+	memset( st, 0, sizeof( mdb_ixstat ));
+	rc = mdb_cursor_open( txn, dbi, &mc );
+	if ( rc )
+		return rc;
+
+	rc = mdb_cursor_get( mc, &key, &data, MDB_FIRST );
+	while ( rc == 0 ) {
+		memcpy( &first, data.mv_data, sizeof(ID) );
+		if ( first == 0 ) {
+			/* a range, or a bitmap that keeps its own count */
+			ID marker[2];
+			rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_DUP );
+			if ( rc == 0 ) {
+				memcpy( &marker[0], data.mv_data, sizeof(ID) );
+				rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_DUP );
+			}
+			if ( rc )
+				break;
+			memcpy( &marker[1], data.mv_data, sizeof(ID) );
+			count = NOID;
+			if ( marker[1] == NOID ) {
+				rc = mdb_bitmap_count( mdb, txn, dbi, &key, &count );
+				if ( rc )
+					break;
+			}
+		} else {
+			rc = mdb_cursor_count( mc, &n );
+			if ( rc )
+				break;
+			count = n;
+		}
+		mdb_ixstat_key( st, &key, 0, count );
+		rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_NODUP );
+	}
+	mdb_cursor_close( mc );
+
+	return rc == MDB_NOTFOUND ? 0 : rc;
+}
+
+/* Load the statistics of a newly opened index, collecting them first
+ * if the database doesn't have them yet.
+ */
+int
+mdb_ixstat_open(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai )
+{
+	mdb_ixstat st;
+	int rc;
+
+	rc = mdb_ixstat_get( mdb, txn, ai, &st );
+	if ( rc == MDB_NOTFOUND && mdb->mi_ixstat ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"mdb_ixstat_open: collecting key statistics of %s\n",
+			ai->ai_desc->ad_type->sat_cname.bv_val, 0, 0 );
+		rc = mdb_ixstat_scan( mdb, txn, ai->ai_dbi, &st );
+		if ( rc == 0 )
+			rc = mdb_ixstat_put( mdb, txn, ai, &st );
+	}
+	if ( rc == 0 )
+		mdb_ixstat_setmax( mdb, ai, mdb_ixstat_max( &st ));
+	return rc;
+}
+
+/* The index database was emptied */
+int
+mdb_ixstat_reset(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai )
+{
+	mdb_ixstat st;
+	int rc = 0;
+
+	if ( mdb->mi_ixstat ) {
+		memset( &st, 0, sizeof( st ));
+		rc = mdb_ixstat_put( mdb, txn, ai, &st );
+	}
+	if ( rc == 0 )
+		mdb_ixstat_setmax( mdb, ai, 0 );
+	return rc;
+}
+
+/* Recollect the statistics of an index that was written without them */
+int
+mdb_ixstat_rebuild(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai )
+{
+	mdb_ixstat st;
+	int rc;
+
+	if ( !mdb->mi_ixstat )
+		return 0;
+	rc = mdb_ixstat_scan( mdb, txn, ai->ai_dbi, &st );
+	if ( rc == 0 )
+		rc = mdb_ixstat_put( mdb, txn, ai, &st );
+	if ( rc == 0 )
+		mdb_ixstat_bound( mdb, ai->ai_dbi, mdb_ixstat_max( &st ));
+	return rc;
+}
+
+/*
+ * mdb_idl_insert_keys() and mdb_idl_delete_keys() report each key
+ * they change, and the record is written back once at the end.
+ */
+void
+mdb_ixstat_begin( mdb_ixupdate *iu, MDB_cursor *mc )
+{
+	iu->iu_cursor = mc;
+	iu->iu_ai = NULL;
+	iu->iu_state = 0;
+}
+
+void
+mdb_ixstat_update(
+	BackendDB *be,
+	mdb_ixupdate *iu,
+	MDB_val *key,
+	ID ocount,
+	ID ncount )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_dbi dbi;
+
+	if ( !iu->iu_state ) {
+		iu->iu_state = -1;
+		dbi = mdb_cursor_dbi( iu->iu_cursor );
+		iu->iu_ai = mdb_attr_dbi( mdb, dbi );
+		/* ngram keys are not planned from the statistics */
+		if ( iu->iu_ai && iu->iu_ai->ai_dbi == dbi && mdb_ixstat_get( mdb,
+			mdb_cursor_txn( iu->iu_cursor ), iu->iu_ai, &iu->iu_st ) == 0 )
+			iu->iu_state = 1;
+	}
+	if ( iu->iu_state > 0 )
+		mdb_ixstat_key( &iu->iu_st, key, ocount, ncount );
+}
+
+int
+mdb_ixstat_end( BackendDB *be, mdb_ixupdate *iu )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	int rc;
+
+	if ( iu->iu_state <= 0 )
+		return 0;
+
+	rc = mdb_ixstat_put( mdb, mdb_cursor_txn( iu->iu_cursor ),
+		iu->iu_ai, &iu->iu_st );
+	if ( rc == 0 )
+		mdb_ixstat_bound( mdb, iu->iu_ai->ai_dbi,
+			mdb_ixstat_max( &iu->iu_st ));
+	return rc;
+}
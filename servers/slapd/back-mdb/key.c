@@ -25,7 +25,7 @@
 #include "back-mdb.h"
 #include "idl.h"
 
-/* read a key */
+/* read a key; ids must hold an IDL of MDB_IDL_UM_SIZE */
 int
 mdb_key_read(
 	Backend	*be,
@@ -70,3 +70,82 @@ mdb_key_read(
 
 	return rc;
 }
+
+/* count the IDs of a key; *range is set if that is only the size
+ * of the range they were turned into */
+int
+mdb_key_count(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *count,
+	int *range
+)
+{
+	MDB_val key;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+
+	if (k->bv_len & ALIGNER) {
+		key.mv_size = sizeof(kbuf);
+		key.mv_data = kbuf;
+		kbuf[1] = 0;
+		memcpy(kbuf, k->bv_val, k->bv_len);
+	} else
+#endif
+	{
+		key.mv_size = k->bv_len;
+		key.mv_data = k->bv_val;
+	}
+
+	return mdb_idl_count_key( be, txn, dbi, &key, count, range );
+}
+
+/* intersect or unite the IDs of n keys, see mdb_bitmap_combine() */
+int
+mdb_key_combine(
+	Backend	*be,
+	MDB_txn *txn,
+	int ftype,
+	int n,
+	MDB_dbi *dbis,
+	struct berval *k,
+	int withids,
+	ID *ids,
+	ID *tmp
+)
+{
+	MDB_val *keys;
+	int i, rc;
+#ifndef MISALIGNED_OK
+	int *kbuf;
+#endif
+
+	keys = ch_malloc( n * ( sizeof(MDB_val) + 2 * sizeof(int) ));
+#ifndef MISALIGNED_OK
+	kbuf = (int *)(keys + n);
+#endif
+	for ( i = 0; i < n; i++ ) {
+#ifndef MISALIGNED_OK
+		if (k[i].bv_len & ALIGNER) {
+			keys[i].mv_size = 2 * sizeof(int);
+			keys[i].mv_data = kbuf + 2*i;
+			kbuf[2*i+1] = 0;
+			memcpy(keys[i].mv_data, k[i].bv_val, k[i].bv_len);
+		} else
+#endif
+		{
+			keys[i].mv_size = k[i].bv_len;
+			keys[i].mv_data = k[i].bv_val;
+		}
+	}
+
+	rc = mdb_bitmap_combine( be, txn, ftype, n, dbis, keys, withids,
+		ids, tmp );
+	ch_free( keys );
+
+	Debug( LDAP_DEBUG_TRACE, "<= mdb_key_combine: rc=%d %ld candidates\n",
+		rc, (long) MDB_IDL_N(ids), 0 );
+	return rc;
+}
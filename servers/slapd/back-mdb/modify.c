@@ -438,6 +438,16 @@ int mdb_modify_internal(
 		}
 	}
 
+	/* entries that gained or lost a sort attribute */
+	rc = mdb_order_modify( op, tid, e, save_attrs );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY,
+			"%s: ordering index update failure\n",
+			op->o_log_prefix, 0, 0 );
+		attrs_free( e->e_attrs );
+		e->e_attrs = save_attrs;
+	}
+
 	return rc;
 }
 
@@ -467,6 +477,9 @@ mdb_modify( Operation *op, SlapReply *rs )
 		return rs->sr_err;
 #endif
 
+	if ( mdb_group_usable( op, mdb ))
+		return mdb_group_op( op, rs, mdb_modify );
+
 	ctrls[num_ctrls] = NULL;
 
 	/* begin transaction */
@@ -679,7 +692,9 @@ return_results:
 #endif
 
 done:
-	slap_graduate_commit_csn( op );
+	/* a group commit sends the result later */
+	if ( !( moi->moi_flag & MOI_GROUPED ))
+		slap_graduate_commit_csn( op );
 
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
@@ -64,6 +64,9 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 		return rs->sr_err;
 #endif
 
+	if ( mdb_group_usable( op, mdb ))
+		return mdb_group_op( op, rs, mdb_modrdn );
+
 	ctrls[num_ctrls] = NULL;
 
 	/* begin transaction */
@@ -515,6 +518,8 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 			} else {
 				parent_is_leaf = 1;
 			}
+			/* don't let MDB_NOTFOUND leak into an outer txn's result */
+			rs->sr_err = LDAP_SUCCESS;
 		}
 		mdb_entry_return( op, p );
 		p = NULL;
@@ -595,7 +600,9 @@ return_results:
 	}
 
 done:
-	slap_graduate_commit_csn( op );
+	/* a group commit sends the result later */
+	if ( !( moi->moi_flag & MOI_GROUPED ))
+		slap_graduate_commit_csn( op );
 
 	if( new_ndn.bv_val != NULL ) op->o_tmpfree( new_ndn.bv_val, op->o_tmpmemctx );
 	if( new_dn.bv_val != NULL ) op->o_tmpfree( new_dn.bv_val, op->o_tmpmemctx );
@@ -32,6 +32,34 @@
 static ObjectClass		*oc_olmMDBDatabase;
 
 static AttributeDescription *ad_olmDbDirectory;
+static AttributeDescription *ad_olmDbIndexStats;
+static AttributeDescription *ad_olmDbEntryCacheEntries,
+	*ad_olmDbEntryCacheBytes, *ad_olmDbEntryCacheHits,
+	*ad_olmDbEntryCacheMisses, *ad_olmDbEntryCacheEvictions;
+static AttributeDescription *ad_olmDbIndexProgress, *ad_olmDbIndexRate,
+	*ad_olmDbIndexETA,
+	*ad_olmDbBackupProgress,
+	*ad_olmDbBackupRate;
+
+static int
+mdb_monitor_ixstat_entry_add(
+	struct mdb_info	*mdb,
+	Entry		*e );
+
+static int
+mdb_monitor_cache_entry_add(
+	struct mdb_info	*mdb,
+	Entry		*e );
+
+static int
+mdb_monitor_oindex_entry_add(
+	struct mdb_info	*mdb,
+	Entry		*e );
+
+static int
+mdb_monitor_backup_entry_add(
+	struct mdb_info	*mdb,
+	Entry		*e );
 
 #ifdef MDB_MONITOR_IDX
 static int
@@ -88,6 +116,94 @@ static struct {
 		&ad_olmDbNotIndexed },
 #endif /* MDB_MONITOR_IDX */
 
+	{ "( olmDatabaseAttributes:3 "
+		"NAME ( 'olmDbIndexStats' ) "
+		"DESC 'Key statistics of an attribute index' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexStats },
+
+	{ "( olmDatabaseAttributes:4 "
+		"NAME ( 'olmDbEntryCacheEntries' ) "
+		"DESC 'Number of entries in the entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbEntryCacheEntries },
+
+	{ "( olmDatabaseAttributes:5 "
+		"NAME ( 'olmDbEntryCacheBytes' ) "
+		"DESC 'Bytes used by the entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbEntryCacheBytes },
+
+	{ "( olmDatabaseAttributes:6 "
+		"NAME ( 'olmDbEntryCacheHits' ) "
+		"DESC 'Entries found in the entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbEntryCacheHits },
+
+	{ "( olmDatabaseAttributes:7 "
+		"NAME ( 'olmDbEntryCacheMisses' ) "
+		"DESC 'Entries looked for but not found in the entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbEntryCacheMisses },
+
+	{ "( olmDatabaseAttributes:8 "
+		"NAME ( 'olmDbEntryCacheEvictions' ) "
+		"DESC 'Entries evicted from the entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbEntryCacheEvictions },
+
+	{ "( olmDatabaseAttributes:9 "
+		"NAME ( 'olmDbIndexProgress' ) "
+		"DESC 'Entries indexed online and entries to index' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexProgress },
+
+	{ "( olmDatabaseAttributes:10 "
+		"NAME ( 'olmDbIndexRate' ) "
+		"DESC 'Entries indexed online per second' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexRate },
+
+	{ "( olmDatabaseAttributes:11 "
+		"NAME ( 'olmDbIndexETA' ) "
+		"DESC 'Estimated seconds until online indexing is complete' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexETA },
+
+	{ "( olmDatabaseAttributes:12 "
+		"NAME ( 'olmDbBackupProgress' ) "
+		"DESC 'Bytes of the online backup sent and estimated size' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbBackupProgress },
+
+	{ "( olmDatabaseAttributes:13 "
+		"NAME ( 'olmDbBackupRate' ) "
+		"DESC 'Bytes of the online backup sent per second' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbBackupRate },
+
 	{ NULL }
 };
 
@@ -105,6 +221,17 @@ static struct {
 #ifdef MDB_MONITOR_IDX
 			"$ olmDbNotIndexed "
 #endif /* MDB_MONITOR_IDX */
+			"$ olmDbIndexStats "
+			"$ olmDbEntryCacheEntries "
+			"$ olmDbEntryCacheBytes "
+			"$ olmDbEntryCacheHits "
+			"$ olmDbEntryCacheMisses "
+			"$ olmDbEntryCacheEvictions "
+			"$ olmDbIndexProgress "
+			"$ olmDbIndexRate "
+			"$ olmDbIndexETA "
+			"$ olmDbBackupProgress "
+			"$ olmDbBackupRate "
 			") )",
 		&oc_olmMDBDatabase },
 
@@ -124,6 +251,11 @@ mdb_monitor_update(
 	mdb_monitor_idx_entry_add( mdb, e );
 #endif /* MDB_MONITOR_IDX */
 
+	mdb_monitor_ixstat_entry_add( mdb, e );
+	mdb_monitor_cache_entry_add( mdb, e );
+	mdb_monitor_oindex_entry_add( mdb, e );
+	mdb_monitor_backup_entry_add( mdb, e );
+
 	return SLAP_CB_CONTINUE;
 }
 
@@ -456,6 +588,281 @@ mdb_monitor_db_destroy( BackendDB *be )
 	return 0;
 }
 
+/*
+ * One value per index database:
+ * <attr>#keys=<n>#ranges=<n>#ids=<n>#sizes=<2^k>:<n>,...#heavy=<key>:<n>,...
+ * where sizes counts the keys holding 2^k up to 2^(k+1)-1 IDs and
+ * heavy lists the biggest keys in hex.
+ */
+static int
+mdb_monitor_ixstat_entry_add(
+	struct mdb_info	*mdb,
+	Entry		*e )
+{
+	BerVarray	vals = NULL;
+	Attribute	*a;
+	MDB_txn		*txn;
+	mdb_ixstat	st;
+	char		buf[ 1024 ], *ptr, *end;
+	struct berval	bv;
+	int		i, j, k;
+
+	if ( !( mdb->mi_flags & MDB_IS_OPEN ) ||
+		mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn ) != 0 )
+		return 0;
+
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[i];
+
+		if ( !ai->ai_dbi )
+			continue;
+		/* tagged and subtypes share their type's database */
+		for ( j = 0; j < i; j++ )
+			if ( mdb->mi_attrs[j]->ai_dbi == ai->ai_dbi )
+				break;
+		if ( j < i || mdb_ixstat_get( mdb, txn, ai, &st ) != 0 )
+			continue;
+
+		ptr = buf;
+		end = buf + sizeof( buf );
+		ptr += snprintf( ptr, end - ptr, "%s#keys=%lu#ranges=%lu#ids=%lu#sizes=",
+			ai->ai_desc->ad_type->sat_cname.bv_val, (unsigned long)st.is_nkeys,
+			(unsigned long)st.is_nranges, (unsigned long)st.is_nids );
+		for ( j = 0, k = 0; j < MDB_IXSTAT_BUCKETS && ptr < end; j++ ) {
+			if ( !st.is_hist[j] )
+				continue;
+			ptr += snprintf( ptr, end - ptr, "%s%lu:%lu", k++ ? "," : "",
+				1UL << j, (unsigned long)st.is_hist[j] );
+		}
+		if ( ptr < end )
+			ptr += snprintf( ptr, end - ptr, "#heavy=" );
+		for ( j = 0, k = 0; j < MDB_IXSTAT_HEAVY && ptr < end; j++ ) {
+			mdb_ixheavy *ih = &st.is_heavy[j];
+			int l, len = ih->ih_klen < MDB_IXSTAT_KEYLEN ?
+				ih->ih_klen : MDB_IXSTAT_KEYLEN;
+
+			if ( !ih->ih_count )
+				continue;
+			if ( k++ && ptr < end )
+				*ptr++ = ',';
+			for ( l = 0; l < len && ptr < end; l++ )
+				ptr += snprintf( ptr, end - ptr, "%02x", ih->ih_key[l] );
+			if ( ptr >= end )
+				break;
+			if ( ih->ih_count == NOID )
+				ptr += snprintf( ptr, end - ptr, ":range" );
+			else
+				ptr += snprintf( ptr, end - ptr, ":%lu",
+					(unsigned long)ih->ih_count );
+		}
+		if ( ptr > end - 1 )
+			ptr = end - 1;
+		*ptr = '\0';
+
+		ber_str2bv( buf, ptr - buf, 1, &bv );
+		ber_bvarray_add( &vals, &bv );
+	}
+	mdb_txn_abort( txn );
+
+	if ( vals != NULL ) {
+		a = attr_find( e->e_attrs, ad_olmDbIndexStats );
+		if ( a != NULL ) {
+			assert( a->a_nvals == a->a_vals );
+
+			ber_bvarray_free( a->a_vals );
+
+		} else {
+			Attribute	**ap;
+
+			for ( ap = &e->e_attrs; *ap != NULL; ap = &(*ap)->a_next )
+				;
+			*ap = attr_alloc( ad_olmDbIndexStats );
+			a = *ap;
+		}
+		a->a_vals = vals;
+		a->a_nvals = a->a_vals;
+		for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ )
+			;
+		a->a_numvals = i;
+	}
+
+	return 0;
+}
+
+/*
+ * The counters of the entry cache, if it is enabled.
+ */
+static int
+mdb_monitor_cache_entry_add(
+	struct mdb_info	*mdb,
+	Entry		*e )
+{
+	mdb_cache	*cache = &mdb->mi_cache;
+	struct {
+		AttributeDescription	*ad;
+		unsigned long		value;
+	}		counters[ 5 ];
+	Attribute	*a;
+	struct berval	bv;
+	char		buf[ LDAP_PVT_INTTYPE_CHARS(unsigned long) ];
+	int		i;
+
+	if ( !cache->c_maxsize )
+		return 0;
+
+	counters[ 0 ].ad = ad_olmDbEntryCacheEntries;
+	counters[ 1 ].ad = ad_olmDbEntryCacheBytes;
+	counters[ 2 ].ad = ad_olmDbEntryCacheHits;
+	counters[ 3 ].ad = ad_olmDbEntryCacheMisses;
+	counters[ 4 ].ad = ad_olmDbEntryCacheEvictions;
+
+	ldap_pvt_thread_mutex_lock( &cache->c_mutex );
+	counters[ 0 ].value = cache->c_count;
+	counters[ 1 ].value = cache->c_cursize;
+	counters[ 2 ].value = cache->c_hits;
+	counters[ 3 ].value = cache->c_misses;
+	counters[ 4 ].value = cache->c_evicts;
+	ldap_pvt_thread_mutex_unlock( &cache->c_mutex );
+
+	for ( i = 0; i < 5; i++ ) {
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", counters[ i ].value );
+
+		a = attr_find( e->e_attrs, counters[ i ].ad );
+		if ( a != NULL ) {
+			assert( a->a_nvals == a->a_vals );
+			ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+		} else {
+			attr_merge_one( e, counters[ i ].ad, &bv, NULL );
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * The progress of the online indexer while it runs: the entries
+ * indexed out of those there were when it started, the rate since
+ * then, and the seconds the rest should take at that rate.
+ */
+static int
+mdb_monitor_oindex_entry_add(
+	struct mdb_info	*mdb,
+	Entry		*e )
+{
+	AttributeDescription	*ads[ 3 ];
+	Attribute	*a;
+	struct berval	bv;
+	char		buf[ 3 ][ 2 * LDAP_PVT_INTTYPE_CHARS(unsigned long) + 16 ];
+	unsigned long	done, total, rate, eta;
+	time_t		start, secs;
+	int		i;
+
+	ads[ 0 ] = ad_olmDbIndexProgress;
+	ads[ 1 ] = ad_olmDbIndexRate;
+	ads[ 2 ] = ad_olmDbIndexETA;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_oindex_mutex );
+	start = mdb->mi_oindex_start;
+	done = mdb->mi_oindex_done;
+	total = mdb->mi_oindex_total;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_oindex_mutex );
+
+	if ( !start ) {
+		for ( i = 0; i < 3; i++ )
+			attr_delete( &e->e_attrs, ads[ i ] );
+		return 0;
+	}
+
+	/* entries added since are indexed as they are added */
+	if ( total < done )
+		total = done;
+	secs = slap_get_time() - start;
+	if ( secs < 1 )
+		secs = 1;
+	rate = done / secs;
+	eta = done ? ( total - done ) * secs / done : 0;
+
+	snprintf( buf[ 0 ], sizeof( buf[ 0 ] ), "%lu/%lu", done, total );
+	snprintf( buf[ 1 ], sizeof( buf[ 1 ] ), "%lu", rate );
+	snprintf( buf[ 2 ], sizeof( buf[ 2 ] ), "%lu", eta );
+
+	for ( i = 0; i < 3; i++ ) {
+		bv.bv_val = buf[ i ];
+		bv.bv_len = strlen( buf[ i ] );
+
+		a = attr_find( e->e_attrs, ads[ i ] );
+		if ( a != NULL ) {
+			assert( a->a_nvals == a->a_vals );
+			ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+		} else {
+			attr_merge_one( e, ads[ i ], &bv, NULL );
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * The progress of an online backup while it runs: the bytes sent
+ * out of the size of the database when it started, and the rate.
+ */
+static int
+mdb_monitor_backup_entry_add(
+	struct mdb_info	*mdb,
+	Entry		*e )
+{
+	AttributeDescription	*ads[ 2 ];
+	Attribute	*a;
+	struct berval	bv;
+	char		buf[ 2 ][ 2 * LDAP_PVT_INTTYPE_CHARS(unsigned long) + 16 ];
+	unsigned long	sent, total;
+	time_t		start, secs;
+	int		i;
+
+	ads[ 0 ] = ad_olmDbBackupProgress;
+	ads[ 1 ] = ad_olmDbBackupRate;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_backup_mutex );
+	start = mdb->mi_backup_start;
+	sent = mdb->mi_backup_sent;
+	total = mdb->mi_backup_total;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_backup_mutex );
+
+	if ( !start ) {
+		for ( i = 0; i < 2; i++ )
+			attr_delete( &e->e_attrs, ads[ i ] );
+		return 0;
+	}
+
+	if ( total < sent )
+		total = sent;
+	secs = slap_get_time() - start;
+	if ( secs < 1 )
+		secs = 1;
+
+	snprintf( buf[ 0 ], sizeof( buf[ 0 ] ), "%lu/%lu", sent, total );
+	snprintf( buf[ 1 ], sizeof( buf[ 1 ] ), "%lu", sent / secs );
+
+	for ( i = 0; i < 2; i++ ) {
+		bv.bv_val = buf[ i ];
+		bv.bv_len = strlen( buf[ i ] );
+
+		a = attr_find( e->e_attrs, ads[ i ] );
+		if ( a != NULL ) {
+			assert( a->a_nvals == a->a_vals );
+			ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+		} else {
+			attr_merge_one( e, ads[ i ], &bv, NULL );
+		}
+	}
+
+	return 0;
+}
+
 #ifdef MDB_MONITOR_IDX
 
 #define MDB_MONITOR_IDX_TYPES	(4)
@@ -0,0 +1,370 @@
+/* ngram.c - ngram indexes of substrings */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+#include "lutil.h"
+
+/*
+ * Unlike the hashed substring keys, which only cover the pieces of
+ * an assertion as long as index_substr_any_len, the ngrams of any
+ * piece of MDB_NGRAM_LEN bytes or more are all in the index. The
+ * rarest of them are read first, and once few candidates are left the
+ * rest are left to test_filter(), as in an AND.
+ */
+
+typedef struct ngram_plan {
+	struct berval	*np_key;
+	ID		np_count;
+} ngram_plan;
+
+static int
+ngram_cmp( const void *v1, const void *v2 )
+{
+	return memcmp( v1, v2, MDB_NGRAM_LEN );
+}
+
+static int
+ngram_plan_cmp( const void *v1, const void *v2 )
+{
+	const ngram_plan *p1 = v1, *p2 = v2;
+
+	if ( p1->np_count != p2->np_count )
+		return p1->np_count < p2->np_count ? -1 : 1;
+	return 0;
+}
+
+/*
+ * The distinct ngrams of vals, in one block to be freed with
+ * op->o_tmpfree; NULL if the values are all too short.
+ */
+static struct berval *
+ngram_keys( Operation *op, BerVarray vals, int *nkeys )
+{
+	struct berval *keys;
+	char *buf, *p;
+	ber_len_t j;
+	int i, n = 0;
+
+	for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ ) {
+		if ( vals[i].bv_len >= MDB_NGRAM_LEN )
+			n += vals[i].bv_len - ( MDB_NGRAM_LEN - 1 );
+	}
+	if ( !n )
+		return NULL;
+
+	keys = op->o_tmpalloc( ( n + 1 ) * sizeof(struct berval) +
+		n * MDB_NGRAM_LEN, op->o_tmpmemctx );
+	buf = (char *)( keys + n + 1 );
+	p = buf;
+	for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ ) {
+		for ( j = 0; j + MDB_NGRAM_LEN <= vals[i].bv_len; j++ ) {
+			AC_MEMCPY( p, vals[i].bv_val + j, MDB_NGRAM_LEN );
+			p += MDB_NGRAM_LEN;
+		}
+	}
+
+	qsort( buf, n, MDB_NGRAM_LEN, ngram_cmp );
+	for ( i = 1, p = buf; i < n; i++ ) {
+		if ( memcmp( p, buf + i * MDB_NGRAM_LEN, MDB_NGRAM_LEN )) {
+			p += MDB_NGRAM_LEN;
+			AC_MEMCPY( p, buf + i * MDB_NGRAM_LEN, MDB_NGRAM_LEN );
+		}
+	}
+	n = ( p - buf ) / MDB_NGRAM_LEN + 1;
+
+	for ( i = 0; i < n; i++ ) {
+		keys[i].bv_val = buf + i * MDB_NGRAM_LEN;
+		keys[i].bv_len = MDB_NGRAM_LEN;
+	}
+	BER_BVZERO( &keys[n] );
+	*nkeys = n;
+	return keys;
+}
+
+int
+mdb_ngram_open( struct mdb_info *mdb, MDB_txn *txn, AttrInfo *ai )
+{
+	char *name;
+	int rc, flags;
+
+	if ( !(( ai->ai_indexmask | ai->ai_newmask ) & SLAP_INDEX_NGRAM ))
+		return 0;
+
+	if ( !ai->ai_ndbi ) {
+		flags = MDB_DUPSORT|MDB_DUPFIXED|MDB_INTEGERDUP;
+		if ( !(slapMode & SLAP_TOOL_READONLY) )
+			flags |= MDB_CREATE;
+		name = ch_malloc( STRLENOF( MDB_NGRAM_PREFIX ) +
+			ai->ai_desc->ad_cname.bv_len + 1 );
+		lutil_strcopy( lutil_strcopy( name, MDB_NGRAM_PREFIX ),
+			ai->ai_desc->ad_cname.bv_val );
+		rc = mdb_dbi_open( txn, name, flags, &ai->ai_ndbi );
+		ch_free( name );
+		if ( rc ) {
+			ai->ai_ndbi = 0;
+			/* never built, nothing to read */
+			if ( rc == MDB_NOTFOUND && ( slapMode & SLAP_TOOL_READONLY ))
+				rc = 0;
+			return rc;
+		}
+	}
+
+	/* an index being built anew must not keep keys from an
+	 * earlier time it was configured */
+	if ( !( ai->ai_indexmask & SLAP_INDEX_NGRAM )) {
+		rc = mdb_drop( txn, ai->ai_ndbi, 0 );
+		if ( rc == 0 )
+			rc = mdb_bitmap_drop( mdb, txn, ai, ai->ai_ndbi );
+		return rc;
+	}
+	return 0;
+}
+
+/* called by the indexer for the values of ai's attribute and its
+ * subtypes */
+int
+mdb_ngram_values(
+	Operation *op,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	BerVarray vals,
+	ID id,
+	int opid )
+{
+	MDB_cursor *mc;
+	mdb_ixkeys *ik;
+	struct berval *keys;
+	int rc, n;
+
+	if ( !ai->ai_ndbi )
+		return LDAP_OTHER;
+
+	keys = ngram_keys( op, vals, &n );
+	if ( !keys )
+		return 0;
+
+	if ( opid == SLAP_INDEX_ADD_OP &&
+		( ik = mdb_ixkeys_get( op )) != NULL ) {
+		rc = mdb_ixkeys_add( ik, NULL, ai->ai_ndbi, keys, id );
+		op->o_tmpfree( keys, op->o_tmpmemctx );
+		return rc;
+	}
+
+	rc = mdb_cursor_open( txn, ai->ai_ndbi, &mc );
+	if ( rc == 0 ) {
+		if ( opid == SLAP_INDEX_ADD_OP )
+			rc = mdb_idl_insert_keys( op->o_bd, mc, keys, id );
+		else
+			rc = mdb_idl_delete_keys( op->o_bd, mc, keys, id );
+		mdb_cursor_close( mc );
+	}
+	op->o_tmpfree( keys, op->o_tmpmemctx );
+	return rc;
+}
+
+/*
+ * Count the IDs under each ngram of the pieces of sub, rarest first.
+ * Returns LDAP_INAPPROPRIATE_MATCHING if there is no ngram index to
+ * use or no piece is long enough.
+ */
+static int
+ngram_plan_keys(
+	Operation *op,
+	MDB_txn *rtxn,
+	SubstringsAssertion *sub,
+	AttrInfo **aip,
+	struct berval **keysp,
+	ngram_plan **planp,
+	int *np )
+{
+	AttrInfo *ai;
+	struct berval atname, *pieces, *keys;
+	ngram_plan *plan;
+	int i, n = 0, rc = 0;
+
+	ai = mdb_index_mask( op->o_bd, sub->sa_desc, &atname );
+	if ( !ai || !ai->ai_ndbi ||
+		!IS_SLAP_INDEX( ai->ai_indexmask, SLAP_INDEX_NGRAM ))
+		return LDAP_INAPPROPRIATE_MATCHING;
+
+	if ( sub->sa_any )
+		for ( ; !BER_BVISNULL( &sub->sa_any[n] ); n++ );
+	pieces = op->o_tmpalloc( ( n + 3 ) * sizeof(struct berval),
+		op->o_tmpmemctx );
+	n = 0;
+	if ( !BER_BVISNULL( &sub->sa_initial ))
+		pieces[n++] = sub->sa_initial;
+	if ( sub->sa_any )
+		for ( i = 0; !BER_BVISNULL( &sub->sa_any[i] ); i++ )
+			pieces[n++] = sub->sa_any[i];
+	if ( !BER_BVISNULL( &sub->sa_final ))
+		pieces[n++] = sub->sa_final;
+	BER_BVZERO( &pieces[n] );
+
+	keys = ngram_keys( op, pieces, &n );
+	op->o_tmpfree( pieces, op->o_tmpmemctx );
+	if ( !keys )
+		return LDAP_INAPPROPRIATE_MATCHING;
+
+	plan = op->o_tmpalloc( n * sizeof(ngram_plan), op->o_tmpmemctx );
+	for ( i = 0; i < n; i++ ) {
+		plan[i].np_key = &keys[i];
+		rc = mdb_key_count( op->o_bd, rtxn, ai->ai_ndbi, &keys[i],
+			&plan[i].np_count, NULL );
+		if ( rc ) {
+			op->o_tmpfree( plan, op->o_tmpmemctx );
+			op->o_tmpfree( keys, op->o_tmpmemctx );
+			return rc;
+		}
+		/* nothing has it */
+		if ( !plan[i].np_count ) {
+			plan[0] = plan[i];
+			n = 1;
+			break;
+		}
+	}
+	qsort( plan, n, sizeof(ngram_plan), ngram_plan_cmp );
+
+	*aip = ai;
+	*keysp = keys;
+	*planp = plan;
+	*np = n;
+	return 0;
+}
+
+/*
+ * Estimate the number of candidates mdb_ngram_candidates() would
+ * return for sub; NOID if the ngram index can't be used.
+ */
+ID
+mdb_ngram_estimate(
+	Operation *op,
+	MDB_txn *rtxn,
+	SubstringsAssertion *sub )
+{
+	AttrInfo *ai;
+	struct berval *keys;
+	ngram_plan *plan;
+	ID est;
+	int n;
+
+	if ( ngram_plan_keys( op, rtxn, sub, &ai, &keys, &plan, &n ))
+		return NOID;
+	est = plan[0].np_count;
+	op->o_tmpfree( plan, op->o_tmpmemctx );
+	op->o_tmpfree( keys, op->o_tmpmemctx );
+	return est;
+}
+
+/*
+ * The candidates of sub from its attribute's ngram index. Returns
+ * LDAP_INAPPROPRIATE_MATCHING, leaving ids alone, if the index can't
+ * be used.
+ */
+int
+mdb_ngram_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	SubstringsAssertion *sub,
+	ID *ids,
+	ID *tmp )
+{
+	AttrInfo *ai;
+	struct berval *keys, *ckeys;
+	ngram_plan *plan;
+	MDB_dbi *dbis;
+	int i, n, rc;
+
+	rc = ngram_plan_keys( op, rtxn, sub, &ai, &keys, &plan, &n );
+	if ( rc )
+		return rc;
+
+	Debug( LDAP_DEBUG_TRACE, "=> mdb_ngram_candidates (%s) %d ngrams\n",
+		sub->sa_desc->ad_cname.bv_val, n, 0 );
+
+	if ( !plan[0].np_count ) {
+		MDB_IDL_ZERO( ids );
+		goto done;
+	}
+
+	if ( plan[0].np_count > MDB_IDL_DB_MAX && n > 1 ) {
+		/* they are all bitmaps, which are intersected exactly
+		 * from their compressed form */
+		ckeys = op->o_tmpalloc( n * ( sizeof(struct berval) +
+			sizeof(MDB_dbi)), op->o_tmpmemctx );
+		dbis = (MDB_dbi *)( ckeys + n );
+		for ( i = 0; i < n; i++ ) {
+			ckeys[i] = *plan[i].np_key;
+			dbis[i] = ai->ai_ndbi;
+		}
+		rc = mdb_key_combine( op->o_bd, rtxn, LDAP_FILTER_AND, n, dbis,
+			ckeys, 0, ids, tmp );
+		op->o_tmpfree( ckeys, op->o_tmpmemctx );
+		if ( rc )
+			MDB_IDL_ALL( ids );
+		goto done;
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		if ( i && !get_count( op ) && !MDB_IDL_IS_RANGE( ids ) &&
+			( ids[0] <= MDB_FILTER_DIRECT ||
+			plan[i].np_count / MDB_FILTER_DIRECT_RATIO > ids[0] ))
+		{
+			Debug( LDAP_DEBUG_FILTER,
+				"<= mdb_ngram_candidates: %ld candidates left, "
+				"skipping %d ngrams\n",
+				(long) ids[0], n - i, 0 );
+			break;
+		}
+
+		rc = mdb_key_read( op->o_bd, rtxn, ai->ai_ndbi, plan[i].np_key,
+			i ? tmp : ids, NULL, 0 );
+		if ( rc == MDB_NOTFOUND ) {
+			/* gone since it was counted */
+			MDB_IDL_ZERO( ids );
+			rc = 0;
+			break;
+		} else if ( rc ) {
+			Debug( LDAP_DEBUG_TRACE,
+				"<= mdb_ngram_candidates: (%s) "
+				"key read failed (%d)\n",
+				sub->sa_desc->ad_cname.bv_val, rc, 0 );
+			MDB_IDL_ALL( ids );
+			break;
+		}
+		if ( i )
+			mdb_idl_intersection( ids, tmp );
+		if ( MDB_IDL_IS_ZERO( ids ))
+			break;
+	}
+
+done:
+	op->o_tmpfree( plan, op->o_tmpmemctx );
+	op->o_tmpfree( keys, op->o_tmpmemctx );
+
+	Debug( LDAP_DEBUG_TRACE,
+		"<= mdb_ngram_candidates: %ld, first=%ld, last=%ld\n",
+		(long) ids[0],
+		(long) MDB_IDL_FIRST(ids),
+		(long) MDB_IDL_LAST(ids) );
+	return rc;
+}
@@ -0,0 +1,1393 @@
+/* order.c - ordering indexes and searches that follow them */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+#include "lutil.h"
+
+/*
+ * A search asked for its entries in the order of an attribute with
+ * an ordering index (see OpSorted) walks that index instead of its
+ * candidate list, and only returns the IDs that are candidates. An
+ * entry with several values comes up once per value; it is sent for
+ * the first one the walk meets. Positions are counted in index
+ * entries that are candidates, so they are estimates when the
+ * candidates are, or when there are several values. VLV windows far
+ * from both ends of the list are found through the counts of the
+ * whole index, scaled to the number of candidates.
+ *
+ * In reverse order the keys are walked backwards, but the IDs under
+ * each key still forwards, which is the order sssvlv keeps for
+ * entries that sort the same.
+ */
+
+struct mdb_ordscan {
+	OpSorted	*os_req;
+	void		*os_memctx;
+	MDB_cursor	*os_mc;
+	ID		*os_cands;
+	int		os_reverse;
+	int		os_pending;	/* the cursor is on an ID not returned yet */
+	int		os_end;
+	unsigned long	os_size;	/* IDs to send, 0 for all */
+	size_t		os_maxkey;	/* of an index key */
+	ID		os_id;		/* where the last ID came from */
+	MDB_val		os_key;
+	char		os_kbuf[1];
+};
+
+static MatchingRule *octet_ordering;
+
+/* an index key also fits behind the header of a block key */
+#define	MDB_ORDER_KEYMAX(maxkey)	((maxkey) - MDB_ORDER_HDR)
+
+#define	OB_ENTRIES	0
+#define	OB_ITEMS	1
+
+static void
+mdb_order_key( struct berval *val, char *buf, int maxkey, MDB_val *key )
+{
+	ber_len_t len = val->bv_len;
+
+	if ( len > (ber_len_t)MDB_ORDER_KEYMAX( maxkey ) - 1 )
+		len = MDB_ORDER_KEYMAX( maxkey ) - 1;
+	buf[0] = MDB_ORDER_VALUE;
+	AC_MEMCPY( buf + 1, val->bv_val, len );
+	key->mv_data = buf;
+	key->mv_size = len + 1;
+}
+
+/* index entries in the order the index has them */
+static int
+mdb_order_ecmp( const MDB_val *k1, ID id1, const MDB_val *k2, ID id2 )
+{
+	size_t len = k1->mv_size < k2->mv_size ? k1->mv_size : k2->mv_size;
+	int cmp;
+
+	cmp = memcmp( k1->mv_data, k2->mv_data, len );
+	if ( cmp )
+		return cmp;
+	if ( k1->mv_size != k2->mv_size )
+		return k1->mv_size < k2->mv_size ? -1 : 1;
+	return id1 < id2 ? -1 : id1 > id2;
+}
+
+/* block keys, by level and then by the entry they start at */
+static int
+mdb_order_bcmp( const MDB_val *a, const MDB_val *b )
+{
+	const char *pa = a->mv_data, *pb = b->mv_data;
+	MDB_val ka, kb;
+	ID ia, ib;
+
+	if ( pa[0] != pb[0] )
+		return (unsigned char)pa[0] < (unsigned char)pb[0] ? -1 : 1;
+	memcpy( &ia, pa + 1, sizeof( ID ));
+	memcpy( &ib, pb + 1, sizeof( ID ));
+	ka.mv_data = (char *)pa + MDB_ORDER_HDR;
+	ka.mv_size = a->mv_size - MDB_ORDER_HDR;
+	kb.mv_data = (char *)pb + MDB_ORDER_HDR;
+	kb.mv_size = b->mv_size - MDB_ORDER_HDR;
+	return mdb_order_ecmp( &ka, ia, &kb, ib );
+}
+
+/* the key of the block at level starting at okey/id; with no okey,
+ * the first block of the level, which sorts before any entry */
+static void
+mdb_order_bkey( char *buf, int level, MDB_val *okey, ID id, MDB_val *bkey )
+{
+	buf[0] = level;
+	memcpy( buf + 1, &id, sizeof( ID ));
+	bkey->mv_data = buf;
+	bkey->mv_size = MDB_ORDER_HDR;
+	if ( okey ) {
+		AC_MEMCPY( buf + MDB_ORDER_HDR, okey->mv_data, okey->mv_size );
+		bkey->mv_size += okey->mv_size;
+	}
+}
+
+static int
+mdb_order_level( MDB_val *bkey )
+{
+	return ((unsigned char *)bkey->mv_data)[0];
+}
+
+/* the single block on the highest level */
+static int
+mdb_order_root( MDB_cursor *cc, MDB_val *key, ID *cnt )
+{
+	MDB_val data;
+	int rc;
+
+	rc = mdb_cursor_get( cc, key, &data, MDB_LAST );
+	if ( rc == 0 )
+		memcpy( cnt, data.mv_data, 2 * sizeof( ID ));
+	return rc;
+}
+
+/* the block of want's level that want falls into */
+static int
+mdb_order_block( MDB_cursor *cc, MDB_val *want, MDB_val *key, ID *cnt )
+{
+	MDB_val data;
+	int rc;
+
+	*key = *want;
+	rc = mdb_cursor_get( cc, key, &data, MDB_SET_RANGE );
+	if ( rc == 0 && mdb_order_bcmp( key, want ))
+		rc = mdb_cursor_get( cc, key, &data, MDB_PREV );
+	else if ( rc == MDB_NOTFOUND )
+		rc = mdb_cursor_get( cc, key, &data, MDB_LAST );
+	/* every level starts with a block before any entry */
+	if ( rc == 0 && mdb_order_level( key ) != mdb_order_level( want ))
+		rc = MDB_CORRUPTED;
+	if ( rc == 0 )
+		memcpy( cnt, data.mv_data, 2 * sizeof( ID ));
+	return rc;
+}
+
+static int
+mdb_order_bput( MDB_txn *txn, AttrInfo *ai, MDB_val *bkey, ID *cnt,
+	unsigned flags )
+{
+	MDB_val data;
+
+	data.mv_size = 2 * sizeof( ID );
+	data.mv_data = cnt;
+	return mdb_put( txn, ai->ai_cdbi, bkey, &data, flags );
+}
+
+/* the first index entry at or after the start of block bkey */
+static int
+mdb_order_bstart( MDB_cursor *mc, MDB_val *bkey, MDB_val *key, MDB_val *data )
+{
+	MDB_val want;
+	ID id;
+	int rc;
+
+	if ( bkey->mv_size == MDB_ORDER_HDR )
+		return mdb_cursor_get( mc, key, data, MDB_FIRST );
+
+	want.mv_data = (char *)bkey->mv_data + MDB_ORDER_HDR;
+	want.mv_size = bkey->mv_size - MDB_ORDER_HDR;
+	memcpy( &id, (char *)bkey->mv_data + 1, sizeof( ID ));
+	*key = want;
+	data->mv_size = sizeof( ID );
+	data->mv_data = &id;
+	rc = mdb_cursor_get( mc, key, data, MDB_GET_BOTH_RANGE );
+	if ( rc == MDB_NOTFOUND ) {
+		/* no ID that high under the key, the next key then */
+		*key = want;
+		rc = mdb_cursor_get( mc, key, data, MDB_SET_RANGE );
+		if ( rc == 0 && key->mv_size == want.mv_size &&
+			!memcmp( key->mv_data, want.mv_data, want.mv_size ))
+			rc = mdb_cursor_get( mc, key, data, MDB_NEXT_NODUP );
+	}
+	return rc;
+}
+
+/*
+ * Split block bkey of level, which covers cnt, in two halves. The
+ * key of the new second half is left in nbuf and nkey, whose size
+ * is 0 if the block could not be split.
+ */
+static int
+mdb_order_split(
+	MDB_txn *txn,
+	AttrInfo *ai,
+	MDB_cursor *cc,
+	int level,
+	MDB_val *bkey,
+	ID *cnt,
+	char *nbuf,
+	MDB_val *nkey )
+{
+	MDB_cursor *mc;
+	MDB_val key, data;
+	ID half = cnt[OB_ITEMS] / 2, entries = 0, ncnt[2], sub[2], i, id;
+	int rc;
+
+	nkey->mv_size = 0;
+	if ( level == 1 ) {
+		rc = mdb_cursor_open( txn, ai->ai_odbi, &mc );
+		if ( rc )
+			return rc;
+		rc = mdb_order_bstart( mc, bkey, &key, &data );
+		for ( i = 0; rc == 0 && i < half; i++ )
+			rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT );
+		if ( rc == 0 ) {
+			entries = half;
+			memcpy( &id, data.mv_data, sizeof( ID ));
+			mdb_order_bkey( nbuf, 1, &key, id, nkey );
+		}
+		mdb_cursor_close( mc );
+	} else {
+		/* the blocks of the level below start where this one does */
+		AC_MEMCPY( nbuf, bkey->mv_data, bkey->mv_size );
+		nbuf[0] = level - 1;
+		key.mv_data = nbuf;
+		key.mv_size = bkey->mv_size;
+		rc = mdb_cursor_get( cc, &key, &data, MDB_SET_KEY );
+		for ( i = 0; rc == 0 && i < half; i++ ) {
+			memcpy( sub, data.mv_data, sizeof( sub ));
+			entries += sub[OB_ENTRIES];
+			rc = mdb_cursor_get( cc, &key, &data, MDB_NEXT );
+		}
+		if ( rc == 0 && mdb_order_level( &key ) == level - 1 ) {
+			AC_MEMCPY( nbuf, key.mv_data, key.mv_size );
+			nbuf[0] = level;
+			nkey->mv_data = nbuf;
+			nkey->mv_size = key.mv_size;
+		}
+	}
+	/* fewer than counted; leave it to the next rebuild */
+	if ( rc == MDB_NOTFOUND || ( rc == 0 && !nkey->mv_size )) {
+		nkey->mv_size = 0;
+		return 0;
+	}
+	if ( rc )
+		return rc;
+
+	ncnt[OB_ENTRIES] = cnt[OB_ENTRIES] > entries ? cnt[OB_ENTRIES] - entries : 0;
+	ncnt[OB_ITEMS] = cnt[OB_ITEMS] - half;
+	cnt[OB_ENTRIES] = entries;
+	cnt[OB_ITEMS] = half;
+	rc = mdb_order_bput( txn, ai, bkey, cnt, 0 );
+	if ( rc == 0 )
+		rc = mdb_order_bput( txn, ai, nkey, ncnt, MDB_NOOVERWRITE );
+	return rc;
+}
+
+/*
+ * Count index entry okey/id in or out of the blocks holding it, and
+ * split those that got too big. buf has room for three block keys.
+ */
+static int
+mdb_order_count(
+	MDB_txn *txn,
+	AttrInfo *ai,
+	MDB_val *okey,
+	ID id,
+	int add,
+	char *buf,
+	int maxkey )
+{
+	MDB_cursor *cc;
+	MDB_val want, key, nkey;
+	char *bbuf = buf + maxkey, *nbuf = bbuf + maxkey;
+	ID cnt[2], total;
+	int rc, level, top = 0;
+
+	if ( !ai->ai_cdbi )
+		return 0;
+	rc = mdb_cursor_open( txn, ai->ai_cdbi, &cc );
+	if ( rc )
+		return rc;
+
+	rc = mdb_order_root( cc, &key, cnt );
+	if ( rc == MDB_NOTFOUND && add ) {
+		mdb_order_bkey( bbuf, 1, NULL, 0, &key );
+		cnt[OB_ENTRIES] = cnt[OB_ITEMS] = 0;
+		rc = mdb_order_bput( txn, ai, &key, cnt, 0 );
+		top = 1;
+	} else if ( rc == 0 ) {
+		top = mdb_order_level( &key );
+	}
+	if ( rc ) {
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+		goto done;
+	}
+
+	for ( level = 1; level <= top; level++ ) {
+		mdb_order_bkey( buf, level, okey, id, &want );
+		rc = mdb_order_block( cc, &want, &key, cnt );
+		if ( rc )
+			goto done;
+		if ( add ) {
+			cnt[OB_ENTRIES]++;
+			if ( level == 1 )
+				cnt[OB_ITEMS]++;
+		} else {
+			if ( cnt[OB_ENTRIES] )
+				cnt[OB_ENTRIES]--;
+			if ( level == 1 && cnt[OB_ITEMS] )
+				cnt[OB_ITEMS]--;
+		}
+		AC_MEMCPY( bbuf, key.mv_data, key.mv_size );
+		key.mv_data = bbuf;
+		rc = mdb_order_bput( txn, ai, &key, cnt, 0 );
+		if ( rc )
+			goto done;
+	}
+	if ( !add )
+		goto done;
+
+	/* blocks are never merged again, only split */
+	for ( level = 1; level <= top; level++ ) {
+		mdb_order_bkey( buf, level, okey, id, &want );
+		rc = mdb_order_block( cc, &want, &key, cnt );
+		if ( rc || cnt[OB_ITEMS] < MDB_ORDER_BLOCK )
+			break;
+		AC_MEMCPY( bbuf, key.mv_data, key.mv_size );
+		key.mv_data = bbuf;
+		total = cnt[OB_ENTRIES];
+		rc = mdb_order_split( txn, ai, cc, level, &key, cnt, nbuf, &nkey );
+		if ( rc || !nkey.mv_size )
+			break;
+
+		if ( level == top ) {
+			/* a new root over the two halves */
+			mdb_order_bkey( bbuf, top + 1, NULL, 0, &key );
+			cnt[OB_ENTRIES] = total;
+			cnt[OB_ITEMS] = 2;
+			rc = mdb_order_bput( txn, ai, &key, cnt, 0 );
+			break;
+		}
+		nbuf[0] = level + 1;
+		rc = mdb_order_block( cc, &nkey, &key, cnt );
+		if ( rc )
+			break;
+		AC_MEMCPY( bbuf, key.mv_data, key.mv_size );
+		key.mv_data = bbuf;
+		cnt[OB_ITEMS]++;
+		rc = mdb_order_bput( txn, ai, &key, cnt, 0 );
+		if ( rc )
+			break;
+	}
+
+done:
+	mdb_cursor_close( cc );
+	return rc;
+}
+
+/*
+ * Count an index that has no counts yet, as it was built before they
+ * were kept. Blocks are filled to half, then grouped level by level
+ * until a single one covers all.
+ */
+static int
+mdb_order_build( MDB_txn *txn, AttrInfo *ai, char *buf, int maxkey )
+{
+	MDB_cursor *mc, *cc;
+	MDB_val key, data, bkey;
+	char *bbuf = buf + maxkey;
+	ID cnt[2], sub[2], nblocks = 0, n, id;
+	int rc, level;
+
+	rc = mdb_cursor_open( txn, ai->ai_odbi, &mc );
+	if ( rc )
+		return rc;
+	mdb_order_bkey( bbuf, 1, NULL, 0, &bkey );
+	cnt[OB_ENTRIES] = cnt[OB_ITEMS] = 0;
+	for ( rc = mdb_cursor_get( mc, &key, &data, MDB_FIRST ); rc == 0;
+		rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT ))
+	{
+		if ( cnt[OB_ITEMS] == MDB_ORDER_BLOCK / 2 ) {
+			rc = mdb_order_bput( txn, ai, &bkey, cnt, 0 );
+			if ( rc )
+				break;
+			nblocks++;
+			memcpy( &id, data.mv_data, sizeof( ID ));
+			mdb_order_bkey( bbuf, 1, &key, id, &bkey );
+			cnt[OB_ENTRIES] = cnt[OB_ITEMS] = 0;
+		}
+		cnt[OB_ENTRIES]++;
+		cnt[OB_ITEMS]++;
+	}
+	mdb_cursor_close( mc );
+	if ( rc != MDB_NOTFOUND )
+		return rc;
+	if ( !cnt[OB_ITEMS] )
+		return 0;
+	rc = mdb_order_bput( txn, ai, &bkey, cnt, 0 );
+	if ( rc )
+		return rc;
+	nblocks++;
+
+	rc = mdb_cursor_open( txn, ai->ai_cdbi, &cc );
+	if ( rc )
+		return rc;
+	for ( level = 1; rc == 0 && nblocks > 1; level++ ) {
+		mdb_order_bkey( buf, level, NULL, 0, &key );
+		mdb_order_bkey( bbuf, level + 1, NULL, 0, &bkey );
+		cnt[OB_ENTRIES] = cnt[OB_ITEMS] = 0;
+		n = 0;
+		for ( rc = mdb_cursor_get( cc, &key, &data, MDB_SET_KEY );
+			rc == 0 && mdb_order_level( &key ) == level;
+			rc = mdb_cursor_get( cc, &key, &data, MDB_NEXT ))
+		{
+			if ( cnt[OB_ITEMS] == MDB_ORDER_BLOCK / 2 ) {
+				rc = mdb_order_bput( txn, ai, &bkey, cnt, 0 );
+				/* the put may have moved the page */
+				if ( rc == 0 )
+					rc = mdb_cursor_get( cc, &key, &data, MDB_GET_CURRENT );
+				if ( rc )
+					break;
+				n++;
+				AC_MEMCPY( bbuf, key.mv_data, key.mv_size );
+				bbuf[0] = level + 1;
+				bkey.mv_size = key.mv_size;
+				cnt[OB_ENTRIES] = cnt[OB_ITEMS] = 0;
+			}
+			memcpy( sub, data.mv_data, sizeof( sub ));
+			cnt[OB_ENTRIES] += sub[OB_ENTRIES];
+			cnt[OB_ITEMS]++;
+		}
+		if ( rc == 0 || rc == MDB_NOTFOUND )
+			rc = mdb_order_bput( txn, ai, &bkey, cnt, 0 );
+		nblocks = n + 1;
+	}
+	mdb_cursor_close( cc );
+	return rc;
+}
+
+int
+mdb_order_open( struct mdb_info *mdb, MDB_txn *txn, AttrInfo *ai )
+{
+	MDB_stat ms;
+	char *name, *buf;
+	int rc, flags, maxkey;
+
+	if ( !(( ai->ai_indexmask | ai->ai_newmask ) & SLAP_INDEX_ORDERING ))
+		return 0;
+
+	flags = 0;
+	if ( !(slapMode & SLAP_TOOL_READONLY) )
+		flags |= MDB_CREATE;
+	name = ch_malloc( STRLENOF( MDB_ORDER_COUNTS ) +
+		ai->ai_desc->ad_cname.bv_len + 1 );
+
+	if ( !ai->ai_odbi ) {
+		lutil_strcopy( lutil_strcopy( name, MDB_ORDER_PREFIX ),
+			ai->ai_desc->ad_cname.bv_val );
+		rc = mdb_dbi_open( txn, name,
+			flags|MDB_DUPSORT|MDB_DUPFIXED|MDB_INTEGERDUP, &ai->ai_odbi );
+		if ( rc ) {
+			ai->ai_odbi = 0;
+			/* never built, nothing to read */
+			if ( rc == MDB_NOTFOUND && ( slapMode & SLAP_TOOL_READONLY ))
+				rc = 0;
+			goto done;
+		}
+	}
+
+	if ( !ai->ai_cdbi ) {
+		lutil_strcopy( lutil_strcopy( name, MDB_ORDER_COUNTS ),
+			ai->ai_desc->ad_cname.bv_val );
+		rc = mdb_dbi_open( txn, name, flags, &ai->ai_cdbi );
+		if ( rc ) {
+			ai->ai_cdbi = 0;
+			/* windows are found by walking the index then */
+			if ( rc == MDB_NOTFOUND && ( slapMode & SLAP_TOOL_READONLY ))
+				rc = 0;
+			goto done;
+		}
+		mdb_set_compare( txn, ai->ai_cdbi, mdb_order_bcmp );
+	}
+
+	/* an index being built anew must not keep keys from an
+	 * earlier time it was configured */
+	if ( !( ai->ai_indexmask & SLAP_INDEX_ORDERING )) {
+		rc = mdb_drop( txn, ai->ai_odbi, 0 );
+		if ( rc == 0 )
+			rc = mdb_drop( txn, ai->ai_cdbi, 0 );
+		goto done;
+	}
+
+	rc = 0;
+	if ( !( slapMode & SLAP_TOOL_READONLY ) &&
+		!mdb_stat( txn, ai->ai_cdbi, &ms ) && !ms.ms_entries )
+	{
+		maxkey = mdb_env_get_maxkeysize( mdb->mi_dbenv );
+		buf = ch_malloc( 2 * maxkey );
+		rc = mdb_order_build( txn, ai, buf, maxkey );
+		ch_free( buf );
+	}
+
+done:
+	ch_free( name );
+	return rc;
+}
+
+/* File id under key, or take it out, and count it. Values cut to
+ * the same key share its entry, which deleting any of them takes
+ * out; modify indexes all the values left after a delete again
+ * (see SLAP_ATTR_IXDEL), which puts it back for the others.
+ */
+int
+mdb_order_put(
+	MDB_txn *txn,
+	AttrInfo *ai,
+	MDB_cursor *mc,
+	MDB_val *key,
+	ID id,
+	int opid,
+	char *buf,
+	int maxkey )
+{
+	MDB_val data;
+	int rc;
+
+	data.mv_size = sizeof( ID );
+	data.mv_data = &id;
+	if ( opid == SLAP_INDEX_ADD_OP ) {
+		rc = mdb_cursor_put( mc, key, &data, MDB_NODUPDATA );
+		/* values cut to the same key */
+		if ( rc == MDB_KEYEXIST )
+			return 0;
+	} else {
+		rc = mdb_cursor_get( mc, key, &data, MDB_GET_BOTH );
+		if ( rc == 0 )
+			rc = mdb_cursor_del( mc, 0 );
+		else if ( rc == MDB_NOTFOUND )
+			return 0;
+	}
+	if ( rc == 0 )
+		rc = mdb_order_count( txn, ai, key, id,
+			opid == SLAP_INDEX_ADD_OP, buf, maxkey );
+	return rc;
+}
+
+/* called by the indexer for the values of ai's own attribute */
+int
+mdb_order_values(
+	Operation *op,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	BerVarray vals,
+	ID id,
+	int opid )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc = NULL;
+	MDB_val key;
+	mdb_ixkeys *ik = NULL;
+	struct berval kv[2] = { BER_BVNULL, BER_BVNULL };
+	char *buf;
+	int i, rc, maxkey;
+
+	if ( !ai->ai_odbi )
+		return LDAP_OTHER;
+
+	if ( opid == SLAP_INDEX_ADD_OP )
+		ik = mdb_ixkeys_get( op );
+	if ( !ik ) {
+		rc = mdb_cursor_open( txn, ai->ai_odbi, &mc );
+		if ( rc )
+			return rc;
+	}
+
+	/* the key, and room to count it */
+	maxkey = mdb_env_get_maxkeysize( mdb->mi_dbenv );
+	buf = op->o_tmpalloc( 4 * maxkey, op->o_tmpmemctx );
+	for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ ) {
+		mdb_order_key( &vals[i], buf, maxkey, &key );
+		if ( ik ) {
+			kv[0].bv_val = key.mv_data;
+			kv[0].bv_len = key.mv_size;
+			rc = mdb_ixkeys_add( ik, ai, ai->ai_odbi, kv, id );
+		} else {
+			rc = mdb_order_put( txn, ai, mc, &key, id, opid,
+				buf + maxkey, maxkey );
+		}
+		if ( rc )
+			break;
+	}
+	op->o_tmpfree( buf, op->o_tmpmemctx );
+	if ( !ik )
+		mdb_cursor_close( mc );
+	return rc;
+}
+
+static int
+mdb_order_absent( Operation *op, MDB_txn *txn, AttrInfo *ai, ID id, int opid )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key;
+	mdb_ixkeys *ik;
+	char absent = MDB_ORDER_ABSENT, *buf;
+	int rc, maxkey;
+
+	if ( !ai->ai_odbi )
+		return LDAP_OTHER;
+
+	if ( opid == SLAP_INDEX_ADD_OP &&
+		( ik = mdb_ixkeys_get( op )) != NULL ) {
+		struct berval kv[2];
+
+		kv[0].bv_val = &absent;
+		kv[0].bv_len = 1;
+		BER_BVZERO( &kv[1] );
+		return mdb_ixkeys_add( ik, ai, ai->ai_odbi, kv, id );
+	}
+
+	rc = mdb_cursor_open( txn, ai->ai_odbi, &mc );
+	if ( rc )
+		return rc;
+	maxkey = mdb_env_get_maxkeysize( mdb->mi_dbenv );
+	buf = op->o_tmpalloc( 3 * maxkey, op->o_tmpmemctx );
+	key.mv_data = &absent;
+	key.mv_size = 1;
+	rc = mdb_order_put( txn, ai, mc, &key, id, opid, buf, maxkey );
+	op->o_tmpfree( buf, op->o_tmpmemctx );
+	mdb_cursor_close( mc );
+	return rc;
+}
+
+/* file e under each ordering index it has no value for */
+int
+mdb_order_entry( Operation *op, MDB_txn *txn, int opid, Entry *e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	AttrInfo *ai;
+	slap_mask_t mask;
+	int i, rc;
+
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		ai = mdb->mi_attrs[i];
+		if ( opid == MDB_INDEX_UPDATE_OP )
+			mask = ai->ai_newmask & ~ai->ai_indexmask;
+		else
+			mask = ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask;
+		if ( !( mask & SLAP_INDEX_ORDERING ) ||
+			attr_find( e->e_attrs, ai->ai_desc ))
+			continue;
+		rc = mdb_order_absent( op, txn, ai, e->e_id,
+			opid == SLAP_INDEX_DELETE_OP ? SLAP_INDEX_DELETE_OP :
+			SLAP_INDEX_ADD_OP );
+		if ( rc )
+			return rc;
+	}
+	return 0;
+}
+
+/* e was modified from oldattrs; its values are already indexed */
+int
+mdb_order_modify(
+	Operation *op,
+	MDB_txn *txn,
+	Entry *e,
+	Attribute *oldattrs )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	AttrInfo *ai;
+	slap_mask_t mask;
+	int i, had, has, rc;
+
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		ai = mdb->mi_attrs[i];
+		mask = ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask;
+		if ( !( mask & SLAP_INDEX_ORDERING ))
+			continue;
+		had = attr_find( oldattrs, ai->ai_desc ) != NULL;
+		has = attr_find( e->e_attrs, ai->ai_desc ) != NULL;
+		if ( had == has )
+			continue;
+		rc = mdb_order_absent( op, txn, ai, e->e_id,
+			has ? SLAP_INDEX_DELETE_OP : SLAP_INDEX_ADD_OP );
+		if ( rc )
+			return rc;
+	}
+	return 0;
+}
+
+/* the number of index entries the counts have */
+static int
+mdb_order_total( MDB_txn *txn, AttrInfo *ai, ID *total )
+{
+	MDB_cursor *cc;
+	MDB_val key;
+	ID cnt[2];
+	int rc;
+
+	rc = mdb_cursor_open( txn, ai->ai_cdbi, &cc );
+	if ( rc )
+		return rc;
+	rc = mdb_order_root( cc, &key, cnt );
+	if ( rc == 0 )
+		*total = cnt[OB_ENTRIES];
+	mdb_cursor_close( cc );
+	return rc;
+}
+
+/*
+ * Put mc on the index entry at pos, counting from 0, by going down
+ * from the root to the block holding it. buf has room for a block key.
+ */
+static int
+mdb_order_goto( MDB_txn *txn, AttrInfo *ai, MDB_cursor *mc, ID pos, char *buf )
+{
+	MDB_cursor *cc;
+	MDB_val key, ekey, data;
+	ID cnt[2], base = 0;
+	int rc, level;
+
+	rc = mdb_cursor_open( txn, ai->ai_cdbi, &cc );
+	if ( rc )
+		return rc;
+	rc = mdb_order_root( cc, &key, cnt );
+	for ( level = rc ? 0 : mdb_order_level( &key ); level > 1; level-- ) {
+		/* its first child starts where it does */
+		AC_MEMCPY( buf, key.mv_data, key.mv_size );
+		buf[0] = level - 1;
+		key.mv_data = buf;
+		rc = mdb_cursor_get( cc, &key, &data, MDB_SET_KEY );
+		while ( rc == 0 ) {
+			memcpy( cnt, data.mv_data, sizeof( cnt ));
+			if ( pos < base + cnt[OB_ENTRIES] )
+				break;
+			/* the levels above come after, there is a next one */
+			rc = mdb_cursor_get( cc, &key, &data, MDB_NEXT );
+			if ( rc == 0 && mdb_order_level( &key ) != level - 1 ) {
+				rc = mdb_cursor_get( cc, &key, &data, MDB_PREV );
+				break;
+			}
+			base += cnt[OB_ENTRIES];
+		}
+		if ( rc )
+			break;
+	}
+	if ( rc == 0 )
+		rc = mdb_order_bstart( mc, &key, &ekey, &data );
+	for ( ; rc == 0 && base < pos; base++ )
+		rc = mdb_cursor_get( mc, &ekey, &data, MDB_NEXT );
+	mdb_cursor_close( cc );
+	return rc;
+}
+
+/*
+ * The number of index entries before okey/id, from the blocks before
+ * it on each level. buf has room for two block keys.
+ */
+static int
+mdb_order_rank(
+	MDB_txn *txn,
+	AttrInfo *ai,
+	MDB_val *okey,
+	ID id,
+	ID *rank,
+	char *buf,
+	int maxkey )
+{
+	MDB_cursor *cc, *mc;
+	MDB_val want, key, data;
+	char *wbuf = buf + maxkey;
+	ID cnt[2], base = 0, eid;
+	int rc, level;
+
+	rc = mdb_cursor_open( txn, ai->ai_cdbi, &cc );
+	if ( rc )
+		return rc;
+	rc = mdb_order_root( cc, &key, cnt );
+	for ( level = rc ? 0 : mdb_order_level( &key ); level > 1; level-- ) {
+		AC_MEMCPY( buf, key.mv_data, key.mv_size );
+		buf[0] = level - 1;
+		key.mv_data = buf;
+		mdb_order_bkey( wbuf, level - 1, okey, id, &want );
+		rc = mdb_cursor_get( cc, &key, &data, MDB_SET_KEY );
+		while ( rc == 0 ) {
+			memcpy( cnt, data.mv_data, sizeof( cnt ));
+			rc = mdb_cursor_get( cc, &key, &data, MDB_NEXT );
+			if ( rc == 0 && ( mdb_order_level( &key ) != level - 1 ||
+				mdb_order_bcmp( &key, &want ) > 0 ))
+			{
+				rc = mdb_cursor_get( cc, &key, &data, MDB_PREV );
+				break;
+			}
+			base += cnt[OB_ENTRIES];
+		}
+		if ( rc )
+			break;
+	}
+
+	if ( rc == 0 )
+		rc = mdb_cursor_open( txn, ai->ai_odbi, &mc );
+	if ( rc == 0 ) {
+		MDB_val ekey;
+
+		for ( rc = mdb_order_bstart( mc, &key, &ekey, &data ); rc == 0;
+			rc = mdb_cursor_get( mc, &ekey, &data, MDB_NEXT ))
+		{
+			memcpy( &eid, data.mv_data, sizeof( ID ));
+			if ( mdb_order_ecmp( &ekey, eid, okey, id ) >= 0 )
+				break;
+			base++;
+		}
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+		mdb_cursor_close( mc );
+	}
+	mdb_cursor_close( cc );
+	*rank = base;
+	return rc;
+}
+
+static int
+mdb_ordscan_member( ID *ids, ID id )
+{
+	unsigned x;
+
+	if ( MDB_IDL_IS_RANGE( ids ))
+		return id >= MDB_IDL_RANGE_FIRST( ids ) &&
+			id <= MDB_IDL_RANGE_LAST( ids );
+	x = mdb_idl_search( ids, id );
+	return x <= ids[0] && ids[x] == id;
+}
+
+/* the first ID under the cursor's key; MDB_FIRST_DUP would keep the
+ * end flag MDB_LAST sets, and the next MDB_NEXT_DUP would fail */
+static int
+mdb_ordscan_first_dup( MDB_cursor *mc, MDB_val *key, MDB_val *data )
+{
+	int rc;
+
+	rc = mdb_cursor_get( mc, key, data, MDB_GET_CURRENT );
+	if ( rc == 0 )
+		rc = mdb_cursor_get( mc, key, data, MDB_SET_KEY );
+	return rc;
+}
+
+/* one index entry on in the sort order, or back */
+static int
+mdb_ordscan_step( mdb_ordscan *os, MDB_val *key, MDB_val *data, int back )
+{
+	MDB_cursor *mc = os->os_mc;
+	int rc;
+
+	if ( !os->os_reverse )
+		return mdb_cursor_get( mc, key, data, back ? MDB_PREV : MDB_NEXT );
+
+	rc = mdb_cursor_get( mc, key, data, back ? MDB_PREV_DUP : MDB_NEXT_DUP );
+	if ( rc == MDB_NOTFOUND ) {
+		rc = mdb_cursor_get( mc, key, data,
+			back ? MDB_NEXT_NODUP : MDB_PREV_NODUP );
+		if ( rc == 0 )
+			rc = mdb_cursor_get( mc, key, data,
+				back ? MDB_LAST_DUP : MDB_FIRST_DUP );
+	}
+	return rc;
+}
+
+/* the first index entry of the sort order, or the last */
+static int
+mdb_ordscan_edge( mdb_ordscan *os, int last )
+{
+	MDB_val key, data;
+	int rc;
+
+	if ( !os->os_reverse )
+		return mdb_cursor_get( os->os_mc, &key, &data,
+			last ? MDB_LAST : MDB_FIRST );
+	rc = mdb_cursor_get( os->os_mc, &key, &data, last ? MDB_FIRST : MDB_LAST );
+	if ( rc == 0 ) {
+		if ( last )
+			rc = mdb_cursor_get( os->os_mc, &key, &data, MDB_LAST_DUP );
+		else
+			rc = mdb_ordscan_first_dup( os->os_mc, &key, &data );
+	}
+	return rc;
+}
+
+/* the first index entry whose key sorts at want, or after it */
+static int
+mdb_ordscan_key( mdb_ordscan *os, MDB_val *want, int after )
+{
+	MDB_cursor *mc = os->os_mc;
+	MDB_val key = *want, data;
+	int rc, eq;
+
+	rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+	eq = rc == 0 && key.mv_size == want->mv_size &&
+		!memcmp( key.mv_data, want->mv_data, key.mv_size );
+	if ( !os->os_reverse ) {
+		if ( eq && after )
+			rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_NODUP );
+		return rc;
+	}
+	if ( eq && !after )
+		return 0;
+	if ( rc == 0 )
+		rc = mdb_cursor_get( mc, &key, &data, MDB_PREV_NODUP );
+	else if ( rc == MDB_NOTFOUND )
+		rc = mdb_cursor_get( mc, &key, &data, MDB_LAST );
+	if ( rc == 0 )
+		rc = mdb_ordscan_first_dup( mc, &key, &data );
+	return rc;
+}
+
+/* the nearest candidate, in either direction, or where the cursor is */
+static int
+mdb_ordscan_seek( mdb_ordscan *os, int back, int here )
+{
+	MDB_val key, data;
+	int rc;
+
+	if ( here )
+		rc = mdb_cursor_get( os->os_mc, &key, &data, MDB_GET_CURRENT );
+	else
+		rc = mdb_ordscan_step( os, &key, &data, back );
+	for ( ; rc == 0; rc = mdb_ordscan_step( os, &key, &data, back )) {
+		ID id;
+
+		memcpy( &id, data.mv_data, sizeof( ID ));
+		if ( mdb_ordscan_member( os->os_cands, id ))
+			break;
+	}
+	return rc;
+}
+
+/* remember where the cursor is, to come back to it */
+static void
+mdb_ordscan_mark( mdb_ordscan *os )
+{
+	MDB_val key, data;
+
+	mdb_cursor_get( os->os_mc, &key, &data, MDB_GET_CURRENT );
+	memcpy( &os->os_id, data.mv_data, sizeof( ID ));
+	AC_MEMCPY( os->os_kbuf, key.mv_data, key.mv_size );
+	os->os_key.mv_size = key.mv_size;
+}
+
+static int
+mdb_ordscan_restore( mdb_ordscan *os )
+{
+	MDB_val key = os->os_key, data;
+
+	data.mv_size = sizeof( ID );
+	data.mv_data = &os->os_id;
+	return mdb_cursor_get( os->os_mc, &key, &data, MDB_GET_BOTH );
+}
+
+/* over n candidates, as far as they go; returns how many */
+static unsigned long
+mdb_ordscan_skip( mdb_ordscan *os, unsigned long n, int back )
+{
+	unsigned long i;
+
+	mdb_ordscan_mark( os );
+	for ( i = 0; i < n; i++ ) {
+		if ( mdb_ordscan_seek( os, back, 0 )) {
+			mdb_ordscan_restore( os );
+			break;
+		}
+		mdb_ordscan_mark( os );
+	}
+	return i;
+}
+
+/* the first candidate at or after ID id under key, in sort order */
+static int
+mdb_ordscan_resume( mdb_ordscan *os, MDB_val *key, ID id )
+{
+	MDB_val k = *key, data;
+	int rc;
+
+	data.mv_size = sizeof( ID );
+	data.mv_data = &id;
+	rc = mdb_cursor_get( os->os_mc, &k, &data, MDB_GET_BOTH_RANGE );
+	if ( rc == MDB_NOTFOUND )
+		rc = mdb_ordscan_key( os, key, 1 );
+	if ( rc == 0 )
+		rc = mdb_ordscan_seek( os, 0, 1 );
+	return rc;
+}
+
+/*
+ * Go to about the target'th of count candidates through the counts,
+ * assuming the candidates are spread evenly over the index.
+ */
+static int
+mdb_ordscan_jump(
+	mdb_ordscan *os,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	unsigned long target,
+	unsigned long count,
+	char *buf )
+{
+	ID total, pos;
+	int rc;
+
+	rc = mdb_order_total( txn, ai, &total );
+	if ( rc || !total )
+		return rc ? rc : MDB_NOTFOUND;
+	pos = (double)( target - 1 ) * total / count;
+	if ( pos >= total )
+		pos = total - 1;
+	if ( os->os_reverse )
+		pos = total - 1 - pos;
+
+	rc = mdb_order_goto( txn, ai, os->os_mc, pos, buf );
+	if ( rc == 0 )
+		rc = mdb_ordscan_seek( os, 0, 1 );
+	if ( rc == MDB_NOTFOUND ) {
+		rc = mdb_ordscan_edge( os, 1 );
+		if ( rc == 0 )
+			rc = mdb_ordscan_seek( os, 1, 1 );
+	}
+	return rc;
+}
+
+/* about how many of count candidates come before the marked one */
+static unsigned long
+mdb_ordscan_rank(
+	mdb_ordscan *os,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	unsigned long count,
+	char *buf,
+	int maxkey )
+{
+	ID total, rank;
+
+	if ( mdb_order_total( txn, ai, &total ) || !total ||
+		mdb_order_rank( txn, ai, &os->os_key, os->os_id, &rank,
+			buf, maxkey ))
+		return 0;
+	if ( rank >= total )
+		rank = total - 1;
+	if ( os->os_reverse )
+		rank = total - 1 - rank;
+	return (double)rank * count / total;
+}
+
+/*
+ * Position at the start of a VLV window. Near the ends of the list
+ * the candidates are counted as they are walked; further in, the
+ * counts of the index give the position in O(log n).
+ */
+static int
+mdb_ordscan_vlv( mdb_ordscan *os, MDB_txn *txn, AttrInfo *ai, int maxkey )
+{
+	OpSorted *req = os->os_req;
+	unsigned long target, count = req->os_count, moved;
+	MDB_val key;
+	char *buf = NULL;
+	int rc;
+
+	if ( ai->ai_cdbi )
+		buf = slap_sl_malloc( 2 * maxkey, os->os_memctx );
+
+	if ( !BER_BVISNULL( &req->os_value )) {
+		mdb_order_key( &req->os_value, os->os_kbuf, maxkey, &key );
+		rc = mdb_ordscan_key( os, &key, 0 );
+		if ( rc == 0 )
+			rc = mdb_ordscan_seek( os, 0, 1 );
+		if ( rc == MDB_NOTFOUND ) {
+			/* past the end, send the last ones */
+			req->os_target = count + 1;
+			rc = mdb_ordscan_edge( os, 1 );
+			if ( rc == 0 )
+				rc = mdb_ordscan_seek( os, 1, 1 );
+			if ( rc )
+				goto done;
+			moved = mdb_ordscan_skip( os, req->os_before ?
+				req->os_before - 1 : 0, 1 );
+			os->os_size = moved + 1;
+			goto done;
+		}
+		if ( rc )
+			goto done;
+
+		/* count what comes before it, or look it up */
+		mdb_ordscan_mark( os );
+		for ( target = 1; !mdb_ordscan_seek( os, 1, 0 ); target++ ) {
+			if ( buf && target > MDB_ORDER_BLOCK ) {
+				target = mdb_ordscan_rank( os, txn, ai, count,
+					buf, maxkey ) + 1;
+				break;
+			}
+		}
+		rc = mdb_ordscan_restore( os );
+		if ( rc )
+			goto done;
+		req->os_target = target < count ? target : count;
+	} else {
+		if ( req->os_offset == req->os_listsize ) {
+			/* wants the last one */
+			target = count;
+		} else if ( req->os_listsize && req->os_listsize != count ) {
+			if ( req->os_offset > req->os_listsize )
+				goto range;
+			target = count * req->os_offset / req->os_listsize;
+		} else {
+			if ( req->os_offset > count ) {
+range:
+				req->os_flags |= SLAP_SORTED_RANGE;
+				os->os_end = 1;
+				rc = 0;
+				goto done;
+			}
+			target = req->os_offset;
+		}
+		req->os_target = target;
+		if ( !target )
+			target = 1;
+
+		if ( buf && target > MDB_ORDER_BLOCK &&
+			count - target > MDB_ORDER_BLOCK )
+		{
+			rc = mdb_ordscan_jump( os, txn, ai, target, count, buf );
+		} else if ( target <= count / 2 ) {
+			/* start from the nearer end */
+			rc = mdb_ordscan_edge( os, 0 );
+			if ( rc == 0 )
+				rc = mdb_ordscan_seek( os, 0, 1 );
+			if ( rc == 0 )
+				mdb_ordscan_skip( os, target - 1, 0 );
+		} else {
+			rc = mdb_ordscan_edge( os, 1 );
+			if ( rc == 0 )
+				rc = mdb_ordscan_seek( os, 1, 1 );
+			if ( rc == 0 )
+				mdb_ordscan_skip( os, count - target, 1 );
+		}
+		if ( rc )
+			goto done;
+	}
+
+	moved = mdb_ordscan_skip( os, req->os_before, 1 );
+	if ( os->os_size )
+		os->os_size -= req->os_before - moved;
+	rc = 0;
+
+done:
+	if ( buf )
+		slap_sl_free( buf, os->os_memctx );
+	return rc;
+}
+
+/*
+ * Set up the walk for op, if it asked for one that this database
+ * can do. The caller then gets the IDs from mdb_ordscan_next().
+ */
+mdb_ordscan *
+mdb_ordscan_start(
+	Operation *op,
+	MDB_txn *txn,
+	ID *cands,
+	ID ncand )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	OpExtra *oex;
+	OpSorted *req = NULL;
+	AttrInfo *ai;
+	mdb_ordscan *os;
+	MDB_stat ms;
+	MDB_val key;
+	ID id;
+	int rc, maxkey;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == SLAP_SORTED_KEY ) {
+			req = (OpSorted *)oex;
+			break;
+		}
+	}
+	if ( !req )
+		return NULL;
+
+	/* glued databases would each send a sorted list of their own */
+	if ( SLAP_GLUE_INSTANCE( op->o_bd ) || SLAP_GLUE_SUBORDINATE( op->o_bd ))
+		return NULL;
+
+	/* the keys are in the order of the octets of the values */
+	if ( !octet_ordering )
+		octet_ordering = mr_find( "octetStringOrderingMatch" );
+	if ( !octet_ordering || !req->os_ordering ||
+		req->os_ordering->smr_match != octet_ordering->smr_match )
+		return NULL;
+
+	ai = mdb_attr_mask( mdb, req->os_ad );
+	if ( !ai || !ai->ai_odbi || !( ai->ai_indexmask & SLAP_INDEX_ORDERING ))
+		return NULL;
+
+	/* a range of IDs also counts those of deleted entries */
+	if ( MDB_IDL_IS_RANGE( cands ) &&
+		!mdb_stat( txn, mdb->mi_id2entry, &ms ) && ms.ms_entries < ncand )
+		ncand = ms.ms_entries;
+
+	/* few candidates are quicker to sort than to look for, but
+	 * the pages after the first must come from the index too */
+	if ( BER_BVISNULL( &req->os_resume ) &&
+		( mdb_stat( txn, ai->ai_odbi, &ms ) ||
+		  ms.ms_entries / MDB_ORDER_SPARSE > ncand ))
+		return NULL;
+
+	maxkey = mdb_env_get_maxkeysize( mdb->mi_dbenv );
+	os = op->o_tmpalloc( sizeof( mdb_ordscan ) + maxkey, op->o_tmpmemctx );
+	if ( mdb_cursor_open( txn, ai->ai_odbi, &os->os_mc )) {
+		op->o_tmpfree( os, op->o_tmpmemctx );
+		return NULL;
+	}
+	os->os_req = req;
+	os->os_memctx = op->o_tmpmemctx;
+	os->os_cands = cands;
+	os->os_reverse = req->os_reverse;
+	os->os_pending = 0;
+	os->os_end = 0;
+	os->os_size = req->os_size;
+	os->os_maxkey = MDB_ORDER_KEYMAX( maxkey );
+	os->os_id = NOID;
+	os->os_key.mv_data = os->os_kbuf;
+	os->os_key.mv_size = 0;
+
+	req->os_count = ncand;
+	req->os_target = 0;
+	BER_BVZERO( &req->os_next );
+
+	if ( !BER_BVISNULL( &req->os_resume )) {
+		/* the next page */
+		rc = MDB_NOTFOUND;
+		if ( req->os_resume.bv_len > sizeof( ID )) {
+			memcpy( &id, req->os_resume.bv_val, sizeof( ID ));
+			key.mv_data = req->os_resume.bv_val + sizeof( ID );
+			key.mv_size = req->os_resume.bv_len - sizeof( ID );
+			rc = mdb_ordscan_resume( os, &key, id );
+		}
+	} else if ( req->os_flags & SLAP_SORTED_VLV ) {
+		rc = mdb_ordscan_vlv( os, txn, ai, maxkey );
+	} else {
+		rc = mdb_ordscan_edge( os, 0 );
+		if ( rc == 0 )
+			rc = mdb_ordscan_seek( os, 0, 1 );
+	}
+	if ( rc == 0 )
+		os->os_pending = !os->os_end;
+	else if ( rc == MDB_NOTFOUND )
+		os->os_end = 1;
+	else {
+		mdb_cursor_close( os->os_mc );
+		op->o_tmpfree( os, op->o_tmpmemctx );
+		return NULL;
+	}
+
+	req->os_flags |= SLAP_SORTED_DONE;
+	return os;
+}
+
+/* the next ID to check, with nsent entries sent so far */
+ID
+mdb_ordscan_next( mdb_ordscan *os, int nsent )
+{
+	OpSorted *req = os->os_req;
+	MDB_val key, data;
+	int rc;
+
+	if ( os->os_end )
+		return NOID;
+	if ( os->os_pending ) {
+		os->os_pending = 0;
+		rc = 0;
+	} else {
+		rc = mdb_ordscan_seek( os, 0, 0 );
+	}
+	if ( rc ) {
+		os->os_end = 1;
+		return NOID;
+	}
+
+	if ( os->os_size && (unsigned long)nsent >= os->os_size ) {
+		/* a following page starts here */
+		mdb_cursor_get( os->os_mc, &key, &data, MDB_GET_CURRENT );
+		req->os_next.bv_len = sizeof( ID ) + key.mv_size;
+		req->os_next.bv_val = slap_sl_malloc( req->os_next.bv_len,
+			os->os_memctx );
+		memcpy( req->os_next.bv_val, data.mv_data, sizeof( ID ));
+		memcpy( req->os_next.bv_val + sizeof( ID ), key.mv_data, key.mv_size );
+		os->os_end = 1;
+		return NOID;
+	}
+
+	mdb_ordscan_mark( os );
+	return os->os_id;
+}
+
+/*
+ * Entries are sent where the walk meets their least value, as
+ * sssvlv sorts them; returns nonzero if e, as the last ID returned,
+ * is not there.
+ */
+int
+mdb_ordscan_check( mdb_ordscan *os, Entry *e )
+{
+	Attribute *a;
+	struct berval *least;
+	unsigned i;
+	int cmp;
+
+	a = attr_find( e->e_attrs, os->os_req->os_ad );
+	if ( !a )
+		return os->os_kbuf[0] != MDB_ORDER_ABSENT;
+	if ( os->os_kbuf[0] != MDB_ORDER_VALUE )
+		return 1;
+
+	least = &a->a_nvals[0];
+	for ( i = 1; i < a->a_numvals; i++ ) {
+		ber_len_t len = a->a_nvals[i].bv_len < least->bv_len ?
+			a->a_nvals[i].bv_len : least->bv_len;
+
+		cmp = memcmp( a->a_nvals[i].bv_val, least->bv_val, len );
+		if ( cmp < 0 || ( cmp == 0 && a->a_nvals[i].bv_len < least->bv_len ))
+			least = &a->a_nvals[i];
+	}
+
+	/* compared as the index has it */
+	if ( least->bv_len + 1 < os->os_key.mv_size ||
+		( least->bv_len + 1 > os->os_key.mv_size &&
+		  os->os_key.mv_size < os->os_maxkey ))
+		return 1;
+	return memcmp( least->bv_val, os->os_kbuf + 1,
+		os->os_key.mv_size - 1 ) != 0;
+}
+
+/* the read txn was reset and renewed */
+int
+mdb_ordscan_fixup( mdb_ordscan *os, MDB_txn *txn )
+{
+	int rc;
+
+	rc = mdb_cursor_renew( txn, os->os_mc );
+	if ( rc || os->os_end || os->os_pending || !os->os_key.mv_size )
+		return rc;
+
+	rc = mdb_ordscan_restore( os );
+	if ( rc == MDB_NOTFOUND ) {
+		/* gone meanwhile, go on from the next one */
+		rc = mdb_ordscan_resume( os, &os->os_key, os->os_id );
+		if ( rc == 0 )
+			os->os_pending = 1;
+		else if ( rc == MDB_NOTFOUND ) {
+			os->os_end = 1;
+			rc = 0;
+		}
+	}
+	return rc;
+}
+
+void
+mdb_ordscan_end( Operation *op, mdb_ordscan *os )
+{
+	mdb_cursor_close( os->os_mc );
+	op->o_tmpfree( os, op->o_tmpmemctx );
+}
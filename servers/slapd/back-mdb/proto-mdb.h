@@ -29,6 +29,8 @@ AttrInfo *mdb_attr_mask( struct mdb_info *mdb,
 
 void mdb_attr_flush( struct mdb_info *mdb );
 
+AttrInfo *mdb_attr_dbi( struct mdb_info *mdb, MDB_dbi dbi );
+
 int mdb_attr_slot( struct mdb_info *mdb,
 	AttributeDescription *desc, int *insert );
 
@@ -48,6 +50,49 @@ void mdb_attr_info_free( AttrInfo *ai );
 
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn );
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
+void mdb_ad_unwind( struct mdb_info *mdb, int prev_ads );
+
+/*
+ * bitmap.c
+ */
+
+int mdb_bitmap_add( BackendDB *be, MDB_txn *txn, MDB_dbi dbi,
+	MDB_val *key, ID id, ID *count );
+int mdb_bitmap_del( BackendDB *be, MDB_txn *txn, MDB_dbi dbi,
+	MDB_val *key, ID id, ID *count );
+int mdb_bitmap_create( BackendDB *be, MDB_cursor *mc, MDB_val *key,
+	ID *count );
+int mdb_bitmap_load( BackendDB *be, MDB_txn *txn, MDB_dbi dbi,
+	MDB_val *key, ID *ids, size_t n );
+int mdb_bitmap_count( struct mdb_info *mdb, MDB_txn *txn, MDB_dbi dbi,
+	MDB_val *key, ID *count );
+int mdb_bitmap_drop( struct mdb_info *mdb, MDB_txn *txn, AttrInfo *ai,
+	MDB_dbi dbi );
+int mdb_bitmap_fetch( BackendDB *be, MDB_txn *txn, MDB_dbi dbi,
+	MDB_val *key, ID *ids );
+int mdb_bitmap_combine( BackendDB *be, MDB_txn *txn, int ftype,
+	int n, MDB_dbi *dbis, MDB_val *keys, int withids, ID *ids, ID *tmp );
+
+/*
+ * cache.c
+ */
+
+int mdb_cache_usable( Operation *op, struct mdb_info *mdb );
+int mdb_cache_find( Operation *op, MDB_txn *txn, ID id, Entry **e );
+int mdb_cache_add( Operation *op, MDB_txn *txn, ID id, MDB_val *data,
+	Entry **e );
+void mdb_cache_return( mdb_centry *ce );
+void mdb_cache_invalidate( struct mdb_info *mdb, MDB_txn *txn, ID id );
+void mdb_cache_init( mdb_cache *cache );
+void mdb_cache_release_all( mdb_cache *cache );
+void mdb_cache_destroy( mdb_cache *cache );
+
+/*
+ * backup.c
+ */
+
+int mdb_backup_init( void );
+BI_op_extended mdb_backup;
 
 /*
  * config.c
@@ -55,6 +100,31 @@ int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 
 int mdb_back_init_cf( BackendInfo *bi );
 
+/*
+ * count.c
+ */
+
+#ifdef SLAP_CONTROL_X_COUNT
+struct IdScopes;
+
+int mdb_search_count(
+	Operation *op,
+	SlapReply *rs,
+	MDB_cursor *mc,
+	Entry *base,
+	struct IdScopes *isc,
+	ID *ids,
+	ID nsubs,
+	ID *stack );
+#endif
+
+/*
+ * group.c
+ */
+
+int mdb_group_usable( Operation *op, struct mdb_info *mdb );
+int mdb_group_op( Operation *op, SlapReply *rs, BI_op_func *func );
+
 /*
  * dn2entry.c
  */
@@ -164,6 +234,16 @@ int mdb_filter_candidates(
 	ID *tmp,
 	ID *stack );
 
+int mdb_filter_exact(
+	Operation *op,
+	Filter *f );
+
+int mdb_filter_keycount(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f,
+	ID *count );
+
 /*
  * id2entry.c
  */
@@ -203,6 +283,11 @@ BI_entry_get_rw mdb_entry_get;
 BI_op_txn mdb_txn;
 
 int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, Entry **e );
+int mdb_entry_decode_map( Operation *op, MDB_txn *txn, MDB_val *data,
+	mdb_attrmap *map, Entry **e );
+size_t mdb_entry_decode_size( MDB_val *data );
+int mdb_entry_decode_to( struct mdb_info *mdb, MDB_txn *txn, MDB_val *data,
+	mdb_attrmap *map, Entry *x );
 
 void mdb_reader_flush( MDB_env *env );
 int mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **moi );
@@ -222,6 +307,14 @@ int mdb_idl_fetch_key(
 	MDB_cursor	**saved_cursor,
 	int                     get_flag );
 
+int mdb_idl_count_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count,
+	int			*range );
+
 int mdb_idl_insert( ID *ids, ID id );
 
 typedef int (mdb_idl_keyfunc)(
@@ -243,6 +336,12 @@ mdb_idl_union(
 	ID *a,
 	ID *b );
 
+int
+mdb_idl_notin(
+	ID *a,
+	ID *b,
+	ID *ids );
+
 ID mdb_idl_first( ID *ids, ID *cursor );
 ID mdb_idl_next( ID *ids, ID *cursor );
 
@@ -303,6 +402,20 @@ int mdb_index_entry LDAP_P(( Operation *op, MDB_txn *t, int r, Entry *e ));
 #define mdb_index_entry_del(op,t,e) \
 	mdb_index_entry((op),(t),SLAP_INDEX_DELETE_OP,(e))
 
+void mdb_ixkeys_start( Operation *op, mdb_ixkeys *ik );
+mdb_ixkeys *mdb_ixkeys_get( Operation *op );
+int mdb_ixkeys_add(
+	mdb_ixkeys *ik,
+	AttrInfo *ai,
+	MDB_dbi dbi,
+	struct berval *keys,
+	ID id );
+int mdb_ixkey_cmp( const void *v1, const void *v2 );
+void mdb_ixkeys_sort( mdb_ixkeys *ik );
+void mdb_ixkeys_stop( Operation *op, mdb_ixkeys *ik );
+int mdb_ixkeys_store( Operation *op, MDB_txn *txn, mdb_ixkeys *ik, ID *skip );
+void mdb_ixkeys_free( mdb_ixkeys *ik );
+
 /*
  * key.c
  */
@@ -317,6 +430,42 @@ mdb_key_read(
     MDB_cursor **saved_cursor,
         int get_flags );
 
+extern int
+mdb_key_count(
+    Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+    struct berval *k,
+	ID *count,
+	int *range );
+
+extern int
+mdb_key_combine(
+    Backend	*be,
+	MDB_txn *txn,
+	int ftype,
+	int n,
+	MDB_dbi *dbis,
+    struct berval *k,
+	int withids,
+	ID *ids,
+	ID *tmp );
+
+/*
+ * ixstat.c
+ */
+
+int mdb_ixstat_get( struct mdb_info *mdb, MDB_txn *txn, AttrInfo *ai,
+	mdb_ixstat *st );
+int mdb_ixstat_open( struct mdb_info *mdb, MDB_txn *txn, AttrInfo *ai );
+int mdb_ixstat_reset( struct mdb_info *mdb, MDB_txn *txn, AttrInfo *ai );
+int mdb_ixstat_rebuild( struct mdb_info *mdb, MDB_txn *txn, AttrInfo *ai );
+ID mdb_ixstat_maxcount( struct mdb_info *mdb, AttrInfo *ai );
+void mdb_ixstat_begin( mdb_ixupdate *iu, MDB_cursor *mc );
+void mdb_ixstat_update( BackendDB *be, mdb_ixupdate *iu, MDB_val *key,
+	ID ocount, ID ncount );
+int mdb_ixstat_end( BackendDB *be, mdb_ixupdate *iu );
+
 /*
  * nextid.c
  */
@@ -353,6 +502,77 @@ mdb_monitor_idx_add(
 	slap_mask_t		type );
 #endif /* MDB_MONITOR_IDX */
 
+/*
+ * ngram.c
+ */
+
+int mdb_ngram_open( struct mdb_info *mdb, MDB_txn *txn, AttrInfo *ai );
+int mdb_ngram_values(
+	Operation *op,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	BerVarray vals,
+	ID id,
+	int opid );
+ID mdb_ngram_estimate(
+	Operation *op,
+	MDB_txn *rtxn,
+	SubstringsAssertion *sub );
+int mdb_ngram_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	SubstringsAssertion *sub,
+	ID *ids,
+	ID *tmp );
+
+/*
+ * order.c
+ */
+
+int mdb_order_open( struct mdb_info *mdb, MDB_txn *txn, AttrInfo *ai );
+int mdb_order_values(
+	Operation *op,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	BerVarray vals,
+	ID id,
+	int opid );
+int mdb_order_entry( Operation *op, MDB_txn *txn, int opid, Entry *e );
+int mdb_order_put(
+	MDB_txn *txn,
+	AttrInfo *ai,
+	MDB_cursor *mc,
+	MDB_val *key,
+	ID id,
+	int opid,
+	char *buf,
+	int maxkey );
+int mdb_order_modify(
+	Operation *op,
+	MDB_txn *txn,
+	Entry *e,
+	Attribute *oldattrs );
+
+mdb_ordscan *mdb_ordscan_start(
+	Operation *op,
+	MDB_txn *txn,
+	ID *cands,
+	ID ncand );
+ID mdb_ordscan_next( mdb_ordscan *os, int nsent );
+int mdb_ordscan_check( mdb_ordscan *os, Entry *e );
+int mdb_ordscan_fixup( mdb_ordscan *os, MDB_txn *txn );
+void mdb_ordscan_end( Operation *op, mdb_ordscan *os );
+
+/*
+ * search.c
+ */
+
+void *mdb_pcursor_expire( void *ctx, void *arg );
+void mdb_pcursor_release_all( struct mdb_info *mdb );
+void mdb_pcursor_schedule( BackendDB *be );
+void mdb_pcursor_clamp( BackendDB *be );
+BI_connection_destroy mdb_connection_destroy;
+
 /*
  * former external.h
  */
@@ -387,6 +607,7 @@ extern BI_tool_entry_reindex		mdb_tool_entry_reindex;
 extern BI_tool_dn2id_get		mdb_tool_dn2id_get;
 extern BI_tool_entry_modify		mdb_tool_entry_modify;
 extern BI_tool_entry_delete		mdb_tool_entry_delete;
+extern BI_tool_entry_range		mdb_tool_entry_range;
 
 extern mdb_idl_keyfunc mdb_tool_idl_add;
 
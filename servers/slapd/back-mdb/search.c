@@ -21,6 +21,8 @@
 
 #include "back-mdb.h"
 #include "idl.h"
+#include "lutil.h"
+#include "ldap_rq.h"
 
 static int base_candidate(
 	BackendDB	*be,
@@ -44,6 +46,19 @@ static void send_paged_response(
 	ID  *lastid,
 	int tentries );
 
+static mdb_pcursor *mdb_pcursor_take( Operation *op, struct mdb_info *mdb );
+static void mdb_pcursor_free( mdb_pcursor *pc );
+
+static void mdb_pcursor_keep(
+	Operation *op,
+	struct mdb_info *mdb,
+	mdb_pcursor *pc,
+	struct berval *base,
+	ID *ids,
+	ID ncand,
+	MDB_txn *txn,
+	ID lastid );
+
 /* Dereference aliases for a single alias entry. Return the final
  * dereferenced entry on success, NULL on any failure.
  */
@@ -122,7 +137,8 @@ static Entry * deref_base (
 }
 
 /* Look for and dereference all aliases within the search scope.
- * Requires "stack" to be able to hold 6 levels of DB_SIZE IDLs.
+ * Requires "stack" to be able to hold 3 UM_SIZE and 3 DB_SIZE IDLs,
+ * since index reads may return up to UM_SIZE IDs.
  * Of course we're hardcoded to require a minimum of 8 UM_SIZE
  * IDLs so this is never a problem.
  */
@@ -142,9 +158,9 @@ static int search_aliases(
 	Filter	af;
 
 	aliases = stack;	/* IDL of all aliases in the database */
-	curscop = aliases + MDB_IDL_DB_SIZE;	/* Aliases in the current scope */
-	visited = curscop + MDB_IDL_DB_SIZE;	/* IDs we've seen in this search */
-	newsubs = visited + MDB_IDL_DB_SIZE;	/* New subtrees we've added */
+	curscop = aliases + MDB_IDL_UM_SIZE;	/* Aliases in the current scope */
+	visited = curscop + MDB_IDL_UM_SIZE;	/* IDs we've seen in this search */
+	newsubs = visited + MDB_IDL_UM_SIZE;	/* New subtrees we've added */
 	oldsubs = newsubs + MDB_IDL_DB_SIZE;	/* Subtrees added previously */
 	tmp = oldsubs + MDB_IDL_DB_SIZE;	/* Scratch space for deref_base() */
 
@@ -412,13 +428,559 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 	return rc;
 }
 
+/* Entries are decoded with only the attributes a search can look at:
+ * those in its filter, the requested ones, and those its access
+ * rules depend on. Overlays and callbacks may look at anything, so
+ * when there are any the whole entry is decoded.
+ */
+static mdb_attrmap *
+mdb_attrmap_new( Operation *op, struct mdb_info *mdb )
+{
+	mdb_attrmap *map;
+
+	map = op->o_tmpcalloc( 1, sizeof( mdb_attrmap ) + mdb->mi_numads,
+		op->o_tmpmemctx );
+	map->am_numads = mdb->mi_numads;
+	return map;
+}
+
+static void
+mdb_attrmap_add( struct mdb_info *mdb, mdb_attrmap *map,
+	AttributeDescription *ad )
+{
+	int i;
+
+	for ( i = 1; i <= map->am_numads; i++ ) {
+		if ( !map->am_want[i] && is_ad_subtype( mdb->mi_ads[i], ad ))
+			map->am_want[i] = 1;
+	}
+}
+
+static void
+mdb_attrmap_filter( struct mdb_info *mdb, mdb_attrmap *map, Filter *f )
+{
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f; f = f->f_next )
+			mdb_attrmap_filter( mdb, map, f );
+		break;
+	case LDAP_FILTER_NOT:
+		mdb_attrmap_filter( mdb, map, f->f_not );
+		break;
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		mdb_attrmap_add( mdb, map, f->f_av_desc );
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		mdb_attrmap_add( mdb, map, f->f_sub_desc );
+		break;
+	case LDAP_FILTER_PRESENT:
+		mdb_attrmap_add( mdb, map, f->f_desc );
+		break;
+	case LDAP_FILTER_EXT:
+		/* without a type, the rule applies to every attribute */
+		if ( f->f_mr_desc )
+			mdb_attrmap_add( mdb, map, f->f_mr_desc );
+		else
+			memset( map->am_want, 1, map->am_numads + 1 );
+		break;
+	}
+}
+
+static int
+mdb_attrmap_acl( struct mdb_info *mdb, mdb_attrmap *map, AccessControl *a )
+{
+	Access *b;
+
+	for ( ; a; a = a->acl_next ) {
+		if ( a->acl_filter )
+			mdb_attrmap_filter( mdb, map, a->acl_filter );
+		for ( b = a->acl_access; b; b = b->a_next ) {
+			/* sets and dynamic ACLs may read any attribute */
+			if ( !BER_BVISEMPTY( &b->a_set_pat ))
+				return -1;
+#ifdef SLAP_DYNACL
+			if ( b->a_dynacl )
+				return -1;
+#endif /* SLAP_DYNACL */
+			if ( b->a_dn_at )
+				mdb_attrmap_add( mdb, map, b->a_dn_at );
+			if ( b->a_realdn_at )
+				mdb_attrmap_add( mdb, map, b->a_realdn_at );
+			/* the group may be the entry itself */
+			if ( b->a_group_at )
+				mdb_attrmap_add( mdb, map, b->a_group_at );
+		}
+	}
+	return 0;
+}
+
+/* the attributes to send entries with, or NULL for all of them */
+static mdb_attrmap *
+mdb_search_attrmap( Operation *op, struct mdb_info *mdb )
+{
+	mdb_attrmap *map;
+	slap_callback *sc;
+	AttributeName *an;
+	int i, user, oper;
+
+	if ( overlay_is_over( op->o_bd ) || overlay_is_over( frontendDB ))
+		return NULL;
+	for ( sc = op->o_callback; sc; sc = sc->sc_next ) {
+		if ( sc->sc_response )
+			return NULL;
+	}
+	for ( an = op->ors_attrs; an && !BER_BVISNULL( &an->an_name ); an++ ) {
+		if ( an->an_oc )
+			return NULL;
+	}
+
+	map = mdb_attrmap_new( op, mdb );
+	if ( mdb_attrmap_acl( mdb, map, op->o_bd->be_acl ) ||
+		mdb_attrmap_acl( mdb, map, frontendDB->be_acl ))
+	{
+		op->o_tmpfree( map, op->o_tmpmemctx );
+		return NULL;
+	}
+	mdb_attrmap_filter( mdb, map, op->ors_filter );
+	mdb_attrmap_add( mdb, map, slap_schema.si_ad_objectClass );
+	mdb_attrmap_add( mdb, map, slap_schema.si_ad_ref );
+
+	user = op->ors_attrs == NULL ||
+		an_find( op->ors_attrs, slap_bv_all_user_attrs );
+	oper = op->ors_attrs != NULL &&
+		an_find( op->ors_attrs, slap_bv_all_operational_attrs );
+	for ( i = 1; i <= map->am_numads; i++ ) {
+		if ( is_at_operational( mdb->mi_ads[i]->ad_type ) ? oper : user )
+			map->am_want[i] = 1;
+	}
+	for ( an = op->ors_attrs; an && !BER_BVISNULL( &an->an_name ); an++ ) {
+		if ( an->an_desc )
+			mdb_attrmap_add( mdb, map, an->an_desc );
+	}
+	return map;
+}
+
+/* Large candidate-based searches can have helper tasks on the
+ * thread pool fetch, decode and filter chunks of the candidate
+ * list ahead of the thread sending the results. Each helper reads
+ * the database in the snapshot the search started with, and only
+ * passes on the IDs of entries that match the filter; the sender
+ * still checks scope, access and the filter again for each of them
+ * in its own txn, and sends them in ID order. Chunks that no helper
+ * has started yet are simply processed by the sender itself, so it
+ * never waits for a task that may not get a thread.
+ *
+ * Helpers test the filter as the rootdn of the database, and so are
+ * only used if it has one, and without the entry's DN. Access
+ * control can only make a filter Undefined that would otherwise have
+ * been True or False, so nothing the sender would send is dropped;
+ * filters that depend on the DN or on the backend are never
+ * evaluated by helpers.
+ */
+enum {
+	PC_FREE = 0,	/* not started yet */
+	PC_BUSY,	/* a helper is filtering it */
+	PC_DONE,	/* pc_ids holds the matching IDs */
+	PC_SENDER	/* all candidates must be checked by the sender */
+};
+
+typedef struct ps_chunk {
+	ID		pc_first, pc_last;	/* IDL positions, or IDs of a range */
+	int		pc_state;
+	ID		*pc_ids;
+} ps_chunk;
+
+typedef struct psearch {
+	Operation	ps_op;		/* template for the helpers */
+	Operation	*ps_orig;	/* the search itself */
+	Opheader	ps_hdr;
+	ID		*ps_cands;
+	FilterProgram	*ps_fprog;
+	mdb_attrmap	*ps_map;	/* the filter's attributes */
+	MDB_txn	**ps_txns;	/* for the helpers, in the search's snapshot */
+	int		ps_ntxns;	/* taken by helpers */
+	ps_chunk	*ps_chunks;
+	int		ps_nchunks;
+	int		ps_next;	/* next chunk to start */
+	int		ps_send;	/* chunk the sender is at */
+	int		ps_window;
+	int		ps_tasks;	/* helpers not finished yet */
+	int		ps_filtered;	/* chunks the helpers filtered */
+	int		ps_stop;
+	ID		ps_cur;		/* sender's position in its chunk */
+	ldap_pvt_thread_mutex_t	ps_mutex;
+	ldap_pvt_thread_cond_t	ps_cond;
+} psearch;
+
+static int
+mdb_psearch_filter_ok( Filter *f )
+{
+	AttributeDescription *ad;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f; f = f->f_next ) {
+			if ( !mdb_psearch_filter_ok( f ))
+				return 0;
+		}
+		return 1;
+	case LDAP_FILTER_NOT:
+		return mdb_psearch_filter_ok( f->f_not );
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		break;
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		break;
+	case LDAP_FILTER_EXT:
+		if ( f->f_mr_dnattrs )
+			return 0;
+		ad = f->f_mr_desc;
+		break;
+	default:
+		return 1;
+	}
+	return ad != slap_schema.si_ad_entryDN &&
+		ad != slap_schema.si_ad_hasSubordinates;
+}
+
+/* filter one chunk, leaving the IDs of matching entries in pc_ids */
+static int
+mdb_psearch_chunk( Operation *op, psearch *ps, MDB_cursor *mc, ps_chunk *pc )
+{
+	MDB_val key, data;
+	Entry *e;
+	ID id, i;
+	int rc = 0, isrange = MDB_IDL_IS_RANGE( ps->ps_cands );
+
+	pc->pc_ids = ch_malloc( ( MDB_PSEARCH_CHUNK + 1 ) * sizeof(ID) );
+	pc->pc_ids[0] = 0;
+
+	key.mv_size = sizeof(ID);
+	if ( isrange ) {
+		id = pc->pc_first;
+		key.mv_data = &id;
+		rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+	}
+	for ( i = pc->pc_first; i <= pc->pc_last; i++ ) {
+		if ( isrange ) {
+			if ( rc )
+				break;
+			memcpy( &id, key.mv_data, sizeof(ID) );
+			if ( id > pc->pc_last )
+				break;
+		} else {
+			id = ps->ps_cands[i];
+			rc = mdb_id2edata( op, mc, id, &data );
+		}
+		if ( rc == MDB_SUCCESS && data.mv_size ) {
+			rc = mdb_entry_decode_map( op, mdb_cursor_txn( mc ), &data,
+				ps->ps_map, &e );
+			if ( rc )
+				return rc;
+			e->e_id = id;
+			BER_BVZERO( &e->e_name );
+			BER_BVZERO( &e->e_nname );
+			if ( test_filter_program( op, e, ps->ps_fprog ) == LDAP_COMPARE_TRUE )
+				pc->pc_ids[++pc->pc_ids[0]] = id;
+			mdb_entry_return( op, e );
+		} else if ( rc != MDB_SUCCESS && rc != MDB_NOTFOUND ) {
+			return rc;
+		}
+		if ( isrange )
+			rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT );
+	}
+	return 0;
+}
+
+static void *
+mdb_psearch_task( void *ctx, void *arg )
+{
+	psearch *ps = arg;
+	struct mdb_info *mdb = (struct mdb_info *) ps->ps_op.o_bd->be_private;
+	Operation op = ps->ps_op;
+	Opheader hdr = ps->ps_hdr;
+	mdb_op_info opinfo = {{{0}}};
+	MDB_cursor *mc = NULL;
+	ps_chunk *pc;
+	int rc;
+
+	/* our own thread and memory, and one of the txns the search
+	 * opened; full access, see above */
+	op.o_hdr = &hdr;
+	op.o_threadctx = ctx;
+	op.o_tmpmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK,
+		ctx, 1 );
+	op.o_dn = op.o_bd->be_rootdn;
+	op.o_ndn = op.o_bd->be_rootndn;
+	LDAP_SLIST_INIT( &op.o_extra );
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	opinfo.moi_txn = ps->ps_txns[ps->ps_ntxns++];
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+	opinfo.moi_oe.oe_key = mdb;
+	opinfo.moi_ref = 1;
+	opinfo.moi_flag = MOI_READER;
+	LDAP_SLIST_INSERT_HEAD( &op.o_extra, &opinfo.moi_oe, oe_next );
+	rc = mdb_cursor_open( opinfo.moi_txn, mdb->mi_id2entry, &mc );
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	while ( rc == 0 ) {
+		while ( !ps->ps_stop && ps->ps_next < ps->ps_nchunks &&
+			ps->ps_next >= ps->ps_send + ps->ps_window )
+			ldap_pvt_thread_cond_wait( &ps->ps_cond, &ps->ps_mutex );
+		if ( ps->ps_stop || ps->ps_next >= ps->ps_nchunks ||
+			ps->ps_orig->o_abandon )
+			break;
+		pc = &ps->ps_chunks[ps->ps_next++];
+		pc->pc_state = PC_BUSY;
+		ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+		rc = mdb_psearch_chunk( &op, ps, mc, pc );
+
+		ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+		pc->pc_state = rc ? PC_SENDER : PC_DONE;
+		if ( !rc )
+			ps->ps_filtered++;
+		ldap_pvt_thread_cond_broadcast( &ps->ps_cond );
+	}
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+	if ( mc )
+		mdb_cursor_close( mc );
+	/* the search aborts the txn */
+	LDAP_SLIST_REMOVE( &op.o_extra, &opinfo.moi_oe, OpExtra, oe_next );
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	ps->ps_tasks--;
+	ldap_pvt_thread_cond_broadcast( &ps->ps_cond );
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+	return NULL;
+}
+
+/* whether helpers can evaluate the filter of the search, and may
+ * be used for it at all */
+static int
+mdb_psearch_ok( Operation *op )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+
+	return mdb->mi_search_threads && ( mdb->mi_flags & MDB_PCURSORS ) &&
+		!( slapMode & SLAP_TOOL_MODE ) &&
+		op->ors_scope != LDAP_SCOPE_BASE &&
+		!BER_BVISEMPTY( &op->o_bd->be_rootndn ) &&
+		mdb_psearch_filter_ok( op->ors_filter );
+}
+
+static void
+mdb_psearch_txns_free( Operation *op, MDB_txn **txns )
+{
+	int i;
+
+	for ( i = 0; txns[i]; i++ )
+		mdb_txn_abort( txns[i] );
+	op->o_tmpfree( txns, op->o_tmpmemctx );
+}
+
+/* Open the read txns of the helpers before the search reads anything
+ * in its own txn, and in the same snapshot; if a write commits in
+ * between, the search's txn is renewed and they are opened again.
+ * The array ends with a NULL, and is NULL if they can't be had.
+ */
+static MDB_txn **
+mdb_psearch_txns( Operation *op, MDB_txn *txn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_txn **txns;
+	int i, n = mdb->mi_search_threads, rc = 0, tries;
+
+	txns = op->o_tmpcalloc( n + 1, sizeof( MDB_txn * ), op->o_tmpmemctx );
+	for ( tries = 0; tries < MDB_PSEARCH_TRIES; tries++ ) {
+		for ( i = 0; i < n; i++ ) {
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txns[i] );
+			if ( rc ) {
+				txns[i] = NULL;
+				break;
+			}
+			if ( mdb_txn_id( txns[i] ) != mdb_txn_id( txn ))
+				break;
+		}
+		if ( i == n )
+			return txns;
+		for ( i = 0; txns[i]; i++ ) {
+			mdb_txn_abort( txns[i] );
+			txns[i] = NULL;
+		}
+		if ( rc )
+			break;
+		mdb_txn_reset( txn );
+		rc = mdb_txn_renew( txn );
+		if ( rc )
+			break;
+	}
+	op->o_tmpfree( txns, op->o_tmpmemctx );
+	Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_search)
+		": no txns for helpers: %s (%d)\n",
+		rc ? mdb_strerror( rc ) : "database changing", rc, 0 );
+	return NULL;
+}
+
+/* Set up helpers for the candidates from position start on, if the
+ * search is worth it, with the txns from mdb_psearch_txns(), which
+ * are freed with the helpers or now if there are none.
+ */
+static psearch *
+mdb_psearch_start( Operation *op, MDB_txn **txns, ID *cands, ID start,
+	ID ncand, FilterProgram *fprog )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	psearch *ps;
+	ID first, last;
+	int i, n;
+
+	if ( ncand < MDB_PSEARCH_MIN ) {
+		mdb_psearch_txns_free( op, txns );
+		return NULL;
+	}
+
+	first = start;
+	if ( MDB_IDL_IS_RANGE( cands ))
+		last = MDB_IDL_RANGE_LAST( cands );
+	else
+		last = cands[0];
+	n = ( last - first ) / MDB_PSEARCH_CHUNK + 1;
+	if ( n < 2 ) {
+		mdb_psearch_txns_free( op, txns );
+		return NULL;
+	}
+
+	ps = ch_calloc( 1, sizeof( psearch ) + n * sizeof( ps_chunk ));
+	ps->ps_op = *op;
+	ps->ps_orig = op;
+	ps->ps_hdr = *op->o_hdr;
+	ps->ps_cands = cands;
+	ps->ps_fprog = fprog;
+	ps->ps_map = mdb_attrmap_new( op, mdb );
+	mdb_attrmap_filter( mdb, ps->ps_map, op->ors_filter );
+	mdb_attrmap_add( mdb, ps->ps_map, slap_schema.si_ad_objectClass );
+	ps->ps_txns = txns;
+	ps->ps_chunks = (ps_chunk *)( ps + 1 );
+	ps->ps_nchunks = n;
+	ps->ps_window = 4 * mdb->mi_search_threads;
+	for ( i = 0; i < n; i++ ) {
+		ps->ps_chunks[i].pc_first = first + (ID)i * MDB_PSEARCH_CHUNK;
+		ps->ps_chunks[i].pc_last = ps->ps_chunks[i].pc_first +
+			MDB_PSEARCH_CHUNK - 1;
+	}
+	ps->ps_chunks[n-1].pc_last = last;
+	ps->ps_cur = NOID;
+	ldap_pvt_thread_mutex_init( &ps->ps_mutex );
+	ldap_pvt_thread_cond_init( &ps->ps_cond );
+
+	/* the sender takes the first chunk itself */
+	if ( n > (int)mdb->mi_search_threads )
+		n = mdb->mi_search_threads + 1;
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	for ( i = 1; i < n; i++ ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			mdb_psearch_task, ps ))
+			break;
+		ps->ps_tasks++;
+	}
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+	Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_search)
+		": %d helpers for %d chunks\n", ps->ps_tasks, ps->ps_nchunks, 0 );
+	return ps;
+}
+
+/* the next ID for the sender to check */
+static ID
+mdb_psearch_next( psearch *ps )
+{
+	ps_chunk *pc;
+
+	for (;;) {
+		if ( ps->ps_cur != NOID ) {
+			pc = &ps->ps_chunks[ps->ps_send];
+			if ( pc->pc_state == PC_DONE ) {
+				if ( ++ps->ps_cur <= pc->pc_ids[0] )
+					return pc->pc_ids[ps->ps_cur];
+			} else if ( ++ps->ps_cur <= pc->pc_last ) {
+				if ( MDB_IDL_IS_RANGE( ps->ps_cands ))
+					return ps->ps_cur;
+				return ps->ps_cands[ps->ps_cur];
+			}
+			ch_free( pc->pc_ids );
+			pc->pc_ids = NULL;
+			ps->ps_cur = NOID;
+			ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+			ps->ps_send++;
+			ldap_pvt_thread_cond_broadcast( &ps->ps_cond );
+			ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+		}
+		if ( ps->ps_send >= ps->ps_nchunks )
+			return NOID;
+
+		pc = &ps->ps_chunks[ps->ps_send];
+		ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+		if ( ps->ps_next == ps->ps_send ) {
+			ps->ps_next++;
+			pc->pc_state = PC_SENDER;
+		}
+		while ( pc->pc_state == PC_BUSY )
+			ldap_pvt_thread_cond_wait( &ps->ps_cond, &ps->ps_mutex );
+		ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+		ps->ps_cur = pc->pc_state == PC_DONE ? 0 : pc->pc_first - 1;
+	}
+}
+
+static void
+mdb_psearch_end( Operation *op, psearch *ps )
+{
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	ps->ps_stop = 1;
+	ldap_pvt_thread_cond_broadcast( &ps->ps_cond );
+	/* helpers that never got a thread won't get one now */
+	while ( ps->ps_tasks && ldap_pvt_thread_pool_retract( &connection_pool,
+		mdb_psearch_task, ps ) > 0 )
+		ps->ps_tasks--;
+	while ( ps->ps_tasks )
+		ldap_pvt_thread_cond_wait( &ps->ps_cond, &ps->ps_mutex );
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+	Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_search)
+		": helpers filtered %d of %d chunks\n",
+		ps->ps_filtered, ps->ps_nchunks, 0 );
+	for ( i = 0; i < ps->ps_nchunks; i++ )
+		ch_free( ps->ps_chunks[i].pc_ids );
+	mdb_psearch_txns_free( op, ps->ps_txns );
+	op->o_tmpfree( ps->ps_map, op->o_tmpmemctx );
+	ldap_pvt_thread_cond_destroy( &ps->ps_cond );
+	ldap_pvt_thread_mutex_destroy( &ps->ps_mutex );
+	ch_free( ps );
+}
+
 int
 mdb_search( Operation *op, SlapReply *rs )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	ID		id, cursor, nsubs, ncand, cscope;
 	ID		lastid = NOID;
-	ID		candidates[MDB_IDL_UM_SIZE];
+	ID		idlbuf[MDB_IDL_UM_SIZE], *candidates = idlbuf;
 	ID		iscopes[MDB_IDL_DB_SIZE];
 	ID2		*scopes;
 	void	*stack;
@@ -433,6 +995,14 @@ mdb_search( Operation *op, SlapReply *rs )
 	MDB_cursor	*mci, *mcd;
 	ww_ctx wwctx;
 	slap_callback cb = { 0 };
+	FilterProgram	*fprog = NULL;
+	psearch		*helpers = NULL;
+	MDB_txn		**htxns = NULL;
+	mdb_attrmap	*map = NULL;
+	int		cache = 0;
+	mdb_pcursor	*pc = NULL;
+	mdb_ordscan	*os = NULL;
+	struct berval	reqndn = op->o_req_ndn;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -453,8 +1023,29 @@ mdb_search( Operation *op, SlapReply *rs )
 
 	ltid = moi->moi_txn;
 
+	/* a later page of a paged search resumes in the txn it began in,
+	 * which ACL checks and operational attributes must read too */
+	if ( moi == &opinfo && get_pagedresults( op ) > SLAP_CONTROL_IGNORED )
+	{
+		pc = mdb_pcursor_take( op, mdb );
+		if ( pc ) {
+			mdb_txn_reset( moi->moi_txn );
+			moi->moi_txn = ltid = pc->pc_txn;
+		}
+	}
+
+	/* helpers read the snapshot the candidates are found in */
+	if ( moi == &opinfo && !pc && mdb_psearch_ok( op ))
+		htxns = mdb_psearch_txns( op, ltid );
+
 	rs->sr_err = mdb_cursor_open( ltid, mdb->mi_id2entry, &mci );
 	if ( rs->sr_err ) {
+		if ( htxns )
+			mdb_psearch_txns_free( op, htxns );
+		if ( pc ) {
+			moi->moi_txn = NULL;
+			mdb_pcursor_free( pc );
+		}
 		send_ldap_error( op, rs, LDAP_OTHER, "internal error" );
 		return rs->sr_err;
 	}
@@ -462,6 +1053,12 @@ mdb_search( Operation *op, SlapReply *rs )
 	rs->sr_err = mdb_cursor_open( ltid, mdb->mi_dn2id, &mcd );
 	if ( rs->sr_err ) {
 		mdb_cursor_close( mci );
+		if ( htxns )
+			mdb_psearch_txns_free( op, htxns );
+		if ( pc ) {
+			moi->moi_txn = NULL;
+			mdb_pcursor_free( pc );
+		}
 		send_ldap_error( op, rs, LDAP_OTHER, "internal error" );
 		return rs->sr_err;
 	}
@@ -644,6 +1241,13 @@ dn2entry_retry:
 		rs->sr_err = base_candidate( op->o_bd, base, candidates );
 		scopes[0].mid = 0;
 		ncand = 1;
+	} else if ( pc ) {
+		/* the candidates of the first page still hold in its txn */
+		candidates = pc->pc_ids;
+		ncand = pc->pc_ncand;
+		scopes[0].mid = 1;
+		scopes[1].mid = base->e_id;
+		scopes[1].mval.mv_data = NULL;
 	} else {
 		if ( op->ors_scope == LDAP_SCOPE_ONELEVEL ) {
 			size_t nkids;
@@ -680,6 +1284,13 @@ dn2entry_retry:
 		}
 	}
 
+#ifdef SLAP_CONTROL_X_COUNT
+	if ( get_count( op )) {
+		mdb_search_count( op, rs, mci, base, &isc, candidates, nsubs, stack );
+		goto done;
+	}
+#endif
+
 	/* start cursor at beginning of candidates.
 	 */
 	cursor = 0;
@@ -709,9 +1320,13 @@ dn2entry_retry:
 		tentries = ncand;
 	}
 
+	fprog = filter_compile( op, op->oq_search.rs_filter );
+	map = mdb_search_attrmap( op, mdb );
+	cache = mdb_cache_usable( op, mdb );
+
 	wwctx.flag = 0;
 	/* If we're running in our own read txn */
-	if (  moi == &opinfo ) {
+	if (  moi == &opinfo && !pc ) {
 		cb.sc_writewait = mdb_writewait;
 		cb.sc_private = &wwctx;
 		wwctx.txn = ltid;
@@ -720,6 +1335,19 @@ dn2entry_retry:
 		op->o_callback = &cb;
 	}
 
+	/* the caller wants the entries in the order of an index */
+	if ( !pc && ( os = mdb_ordscan_start( op, ltid, candidates, ncand ))) {
+		if ( htxns ) {
+			mdb_psearch_txns_free( op, htxns );
+			htxns = NULL;
+		}
+		nsubs = ncand;
+		id = mdb_ordscan_next( os, 0 );
+		if ( id == NOID )
+			goto nochange;
+		goto loop_begin;
+	}
+
 	if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED ) {
 		PagedResultsState *ps = op->o_pagedresults_state;
 		/* deferred cookie parsing */
@@ -750,11 +1378,22 @@ dn2entry_retry:
 		if ( id == (ID)ps->ps_cookie )
 			id = mdb_idl_next( candidates, &cursor );
 		nsubs = ncand;	/* always bypass scope'd search */
+		if ( htxns && id != NOID ) {
+			helpers = mdb_psearch_start( op, htxns, candidates,
+				cursor, ncand, fprog );
+			htxns = NULL;
+			if ( helpers )
+				id = mdb_psearch_next( helpers );
+		}
 		goto loop_begin;
 	}
 	if ( nsubs < ncand ) {
 		int rc;
 		/* Do scope-based search */
+		if ( htxns ) {
+			mdb_psearch_txns_free( op, htxns );
+			htxns = NULL;
+		}
 
 		/* if any alias scopes were set, save them */
 		if (scopes[0].mid > 1) {
@@ -781,6 +1420,13 @@ dn2entry_retry:
 		cscope = 0;
 	} else {
 		id = mdb_idl_first( candidates, &cursor );
+		if ( htxns && id != NOID ) {
+			helpers = mdb_psearch_start( op, htxns, candidates, cursor,
+				ncand, fprog );
+			htxns = NULL;
+			if ( helpers )
+				id = mdb_psearch_next( helpers );
+		}
 	}
 
 	while (id != NOID)
@@ -887,6 +1533,10 @@ scopeok:
 			e = base;
 		} else {
 
+			/* a cached entry will do, whatever the attrmap */
+			if ( cache && mdb_cache_find( op, ltid, id, &e ) == 0 )
+				goto cached;
+
 			/* get the entry */
 			rs->sr_err = mdb_id2edata( op, mci, id, &edata );
 			if ( rs->sr_err == MDB_NOTFOUND ) {
@@ -900,7 +1550,7 @@ notfound:
 						LDAP_XSTRING(mdb_search)
 						": candidate %ld not found\n",
 						(long) id, 0, 0 );
-				} else {
+				} else if ( !helpers && !os ) {
 					/* get the next ID from the DB */
 					rs->sr_err = mdb_get_nextid( mci, &cursor );
 					if ( rs->sr_err == MDB_NOTFOUND ) {
@@ -923,18 +1573,28 @@ notfound:
 				goto done;
 			}
 
-			rs->sr_err = mdb_entry_decode( op, ltid, &edata, &e );
+			/* only small searches may fill the cache, so that one
+			 * big scan doesn't flush it */
+			if ( cache && !helpers && ncand < MDB_PSEARCH_MIN )
+				rs->sr_err = mdb_cache_add( op, ltid, id, &edata, &e );
+			else
+				rs->sr_err = mdb_entry_decode_map( op, ltid, &edata, map, &e );
 			if ( rs->sr_err ) {
 				rs->sr_err = LDAP_OTHER;
 				rs->sr_text = "internal error in mdb_entry_decode";
 				send_ldap_result( op, rs );
 				goto done;
 			}
+cached:
 			e->e_id = id;
 			e->e_name.bv_val = NULL;
 			e->e_nname.bv_val = NULL;
 		}
 
+		/* an entry comes up once for each of its values */
+		if ( os && mdb_ordscan_check( os, e ))
+			goto loop_continue;
+
 		if ( is_entry_subentry( e ) ) {
 			if( op->oq_search.rs_scope != LDAP_SCOPE_BASE ) {
 				if(!get_subentries_visibility( op )) {
@@ -1060,7 +1720,7 @@ notfound:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		rs->sr_err = test_filter_program( op, e, fprog );
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
@@ -1068,6 +1728,26 @@ notfound:
 				if ( rs->sr_nentries >= ((PagedResultsState *)op->o_pagedresults_state)->ps_size ) {
 					mdb_entry_return( op, e );
 					e = NULL;
+					/* let the next page resume right here; the client
+					 * may ask for it as soon as it has this one */
+					if ( moi == &opinfo &&
+						( mdb->mi_flags & MDB_PCURSORS ) &&
+						mdb->mi_pcursor_lim &&
+						op->ors_scope != LDAP_SCOPE_BASE &&
+						!( op->ors_deref & LDAP_DEREF_SEARCHING ))
+					{
+						if ( !pc ) {
+							/* the txn leaves this thread with the
+							 * cursor, and writewait must not touch it */
+							wwctx.flag = 1;
+							ldap_pvt_thread_pool_setkey( op->o_threadctx,
+								mdb->mi_dbenv, NULL, NULL, NULL, NULL );
+						}
+						moi->moi_txn = NULL;
+						mdb_pcursor_keep( op, mdb, pc, &reqndn, candidates,
+							ncand, ltid, lastid );
+						pc = NULL;
+					}
 					send_paged_response( op, rs, &lastid, tentries );
 					goto done;
 				}
@@ -1120,7 +1800,7 @@ notfound:
 		}
 
 loop_continue:
-		if ( moi == &opinfo && !wwctx.flag && mdb->mi_rtxn_size ) {
+		if ( moi == &opinfo && !pc && !wwctx.flag && mdb->mi_rtxn_size ) {
 			wwctx.nentries++;
 			if ( wwctx.nentries >= mdb->mi_rtxn_size ) {
 				wwctx.nentries = 0;
@@ -1129,6 +1809,8 @@ loop_continue:
 		}
 		if ( wwctx.flag ) {
 			rs->sr_err = mdb_waitfixup( op, &wwctx, mci, mcd, &isc );
+			if ( !rs->sr_err && os && mdb_ordscan_fixup( os, ltid ))
+				rs->sr_err = LDAP_OTHER;
 			if ( rs->sr_err ) {
 				send_ldap_result( op, rs );
 				goto done;
@@ -1170,6 +1852,10 @@ loop_continue:
 				}
 			} else
 				id = isc.id;
+		} else if ( os ) {
+			id = mdb_ordscan_next( os, rs->sr_nentries );
+		} else if ( helpers ) {
+			id = mdb_psearch_next( helpers );
 		} else {
 			id = mdb_idl_next( candidates, &cursor );
 		}
@@ -1189,6 +1875,15 @@ nochange:
 	rs->sr_err = LDAP_SUCCESS;
 
 done:
+	if ( helpers )
+		mdb_psearch_end( op, helpers );
+	if ( htxns )
+		mdb_psearch_txns_free( op, htxns );
+	if ( os )
+		mdb_ordscan_end( op, os );
+	filter_program_free( op, fprog );
+	if ( map )
+		op->o_tmpfree( map, op->o_tmpmemctx );
 	if ( cb.sc_private ) {
 		/* remove our writewait callback */
 		slap_callback **scp = &op->o_callback;
@@ -1202,8 +1897,13 @@ done:
 	}
 	mdb_cursor_close( mcd );
 	mdb_cursor_close( mci );
+	if ( pc ) {
+		moi->moi_txn = NULL;
+		mdb_pcursor_free( pc );
+	}
 	if ( moi == &opinfo ) {
-		mdb_txn_reset( moi->moi_txn );
+		if ( moi->moi_txn )
+			mdb_txn_reset( moi->moi_txn );
 		LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
 	} else {
 		moi->moi_ref--;
@@ -1496,3 +2196,265 @@ send_paged_response(
 done:
 	(void) ber_free_buf( ber );
 }
+
+/*
+ * Without a cursor, each page of a paged search finds all the
+ * candidates again and skips the ones sent already. A cursor keeps
+ * the candidates, and the read txn they were found in, from the end
+ * of one page until the next page of the same search comes in on the
+ * same connection. Every cursor holds a reader slot and keeps old
+ * pages of the database from being reused, so there are at most
+ * pagedcursors of them, the least recently used going first, and a
+ * runqueue task drops those left idle for pagedcursoridle seconds.
+ * The txn moves from thread to thread, which the environment must be
+ * opened with MDB_NOTLS for.
+ */
+
+static void
+mdb_pcursor_free( mdb_pcursor *pc )
+{
+	mdb_pcursor *next;
+
+	for ( ; pc; pc = next ) {
+		next = pc->pc_next;
+		mdb_txn_abort( pc->pc_txn );
+		ch_free( pc );
+	}
+}
+
+/* Take the cursor this page resumes from, if there is one. Other
+ * cursors of the connection belong to searches the client is done
+ * with, since it has only one paged search going at a time.
+ */
+static mdb_pcursor *
+mdb_pcursor_take( Operation *op, struct mdb_info *mdb )
+{
+	PagedResultsState *ps = op->o_pagedresults_state;
+	PagedResultsCookie reqcookie = 0;
+	mdb_pcursor *pc, **prev, *found = NULL, *dead = NULL;
+
+	if ( !( mdb->mi_flags & MDB_PCURSORS ))
+		return NULL;
+
+	if ( ps->ps_cookieval.bv_len == sizeof( reqcookie ))
+		AC_MEMCPY( &reqcookie, ps->ps_cookieval.bv_val, sizeof( reqcookie ));
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pcursor_mutex );
+	for ( prev = &mdb->mi_pcursors; ( pc = *prev ) != NULL; ) {
+		if ( pc->pc_connid != op->o_connid ) {
+			prev = &pc->pc_next;
+			continue;
+		}
+		*prev = pc->pc_next;
+		mdb->mi_npcursors--;
+		if ( !found && reqcookie && reqcookie == ps->ps_cookie &&
+			pc->pc_cookie == (ID)reqcookie &&
+			pc->pc_scope == op->ors_scope &&
+			bvmatch( &pc->pc_ndn, &op->o_ndn ) &&
+			bvmatch( &pc->pc_base, &op->o_req_ndn ) &&
+			bvmatch( &pc->pc_filter, &op->ors_filterstr ))
+		{
+			found = pc;
+		} else {
+			pc->pc_next = dead;
+			dead = pc;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pcursor_mutex );
+
+	mdb_pcursor_free( dead );
+	if ( found ) {
+		found->pc_next = NULL;
+		Debug( LDAP_DEBUG_TRACE,
+			LDAP_XSTRING(mdb_search) ": resuming paged search after "
+			"0x%08lx\n", (long) found->pc_cookie, 0, 0 );
+	}
+	return found;
+}
+
+static char *
+mdb_pcursor_bvcopy( char *ptr, struct berval *dst, struct berval *src )
+{
+	dst->bv_val = ptr;
+	dst->bv_len = src->bv_len;
+	if ( src->bv_len )
+		ptr = lutil_strbvcopy( ptr, src );
+	*ptr++ = '\0';
+	return ptr;
+}
+
+/* Keep the cursor pc, or a new one for the candidates ids found in
+ * txn, until the page after lastid is asked for. Base is the search
+ * base as requested, before any alias was dereferenced.
+ */
+static void
+mdb_pcursor_keep(
+	Operation *op,
+	struct mdb_info *mdb,
+	mdb_pcursor *pc,
+	struct berval *base,
+	ID *ids,
+	ID ncand,
+	MDB_txn *txn,
+	ID lastid )
+{
+	mdb_pcursor **prev, *dead = NULL;
+
+	if ( !pc ) {
+		size_t size = MDB_IDL_SIZEOF( ids );
+		char *ptr;
+
+		pc = ch_malloc( sizeof( mdb_pcursor ) + size + op->o_ndn.bv_len +
+			base->bv_len + op->ors_filterstr.bv_len + 3 );
+		pc->pc_connid = op->o_connid;
+		pc->pc_ncand = ncand;
+		pc->pc_scope = op->ors_scope;
+		pc->pc_txn = txn;
+		pc->pc_ids = (ID *)( pc + 1 );
+		AC_MEMCPY( pc->pc_ids, ids, size );
+		ptr = (char *)pc->pc_ids + size;
+		ptr = mdb_pcursor_bvcopy( ptr, &pc->pc_ndn, &op->o_ndn );
+		ptr = mdb_pcursor_bvcopy( ptr, &pc->pc_base, base );
+		mdb_pcursor_bvcopy( ptr, &pc->pc_filter, &op->ors_filterstr );
+	}
+	pc->pc_cookie = lastid;
+	pc->pc_time = slap_get_time();
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pcursor_mutex );
+	pc->pc_next = mdb->mi_pcursors;
+	mdb->mi_pcursors = pc;
+	mdb->mi_npcursors++;
+	while ( mdb->mi_npcursors > mdb->mi_pcursor_lim ) {
+		for ( prev = &mdb->mi_pcursors; (*prev)->pc_next;
+			prev = &(*prev)->pc_next )
+			;
+		(*prev)->pc_next = dead;
+		dead = *prev;
+		*prev = NULL;
+		mdb->mi_npcursors--;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pcursor_mutex );
+
+	mdb_pcursor_free( dead );
+}
+
+/* drop the cursors of a closed connection */
+int
+mdb_connection_destroy( BackendDB *be, Connection *c )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_pcursor *pc, **prev, *dead = NULL;
+
+	if ( !( mdb->mi_flags & MDB_PCURSORS ))
+		return 0;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pcursor_mutex );
+	for ( prev = &mdb->mi_pcursors; ( pc = *prev ) != NULL; ) {
+		if ( pc->pc_connid == c->c_connid ) {
+			*prev = pc->pc_next;
+			pc->pc_next = dead;
+			dead = pc;
+			mdb->mi_npcursors--;
+		} else {
+			prev = &pc->pc_next;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pcursor_mutex );
+
+	mdb_pcursor_free( dead );
+	return 0;
+}
+
+/* drop the cursors that have been idle too long */
+void *
+mdb_pcursor_expire( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	struct mdb_info *mdb = rtask->arg;
+	mdb_pcursor *pc, **prev, *dead;
+	time_t old = slap_get_time() - mdb->mi_pcursor_idle;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pcursor_mutex );
+	/* the list is in order of last use */
+	for ( prev = &mdb->mi_pcursors; ( pc = *prev ) != NULL;
+		prev = &pc->pc_next )
+	{
+		if ( pc->pc_time <= old )
+			break;
+	}
+	dead = *prev;
+	*prev = NULL;
+	for ( pc = dead; pc; pc = pc->pc_next )
+		mdb->mi_npcursors--;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pcursor_mutex );
+
+	mdb_pcursor_free( dead );
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	return NULL;
+}
+
+void
+mdb_pcursor_release_all( struct mdb_info *mdb )
+{
+	mdb_pcursor *dead;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pcursor_mutex );
+	dead = mdb->mi_pcursors;
+	mdb->mi_pcursors = NULL;
+	mdb->mi_npcursors = 0;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pcursor_mutex );
+
+	mdb_pcursor_free( dead );
+}
+
+/* start, retime or stop the task that drops idle cursors */
+void
+mdb_pcursor_schedule( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	struct re_s *re;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	re = mdb->mi_pcursor_task;
+	if ( !mdb->mi_pcursor_idle || !( mdb->mi_flags & MDB_PCURSORS )) {
+		if ( re ) {
+			mdb->mi_pcursor_task = NULL;
+			if ( ldap_pvt_runqueue_isrunning( &slapd_rq, re ))
+				ldap_pvt_runqueue_stoptask( &slapd_rq, re );
+			ldap_pvt_runqueue_remove( &slapd_rq, re );
+		}
+	} else if ( re ) {
+		re->interval.tv_sec = mdb->mi_pcursor_idle;
+	} else {
+		mdb->mi_pcursor_task = ldap_pvt_runqueue_insert( &slapd_rq,
+			mdb->mi_pcursor_idle, mdb_pcursor_expire, mdb,
+			LDAP_XSTRING(mdb_pcursor_expire), be->be_suffix[0].bv_val );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+/* Cursors must leave a reader for each thread of the pool, or the
+ * searches of those threads fail for want of one.
+ */
+void
+mdb_pcursor_clamp( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	unsigned int readers, room = 0, lim = mdb->mi_pcursor_max;
+
+	if ( lim && mdb_env_get_maxreaders( mdb->mi_dbenv, &readers ) == 0 ) {
+		if ( readers > (unsigned)connection_pool_max )
+			room = readers - connection_pool_max;
+		if ( lim > room ) {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_pcursor_clamp)
+				": database \"%s\": only %u of the %u readers may be "
+				"kept by paged searches\n",
+				be->be_suffix[0].bv_val, room, readers );
+			lim = room;
+		}
+	}
+	mdb->mi_pcursor_lim = lim;
+}
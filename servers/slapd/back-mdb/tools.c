@@ -85,6 +85,16 @@ static ldap_pvt_thread_cond_t mdb_tool_index_cond_main;
 static ldap_pvt_thread_cond_t mdb_tool_index_cond_work;
 static void * mdb_tool_index_task( void *ctx, void *ptr );
 
+/* The readers of a threaded slapcat, all on one snapshot */
+typedef struct mdb_tool_rdr {
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_cursor *idc;
+} mdb_tool_rdr;
+
+static mdb_tool_rdr *mdb_tool_rdrs;
+static int mdb_tool_nrdrs;
+
 static int	mdb_writes, mdb_writes_per_commit;
 
 /* Number of ops per commit in Quick mode.
@@ -95,9 +105,67 @@ static int	mdb_writes, mdb_writes_per_commit;
 #define MDB_WRITES_PER_COMMIT	500
 #endif
 
+/* In a bulk load into an empty database, the index keys of the
+ * entries are gathered instead of being stored with each entry. Once
+ * they take more than the bulkmem of the database they are sorted and
+ * written to a temporary file, and every MDB_TOOL_BULK_RUNS files of
+ * the same size are merged into one. mdb_tool_bulk_flush() merges
+ * the rest and appends the keys to the indices in order at the end.
+ * If a file can't be written, no more entries are taken.
+ */
+#ifndef MDB_TOOL_BULK_RUNS
+#define MDB_TOOL_BULK_RUNS	16
+#endif
+
+/* IDs appended per commit while flushing */
+#ifndef MDB_TOOL_BULK_PER_COMMIT
+#define MDB_TOOL_BULK_PER_COMMIT	(1<<20)
+#endif
+
+typedef struct mdb_tool_runrec {
+	AttrInfo *rr_ai;
+	MDB_dbi rr_dbi;
+	unsigned rr_len;
+	ID rr_id;
+} mdb_tool_runrec;
+
+typedef struct mdb_tool_run {
+	FILE *fp;
+	int level;	/* the number of merges it took */
+} mdb_tool_run;
+
+static int mdb_tool_bulk;
+static size_t mdb_tool_bulk_mem;	/* bytes */
+static int mdb_tool_bulk_err;	/* errno of the last spill that failed */
+static mdb_ixkeys mdb_tool_ixkeys;
+static int mdb_tool_ixmark;	/* the keys of committed entries */
+static size_t mdb_tool_ixmlen;
+static mdb_tool_run *mdb_tool_runs;
+static int mdb_tool_nruns;
+
+static int mdb_tool_bulk_flush( BackendDB *be );
+
 static int
 mdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep );
 
+static void
+mdb_tool_rdrs_close( void )
+{
+	int i;
+
+	for ( i = 0; i < mdb_tool_nrdrs; i++ ) {
+		mdb_tool_rdr *r = &mdb_tool_rdrs[i];
+		if ( r->idc )
+			mdb_cursor_close( r->idc );
+		if ( r->mc )
+			mdb_cursor_close( r->mc );
+		mdb_txn_abort( r->txn );
+	}
+	ch_free( mdb_tool_rdrs );
+	mdb_tool_rdrs = NULL;
+	mdb_tool_nrdrs = 0;
+}
+
 int mdb_tool_entry_open(
 	BackendDB *be, int mode )
 {
@@ -108,9 +176,81 @@ int mdb_tool_entry_open(
 	else
 		mdb_writes_per_commit = 1;
 
+	if (( slapMode & (SLAP_TOOL_BULKLOAD|SLAP_TOOL_READONLY)) == SLAP_TOOL_BULKLOAD &&
+		!mdb_tool_bulk ) {
+		struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+		MDB_txn *txn;
+		MDB_stat st1, st2;
+		int rc;
+
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+		if ( rc == 0 ) {
+			rc = mdb_stat( txn, mdb->mi_id2entry, &st1 );
+			if ( rc == 0 )
+				rc = mdb_stat( txn, mdb->mi_dn2id, &st2 );
+			mdb_txn_abort( txn );
+		}
+		if ( rc == 0 && !st1.ms_entries && !st2.ms_entries ) {
+			Operation op = {0};
+
+			/* sets up the key of the extra */
+			mdb_ixkeys_start( &op, &mdb_tool_ixkeys );
+			mdb_tool_ixmark = 0;
+			mdb_tool_ixmlen = 0;
+			mdb_tool_bulk_mem = (size_t)mdb->mi_bulk_mem * 1024;
+			mdb_tool_bulk_err = 0;
+			mdb_tool_bulk = 1;
+		} else {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_open) ": database %s: "
+				"not empty, bulk-load ignored\n",
+				be->be_suffix[0].bv_val, 0, 0 );
+		}
+	}
+
+	if (( slapMode & SLAP_TOOL_READONLY ) && slap_tool_thread_max > 1 &&
+		!mdb_tool_rdrs ) {
+		struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+		int i, n = slap_tool_thread_max, rc, same;
+
+		mdb_tool_rdrs = ch_calloc( n, sizeof( mdb_tool_rdr ));
+		do {
+			/* retry until no write is committed in between */
+			for ( i = 0; i < mdb_tool_nrdrs; i++ )
+				mdb_txn_abort( mdb_tool_rdrs[i].txn );
+			mdb_tool_nrdrs = 0;
+			same = 1;
+			for ( i = 0; i < n; i++ ) {
+				rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY,
+					&mdb_tool_rdrs[i].txn );
+				if ( rc )
+					break;
+				mdb_tool_nrdrs++;
+				if ( mdb_txn_id( mdb_tool_rdrs[i].txn ) !=
+					mdb_txn_id( mdb_tool_rdrs[0].txn )) {
+					same = 0;
+					break;
+				}
+			}
+		} while ( rc == 0 && !same );
+		for ( i = 0; rc == 0 && i < n; i++ ) {
+			mdb_tool_rdr *r = &mdb_tool_rdrs[i];
+			rc = mdb_cursor_open( r->txn, mdb->mi_id2entry, &r->mc );
+		}
+		if ( rc ) {
+			/* slapcat falls back to reading on one thread */
+			mdb_tool_rdrs_close();
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_open) ": database %s: "
+				"could not open readers: %s (%d)\n",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		}
+	}
+
 #ifdef MDB_TOOL_IDL_CACHING			/* threaded indexing has no performance advantage */
 	/* Set up for threaded slapindex */
-	if (( slapMode & (SLAP_TOOL_QUICK|SLAP_TOOL_READONLY)) == SLAP_TOOL_QUICK ) {
+	if (( slapMode & (SLAP_TOOL_QUICK|SLAP_TOOL_READONLY)) == SLAP_TOOL_QUICK &&
+		!mdb_tool_bulk ) {
 		if ( !mdb_tool_info ) {
 			struct mdb_info *mdb = (struct mdb_info *) be->be_private;
 			ldap_pvt_thread_mutex_init( &mdb_tool_index_mutex );
@@ -147,6 +287,9 @@ int mdb_tool_entry_open(
 int mdb_tool_entry_close(
 	BackendDB *be )
 {
+	if ( mdb_tool_bulk && mdb_tool_bulk_flush( be ))
+		return -1;
+
 #ifdef MDB_TOOL_IDL_CACHING
 	if ( mdb_tool_info ) {
 		int i;
@@ -190,6 +333,8 @@ int mdb_tool_entry_close(
 	}
 #endif
 
+	if ( mdb_tool_rdrs )
+		mdb_tool_rdrs_close();
 	if( idcursor ) {
 		mdb_cursor_close( idcursor );
 		idcursor = NULL;
@@ -198,6 +343,25 @@ int mdb_tool_entry_close(
 		mdb_cursor_close( cursor );
 		cursor = NULL;
 	}
+	/* the last batch of a quick reindex */
+	if( txi ) {
+		int rc;
+		unsigned i;
+		struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+		MDB_TOOL_IDL_FLUSH( be, txi );
+		rc = mdb_txn_commit( txi );
+		txi = NULL;
+		mdb_writes = 0;
+		for ( i=0; i<mdb->mi_nattrs; i++ )
+			mdb->mi_attrs[i]->ai_cursor = NULL;
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
+				"txn_commit failed: %s (%d)\n",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			return -1;
+		}
+	}
 	if( mdb_tool_txn ) {
 		int rc;
 		if (( rc = mdb_txn_commit( mdb_tool_txn ))) {
@@ -438,6 +602,77 @@ mdb_tool_entry_get( BackendDB *be, ID id )
 	return e;
 }
 
+/* Call func for each entry with an ID from *idp up to hi, in ID order,
+ * reading with the reader-th of the tool-threads readers, which all
+ * see one snapshot. *idp is set to the ID of the next entry after
+ * hi, or NOID if there is none. Each reader may be used by one thread
+ * at a time; an entry that cannot be decoded is passed as NULL. With
+ * *idp above hi, only checks that the reader can be used.
+ */
+int
+mdb_tool_entry_range(
+	BackendDB *be,
+	int reader,
+	ID *idp,
+	ID hi,
+	BI_tool_entry_func *func,
+	void *arg )
+{
+	Operation op = {0};
+	Opheader ohdr = {0};
+	mdb_tool_rdr *r;
+	MDB_val key, data;
+	ID id = *idp;
+	int rc;
+
+	if ( reader >= mdb_tool_nrdrs )
+		return LDAP_OTHER;
+	if ( id > hi )
+		return 0;
+	r = &mdb_tool_rdrs[reader];
+
+	op.o_hdr = &ohdr;
+	op.o_bd = be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+
+	key.mv_size = sizeof(ID);
+	key.mv_data = &id;
+	for ( rc = mdb_cursor_get( r->mc, &key, &data, MDB_SET_RANGE ); rc == 0;
+		rc = mdb_cursor_get( r->mc, &key, &data, MDB_NEXT )) {
+		struct berval dn, ndn;
+		Entry *e = NULL;
+
+		id = *(ID *)key.mv_data;
+		if ( id > hi )
+			break;
+		if ( !data.mv_size )
+			continue;
+
+		if ( mdb_id2name( &op, r->txn, &r->idc, id, &dn, &ndn ) == 0 ) {
+			if ( mdb_entry_decode( &op, r->txn, &data, &e ) == 0 ) {
+				e->e_id = id;
+				e->e_name = dn;
+				e->e_nname = ndn;
+			} else {
+				ch_free( dn.bv_val );
+				ch_free( ndn.bv_val );
+			}
+		}
+		rc = func( be, id, e, arg );
+		if ( rc )
+			return rc;
+	}
+	if ( rc == MDB_NOTFOUND ) {
+		*idp = NOID;
+	} else if ( rc == 0 ) {
+		*idp = id;
+	} else {
+		return LDAP_OTHER;
+	}
+	return 0;
+}
+
 static int mdb_tool_next_id(
 	Operation *op,
 	MDB_txn *tid,
@@ -589,6 +824,12 @@ mdb_tool_index_add(
 			ldap_pvt_thread_cond_wait( &mdb_tool_index_cond_main,
 				&mdb_tool_index_mutex );
 		}
+		/* while no thread is writing to the txn */
+		rc = mdb_order_entry( op, txn, SLAP_INDEX_ADD_OP, e );
+		if ( rc ) {
+			ldap_pvt_thread_mutex_unlock( &mdb_tool_index_mutex );
+			return rc;
+		}
 
 		for ( i=1; i<mdb_tool_threads; i++ )
 			mdb_tool_index_rec[i].ir_i = LDAP_BUSY;
@@ -624,6 +865,494 @@ mdb_tool_index_finish()
 	return rc;
 }
 
+/* A source of sorted keys for a merge: a temporary file, or the
+ * keys still in memory when fp is NULL.
+ */
+typedef struct mdb_tool_src {
+	FILE *fp;
+	int next;
+	mdb_ixkey k;
+	char *buf;
+	unsigned size;
+} mdb_tool_src;
+
+typedef struct mdb_tool_merge {
+	mdb_tool_src *srcs;
+	mdb_tool_src **heap;
+	int nsrcs;
+	int n;
+	int started;
+} mdb_tool_merge;
+
+/* Read the next key of src. Returns MDB_NOTFOUND at the end. */
+static int
+mdb_tool_src_next( mdb_tool_src *src )
+{
+	mdb_tool_runrec rr;
+
+	if ( !src->fp ) {
+		if ( src->next == mdb_tool_ixkeys.ix_nkeys )
+			return MDB_NOTFOUND;
+		src->k = mdb_tool_ixkeys.ix_keys[src->next++];
+		return 0;
+	}
+	if ( fread( &rr, sizeof(rr), 1, src->fp ) != 1 )
+		return ferror( src->fp ) ? LDAP_OTHER : MDB_NOTFOUND;
+	if ( rr.rr_len > src->size ) {
+		src->size = rr.rr_len;
+		src->buf = ch_realloc( src->buf, src->size );
+	}
+	if ( fread( src->buf, 1, rr.rr_len, src->fp ) != rr.rr_len )
+		return LDAP_OTHER;
+	src->k.ik_ai = rr.rr_ai;
+	src->k.ik_dbi = rr.rr_dbi;
+	src->k.ik_id = rr.rr_id;
+	src->k.ik_len = rr.rr_len;
+	src->k.ik_key = src->buf;
+	return 0;
+}
+
+static void
+mdb_tool_merge_sift( mdb_tool_src **heap, int n, int i )
+{
+	mdb_tool_src *s = heap[i];
+	int c;
+
+	while (( c = 2*i + 1 ) < n ) {
+		if ( c + 1 < n && mdb_ixkey_cmp( &heap[c+1]->k, &heap[c]->k ) < 0 )
+			c++;
+		if ( mdb_ixkey_cmp( &heap[c]->k, &s->k ) >= 0 )
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = s;
+}
+
+/* Merge the nruns runs at runs, and the sorted keys in memory if mem */
+static void
+mdb_tool_merge_open( mdb_tool_merge *mg, mdb_tool_run *runs, int nruns, int mem )
+{
+	int i;
+
+	mg->nsrcs = nruns + ( mem != 0 );
+	mg->srcs = ch_calloc( mg->nsrcs, sizeof( mdb_tool_src ));
+	mg->heap = ch_malloc( mg->nsrcs * sizeof( mdb_tool_src * ));
+	for ( i = 0; i < nruns; i++ )
+		mg->srcs[i].fp = runs[i].fp;
+	mg->n = 0;
+	mg->started = 0;
+}
+
+/* The next key of the merge in *kp. Returns MDB_NOTFOUND at the end. */
+static int
+mdb_tool_merge_next( mdb_tool_merge *mg, mdb_ixkey **kp )
+{
+	int i, rc;
+
+	if ( !mg->started ) {
+		mg->started = 1;
+		for ( i = 0; i < mg->nsrcs; i++ ) {
+			rc = mdb_tool_src_next( &mg->srcs[i] );
+			if ( rc == 0 )
+				mg->heap[mg->n++] = &mg->srcs[i];
+			else if ( rc != MDB_NOTFOUND )
+				return rc;
+		}
+		for ( i = mg->n/2 - 1; i >= 0; i-- )
+			mdb_tool_merge_sift( mg->heap, mg->n, i );
+	} else if ( mg->n ) {
+		rc = mdb_tool_src_next( mg->heap[0] );
+		if ( rc == MDB_NOTFOUND )
+			mg->heap[0] = mg->heap[--mg->n];
+		else if ( rc )
+			return rc;
+		if ( mg->n )
+			mdb_tool_merge_sift( mg->heap, mg->n, 0 );
+	}
+	if ( !mg->n )
+		return MDB_NOTFOUND;
+	*kp = &mg->heap[0]->k;
+	return 0;
+}
+
+/* Free the merge, but not its runs */
+static void
+mdb_tool_merge_close( mdb_tool_merge *mg )
+{
+	int i;
+
+	for ( i = 0; i < mg->nsrcs; i++ )
+		ch_free( mg->srcs[i].buf );
+	ch_free( mg->srcs );
+	ch_free( mg->heap );
+}
+
+static int
+mdb_tool_run_put( FILE *fp, mdb_ixkey *k )
+{
+	mdb_tool_runrec rr;
+
+	rr.rr_ai = k->ik_ai;
+	rr.rr_dbi = k->ik_dbi;
+	rr.rr_len = k->ik_len;
+	rr.rr_id = k->ik_id;
+	if ( fwrite( &rr, sizeof(rr), 1, fp ) != 1 ||
+		fwrite( k->ik_key, 1, k->ik_len, fp ) != k->ik_len )
+		return -1;
+	return 0;
+}
+
+/* Rewind a new run and add it to the list */
+static int
+mdb_tool_run_add( FILE *fp, int level )
+{
+	if ( fflush( fp ) || fseek( fp, 0, SEEK_SET ))
+		return -1;
+	mdb_tool_runs = ch_realloc( mdb_tool_runs,
+		( mdb_tool_nruns + 1 ) * sizeof( mdb_tool_run ));
+	mdb_tool_runs[mdb_tool_nruns].fp = fp;
+	mdb_tool_runs[mdb_tool_nruns++].level = level;
+	return 0;
+}
+
+/* Write the keys in memory to a new run, and merge the last
+ * MDB_TOOL_BULK_RUNS runs into one while they are of one level.
+ */
+static int
+mdb_tool_bulk_spill( void )
+{
+	mdb_ixkeys *ik = &mdb_tool_ixkeys;
+	mdb_ixkey *k, *prev = NULL;
+	mdb_tool_merge mg;
+	FILE *fp;
+	int i, rc, level;
+
+	fp = tmpfile();
+	if ( !fp )
+		return -1;
+	mdb_ixkeys_sort( ik );
+	for ( i = 0; i < ik->ix_nkeys; i++ ) {
+		k = &ik->ix_keys[i];
+		if ( prev && mdb_ixkey_cmp( prev, k ) == 0 )
+			continue;
+		prev = k;
+		if ( mdb_tool_run_put( fp, k ))
+			break;
+	}
+	if ( i < ik->ix_nkeys || mdb_tool_run_add( fp, 0 )) {
+		fclose( fp );
+		return -1;
+	}
+	ik->ix_nkeys = mdb_tool_ixmark = 0;
+	ik->ix_len = mdb_tool_ixmlen = 0;
+
+	while ( mdb_tool_nruns >= MDB_TOOL_BULK_RUNS &&
+		( level = mdb_tool_runs[mdb_tool_nruns-1].level ) ==
+		mdb_tool_runs[mdb_tool_nruns-MDB_TOOL_BULK_RUNS].level ) {
+		mdb_tool_run *runs = mdb_tool_runs + mdb_tool_nruns - MDB_TOOL_BULK_RUNS;
+
+		fp = tmpfile();
+		if ( !fp )
+			return -1;
+		/* the runs have the keys of different entries, none repeat */
+		mdb_tool_merge_open( &mg, runs, MDB_TOOL_BULK_RUNS, 0 );
+		while (( rc = mdb_tool_merge_next( &mg, &k )) == 0 ) {
+			if ( mdb_tool_run_put( fp, k ))
+				break;
+		}
+		mdb_tool_merge_close( &mg );
+		if ( rc != MDB_NOTFOUND ) {
+			/* keep the runs as they are */
+			fclose( fp );
+			for ( i = 0; i < MDB_TOOL_BULK_RUNS; i++ )
+				rewind( runs[i].fp );
+			return -1;
+		}
+		for ( i = 0; i < MDB_TOOL_BULK_RUNS; i++ )
+			fclose( runs[i].fp );
+		mdb_tool_nruns -= MDB_TOOL_BULK_RUNS;
+		if ( mdb_tool_run_add( fp, level + 1 ))
+			return -1;
+		Debug( LDAP_DEBUG_TRACE, "=> " LDAP_XSTRING(mdb_tool_bulk_spill)
+			": merged %d temporary files into one of level %d\n",
+			MDB_TOOL_BULK_RUNS, level + 1, 0 );
+	}
+	return 0;
+}
+
+/* The entries since the last commit were committed, or lost if rc */
+static void
+mdb_tool_bulk_commit( int rc )
+{
+	mdb_ixkeys *ik = &mdb_tool_ixkeys;
+
+	if ( rc ) {
+		ik->ix_nkeys = mdb_tool_ixmark;
+		ik->ix_len = mdb_tool_ixmlen;
+		return;
+	}
+	mdb_tool_ixmark = ik->ix_nkeys;
+	mdb_tool_ixmlen = ik->ix_len;
+	if ( ik->ix_nkeys * sizeof(mdb_ixkey) + ik->ix_len >= mdb_tool_bulk_mem &&
+		mdb_tool_bulk_spill()) {
+		/* the keys stay in memory for the entries committed so far */
+		mdb_tool_bulk_err = errno ? errno : EIO;
+		Debug( LDAP_DEBUG_ANY,
+			"=> " LDAP_XSTRING(mdb_tool_bulk_commit)
+			": could not write index keys to a temporary file: %s (%d)\n",
+			strerror( mdb_tool_bulk_err ), mdb_tool_bulk_err, 0 );
+	}
+}
+
+/* IDs of a key kept before they go to its bitmap */
+#define BULK_IDS	(2*MDB_IDL_DB_SIZE)
+
+#ifdef MISALIGNED_OK
+#define BULK_APPEND	MDB_APPEND
+#else
+#define BULK_APPEND	0
+#endif
+
+/* The key being flushed, and those of its IDs not yet stored */
+typedef struct mdb_tool_bkey {
+	MDB_val key;
+	char *kbuf;
+	ID *ids;
+	unsigned nids;
+	ID count;
+	ID lo, hi;
+	int range;
+#ifndef MISALIGNED_OK
+	int pad[2];
+#endif
+} mdb_tool_bkey;
+
+/* Move the IDs of a key with too many for the index to its bitmap */
+static int
+mdb_tool_bulk_bitmap( BackendDB *be, MDB_cursor *mc, mdb_tool_bkey *bk )
+{
+	int rc = 0;
+
+	if ( !bk->range ) {
+		rc = mdb_bitmap_load( be, mdb_cursor_txn( mc ), mdb_cursor_dbi( mc ),
+			&bk->key, bk->ids, bk->nids );
+		/* no bitmap for this key, it becomes a range */
+		if ( rc == MDB_BAD_VALSIZE ) {
+			bk->range = 1;
+			rc = 0;
+		}
+	}
+	bk->nids = 0;
+	return rc;
+}
+
+/* Store the IDs of a key the way mdb_idl_insert_keys() would have */
+static int
+mdb_tool_bulk_put( BackendDB *be, MDB_cursor *mc, mdb_tool_bkey *bk )
+{
+	MDB_val data[2];
+	ID marker[3], *ids = bk->ids;
+	unsigned n = bk->nids;
+	int rc = 0;
+
+	if ( bk->count > MDB_IDL_DB_MAX ) {
+		rc = mdb_tool_bulk_bitmap( be, mc, bk );
+		marker[0] = 0;
+		marker[1] = bk->range ? bk->lo : 1;
+		marker[2] = bk->range ? bk->hi : NOID;
+		ids = marker;
+		n = 3;
+	}
+	if ( rc == 0 ) {
+		data[0].mv_size = sizeof(ID);
+		data[0].mv_data = ids;
+		rc = mdb_cursor_put( mc, &bk->key, data, BULK_APPEND );
+	}
+	if ( rc == 0 && n > 1 ) {
+		data[0].mv_data = ids + 1;
+		data[1].mv_size = n - 1;
+		rc = mdb_cursor_put( mc, &bk->key, data, MDB_APPENDDUP|MDB_MULTIPLE );
+	}
+	bk->count = 0;
+	bk->nids = 0;
+	bk->range = 0;
+	return rc;
+}
+
+/* Append the index keys gathered by a bulk load to the indices, and
+ * end it. The transaction is committed every MDB_TOOL_BULK_PER_COMMIT
+ * IDs and at the end.
+ */
+static int
+mdb_tool_bulk_flush( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_tool_merge mg;
+	mdb_tool_bkey bk = {{0}};
+	mdb_ixkey *k, prev;
+	MDB_cursor *mc = NULL;
+	char *obuf, *err = "";
+	int i, rc = 0, maxkey, have = 0;
+	ID nput = 0;
+
+	Debug( LDAP_DEBUG_TRACE, "=> " LDAP_XSTRING(mdb_tool_bulk_flush)
+		": %d temporary files\n", mdb_tool_nruns, 0, 0 );
+
+	mdb_tool_bulk = 0;
+	if ( idcursor ) {
+		mdb_cursor_close( idcursor );
+		idcursor = NULL;
+	}
+	if ( cursor ) {
+		mdb_cursor_close( cursor );
+		cursor = NULL;
+	}
+	if ( !mdb_tool_txn ) {
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &mdb_tool_txn );
+		if ( rc ) {
+			err = "txn_begin";
+			mdb_tool_txn = NULL;
+		}
+	}
+
+	mdb_ixkeys_sort( &mdb_tool_ixkeys );
+	mdb_tool_merge_open( &mg, mdb_tool_runs, mdb_tool_nruns, 1 );
+	maxkey = mdb_env_get_maxkeysize( mdb->mi_dbenv );
+	obuf = ch_malloc( 3 * maxkey );
+	bk.kbuf = ch_malloc( maxkey );
+	bk.ids = ch_malloc( BULK_IDS * sizeof( ID ));
+
+	while ( rc == 0 && ( rc = mdb_tool_merge_next( &mg, &k )) == 0 ) {
+		if ( have && mdb_ixkey_cmp( &prev, k ) == 0 )
+			continue;
+		if ( !have || prev.ik_dbi != k->ik_dbi || prev.ik_len != k->ik_len ||
+			memcmp( prev.ik_key, k->ik_key, k->ik_len )) {
+			/* a new key */
+			if ( bk.count ) {
+				nput += bk.count;
+				rc = mdb_tool_bulk_put( be, mc, &bk );
+				if ( rc ) {
+					err = "put";
+					break;
+				}
+			}
+			if ( k->ik_len > (unsigned)maxkey ) {
+				rc = MDB_BAD_VALSIZE;
+				err = "key";
+				break;
+			}
+			if ( mc && ( prev.ik_dbi != k->ik_dbi ||
+				nput >= MDB_TOOL_BULK_PER_COMMIT )) {
+				mdb_cursor_close( mc );
+				mc = NULL;
+			}
+			if ( nput >= MDB_TOOL_BULK_PER_COMMIT ) {
+				nput = 0;
+				rc = mdb_txn_commit( mdb_tool_txn );
+				mdb_tool_txn = NULL;
+				if ( rc == 0 )
+					rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &mdb_tool_txn );
+				if ( rc ) {
+					mdb_tool_txn = NULL;
+					err = "txn_commit";
+					break;
+				}
+			}
+			if ( !mc ) {
+				rc = mdb_cursor_open( mdb_tool_txn, k->ik_dbi, &mc );
+				if ( rc ) {
+					mc = NULL;
+					err = "cursor_open";
+					break;
+				}
+			}
+			memcpy( bk.kbuf, k->ik_key, k->ik_len );
+			bk.key.mv_data = bk.kbuf;
+			bk.key.mv_size = k->ik_len;
+#ifndef MISALIGNED_OK
+			if ( k->ik_len & ALIGNER ) {
+				bk.pad[1] = 0;
+				memcpy( bk.pad, k->ik_key, k->ik_len );
+				bk.key.mv_data = bk.pad;
+				bk.key.mv_size = sizeof( bk.pad );
+			}
+#endif
+		}
+		prev = *k;
+		prev.ik_key = bk.kbuf;
+		have = 1;
+
+		if ( k->ik_ai ) {
+			MDB_val key;
+			key.mv_data = bk.kbuf;
+			key.mv_size = k->ik_len;
+			rc = mdb_order_put( mdb_tool_txn, k->ik_ai, mc, &key,
+				k->ik_id, SLAP_INDEX_ADD_OP, obuf, maxkey );
+			nput++;
+		} else {
+			if ( !bk.count )
+				bk.lo = k->ik_id;
+			bk.hi = k->ik_id;
+			bk.count++;
+			bk.ids[bk.nids++] = k->ik_id;
+			if ( bk.nids == BULK_IDS )
+				rc = mdb_tool_bulk_bitmap( be, mc, &bk );
+		}
+		if ( rc )
+			err = "put";
+	}
+	if ( rc == MDB_NOTFOUND ) {
+		rc = 0;
+		if ( bk.count ) {
+			rc = mdb_tool_bulk_put( be, mc, &bk );
+			if ( rc )
+				err = "put";
+		}
+	} else if ( !*err ) {
+		err = "read";
+	}
+	if ( mc )
+		mdb_cursor_close( mc );
+
+	/* the keys bypassed the statistics */
+	for ( i = 0; rc == 0 && i < mdb->mi_nattrs; i++ ) {
+		rc = mdb_ixstat_rebuild( mdb, mdb_tool_txn, mdb->mi_attrs[i] );
+		if ( rc )
+			err = "ixstat";
+	}
+	if ( rc == 0 ) {
+		rc = mdb_txn_commit( mdb_tool_txn );
+		if ( rc )
+			err = "txn_commit";
+	} else if ( mdb_tool_txn ) {
+		mdb_txn_abort( mdb_tool_txn );
+	}
+	mdb_tool_txn = NULL;
+	mdb_writes = 0;
+	for ( i = 0; i < mdb->mi_nattrs; i++ )
+		mdb->mi_attrs[i]->ai_cursor = NULL;
+
+	mdb_tool_merge_close( &mg );
+	for ( i = 0; i < mdb_tool_nruns; i++ )
+		fclose( mdb_tool_runs[i].fp );
+	ch_free( mdb_tool_runs );
+	mdb_tool_runs = NULL;
+	mdb_tool_nruns = 0;
+	mdb_ixkeys_free( &mdb_tool_ixkeys );
+	ch_free( obuf );
+	ch_free( bk.kbuf );
+	ch_free( bk.ids );
+
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			"=> " LDAP_XSTRING(mdb_tool_bulk_flush) ": database %s: "
+			"%s failed: %s\n", be->be_suffix[0].bv_val, err,
+			rc == LDAP_OTHER ? "Internal error" : mdb_strerror( rc ));
+	}
+	return rc;
+}
+
 ID mdb_tool_entry_put(
 	BackendDB *be,
 	Entry *e,
@@ -646,6 +1375,16 @@ ID mdb_tool_entry_put(
 
 	mdb = (struct mdb_info *) be->be_private;
 
+	if ( mdb_tool_bulk_err ) {
+		snprintf( text->bv_val, text->bv_len,
+			"bulk load stopped, index keys could not be written: %s (%d)",
+			strerror( mdb_tool_bulk_err ), mdb_tool_bulk_err );
+		Debug( LDAP_DEBUG_ANY,
+			"=> " LDAP_XSTRING(mdb_tool_entry_put) ": %s\n",
+			 text->bv_val, 0, 0 );
+		return NOID;
+	}
+
 	if ( !mdb_tool_txn ) {
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &mdb_tool_txn );
 		if( rc != 0 ) {
@@ -707,6 +1446,9 @@ ID mdb_tool_entry_put(
 	if ( mdb_tool_threads > 1 ) {
 		LDAP_SLIST_INSERT_HEAD( &op.o_extra, &mdb_tool_axinfo[0]->ai_oe, oe_next );
 	}
+	if ( mdb_tool_bulk ) {
+		LDAP_SLIST_INSERT_HEAD( &op.o_extra, &mdb_tool_ixkeys.ix_oe, oe_next );
+	}
 	rc = mdb_tool_index_add( &op, mdb_tool_txn, e );
 	if( rc != 0 ) {
 		snprintf( text->bv_val, text->bv_len,
@@ -753,10 +1495,14 @@ done:
 					text->bv_val, 0, 0 );
 				e->e_id = NOID;
 			}
+			if ( mdb_tool_bulk )
+				mdb_tool_bulk_commit( rc );
 		}
 
 	} else {
 		unsigned i;
+		if ( mdb_tool_bulk )
+			mdb_tool_bulk_commit( rc );
 		mdb_txn_abort( mdb_tool_txn );
 		mdb_tool_txn = NULL;
 		idcursor = NULL;
@@ -883,6 +1629,52 @@ int mdb_tool_entry_reindex(
 					mdb_strerror(rc), rc );
 				return -1;
 			}
+			if ( mi->mi_attrs[i]->ai_odbi ) {
+				rc = mdb_drop( txi, mi->mi_attrs[i]->ai_odbi, 0 );
+				if ( rc == 0 && mi->mi_attrs[i]->ai_cdbi )
+					rc = mdb_drop( txi, mi->mi_attrs[i]->ai_cdbi, 0 );
+				if ( rc ) {
+					Debug( LDAP_DEBUG_ANY,
+						LDAP_XSTRING(mdb_tool_entry_reindex)
+						": (Truncate) mdb_drop(%s) failed: %s (%d)\n",
+						mi->mi_attrs[i]->ai_desc->ad_cname.bv_val,
+						mdb_strerror(rc), rc );
+					return -1;
+				}
+			}
+			if ( mi->mi_attrs[i]->ai_ndbi ) {
+				rc = mdb_drop( txi, mi->mi_attrs[i]->ai_ndbi, 0 );
+				if ( rc == 0 )
+					rc = mdb_bitmap_drop( mi, txi, mi->mi_attrs[i],
+						mi->mi_attrs[i]->ai_ndbi );
+				if ( rc ) {
+					Debug( LDAP_DEBUG_ANY,
+						LDAP_XSTRING(mdb_tool_entry_reindex)
+						": (Truncate) mdb_drop(%s) failed: %s (%d)\n",
+						mi->mi_attrs[i]->ai_desc->ad_cname.bv_val,
+						mdb_strerror(rc), rc );
+					return -1;
+				}
+			}
+			rc = mdb_bitmap_drop( mi, txi, mi->mi_attrs[i],
+				mi->mi_attrs[i]->ai_dbi );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_entry_reindex)
+					": (Truncate) mdb_bitmap_drop(%s) failed: %s (%d)\n",
+					mi->mi_attrs[i]->ai_desc->ad_type->sat_cname.bv_val,
+					mdb_strerror(rc), rc );
+				return -1;
+			}
+			rc = mdb_ixstat_reset( mi, txi, mi->mi_attrs[i] );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_entry_reindex)
+					": (Truncate) mdb_ixstat_reset(%s) failed: %s (%d)\n",
+					mi->mi_attrs[i]->ai_desc->ad_type->sat_cname.bv_val,
+					mdb_strerror(rc), rc );
+				return -1;
+			}
 		}
 		slapMode ^= SLAP_TRUNCATE_MODE;
 	}
@@ -978,6 +1770,12 @@ ID mdb_tool_entry_modify(
 
 	mdb = (struct mdb_info *) be->be_private;
 
+	/* the entry's keys must be in the indices to be replaced */
+	if ( mdb_tool_bulk && mdb_tool_bulk_flush( be )) {
+		snprintf( text->bv_val, text->bv_len,
+			"bulk-load flush failed" );
+		return NOID;
+	}
 	if( cursor ) {
 		mdb_cursor_close( cursor );
 		cursor = NULL;
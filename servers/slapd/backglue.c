@@ -1306,6 +1306,8 @@ glue_db_init(
 		oi->oi_bi.bi_tool_entry_modify = glue_tool_entry_modify;
 	if ( bi->bi_tool_sync )
 		oi->oi_bi.bi_tool_sync = glue_tool_sync;
+	/* the IDs of a range are those of the root DB alone */
+	oi->oi_bi.bi_tool_entry_range = 0;
 
 	SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_GLUE_INSTANCE;
 
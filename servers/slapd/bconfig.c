@@ -200,6 +200,8 @@ enum {
 	CFG_DISABLED,
 	CFG_THREADQS,
 	CFG_TLS_ECNAME,
+	CFG_DNCACHE,
+	CFG_ACLCACHE,
 
 	CFG_LAST
 };
@@ -302,6 +304,9 @@ static ConfigTable config_back_cf_table[] = {
 			"DESC 'Access Control List' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )", NULL, NULL },
+	{ "aclcachesize", "size", 2, 2, 0, ARG_UINT|ARG_MAGIC|CFG_ACLCACHE,
+		&config_generic, "( OLcfgGlAt:98 NAME 'olcAclCacheSize' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "add_content_acl",	NULL, 0, 0, 0, ARG_MAY_DB|ARG_ON_OFF|ARG_MAGIC|CFG_ACL_ADD,
 		&config_generic, "( OLcfgGlAt:86 NAME 'olcAddContentAcl' "
 			"DESC 'Check ACLs against content of Add ops' "
@@ -374,6 +379,9 @@ static ConfigTable config_back_cf_table[] = {
 		&config_disallows, "( OLcfgGlAt:15 NAME 'olcDisallows' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "dncachesize", "size", 2, 2, 0, ARG_UINT|ARG_MAGIC|CFG_DNCACHE,
+		&config_generic, "( OLcfgGlAt:97 NAME 'olcDnCacheSize' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "ditcontentrule",	NULL, 0, 0, 0, ARG_MAGIC|CFG_DIT|ARG_NO_DELETE|ARG_NO_INSERT,
 		&config_generic, "( OLcfgGlAt:16 NAME 'olcDitContentRules' "
 			"DESC 'OpenLDAP DIT content rules' "
@@ -846,11 +854,11 @@ static ConfigOCs cf_ocs[] = {
 		"NAME 'olcGlobal' "
 		"DESC 'OpenLDAP Global configuration options' "
 		"SUP olcConfig STRUCTURAL "
-		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAllows $ olcArgsFile $ "
+		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAclCacheSize $ olcAllows $ olcArgsFile $ "
 		 "olcAttributeOptions $ olcAuthIDRewrite $ "
 		 "olcAuthzPolicy $ olcAuthzRegexp $ olcConcurrency $ "
 		 "olcConnMaxPending $ olcConnMaxPendingAuth $ "
-		 "olcDisallows $ olcGentleHUP $ olcIdleTimeout $ "
+		 "olcDisallows $ olcDnCacheSize $ olcGentleHUP $ olcIdleTimeout $ "
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
 		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ "
 		 "olcIndexIntLen $ "
@@ -976,6 +984,12 @@ config_generic(ConfigArgs *c) {
 		case CFG_LTHREADS:
 			c->value_uint = slapd_daemon_threads;
 			break;
+		case CFG_DNCACHE:
+			c->value_uint = slap_dncache_size;
+			break;
+		case CFG_ACLCACHE:
+			c->value_uint = slap_aclcache_size;
+			break;
 		case CFG_SALT:
 			if ( passwd_salt )
 				c->value_string = ch_strdup( passwd_salt );
@@ -1456,6 +1470,15 @@ config_generic(ConfigArgs *c) {
 				SLAP_INDEX_INTLEN_DEFAULT );
 			break;
 
+		case CFG_DNCACHE:
+			dn_cache_resize( 0 );
+			break;
+
+		case CFG_ACLCACHE:
+			slap_aclcache_size = 0;
+			acl_cache_acls_changed();
+			break;
+
 		case CFG_ACL:
 			if ( c->valx < 0 ) {
 				acl_destroy( c->be->be_acl );
@@ -1471,6 +1494,11 @@ config_generic(ConfigArgs *c) {
 				}
 				a = *prev;
 				*prev = a->acl_next;
+				if ( c->be->be_acl ) {
+					acl_index_build( c->be->be_acl );
+				} else {
+					acl_index_free( a->acl_index );
+				}
 				acl_free( a );
 			}
 			if ( SLAP_CONFIG( c->be ) && !c->be->be_acl ) {
@@ -1976,6 +2004,15 @@ config_generic(ConfigArgs *c) {
 				return 1;
 			break;
 
+		case CFG_DNCACHE:
+			dn_cache_resize( c->value_uint );
+			break;
+
+		case CFG_ACLCACHE:
+			slap_aclcache_size = c->value_uint;
+			acl_cache_acls_changed();
+			break;
+
 		case CFG_IX_INTLEN:
 			if ( c->value_int < SLAP_INDEX_INTLEN_DEFAULT )
 				c->value_int = SLAP_INDEX_INTLEN_DEFAULT;
@@ -468,6 +468,9 @@ Connection * connection_init(
 	/* set to zero until bind, implies LDAP_VERSION3 */
 	c->c_protocol = 0;
 
+	if ( slap_aclcache_size )
+		acl_cache_alloc( c );
+
 #ifndef SLAPD_MONITOR
 	if ( global_idletimeout > 0 )
 #endif /* ! SLAPD_MONITOR */
@@ -654,6 +657,8 @@ connection_destroy( Connection *c )
 
 	slap_sasl_close( c );
 
+	acl_cache_free( c );
+
 	if ( c->c_currentber != NULL ) {
 		ber_free( c->c_currentber, 1 );
 		c->c_currentber = NULL;
@@ -1061,6 +1066,8 @@ connection_operation( void *ctx, void *arg_v )
 
 	op->o_threadctx = ctx;
 	op->o_tid = ldap_pvt_thread_pool_tid( ctx );
+	if ( conn->c_aclcache != NULL )
+		acl_cache_op_init( op );
 
 	switch ( tag ) {
 	case LDAP_REQ_BIND:
@@ -54,6 +54,9 @@ static SLAP_CTRL_PARSE_FN parseWhatFailed;
 #ifdef SLAP_CONTROL_X_LAZY_COMMIT
 static SLAP_CTRL_PARSE_FN parseLazyCommit;
 #endif
+#ifdef SLAP_CONTROL_X_COUNT
+static SLAP_CTRL_PARSE_FN parseCount;
+#endif
 
 #undef sc_mask /* avoid conflict with Irix 6.5 <sys/signal.h> */
 
@@ -236,6 +239,13 @@ static struct slap_control control_defs[] = {
 		NULL, NULL,
 		parseLazyCommit, LDAP_SLIST_ENTRY_INITIALIZER(next) },
 #endif
+#ifdef SLAP_CONTROL_X_COUNT
+	{ LDAP_CONTROL_X_COUNT,
+		(int)offsetof(struct slap_control_ids, sc_count),
+		SLAP_CTRL_SEARCH|SLAP_CTRL_HIDE,
+		NULL, NULL,
+		parseCount, LDAP_SLIST_ENTRY_INITIALIZER(next) },
+#endif
 
 	{ NULL, 0, 0, NULL, 0, NULL, LDAP_SLIST_ENTRY_INITIALIZER(next) }
 };
@@ -2190,3 +2200,75 @@ static int parseLazyCommit(
 	return LDAP_SUCCESS;
 }
 #endif
+
+#ifdef SLAP_CONTROL_X_COUNT
+static int parseCount(
+	Operation *op,
+	SlapReply *rs,
+	LDAPControl *ctrl )
+{
+	if ( op->o_count != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "count control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( !BER_BVISNULL( &ctrl->ldctl_value )) {
+		rs->sr_text = "count control value not absent";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	op->o_count = ctrl->ldctl_iscritical
+		? SLAP_CONTROL_CRITICAL
+		: SLAP_CONTROL_NONCRITICAL;
+
+	return LDAP_SUCCESS;
+}
+
+/*
+ * countResponse ::= SEQUENCE {
+ *	count		INTEGER (0..maxInt),
+ *	estimated	BOOLEAN DEFAULT FALSE }
+ *
+ * An estimated count is an upper bound of the number of entries
+ * that match.
+ */
+int
+slap_ctrl_count_add(
+	Operation *op,
+	SlapReply *rs,
+	ber_int_t count,
+	int estimated )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *) &berbuf;
+	LDAPControl *ctrls[ 2 ];
+	struct berval ctrlval;
+	int rc;
+
+	ber_init2( ber, NULL, LBER_USE_DER );
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+	if ( estimated ) {
+		rc = ber_printf( ber, "{ib}", count, (ber_int_t)1 );
+	} else {
+		rc = ber_printf( ber, "{i}", count );
+	}
+	if ( rc == -1 || ber_flatten2( ber, &ctrlval, 0 ) == -1 ) {
+		ber_free_buf( ber );
+		return LDAP_OTHER;
+	}
+
+	/* the value goes along with the control, for slap_free_ctrls() */
+	ctrls[ 0 ] = op->o_tmpalloc( sizeof(LDAPControl) + ctrlval.bv_len + 1,
+		op->o_tmpmemctx );
+	ctrls[ 0 ]->ldctl_oid = LDAP_CONTROL_X_COUNT;
+	ctrls[ 0 ]->ldctl_iscritical = 0;
+	ctrls[ 0 ]->ldctl_value.bv_val = (char *)&ctrls[ 0 ][ 1 ];
+	AC_MEMCPY( ctrls[ 0 ]->ldctl_value.bv_val, ctrlval.bv_val, ctrlval.bv_len + 1 );
+	ctrls[ 0 ]->ldctl_value.bv_len = ctrlval.bv_len;
+	ctrls[ 1 ] = NULL;
+	ber_free_buf( ber );
+
+	slap_add_ctrls( op, rs, ctrls );
+	return LDAP_SUCCESS;
+}
+#endif
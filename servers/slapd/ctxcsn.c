@@ -132,6 +132,8 @@ slap_graduate_commit_csn( Operation *op )
 
 	ldap_pvt_thread_mutex_unlock( &be->be_pcl_mutex );
 
+	acl_cache_entries_changed();
+
 	return;
 }
 
@@ -412,6 +412,358 @@ LDAPDN_rewrite( LDAPDN dn, unsigned flags, void *ctx )
 	return LDAP_SUCCESS;
 }
 
+/*
+ * Cache of pretty and normalized DNs, keyed by the DN string as
+ * received.  The same DNs (bind DNs, search bases, group members)
+ * show up in request after request; converting them to structural
+ * form and back allocates for each AVA, so remembering the results
+ * saves most of that work.  The cache is split in shards, each with
+ * its own mutex and LRU list, to keep the worker threads from
+ * contending on a single lock.  Either form may be missing from an
+ * entry, since dnPretty() and dnNormalize() are often called on
+ * their own; they fill in whatever they computed.
+ *
+ * Normalization depends on the schema, so the cache is flushed
+ * whenever attribute types are added or deleted.
+ */
+#define DNCACHE_SHARDS	16
+
+typedef struct dncache_entry {
+	struct dncache_entry *de_next;		/* hash chain */
+	struct dncache_entry *de_lru_prev;	/* towards most recently used */
+	struct dncache_entry *de_lru_next;	/* towards least recently used */
+	unsigned int de_hash;
+	struct berval de_dn;
+	struct berval de_pretty;
+	struct berval de_normal;
+} dncache_entry;
+
+typedef struct dncache_shard {
+	ldap_pvt_thread_mutex_t ds_mutex;
+	dncache_entry **ds_buckets;
+	unsigned int ds_nbuckets;
+	unsigned int ds_count;
+	unsigned int ds_max;
+	dncache_entry *ds_lru_head;
+	dncache_entry *ds_lru_tail;
+	unsigned long ds_hits;
+	unsigned long ds_misses;
+} dncache_shard;
+
+static dncache_shard dncache[DNCACHE_SHARDS];
+static int dncache_inited;
+
+/* total number of cached DNs, 0 disables the cache */
+unsigned int slap_dncache_size;
+
+static unsigned int
+dncache_hash( struct berval *dn )
+{
+	unsigned char *p = (unsigned char *)dn->bv_val;
+	unsigned char *end = p + dn->bv_len;
+	unsigned int h = 2166136261U;
+
+	for ( ; p < end; p++ ) {
+		h ^= *p;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void
+dncache_lru_unlink( dncache_shard *ds, dncache_entry *de )
+{
+	if ( de->de_lru_prev )
+		de->de_lru_prev->de_lru_next = de->de_lru_next;
+	else
+		ds->ds_lru_head = de->de_lru_next;
+	if ( de->de_lru_next )
+		de->de_lru_next->de_lru_prev = de->de_lru_prev;
+	else
+		ds->ds_lru_tail = de->de_lru_prev;
+}
+
+static void
+dncache_lru_push( dncache_shard *ds, dncache_entry *de )
+{
+	de->de_lru_prev = NULL;
+	de->de_lru_next = ds->ds_lru_head;
+	if ( ds->ds_lru_head )
+		ds->ds_lru_head->de_lru_prev = de;
+	else
+		ds->ds_lru_tail = de;
+	ds->ds_lru_head = de;
+}
+
+static void
+dncache_entry_free( dncache_entry *de )
+{
+	if ( !BER_BVISNULL( &de->de_pretty ))
+		ch_free( de->de_pretty.bv_val );
+	if ( !BER_BVISNULL( &de->de_normal ))
+		ch_free( de->de_normal.bv_val );
+	ch_free( de );
+}
+
+/* must be called with the shard locked */
+static void
+dncache_shard_empty( dncache_shard *ds )
+{
+	dncache_entry *de, *next;
+
+	if ( !ds->ds_count )
+		return;
+
+	for ( de = ds->ds_lru_head; de; de = next ) {
+		next = de->de_lru_next;
+		dncache_entry_free( de );
+	}
+	ds->ds_lru_head = ds->ds_lru_tail = NULL;
+	ds->ds_count = 0;
+	if ( ds->ds_buckets )
+		memset( ds->ds_buckets, 0,
+			ds->ds_nbuckets * sizeof( dncache_entry * ));
+}
+
+/* must be called with the shard locked */
+static dncache_entry *
+dncache_find( dncache_shard *ds, struct berval *dn, unsigned int hash )
+{
+	dncache_entry *de;
+
+	if ( !ds->ds_buckets )
+		return NULL;
+
+	for ( de = ds->ds_buckets[ hash & ( ds->ds_nbuckets - 1 ) ];
+		de; de = de->de_next )
+	{
+		if ( de->de_hash == hash && bvmatch( &de->de_dn, dn ))
+			return de;
+	}
+	return NULL;
+}
+
+/*
+ * Look up dn in the cache and copy whichever of the requested forms
+ * are available into pretty and/or normal. Returns 1 only if all of
+ * the requested forms were found.
+ */
+static int
+dncache_get(
+	struct berval *dn,
+	struct berval *pretty,
+	struct berval *normal,
+	void *ctx )
+{
+	dncache_shard *ds;
+	dncache_entry *de;
+	unsigned int hash;
+	int rc = 0;
+
+	if ( !slap_dncache_size )
+		return 0;
+
+	hash = dncache_hash( dn );
+	ds = &dncache[ hash % DNCACHE_SHARDS ];
+	hash /= DNCACHE_SHARDS;
+
+	ldap_pvt_thread_mutex_lock( &ds->ds_mutex );
+	de = dncache_find( ds, dn, hash );
+	if ( de
+		&& ( !pretty || !BER_BVISNULL( &de->de_pretty ))
+		&& ( !normal || !BER_BVISNULL( &de->de_normal )))
+	{
+		if ( pretty )
+			ber_dupbv_x( pretty, &de->de_pretty, ctx );
+		if ( normal )
+			ber_dupbv_x( normal, &de->de_normal, ctx );
+		if ( de != ds->ds_lru_head ) {
+			dncache_lru_unlink( ds, de );
+			dncache_lru_push( ds, de );
+		}
+		rc = 1;
+		ds->ds_hits++;
+	} else {
+		ds->ds_misses++;
+	}
+	ldap_pvt_thread_mutex_unlock( &ds->ds_mutex );
+
+	return rc;
+}
+
+/*
+ * Remember the pretty and/or normalized form of dn; either may be NULL.
+ */
+static void
+dncache_put(
+	struct berval *dn,
+	struct berval *pretty,
+	struct berval *normal )
+{
+	dncache_shard *ds;
+	dncache_entry *de;
+	unsigned int hash;
+
+	if ( !slap_dncache_size )
+		return;
+
+	hash = dncache_hash( dn );
+	ds = &dncache[ hash % DNCACHE_SHARDS ];
+	hash /= DNCACHE_SHARDS;
+
+	ldap_pvt_thread_mutex_lock( &ds->ds_mutex );
+	if ( !ds->ds_buckets ) {
+		ldap_pvt_thread_mutex_unlock( &ds->ds_mutex );
+		return;
+	}
+
+	de = dncache_find( ds, dn, hash );
+	if ( de ) {
+		if ( de != ds->ds_lru_head ) {
+			dncache_lru_unlink( ds, de );
+			dncache_lru_push( ds, de );
+		}
+
+	} else {
+		dncache_entry **prev;
+
+		if ( ds->ds_count >= ds->ds_max ) {
+			/* evict the least recently used DN */
+			de = ds->ds_lru_tail;
+			dncache_lru_unlink( ds, de );
+			for ( prev = &ds->ds_buckets[ de->de_hash & ( ds->ds_nbuckets - 1 ) ];
+				*prev != de; prev = &(*prev)->de_next )
+				;
+			*prev = de->de_next;
+			dncache_entry_free( de );
+			ds->ds_count--;
+		}
+
+		de = ch_calloc( 1, sizeof( dncache_entry ) + dn->bv_len + 1 );
+		de->de_hash = hash;
+		de->de_dn.bv_val = (char *)( de + 1 );
+		de->de_dn.bv_len = dn->bv_len;
+		AC_MEMCPY( de->de_dn.bv_val, dn->bv_val, dn->bv_len );
+
+		prev = &ds->ds_buckets[ hash & ( ds->ds_nbuckets - 1 ) ];
+		de->de_next = *prev;
+		*prev = de;
+		dncache_lru_push( ds, de );
+		ds->ds_count++;
+	}
+
+	if ( pretty && BER_BVISNULL( &de->de_pretty ))
+		ber_dupbv( &de->de_pretty, pretty );
+	if ( normal && BER_BVISNULL( &de->de_normal ))
+		ber_dupbv( &de->de_normal, normal );
+	ldap_pvt_thread_mutex_unlock( &ds->ds_mutex );
+}
+
+/*
+ * Drop all cached DNs, e.g. because the schema changed.
+ */
+void
+dn_cache_flush( void )
+{
+	int i;
+
+	if ( !dncache_inited )
+		return;
+
+	for ( i = 0; i < DNCACHE_SHARDS; i++ ) {
+		ldap_pvt_thread_mutex_lock( &dncache[i].ds_mutex );
+		dncache_shard_empty( &dncache[i] );
+		ldap_pvt_thread_mutex_unlock( &dncache[i].ds_mutex );
+	}
+}
+
+/*
+ * Set the total number of DNs the cache may hold; 0 disables it.
+ * Cached DNs are discarded.
+ */
+int
+dn_cache_resize( unsigned int size )
+{
+	int i;
+
+	if ( !dncache_inited )
+		return -1;
+
+	for ( i = 0; i < DNCACHE_SHARDS; i++ ) {
+		dncache_shard *ds = &dncache[i];
+
+		ldap_pvt_thread_mutex_lock( &ds->ds_mutex );
+		dncache_shard_empty( ds );
+		if ( ds->ds_buckets ) {
+			ch_free( ds->ds_buckets );
+			ds->ds_buckets = NULL;
+		}
+		ds->ds_nbuckets = 0;
+		ds->ds_max = 0;
+		ds->ds_hits = ds->ds_misses = 0;
+		if ( size ) {
+			ds->ds_max = ( size + DNCACHE_SHARDS - 1 ) / DNCACHE_SHARDS;
+			for ( ds->ds_nbuckets = 16; ds->ds_nbuckets < ds->ds_max; )
+				ds->ds_nbuckets <<= 1;
+			ds->ds_buckets = ch_calloc( ds->ds_nbuckets,
+				sizeof( dncache_entry * ));
+		}
+		ldap_pvt_thread_mutex_unlock( &ds->ds_mutex );
+	}
+	slap_dncache_size = size;
+
+	return 0;
+}
+
+/*
+ * Return the number of lookups that were answered from the cache
+ * and the number that had to parse the DN, since the last resize.
+ */
+void
+dn_cache_stats( unsigned long *hits, unsigned long *misses )
+{
+	int i;
+
+	*hits = *misses = 0;
+	if ( !dncache_inited )
+		return;
+
+	for ( i = 0; i < DNCACHE_SHARDS; i++ ) {
+		ldap_pvt_thread_mutex_lock( &dncache[i].ds_mutex );
+		*hits += dncache[i].ds_hits;
+		*misses += dncache[i].ds_misses;
+		ldap_pvt_thread_mutex_unlock( &dncache[i].ds_mutex );
+	}
+}
+
+int
+dn_cache_init( void )
+{
+	int i;
+
+	for ( i = 0; i < DNCACHE_SHARDS; i++ ) {
+		ldap_pvt_thread_mutex_init( &dncache[i].ds_mutex );
+	}
+	dncache_inited = 1;
+
+	return dn_cache_resize( slap_dncache_size );
+}
+
+void
+dn_cache_destroy( void )
+{
+	int i;
+
+	if ( !dncache_inited )
+		return;
+
+	dn_cache_resize( 0 );
+	for ( i = 0; i < DNCACHE_SHARDS; i++ ) {
+		ldap_pvt_thread_mutex_destroy( &dncache[i].ds_mutex );
+	}
+	dncache_inited = 0;
+}
+
 int
 dnNormalize(
     slap_mask_t use,
@@ -426,7 +778,10 @@ dnNormalize(
 
 	Debug( LDAP_DEBUG_TRACE, ">>> dnNormalize: <%s>\n", val->bv_val ? val->bv_val : "", 0, 0 );
 
-	if ( val->bv_len != 0 ) {
+	if ( val->bv_len != 0 && dncache_get( val, NULL, out, ctx )) {
+		/* found in cache */
+
+	} else if ( val->bv_len != 0 ) {
 		LDAPDN		dn = NULL;
 		int		rc;
 
@@ -459,6 +814,8 @@ dnNormalize(
 		if ( rc != LDAP_SUCCESS ) {
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dncache_put( val, NULL, out );
 	} else {
 		ber_dupbv_x( out, val, ctx );
 	}
@@ -544,6 +901,9 @@ dnPretty(
 	} else if ( val->bv_len > SLAP_LDAPDN_MAXLEN ) {
 		return LDAP_INVALID_SYNTAX;
 
+	} else if ( dncache_get( val, out, NULL, ctx )) {
+		/* found in cache */
+
 	} else {
 		LDAPDN		dn = NULL;
 		int		rc;
@@ -576,6 +936,8 @@ dnPretty(
 		if ( rc != LDAP_SUCCESS ) {
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dncache_put( val, out, NULL );
 	}
 
 	Debug( LDAP_DEBUG_TRACE, "<<< dnPretty: <%s>\n", out->bv_val ? out->bv_val : "", 0, 0 );
@@ -716,6 +1078,9 @@ dnPrettyNormal(
 		/* too big */
 		return LDAP_INVALID_SYNTAX;
 
+	} else if ( dncache_get( val, pretty, normal, ctx )) {
+		/* found in cache */
+
 	} else {
 		LDAPDN		dn = NULL;
 		int		rc;
@@ -767,6 +1132,8 @@ dnPrettyNormal(
 			pretty->bv_len = 0;
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dncache_put( val, pretty, normal );
 	}
 
 	Debug( LDAP_DEBUG_TRACE, "<<< dnPrettyNormal: <%s>, <%s>\n",
@@ -37,7 +37,6 @@
 #include "ldif.h"
 
 static char		*ebuf;	/* buf returned by entry2str		 */
-static char		*ecur;	/* pointer to end of currently used ebuf */
 static int		emaxsize;/* max size of ebuf			 */
 
 /*
@@ -73,7 +72,6 @@ int entry_destroy(void)
 	slap_list *e;
 	if ( ebuf ) free( ebuf );
 	ebuf = NULL;
-	ecur = NULL;
 	emaxsize = 0;
 
 	for ( e=entry_chunks; e; e=entry_chunks ) {
@@ -371,18 +369,11 @@ fail:
 }
 
 
-#define GRABSIZE	BUFSIZ
-
-#define MAKE_SPACE( n )	{ \
-		while ( ecur + (n) > ebuf + emaxsize ) { \
-			ptrdiff_t	offset; \
-			offset = (int) (ecur - ebuf); \
-			ebuf = ch_realloc( ebuf, \
-				emaxsize + GRABSIZE ); \
-			emaxsize += GRABSIZE; \
-			ecur = ebuf + offset; \
-		} \
-	}
+/* The room an LDIF line of an attribute of nlen and a value of vlen
+ * characters may take, wrapped to wrap columns or more.
+ */
+#define ENTRY_LINE_SIZE( nlen, vlen, wrap ) \
+	LDIF_SIZE_NEEDED_WRAP( nlen, vlen, ( wrap ) == 1 ? 2 : ( wrap ))
 
 /* NOTE: only preserved for binary compatibility */
 char *
@@ -393,9 +384,11 @@ entry2str(
 	return entry2str_wrap( e, len, LDIF_LINE_WIDTH );
 }
 
-char *
-entry2str_wrap(
+static char *
+entry2str_buf(
 	Entry		*e,
+	char		**bufp,
+	int			*sizep,
 	int			*len,
 	ber_len_t	wrap )
 {
@@ -403,6 +396,9 @@ entry2str_wrap(
 	struct berval	*bv;
 	int		i;
 	ber_len_t tmplen;
+	char		*ebuf = *bufp, *ecur;
+	int			emaxsize = *sizep;
+	ber_len_t	size;
 
 	assert( e != NULL );
 
@@ -412,13 +408,28 @@ entry2str_wrap(
 	 *	[<attr>: <value>\n]*
 	 */
 
+	/* room for the whole entry, so that it is formatted in one go */
+	size = 1;
+	if ( e->e_dn != NULL )
+		size += ENTRY_LINE_SIZE( 2, e->e_name.bv_len, wrap );
+	for ( a = e->e_attrs; a != NULL; a = a->a_next ) {
+		tmplen = a->a_desc->ad_cname.bv_len;
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ )
+			size += ENTRY_LINE_SIZE( tmplen, a->a_vals[i].bv_len, wrap );
+	}
+	if ( size > emaxsize ) {
+		if ( size < 2 * emaxsize )
+			size = 2 * emaxsize;
+		ebuf = ch_realloc( ebuf, size );
+		emaxsize = size;
+	}
+
 	ecur = ebuf;
 
 	/* put the dn */
 	if ( e->e_dn != NULL ) {
 		/* put "dn: <dn>" */
 		tmplen = e->e_name.bv_len;
-		MAKE_SPACE( LDIF_SIZE_NEEDED( 2, tmplen ));
 		ldif_sput_wrap( &ecur, LDIF_PUT_VALUE, "dn", e->e_dn, tmplen, wrap );
 	}
 
@@ -427,20 +438,46 @@ entry2str_wrap(
 		/* put "<type>:[:] <value>" line for each value */
 		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
 			bv = &a->a_vals[i];
-			tmplen = a->a_desc->ad_cname.bv_len;
-			MAKE_SPACE( LDIF_SIZE_NEEDED( tmplen, bv->bv_len ));
 			ldif_sput_wrap( &ecur, LDIF_PUT_VALUE,
 				a->a_desc->ad_cname.bv_val,
 				bv->bv_val, bv->bv_len, wrap );
 		}
 	}
-	MAKE_SPACE( 1 );
 	*ecur = '\0';
 	*len = ecur - ebuf;
 
+	*bufp = ebuf;
+	*sizep = emaxsize;
 	return( ebuf );
 }
 
+char *
+entry2str_wrap(
+	Entry		*e,
+	int			*len,
+	ber_len_t	wrap )
+{
+	return entry2str_buf( e, &ebuf, &emaxsize, len, wrap );
+}
+
+/* Like entry2str_wrap(), but into a buffer of the caller's:
+ * buf->bv_val of buf->bv_len bytes, grown as needed.
+ */
+char *
+entry2str_wrap_r(
+	Entry		*e,
+	struct berval	*buf,
+	int			*len,
+	ber_len_t	wrap )
+{
+	int size = buf->bv_len;
+	char *ret;
+
+	ret = entry2str_buf( e, &buf->bv_val, &size, len, wrap );
+	buf->bv_len = size;
+	return ret;
+}
+
 void
 entry_clean( Entry *e )
 {
@@ -984,3 +984,612 @@ test_substrings_filter(
 		rc, 0, 0 );
 	return rc;
 }
+
+/*
+ * Compiled filters
+ *
+ * A search tests the same filter against every candidate entry;
+ * test_filter() walks the Filter tree each time and works out the
+ * matching rule of each assertion for every attribute it looks at.
+ * filter_compile() flattens the tree once into an array of
+ * instructions in prefix order, with the matching rules of the
+ * asserted attribute types resolved in advance and the operands of
+ * each AND and OR sorted so the cheapest are tried first.
+ *
+ * The outcome of an AND (OR) whose operands are all evaluated does
+ * not depend on the order of evaluation, except for the error code
+ * returned when no operand is False (True); the position of each
+ * operand in the original filter is kept so that the same code as
+ * test_filter() is returned.  Items that cannot be compiled, such as
+ * extensible matches, are evaluated with test_filter().
+ */
+
+typedef struct FilterInsn {
+	ber_tag_t		fi_choice;
+	int			fi_end;		/* first insn after this subtree */
+	int			fi_pos;		/* position among the siblings */
+	Filter			*fi_filter;
+
+	/* attribute and matching rule of the assertion */
+	AttributeDescription	*fi_desc;
+	AttributeType		*fi_type;	/* only fi_desc itself can match */
+	MatchingRule		*fi_mr;
+	unsigned		fi_use;
+} FilterInsn;
+
+struct FilterProgram {
+	int			fp_ninsns;
+	FilterInsn		fp_insns[1];
+};
+
+#define	FILTER_INSN_GENERIC	((ber_tag_t) -1)
+
+static int
+filter_insn_count( Filter *f )
+{
+	int n = 1;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f != NULL; f = f->f_next )
+			n += filter_insn_count( f );
+		break;
+
+	case LDAP_FILTER_NOT:
+		n += filter_insn_count( f->f_not );
+		break;
+	}
+
+	return n;
+}
+
+/*
+ * Rough relative cost of evaluating f against an entry
+ */
+static int
+filter_cost( Filter *f )
+{
+	int cost = 0;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return 0;
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		return 0;
+
+	case LDAP_FILTER_PRESENT:
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_APPROX:
+		/* may have to look for children in the database */
+		if (( f->f_choice == LDAP_FILTER_PRESENT ? f->f_desc : f->f_av_desc )
+			== slap_schema.si_ad_hasSubordinates )
+		{
+			return 8;
+		}
+		break;
+	}
+
+	switch ( f->f_choice ) {
+
+	case LDAP_FILTER_PRESENT:
+		return 1;
+
+	case LDAP_FILTER_EQUALITY:
+		return 2;
+
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		return 3;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		return 4;
+
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f != NULL && cost < 1000; f = f->f_next )
+			cost += filter_cost( f );
+		return cost;
+
+	case LDAP_FILTER_NOT:
+		return filter_cost( f->f_not );
+	}
+
+	return 8;
+}
+
+typedef struct FilterOperand {
+	Filter	*fo_filter;
+	int	fo_pos;
+	int	fo_cost;
+} FilterOperand;
+
+static int
+filter_operand_cmp( const void *v1, const void *v2 )
+{
+	const FilterOperand *o1 = v1, *o2 = v2;
+
+	if ( o1->fo_cost != o2->fo_cost )
+		return o1->fo_cost < o2->fo_cost ? -1 : 1;
+	return o1->fo_pos - o2->fo_pos;
+}
+
+/*
+ * Matching rule used by an assertion of the given kind on values of at
+ */
+static MatchingRule *
+filter_insn_mr( ber_tag_t choice, AttributeType *at, unsigned *use )
+{
+	switch ( choice ) {
+	case LDAP_FILTER_APPROX:
+		*use = SLAP_MR_EQUALITY_APPROX;
+		if ( at->sat_approx != NULL )
+			return at->sat_approx;
+		/* use EQUALITY matching rule if no APPROX rule */
+		return at->sat_equality;
+
+	case LDAP_FILTER_EQUALITY:
+		*use = SLAP_MR_EQUALITY;
+		return at->sat_equality;
+
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		*use = SLAP_MR_ORDERING;
+		return at->sat_ordering;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		*use = SLAP_MR_SUBSTR;
+		return at->sat_substr;
+	}
+
+	*use = 0;
+	return NULL;
+}
+
+static int
+filter_insn_emit( Operation *op, FilterInsn *insns, int i, Filter *f, int pos )
+{
+	FilterInsn *fi = &insns[i];
+	AttributeDescription *desc = NULL;
+
+	memset( fi, 0, sizeof( *fi ));
+	fi->fi_choice = f->f_choice;
+	fi->fi_pos = pos;
+	fi->fi_filter = f;
+	i++;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		fi->fi_choice = FILTER_INSN_GENERIC;
+		goto done;
+	}
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR: {
+		FilterOperand *fo;
+		Filter *sf;
+		int n, j;
+
+		for ( n = 0, sf = f->f_list; sf != NULL; sf = sf->f_next )
+			n++;
+		if ( n == 0 )
+			break;
+
+		fo = op->o_tmpalloc( n * sizeof( FilterOperand ), op->o_tmpmemctx );
+		for ( j = 0, sf = f->f_list; sf != NULL; j++, sf = sf->f_next ) {
+			fo[j].fo_filter = sf;
+			fo[j].fo_pos = j;
+			fo[j].fo_cost = filter_cost( sf );
+		}
+		qsort( fo, n, sizeof( FilterOperand ), filter_operand_cmp );
+
+		for ( j = 0; j < n; j++ )
+			i = filter_insn_emit( op, insns, i, fo[j].fo_filter, fo[j].fo_pos );
+		op->o_tmpfree( fo, op->o_tmpmemctx );
+		} break;
+
+	case LDAP_FILTER_NOT:
+		i = filter_insn_emit( op, insns, i, f->f_not, 0 );
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+#ifdef LDAP_COMP_MATCH
+		if ( f->f_ava->aa_cf != NULL ) {
+			fi->fi_choice = FILTER_INSN_GENERIC;
+			break;
+		}
+#endif
+		desc = f->f_av_desc;
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		desc = f->f_sub_desc;
+		break;
+
+	case LDAP_FILTER_PRESENT:
+		desc = f->f_desc;
+		break;
+
+	case SLAPD_FILTER_COMPUTED:
+		break;
+
+	default:
+		fi->fi_choice = FILTER_INSN_GENERIC;
+		break;
+	}
+
+	if ( desc != NULL ) {
+		if ( desc == slap_schema.si_ad_hasSubordinates
+			|| desc == slap_schema.si_ad_entryDN
+			|| desc == slap_schema.si_ad_subschemaSubentry )
+		{
+			fi->fi_choice = FILTER_INSN_GENERIC;
+
+		} else {
+			fi->fi_desc = desc;
+			fi->fi_mr = filter_insn_mr( f->f_choice, desc->ad_type,
+				&fi->fi_use );
+
+			/* without subtypes or options, only the attribute
+			 * type itself needs to be compared */
+			if ( desc->ad_type->sat_subtypes == NULL
+				&& desc->ad_flags == 0
+				&& BER_BVISEMPTY( &desc->ad_tags ) )
+			{
+				fi->fi_type = desc->ad_type;
+			}
+		}
+	}
+
+done:
+	fi->fi_end = i;
+	return i;
+}
+
+/*
+ * filter_compile - compile f for repeated evaluation with
+ * test_filter_program(); the program refers to f, which must
+ * outlive it.  Allocated from the operation's memory context.
+ */
+FilterProgram *
+filter_compile( Operation *op, Filter *f )
+{
+	FilterProgram *fp;
+	int n;
+
+	assert( op != NULL );
+	assert( f != NULL );
+
+	n = filter_insn_count( f );
+	fp = op->o_tmpalloc( sizeof( FilterProgram )
+		+ ( n - 1 ) * sizeof( FilterInsn ), op->o_tmpmemctx );
+	fp->fp_ninsns = n;
+	filter_insn_emit( op, fp->fp_insns, 0, f, 0 );
+
+	return fp;
+}
+
+void
+filter_program_free( Operation *op, FilterProgram *fp )
+{
+	if ( fp != NULL )
+		op->o_tmpfree( fp, op->o_tmpmemctx );
+}
+
+static Attribute *
+filter_insn_attr( FilterInsn *fi, Attribute *a )
+{
+	if ( fi->fi_type != NULL ) {
+		for ( ; a != NULL; a = a->a_next ) {
+			if ( a->a_desc->ad_type == fi->fi_type )
+				return a;
+		}
+		return NULL;
+	}
+
+	return attrs_find( a, fi->fi_desc );
+}
+
+static int
+test_ava_insn(
+	Operation	*op,
+	Entry		*e,
+	FilterInsn	*fi )
+{
+	AttributeAssertion *ava = fi->fi_filter->f_ava;
+	ber_tag_t type = fi->fi_choice;
+	Attribute *a;
+	int rc;
+
+	if ( !access_allowed( op, e,
+		ava->aa_desc, &ava->aa_value, ACL_SEARCH, NULL ) )
+	{
+		return LDAP_INSUFFICIENT_ACCESS;
+	}
+
+	rc = LDAP_COMPARE_FALSE;
+
+	for ( a = filter_insn_attr( fi, e->e_attrs );
+		a != NULL;
+		a = filter_insn_attr( fi, a->a_next ) )
+	{
+		unsigned use;
+		MatchingRule *mr;
+		struct berval *bv;
+
+		if (( ava->aa_desc != a->a_desc ) && !access_allowed( op,
+			e, a->a_desc, &ava->aa_value, ACL_SEARCH, NULL ))
+		{
+			rc = LDAP_INSUFFICIENT_ACCESS;
+			continue;
+		}
+
+		if ( a->a_desc->ad_type == fi->fi_desc->ad_type ) {
+			mr = fi->fi_mr;
+			use = fi->fi_use;
+		} else {
+			mr = filter_insn_mr( type, a->a_desc->ad_type, &use );
+		}
+
+		if ( mr == NULL ) {
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			continue;
+		}
+
+		/* We have no Sort optimization for Approx matches */
+		if (( a->a_flags & SLAP_ATTR_SORTED_VALS ) && type != LDAP_FILTER_APPROX ) {
+			unsigned slot;
+			int ret;
+
+			/* For Ordering matches, we just need to do one comparison with
+			 * either the first (least) or last (greatest) value.
+			 */
+			if ( use == SLAP_MR_ORDERING ) {
+				const char *text;
+				int match, which;
+				which = (type == LDAP_FILTER_LE) ? 0 : a->a_numvals-1;
+				ret = value_match( &match, a->a_desc, mr, use,
+					&a->a_nvals[which], &ava->aa_value, &text );
+				if ( ret != LDAP_SUCCESS ) return ret;
+				if (( type == LDAP_FILTER_LE && match <= 0 ) ||
+					( type == LDAP_FILTER_GE && match >= 0 ))
+					return LDAP_COMPARE_TRUE;
+				continue;
+			}
+			/* Only Equality will get here */
+			ret = attr_valfind( a, use | SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH |
+				SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH, 
+				&ava->aa_value, &slot, NULL );
+			if ( ret == LDAP_SUCCESS )
+				return LDAP_COMPARE_TRUE;
+			else if ( ret != LDAP_NO_SUCH_ATTRIBUTE )
+				return ret;
+			continue;
+		}
+
+		for ( bv = a->a_nvals; !BER_BVISNULL( bv ); bv++ ) {
+			int ret, match;
+			const char *text;
+
+			ret = ordered_value_match( &match, a->a_desc, mr, use,
+				bv, &ava->aa_value, &text );
+
+			if( ret != LDAP_SUCCESS ) {
+				rc = ret;
+				break;
+			}
+
+			switch ( type ) {
+			case LDAP_FILTER_EQUALITY:
+			case LDAP_FILTER_APPROX:
+				if ( match == 0 ) return LDAP_COMPARE_TRUE;
+				break;
+
+			case LDAP_FILTER_GE:
+				if ( match >= 0 ) return LDAP_COMPARE_TRUE;
+				break;
+
+			case LDAP_FILTER_LE:
+				if ( match <= 0 ) return LDAP_COMPARE_TRUE;
+				break;
+			}
+		}
+	}
+
+	return rc;
+}
+
+static int
+test_substrings_insn(
+	Operation	*op,
+	Entry		*e,
+	FilterInsn	*fi )
+{
+	Filter *f = fi->fi_filter;
+	Attribute *a;
+	int rc;
+
+	if ( !access_allowed( op, e,
+		f->f_sub_desc, NULL, ACL_SEARCH, NULL ) )
+	{
+		return LDAP_INSUFFICIENT_ACCESS;
+	}
+
+	rc = LDAP_COMPARE_FALSE;
+
+	for ( a = filter_insn_attr( fi, e->e_attrs );
+		a != NULL;
+		a = filter_insn_attr( fi, a->a_next ) )
+	{
+		unsigned use;
+		MatchingRule *mr;
+		struct berval *bv;
+
+		if (( f->f_sub_desc != a->a_desc ) && !access_allowed( op,
+			e, a->a_desc, NULL, ACL_SEARCH, NULL ))
+		{
+			rc = LDAP_INSUFFICIENT_ACCESS;
+			continue;
+		}
+
+		if ( a->a_desc->ad_type == fi->fi_desc->ad_type ) {
+			mr = fi->fi_mr;
+		} else {
+			mr = filter_insn_mr( LDAP_FILTER_SUBSTRINGS,
+				a->a_desc->ad_type, &use );
+		}
+
+		if( mr == NULL ) {
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			continue;
+		}
+
+		for ( bv = a->a_nvals; !BER_BVISNULL( bv ); bv++ ) {
+			int ret, match;
+			const char *text;
+
+			ret = value_match( &match, a->a_desc, mr, SLAP_MR_SUBSTR,
+				bv, f->f_sub, &text );
+
+			if( ret != LDAP_SUCCESS ) {
+				rc = ret;
+				break;
+			}
+			if ( match == 0 ) return LDAP_COMPARE_TRUE;
+		}
+	}
+
+	return rc;
+}
+
+static int
+test_presence_insn(
+	Operation	*op,
+	Entry		*e,
+	FilterInsn	*fi )
+{
+	AttributeDescription *desc = fi->fi_desc;
+	Attribute *a;
+	int rc;
+
+	if ( !access_allowed( op, e, desc, NULL, ACL_SEARCH, NULL ) ) {
+		return LDAP_INSUFFICIENT_ACCESS;
+	}
+
+	rc = LDAP_COMPARE_FALSE;
+
+	for ( a = filter_insn_attr( fi, e->e_attrs );
+		a != NULL;
+		a = filter_insn_attr( fi, a->a_next ) )
+	{
+		if (( desc != a->a_desc ) && !access_allowed( op,
+			e, a->a_desc, NULL, ACL_SEARCH, NULL ))
+		{
+			rc = LDAP_INSUFFICIENT_ACCESS;
+			continue;
+		}
+
+		rc = LDAP_COMPARE_TRUE;
+		break;
+	}
+
+	return rc;
+}
+
+static int
+test_insn( Operation *op, Entry *e, FilterInsn *insns, int i )
+{
+	FilterInsn *fi = &insns[i], *sub;
+	int rc, pos;
+
+	switch ( fi->fi_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		return fi->fi_filter->f_result;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		return test_ava_insn( op, e, fi );
+
+	case LDAP_FILTER_SUBSTRINGS:
+		return test_substrings_insn( op, e, fi );
+
+	case LDAP_FILTER_PRESENT:
+		return test_presence_insn( op, e, fi );
+
+	case LDAP_FILTER_AND:
+		/* True if empty; otherwise False if any operand is, else
+		 * the result of the last operand that is not True */
+		rc = LDAP_COMPARE_TRUE;
+		pos = -1;
+		for ( i++; i < fi->fi_end; i = sub->fi_end ) {
+			int rc2;
+
+			sub = &insns[i];
+			rc2 = test_insn( op, e, insns, i );
+			if ( rc2 == LDAP_COMPARE_FALSE )
+				return rc2;
+			if ( rc2 != LDAP_COMPARE_TRUE && sub->fi_pos > pos ) {
+				rc = rc2;
+				pos = sub->fi_pos;
+			}
+		}
+		return rc;
+
+	case LDAP_FILTER_OR:
+		rc = LDAP_COMPARE_FALSE;
+		pos = -1;
+		for ( i++; i < fi->fi_end; i = sub->fi_end ) {
+			int rc2;
+
+			sub = &insns[i];
+			rc2 = test_insn( op, e, insns, i );
+			if ( rc2 == LDAP_COMPARE_TRUE )
+				return rc2;
+			if ( rc2 != LDAP_COMPARE_FALSE && sub->fi_pos > pos ) {
+				rc = rc2;
+				pos = sub->fi_pos;
+			}
+		}
+		return rc;
+
+	case LDAP_FILTER_NOT:
+		rc = test_insn( op, e, insns, i + 1 );
+		switch ( rc ) {
+		case LDAP_COMPARE_TRUE:
+			rc = LDAP_COMPARE_FALSE;
+			break;
+		case LDAP_COMPARE_FALSE:
+			rc = LDAP_COMPARE_TRUE;
+			break;
+		}
+		return rc;
+	}
+
+	return test_filter( op, e, fi->fi_filter );
+}
+
+/*
+ * test_filter_program - test a compiled filter against a single entry;
+ * returns the same as test_filter() would for the original filter.
+ */
+int
+test_filter_program(
+	Operation	*op,
+	Entry		*e,
+	FilterProgram	*fp )
+{
+	int rc;
+
+	Debug( LDAP_DEBUG_FILTER, "=> test_filter_program\n", 0, 0, 0 );
+	rc = test_insn( op, e, fp->fp_insns, 0 );
+	Debug( LDAP_DEBUG_FILTER, "<= test_filter_program %d\n", rc, 0, 0 );
+
+	return rc;
+}
@@ -26,6 +26,8 @@ static slap_verbmasks idxstr[] = {
 	{ BER_BVC("pres"), SLAP_INDEX_PRESENT },
 	{ BER_BVC("eq"), SLAP_INDEX_EQUALITY },
 	{ BER_BVC("approx"), SLAP_INDEX_APPROX },
+	{ BER_BVC("ordering"), SLAP_INDEX_ORDERING },
+	{ BER_BVC("ngram"), SLAP_INDEX_NGRAM },
 	{ BER_BVC("subinitial"), SLAP_INDEX_SUBSTR_INITIAL },
 	{ BER_BVC("subany"), SLAP_INDEX_SUBSTR_ANY },
 	{ BER_BVC("subfinal"), SLAP_INDEX_SUBSTR_FINAL },
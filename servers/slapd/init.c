@@ -123,6 +123,22 @@ slap_init( int mode, const char *name )
 		return 1;
 	}
 
+	if ( dn_cache_init() != 0 ) {
+		slap_debug |= LDAP_DEBUG_NONE;
+		Debug( LDAP_DEBUG_ANY,
+		    "%s: dn_cache_init failed\n",
+		    name, 0, 0 );
+		return 1;
+	}
+
+	if ( acl_cache_init() != 0 ) {
+		slap_debug |= LDAP_DEBUG_NONE;
+		Debug( LDAP_DEBUG_ANY,
+		    "%s: acl_cache_init failed\n",
+		    name, 0, 0 );
+		return 1;
+	}
+
 	switch ( slapMode & SLAP_MODE ) {
 	case SLAP_SERVER_MODE:
 		root_dse_init();
@@ -256,6 +272,8 @@ int slap_destroy(void)
 	 * because it may use entry_free() */
 	root_dse_destroy();
 	entry_destroy();
+	dn_cache_destroy();
+	acl_cache_destroy();
 
 	switch ( slapMode & SLAP_MODE ) {
 	case SLAP_SERVER_MODE:
@@ -116,8 +116,15 @@ typedef struct sort_op
 	int so_vlv_target;
 	int so_session;
 	unsigned long so_vcontext;
+	int so_ordered;	/* the backend sent the entries in order */
+	OpSorted *so_os;	/* what it was asked for by this op */
+	struct berval so_next;	/* where its next page starts */
 } sort_op;
 
+/* the paged results cookie of a session */
+#define SORT_COOKIE(so)	( (so)->so_ordered ? \
+	(PagedResultsCookie)(so) : (PagedResultsCookie)(so)->so_tree )
+
 /* There is only one conn table for all overlay instances */
 /* Each conn can handle one session by context */
 static sort_op ***sort_conns;
@@ -264,8 +271,8 @@ static int pack_pagedresult_response_control(
 	ber_init2( ber, NULL, LBER_USE_DER );
 	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
 
-	if ( so->so_nentries > 0 ) {
-		resp_cookie		= ( PagedResultsCookie )so->so_tree;
+	if ( so->so_ordered ? !BER_BVISNULL( &so->so_next ) : so->so_nentries > 0 ) {
+		resp_cookie		= SORT_COOKIE( so );
 		cookie.bv_len	= sizeof( PagedResultsCookie );
 		cookie.bv_val	= (char *)&resp_cookie;
 	} else {
@@ -369,7 +376,7 @@ static int find_session_by_context(
 	for(sess_id = 0; sess_id < svi_max_percon; sess_id++) {
 		if( sort_conns[conn_id] && sort_conns[conn_id][sess_id] &&
 		    ( sort_conns[conn_id][sess_id]->so_vcontext == vc_context || 
-                      (PagedResultsCookie) sort_conns[conn_id][sess_id]->so_tree == ps_cookie ) )
+                      SORT_COOKIE( sort_conns[conn_id][sess_id] ) == ps_cookie ) )
 			return sess_id;
 	}
 	return -1;
@@ -412,6 +419,8 @@ static void free_sort_op( Connection *conn, sort_op *so )
 		}
 		so->so_tree = NULL;
 	}
+	if ( so->so_next.bv_val )
+		ch_free( so->so_next.bv_val );
 
 	ldap_pvt_thread_mutex_lock( &sort_conns_mutex );
 	sess_id = find_session_by_so( so->so_info->svi_max_percon, conn->c_conn_idx, so );
@@ -701,12 +710,111 @@ static void send_result(
 		slap_add_ctrls( op, rs, ctrls );
 	send_ldap_result( op, rs );
 
-	if ( so->so_tree == NULL ) {
+	if ( so->so_ordered ) {
+		/* VLV windows are looked up anew, pages are continued */
+		if ( BER_BVISNULL( &so->so_next ) &&
+			( so->so_vlv <= SLAP_CONTROL_IGNORED || !so->so_nentries ))
+			free_sort_op( op->o_conn, so );
+	} else if ( so->so_tree == NULL ) {
 		/* Search finished, so clean up */
 		free_sort_op( op->o_conn, so );
 	}
 }
 
+/* Ask the backend to send the entries in order itself, and only
+ * those in the page or window. It can only do that for one key.
+ */
+static void ask_ordered(
+	Operation		*op,
+	sort_op			*so,
+	PagedResultsState	*ps,
+	vlv_ctrl		*vc )
+{
+	sort_ctrl *sc = so->so_ctrl;
+	MatchingRule *mr = sc->sc_keys[0].sk_ordering;
+	OpSorted *os;
+
+	so->so_os = NULL;
+	if ( sc->sc_nkeys != 1 )
+		return;
+
+	os = op->o_tmpcalloc( 1, sizeof(OpSorted), op->o_tmpmemctx );
+	os->os_oe.oe_key = SLAP_SORTED_KEY;
+	os->os_ad = sc->sc_keys[0].sk_ad;
+	os->os_ordering = mr;
+	os->os_reverse = sc->sc_keys[0].sk_direction < 0;
+	if ( ps ) {
+		os->os_size = ps->ps_size;
+		os->os_resume = so->so_next;
+	} else if ( vc ) {
+		if ( BER_BVISNULL( &vc->vc_value )) {
+			os->os_offset = vc->vc_offset;
+			os->os_listsize = vc->vc_count;
+		} else if ( mr->smr_normalize ) {
+			/* leave the error to send_list() */
+			if ( mr->smr_normalize( SLAP_MR_VALUE_OF_SYNTAX,
+				mr->smr_syntax, mr, &vc->vc_value, &os->os_value,
+				op->o_tmpmemctx ))
+			{
+				op->o_tmpfree( os, op->o_tmpmemctx );
+				return;
+			}
+		} else {
+			ber_dupbv_x( &os->os_value, &vc->vc_value, op->o_tmpmemctx );
+		}
+		os->os_flags = SLAP_SORTED_VLV;
+		os->os_before = vc->vc_before;
+		os->os_size = vc->vc_before + vc->vc_after + 1;
+	}
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &os->os_oe, oe_next );
+	so->so_os = os;
+}
+
+/* The backend is done; returns whether it sent the entries in order */
+static int done_ordered(
+	Operation		*op,
+	SlapReply		*rs,
+	sort_op			*so )
+{
+	OpSorted *os = so->so_os;
+	int done;
+
+	if ( !os )
+		return 0;
+	so->so_os = NULL;
+	LDAP_SLIST_REMOVE( &op->o_extra, &os->os_oe, OpExtra, oe_next );
+
+	done = os->os_flags & SLAP_SORTED_DONE;
+	so->so_ordered = done != 0;
+	if ( done ) {
+		so->so_nentries = os->os_count;
+		so->so_vlv_target = os->os_target;
+		if ( os->os_flags & SLAP_SORTED_RANGE ) {
+			LDAPControl *ctrls[2];
+
+			so->so_vlv_rc = LDAP_VLV_RANGE_ERROR;
+			pack_vlv_response_control( op, rs, so, ctrls );
+			ctrls[1] = NULL;
+			slap_add_ctrls( op, rs, ctrls );
+			rs->sr_err = LDAP_VLV_ERROR;
+		} else {
+			so->so_vlv_rc = LDAP_SUCCESS;
+		}
+		if ( so->so_next.bv_val ) {
+			ch_free( so->so_next.bv_val );
+			BER_BVZERO( &so->so_next );
+		}
+		if ( !BER_BVISNULL( &os->os_next )) {
+			ber_dupbv( &so->so_next, &os->os_next );
+			op->o_tmpfree( os->os_next.bv_val, op->o_tmpmemctx );
+		}
+	}
+	if ( os->os_value.bv_val )
+		op->o_tmpfree( os->os_value.bv_val, op->o_tmpmemctx );
+	op->o_tmpfree( os, op->o_tmpmemctx );
+	return done;
+}
+
 static int sssvlv_op_response(
 	Operation	*op,
 	SlapReply	*rs )
@@ -721,6 +829,10 @@ static int sssvlv_op_response(
 		struct berval *bv;
 		char *ptr;
 
+		/* already in order, pass it on */
+		if ( so->so_os && ( so->so_os->os_flags & SLAP_SORTED_DONE ))
+			return SLAP_CB_CONTINUE;
+
 		len = sizeof(sort_node) + sc->sc_nkeys * sizeof(struct berval) +
 			rs->sr_entry->e_nname.bv_len + 1;
 		sn = op->o_tmpalloc( len, op->o_tmpmemctx );
@@ -788,7 +900,8 @@ static int sssvlv_op_response(
 			op->o_callback = op->o_callback->sc_next;
 		}
 
-		send_entry( op, rs, so );
+		if ( !done_ordered( op, rs, so ))
+			send_entry( op, rs, so );
 		send_result( op, rs, so );
 	}
 
@@ -896,8 +1009,27 @@ static int sssvlv_op_search(
 		/* If we're a global overlay, this check got bypassed */
 		if ( !op->ors_limit && limits_check( op, rs ))
 			return rs->sr_err;
+		/* is the backend continuing a search it sorted? */
+		if ( so && so->so_ordered &&
+			(( vc && vc->vc_context ) || ( ps && ps->ps_cookie ))) {
+			slap_callback *cb = op->o_tmpalloc( sizeof(slap_callback),
+				op->o_tmpmemctx );
+
+			cb->sc_cleanup		= NULL;
+			cb->sc_response		= sssvlv_op_response;
+			cb->sc_next			= op->o_callback;
+			cb->sc_private		= so;
+
+			so->so_ctrl = sc;
+			so->so_nentries = 0;
+			if ( ps ) {
+				so->so_page_size = ps->ps_size;
+				op->o_pagedresults = SLAP_CONTROL_IGNORED;
+			}
+			ask_ordered( op, so, ps, vc );
+			op->o_callback		= cb;
 		/* are we continuing a VLV search? */
-		if ( so && vc && vc->vc_context ) {
+		} else if ( so && vc && vc->vc_context ) {
 			so->so_ctrl = sc;
 			send_list( op, rs, so );
 			send_result( op, rs, so );
@@ -946,6 +1078,7 @@ static int sssvlv_op_search(
 			so->so_vlv = op->o_ctrlflag[vlv_cid];
 			so->so_vcontext = (unsigned long)so;
 			so->so_nentries = 0;
+			ask_ordered( op, so, ps, vc );
 
 			op->o_callback		= cb;
 		}
@@ -74,6 +74,16 @@ LDAP_SLAPD_F (int) acl_check_modlist LDAP_P((
 	Operation *op, Entry *e, Modifications *ml ));
 
 LDAP_SLAPD_F (void) acl_append( AccessControl **l, AccessControl *a, int pos );
+LDAP_SLAPD_F (void) acl_index_build LDAP_P(( AccessControl *a ));
+LDAP_SLAPD_F (void) acl_index_free LDAP_P(( struct AclIndex *ai ));
+LDAP_SLAPD_F (int) acl_cache_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) acl_cache_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) acl_cache_alloc LDAP_P(( Connection *c ));
+LDAP_SLAPD_F (void) acl_cache_free LDAP_P(( Connection *c ));
+LDAP_SLAPD_F (void) acl_cache_op_init LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) acl_cache_acls_changed LDAP_P(( void ));
+LDAP_SLAPD_F (void) acl_cache_entries_changed LDAP_P(( void ));
+LDAP_SLAPD_V (unsigned int) slap_aclcache_size;
 
 #ifdef SLAP_DYNACL
 LDAP_SLAPD_F (int) slap_dynacl_register LDAP_P(( slap_dynacl_t *da ));
@@ -714,6 +724,14 @@ slap_ctrl_whatFailed_add LDAP_P((
 	SlapReply *rs,
 	char **oids ));
 #endif /* SLAP_CONTROL_X_WHATFAILED */
+#ifdef SLAP_CONTROL_X_COUNT
+LDAP_SLAPD_F (int)
+slap_ctrl_count_add LDAP_P((
+	Operation *op,
+	SlapReply *rs,
+	ber_int_t count,
+	int estimated ));
+#endif /* SLAP_CONTROL_X_COUNT */
 
 /*
  * config.c
@@ -1007,6 +1025,14 @@ LDAP_SLAPD_F (int) dnPrettyNormalDN LDAP_P(( Syntax *syntax, struct berval *val,
 #define dnNormalDN(syntax, val, dn, ctx) \
 	dnPrettyNormalDN((syntax),(val),(dn), 0, ctx)
 
+LDAP_SLAPD_V (unsigned int) slap_dncache_size;
+LDAP_SLAPD_F (int) dn_cache_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) dn_cache_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (int) dn_cache_resize LDAP_P(( unsigned int size ));
+LDAP_SLAPD_F (void) dn_cache_flush LDAP_P(( void ));
+LDAP_SLAPD_F (void) dn_cache_stats LDAP_P((
+	unsigned long *hits, unsigned long *misses ));
+
 typedef int (SLAP_CERT_MAP_FN) LDAP_P(( void *ssl, struct berval *dn ));
 LDAP_SLAPD_F (int) register_certificate_map_function LDAP_P(( SLAP_CERT_MAP_FN *fn ));
 
@@ -1022,6 +1048,8 @@ LDAP_SLAPD_F (Entry *) str2entry LDAP_P(( char	*s ));
 LDAP_SLAPD_F (Entry *) str2entry2 LDAP_P(( char	*s, int checkvals ));
 LDAP_SLAPD_F (char *) entry2str LDAP_P(( Entry *e, int *len ));
 LDAP_SLAPD_F (char *) entry2str_wrap LDAP_P(( Entry *e, int *len, ber_len_t wrap ));
+LDAP_SLAPD_F (char *) entry2str_wrap_r LDAP_P(( Entry *e, struct berval *buf,
+	int *len, ber_len_t wrap ));
 
 LDAP_SLAPD_F (ber_len_t) entry_flatsize LDAP_P(( Entry *e, int norm ));
 LDAP_SLAPD_F (void) entry_partsize LDAP_P(( Entry *e, ber_len_t *len,
@@ -1142,6 +1170,10 @@ LDAP_SLAPD_F (void) filter_destroy LDAP_P(( void ));
  */
 
 LDAP_SLAPD_F (int) test_filter LDAP_P(( Operation *op, Entry *e, Filter *f ));
+LDAP_SLAPD_F (FilterProgram *) filter_compile LDAP_P(( Operation *op, Filter *f ));
+LDAP_SLAPD_F (void) filter_program_free LDAP_P(( Operation *op, FilterProgram *fp ));
+LDAP_SLAPD_F (int) test_filter_program LDAP_P(( Operation *op, Entry *e,
+	FilterProgram *fp ));
 
 /*
  * frontend.c
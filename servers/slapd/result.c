@@ -854,6 +854,20 @@ slap_send_ldap_result( Operation *op, SlapReply *rs )
 
 	rs->sr_type = REP_RESULT;
 
+	/* the write is committed, if at all; see acl_cache_op_init().
+	 * A backend that commits later sends the result again then. */
+	if ( !op->o_uncommitted ) {
+		switch ( op->o_tag ) {
+		case LDAP_REQ_ADD:
+		case LDAP_REQ_DELETE:
+		case LDAP_REQ_MODIFY:
+		case LDAP_REQ_MODRDN:
+		case LDAP_REQ_EXTENDED:
+			acl_cache_entries_changed();
+			break;
+		}
+	}
+
 	/* Propagate Abandons so that cleanup callbacks can be processed */
 	if ( rs->sr_err == SLAPD_ABANDON || op->o_abandon )
 		goto abandon;
@@ -63,6 +63,7 @@ LDAP_BEGIN_DECL
 #define LDAP_SYNC_TIMESTAMP
 #define SLAP_CONTROL_X_WHATFAILED
 #define SLAP_CONTROL_X_LAZY_COMMIT
+#define SLAP_CONTROL_X_COUNT
 #define SLAP_CONFIG_DELETE
 #define SLAP_AUXPROP_DONTUSECOPY
 #ifndef SLAP_SCHEMA_EXPOSE
@@ -249,6 +250,8 @@ typedef struct slap_ssf_set {
 #define SLAP_INDEX_APPROX         0x0008UL
 #define SLAP_INDEX_SUBSTR         0x0010UL
 #define SLAP_INDEX_EXTENDED		  0x0020UL
+#define SLAP_INDEX_ORDERING       0x0040UL
+#define SLAP_INDEX_NGRAM          0x0080UL
 
 #define SLAP_INDEX_DEFAULT        SLAP_INDEX_EQUALITY
 
@@ -349,6 +352,7 @@ typedef struct ContentRule ContentRule;
 typedef struct AttributeAssertion AttributeAssertion;
 typedef struct SubstringsAssertion SubstringsAssertion;
 typedef struct Filter Filter;
+typedef struct FilterProgram FilterProgram;
 typedef struct ValuesReturnFilter ValuesReturnFilter;
 typedef struct Attribute Attribute;
 #ifdef LDAP_COMP_MATCH
@@ -1548,6 +1552,10 @@ typedef struct AccessControl {
 	/* "by" part: list of who has what access to the entries */
 	Access	*acl_access;
 
+	/* lookup structure compiled from the whole list, see acl.c */
+	struct AclIndex	*acl_index;
+	int		acl_pos;
+
 	struct AccessControl	*acl_next;
 } AccessControl;
 
@@ -1607,6 +1615,7 @@ LDAP_SLAPD_V (int) slapMode;
 #define	SLAP_TOOL_QUICK		0x0800
 #define SLAP_TOOL_NO_SCHEMA_CHECK	0x1000
 #define SLAP_TOOL_VALUE_CHECK	0x2000
+#define SLAP_TOOL_BULKLOAD	0x4000
 
 #define SLAP_SERVER_RUNNING	0x8000
 
@@ -1829,6 +1838,7 @@ struct BackendDB {
 #define		be_dn2id_get bd_info->bi_tool_dn2id_get
 #define		be_entry_modify	bd_info->bi_tool_entry_modify
 #define		be_entry_delete	bd_info->bi_tool_entry_delete
+#define		be_entry_range	bd_info->bi_tool_entry_range
 #endif
 
 	/* supported controls */
@@ -2215,6 +2225,10 @@ typedef ID (BI_tool_entry_modify) LDAP_P(( BackendDB *be, Entry *e,
 	struct berval *text ));
 typedef int (BI_tool_entry_delete) LDAP_P(( BackendDB *be, struct berval *ndn,
 	struct berval *text ));
+typedef int (BI_tool_entry_func) LDAP_P(( BackendDB *be, ID id, Entry *e,
+	void *arg ));
+typedef int (BI_tool_entry_range) LDAP_P(( BackendDB *be, int reader,
+	ID *idp, ID hi, BI_tool_entry_func *func, void *arg ));
 
 struct BackendInfo {
 	char	*bi_type; /* type of backend */
@@ -2318,6 +2332,7 @@ struct BackendInfo {
 	BI_tool_dn2id_get	*bi_tool_dn2id_get;
 	BI_tool_entry_modify	*bi_tool_entry_modify;
 	BI_tool_entry_delete	*bi_tool_entry_delete;
+	BI_tool_entry_range	*bi_tool_entry_range;
 
 #define SLAP_INDEX_ADD_OP		0x0001
 #define SLAP_INDEX_DELETE_OP	0x0002
@@ -2512,6 +2527,9 @@ struct slap_control_ids {
 #ifdef LDAP_CONTROL_X_LAZY_COMMIT
 	int sc_lazyCommit;
 #endif
+#ifdef SLAP_CONTROL_X_COUNT
+	int sc_count;
+#endif
 };
 
 /*
@@ -2600,6 +2618,44 @@ typedef struct OpExtraDB {
 	BackendDB *oe_db;
 } OpExtraDB;
 
+/*
+ * A request to return the entries of a search in the order of one
+ * attribute, the way the sssvlv overlay would sort them, and only a
+ * window of them. A backend that can do so sets SLAP_SORTED_DONE
+ * before it sends the first entry; otherwise the entries come in
+ * their usual order and the caller sorts them itself. Positions and
+ * counts are the backend's estimates.
+ */
+typedef struct OpSorted {
+	OpExtra os_oe;
+	AttributeDescription *os_ad;
+	MatchingRule *os_ordering;
+	int os_reverse;
+	int os_flags;
+#define SLAP_SORTED_DONE	0x01
+#define SLAP_SORTED_RANGE	0x02	/* os_offset is past the end */
+#define SLAP_SORTED_VLV	0x04	/* start at os_value or os_offset */
+
+	/* Where to start: after os_resume if it is set, else with
+	 * SLAP_SORTED_VLV at the first entry sorting at or after the
+	 * normalized os_value if that is set, or at position os_offset of
+	 * a list of os_listsize entries (0 for the backend's count), else
+	 * at the first entry.
+	 */
+	struct berval os_resume;
+	struct berval os_value;
+	unsigned long os_offset;
+	unsigned long os_listsize;
+	unsigned long os_before;	/* entries to send before the start */
+	unsigned long os_size;	/* entries to send in all, 0 for no limit */
+
+	unsigned long os_count;	/* number of entries in the list */
+	unsigned long os_target;	/* position of the start */
+	struct berval os_next;	/* resume point if os_size was reached */
+} OpSorted;
+
+#define SLAP_SORTED_KEY	((void *)fe_op_search)
+
 struct Operation {
 	Opheader *o_hdr;
 
@@ -2694,6 +2750,8 @@ struct Operation {
 	char o_is_auth_check;	/* authorization in progress */
 	char o_dont_replicate;
 	slap_access_t o_acl_priv;
+	unsigned long o_acl_wgen;	/* write generation at start, see acl.c */
+	char o_uncommitted;	/* the result precedes the commit of the write */
 
 	char o_nocaching;
 	char o_delete_glue_parent;
@@ -2792,6 +2850,11 @@ struct Operation {
 #define get_lazyCommit(op)				_SCM((op)->o_lazyCommit)
 #endif
 
+#ifdef SLAP_CONTROL_X_COUNT
+#define o_count o_ctrlflag[slap_cids.sc_count]
+#define get_count(op)					_SCM((op)->o_count)
+#endif
+
 #define o_sync			o_ctrlflag[slap_cids.sc_LDAPsync]
 
 	AuthorizationInformation o_authz;
@@ -2907,6 +2970,9 @@ struct Connection {
 
 	AuthorizationInformation c_authz;
 
+	/* access decisions cached for this connection, see acl.c */
+	struct AclCache	*c_aclcache;
+
 	ber_int_t	c_protocol;	/* version of the LDAP protocol used by client */
 
 	LDAP_STAILQ_HEAD(c_o, Operation) c_ops;	/* list of operations being processed */
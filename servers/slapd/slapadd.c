@@ -40,20 +40,6 @@
 
 #include "slapcommon.h"
 
-#ifdef _WIN32
-# ifdef __WIN64__
-# define ftello(fp)	_ftelli64(fp)
-# else
-/* Ideally we would use _ftelli64 but that was only available
- * starting in MSVCR80.DLL. The approach used here is inaccurate
- * because returning the underlying file handle's file pointer
- * doesn't take the stdio buffer offset into account. But, it
- * works with all versions of MSVCRT.
- */
-# define ftello(fp)	_telli64(fileno(fp))
-# endif
-#endif
-
 extern int slap_DN_strict;	/* dn.c */
 
 static char csnbuf[ LDAP_PVT_CSNSTR_BUFSIZE ];
@@ -64,15 +50,31 @@ typedef struct Erec {
 	unsigned long nextline;
 } Erec;
 
-typedef struct Trec {
-	Entry *e;
-	unsigned long lineno;
-	unsigned long nextline;
+/* With tool-threads, records are read by one thread, parsed and
+ * checked by several, and handed to be_entry_put() by the main
+ * thread in the order they were read. Each record goes through a
+ * ring of slots; the operational attributes are only added by the
+ * main thread, so that CSNs and IDs come out as without threads.
+ */
+typedef struct Prec {
+	Erec erec;
+	char *rec;	/* in buf, or in the mapped input */
+	char *buf;
+	int lmax;
 	int rc;
-	int ready;
-} Trec;
+	int done;	/* parsed, for the main thread to take */
+} Prec;
+
+static Prec *prec;
+static int nprec;
+static unsigned long add_nread;	/* records read */
+static unsigned long add_nparse;	/* records taken by a parser */
+static unsigned long add_nwrite;	/* records taken by the main thread */
+static int add_eof;	/* reading is over with add_eofrc */
+static int add_eofrc;
+static int add_nthreads;
+static ldap_pvt_thread_t *add_threads;
 
-static Trec trec;
 static unsigned long sid = SLAP_SYNC_SID_MAX + 1;
 static int checkvals;
 static int enable_meter;
@@ -83,271 +85,419 @@ static char *buf;
 static int lmax;
 
 static ldap_pvt_thread_mutex_t add_mutex;
-static ldap_pvt_thread_cond_t add_cond;
+static ldap_pvt_thread_cond_t add_cond;	/* for the reader */
+static ldap_pvt_thread_cond_t add_pcond;	/* for the parsers */
+static ldap_pvt_thread_cond_t add_wcond;	/* for the main thread */
 static int add_stop;
+static int ldif_threaded;
 
-/* returns:
- *	1: got a record
- *	0: EOF
- * -1: read failure
- * -2: parse failure
- */
+/* read the next record to parse; returns 1, 0 on EOF or -1 */
 static int
-getrec0(Erec *erec)
+getrec_read(Erec *erec, char **recp, char **bufp, int *lmaxp)
 {
-	const char *text;
 	int ldifrc;
+
+	do {
+		erec->lineno = erec->nextline+1;
+		/* nextline is the line number of the end of the current entry */
+		ldifrc = slap_tool_ldif_read( &erec->nextline, recp, bufp, lmaxp );
+		if (ldifrc < 1)
+			return ldifrc < 0 ? -1 : 0;
+	} while ( erec->lineno < jumpline );
+
+	if ( enable_meter )
+		lutil_meter_update( &meter,
+				 slap_tool_ldif_tell(),
+				 0);
+	return 1;
+}
+
+/* parse and check the entry of a record; returns 1 or -2 */
+static int
+getrec_parse(Operation *op, Erec *erec, char *rbuf)
+{
+	const char *text;
 	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
 	size_t textlen = sizeof textbuf;
-	struct berval csn;
-	Operation *op = &opbuf.ob_op;
-	op->o_hdr = &opbuf.ob_hdr;
+	BackendDB *bd;
+	Entry *e;
+	int prev_DN_strict;
 
-again:
-	erec->lineno = erec->nextline+1;
-	/* nextline is the line number of the end of the current entry */
-	ldifrc = ldif_read_record( ldiffp, &erec->nextline, &buf, &lmax );
-	if (ldifrc < 1)
-		return ldifrc < 0 ? -1 : 0;
-	{
-		BackendDB *bd;
-		Entry *e;
-		int prev_DN_strict;
+	if ( !dbnum ) {
+		prev_DN_strict = slap_DN_strict;
+		slap_DN_strict = 0;
+	}
+	e = str2entry2( rbuf, checkvals );
+	if ( !dbnum ) {
+		slap_DN_strict = prev_DN_strict;
+	}
 
-		if ( erec->lineno < jumpline )
-			goto again;
+	if( e == NULL ) {
+		fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
+			progname, erec->lineno );
+		return -2;
+	}
 
-		if ( !dbnum ) {
-			prev_DN_strict = slap_DN_strict;
-			slap_DN_strict = 0;
-		}
-		e = str2entry2( buf, checkvals );
-		if ( !dbnum ) {
-			slap_DN_strict = prev_DN_strict;
-		}
+	/* make sure the DN is not empty */
+	if( BER_BVISEMPTY( &e->e_nname ) &&
+		!BER_BVISEMPTY( be->be_nsuffix ))
+	{
+		fprintf( stderr, "%s: line %lu: "
+			"cannot add entry with empty dn=\"%s\"",
+			progname, erec->lineno, e->e_dn );
+		bd = select_backend( &e->e_nname, nosubordinates );
+		if ( bd ) {
+			BackendDB *bdtmp;
+			int dbidx = 0;
+			LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
+				if ( bdtmp == bd ) break;
+				dbidx++;
+			}
 
-		if ( enable_meter )
-			lutil_meter_update( &meter,
-					 ftello( ldiffp->fp ),
-					 0);
+			assert( bdtmp != NULL );
+			
+			fprintf( stderr, "; did you mean to use database #%d (%s)?",
+				dbidx,
+				bd->be_suffix[0].bv_val );
 
-		if( e == NULL ) {
-			fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
-				progname, erec->lineno );
-			return -2;
 		}
+		fprintf( stderr, "\n" );
+		entry_free( e );
+		return -2;
+	}
 
-		/* make sure the DN is not empty */
-		if( BER_BVISEMPTY( &e->e_nname ) &&
-			!BER_BVISEMPTY( be->be_nsuffix ))
-		{
-			fprintf( stderr, "%s: line %lu: "
-				"cannot add entry with empty dn=\"%s\"",
-				progname, erec->lineno, e->e_dn );
-			bd = select_backend( &e->e_nname, nosubordinates );
-			if ( bd ) {
-				BackendDB *bdtmp;
-				int dbidx = 0;
-				LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
-					if ( bdtmp == bd ) break;
-					dbidx++;
-				}
-
-				assert( bdtmp != NULL );
-				
-				fprintf( stderr, "; did you mean to use database #%d (%s)?",
-					dbidx,
-					bd->be_suffix[0].bv_val );
-
+	/* check backend */
+	bd = select_backend( &e->e_nname, nosubordinates );
+	if ( bd != be ) {
+		fprintf( stderr, "%s: line %lu: "
+			"database #%d (%s) not configured to hold \"%s\"",
+			progname, erec->lineno,
+			dbnum,
+			be->be_suffix[0].bv_val,
+			e->e_dn );
+		if ( bd ) {
+			BackendDB *bdtmp;
+			int dbidx = 0;
+			LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
+				if ( bdtmp == bd ) break;
+				dbidx++;
 			}
-			fprintf( stderr, "\n" );
-			entry_free( e );
-			return -2;
-		}
-
-		/* check backend */
-		bd = select_backend( &e->e_nname, nosubordinates );
-		if ( bd != be ) {
-			fprintf( stderr, "%s: line %lu: "
-				"database #%d (%s) not configured to hold \"%s\"",
-				progname, erec->lineno,
-				dbnum,
-				be->be_suffix[0].bv_val,
-				e->e_dn );
-			if ( bd ) {
-				BackendDB *bdtmp;
-				int dbidx = 0;
-				LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
-					if ( bdtmp == bd ) break;
-					dbidx++;
-				}
 
-				assert( bdtmp != NULL );
-				
-				fprintf( stderr, "; did you mean to use database #%d (%s)?",
-					dbidx,
-					bd->be_suffix[0].bv_val );
+			assert( bdtmp != NULL );
+			
+			fprintf( stderr, "; did you mean to use database #%d (%s)?",
+				dbidx,
+				bd->be_suffix[0].bv_val );
 
-			} else {
-				fprintf( stderr, "; no database configured for that naming context" );
-			}
-			fprintf( stderr, "\n" );
-			entry_free( e );
-			return -2;
+		} else {
+			fprintf( stderr, "; no database configured for that naming context" );
 		}
+		fprintf( stderr, "\n" );
+		entry_free( e );
+		return -2;
+	}
 
-		if ( slap_tool_entry_check( progname, op, e, erec->lineno, &text, textbuf, textlen ) !=
-			LDAP_SUCCESS ) {
-			entry_free( e );
-			return -2;
-		}
+	if ( slap_tool_entry_check( progname, op, e, erec->lineno, &text, textbuf, textlen ) !=
+		LDAP_SUCCESS ) {
+		entry_free( e );
+		return -2;
+	}
 
-		if ( SLAP_LASTMOD(be) ) {
-			time_t now = slap_get_time();
-			char uuidbuf[ LDAP_LUTIL_UUIDSTR_BUFSIZE ];
-			struct berval vals[ 2 ];
+	erec->e = e;
+	return 1;
+}
 
-			struct berval name, timestamp;
+/* add the operational attributes, in the order of the records */
+static void
+getrec_finish(Erec *erec)
+{
+	Entry *e = erec->e;
+	struct berval csn;
 
-			struct berval nvals[ 2 ];
-			struct berval nname;
-			char timebuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+	if ( SLAP_LASTMOD(be) ) {
+		time_t now = slap_get_time();
+		char uuidbuf[ LDAP_LUTIL_UUIDSTR_BUFSIZE ];
+		struct berval vals[ 2 ];
 
-			enum {
-				GOT_NONE = 0x0,
-				GOT_CSN = 0x1,
-				GOT_UUID = 0x2,
-				GOT_ALL = (GOT_CSN|GOT_UUID)
-			} got = GOT_ALL;
+		struct berval name, timestamp;
 
-			vals[1].bv_len = 0;
-			vals[1].bv_val = NULL;
+		struct berval nvals[ 2 ];
+		struct berval nname;
+		char timebuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
 
-			nvals[1].bv_len = 0;
-			nvals[1].bv_val = NULL;
+		enum {
+			GOT_NONE = 0x0,
+			GOT_CSN = 0x1,
+			GOT_UUID = 0x2,
+			GOT_ALL = (GOT_CSN|GOT_UUID)
+		} got = GOT_ALL;
 
-			csn.bv_len = ldap_pvt_csnstr( csnbuf, sizeof( csnbuf ), csnsid, 0 );
-			csn.bv_val = csnbuf;
+		vals[1].bv_len = 0;
+		vals[1].bv_val = NULL;
 
-			timestamp.bv_val = timebuf;
-			timestamp.bv_len = sizeof(timebuf);
+		nvals[1].bv_len = 0;
+		nvals[1].bv_val = NULL;
 
-			slap_timestamp( &now, &timestamp );
+		csn.bv_len = ldap_pvt_csnstr( csnbuf, sizeof( csnbuf ), csnsid, 0 );
+		csn.bv_val = csnbuf;
 
-			if ( BER_BVISEMPTY( &be->be_rootndn ) ) {
-				BER_BVSTR( &name, SLAPD_ANONYMOUS );
-				nname = name;
-			} else {
-				name = be->be_rootdn;
-				nname = be->be_rootndn;
-			}
+		timestamp.bv_val = timebuf;
+		timestamp.bv_len = sizeof(timebuf);
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_entryUUID )
-				== NULL )
-			{
-				got &= ~GOT_UUID;
-				vals[0].bv_len = lutil_uuidstr( uuidbuf, sizeof( uuidbuf ) );
-				vals[0].bv_val = uuidbuf;
-				attr_merge_normalize_one( e, slap_schema.si_ad_entryUUID, vals, NULL );
-			}
+		slap_timestamp( &now, &timestamp );
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_creatorsName )
-				== NULL )
-			{
-				vals[0] = name;
-				nvals[0] = nname;
-				attr_merge( e, slap_schema.si_ad_creatorsName, vals, nvals );
-			}
+		if ( BER_BVISEMPTY( &be->be_rootndn ) ) {
+			BER_BVSTR( &name, SLAPD_ANONYMOUS );
+			nname = name;
+		} else {
+			name = be->be_rootdn;
+			nname = be->be_rootndn;
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_createTimestamp )
-				== NULL )
-			{
-				vals[0] = timestamp;
-				attr_merge( e, slap_schema.si_ad_createTimestamp, vals, NULL );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_entryUUID )
+			== NULL )
+		{
+			got &= ~GOT_UUID;
+			vals[0].bv_len = lutil_uuidstr( uuidbuf, sizeof( uuidbuf ) );
+			vals[0].bv_val = uuidbuf;
+			attr_merge_normalize_one( e, slap_schema.si_ad_entryUUID, vals, NULL );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_entryCSN )
-				== NULL )
-			{
-				got &= ~GOT_CSN;
-				vals[0] = csn;
-				attr_merge( e, slap_schema.si_ad_entryCSN, vals, NULL );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_creatorsName )
+			== NULL )
+		{
+			vals[0] = name;
+			nvals[0] = nname;
+			attr_merge( e, slap_schema.si_ad_creatorsName, vals, nvals );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_modifiersName )
-				== NULL )
-			{
-				vals[0] = name;
-				nvals[0] = nname;
-				attr_merge( e, slap_schema.si_ad_modifiersName, vals, nvals );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_createTimestamp )
+			== NULL )
+		{
+			vals[0] = timestamp;
+			attr_merge( e, slap_schema.si_ad_createTimestamp, vals, NULL );
+		}
 
-			if( attr_find( e->e_attrs, slap_schema.si_ad_modifyTimestamp )
-				== NULL )
-			{
-				vals[0] = timestamp;
-				attr_merge( e, slap_schema.si_ad_modifyTimestamp, vals, NULL );
-			}
+		if( attr_find( e->e_attrs, slap_schema.si_ad_entryCSN )
+			== NULL )
+		{
+			got &= ~GOT_CSN;
+			vals[0] = csn;
+			attr_merge( e, slap_schema.si_ad_entryCSN, vals, NULL );
+		}
 
-			if ( SLAP_SINGLE_SHADOW(be) && got != GOT_ALL ) {
-				char buf[SLAP_TEXT_BUFLEN];
+		if( attr_find( e->e_attrs, slap_schema.si_ad_modifiersName )
+			== NULL )
+		{
+			vals[0] = name;
+			nvals[0] = nname;
+			attr_merge( e, slap_schema.si_ad_modifiersName, vals, nvals );
+		}
+
+		if( attr_find( e->e_attrs, slap_schema.si_ad_modifyTimestamp )
+			== NULL )
+		{
+			vals[0] = timestamp;
+			attr_merge( e, slap_schema.si_ad_modifyTimestamp, vals, NULL );
+		}
 
-				snprintf( buf, sizeof(buf),
-					"%s%s%s",
-					( !(got & GOT_UUID) ? slap_schema.si_ad_entryUUID->ad_cname.bv_val : "" ),
-					( !(got & GOT_CSN) ? "," : "" ),
-					( !(got & GOT_CSN) ? slap_schema.si_ad_entryCSN->ad_cname.bv_val : "" ) );
+		if ( SLAP_SINGLE_SHADOW(be) && got != GOT_ALL ) {
+			char buf[SLAP_TEXT_BUFLEN];
 
-				Debug( LDAP_DEBUG_ANY, "%s: warning, missing attrs %s from entry dn=\"%s\"\n",
-					progname, buf, e->e_name.bv_val );
-			}
+			snprintf( buf, sizeof(buf),
+				"%s%s%s",
+				( !(got & GOT_UUID) ? slap_schema.si_ad_entryUUID->ad_cname.bv_val : "" ),
+				( !(got & GOT_CSN) ? "," : "" ),
+				( !(got & GOT_CSN) ? slap_schema.si_ad_entryCSN->ad_cname.bv_val : "" ) );
 
-			sid = slap_tool_update_ctxcsn_check( progname, e );
+			Debug( LDAP_DEBUG_ANY, "%s: warning, missing attrs %s from entry dn=\"%s\"\n",
+				progname, buf, e->e_name.bv_val );
 		}
-		erec->e = e;
+
+		sid = slap_tool_update_ctxcsn_check( progname, e );
 	}
-	return 1;
+}
+
+/* returns:
+ *	1: got a record
+ *	0: EOF
+ * -1: read failure
+ * -2: parse failure
+ */
+static int
+getrec0(Erec *erec)
+{
+	Operation *op = &opbuf.ob_op;
+	char *rec;
+	int rc;
+
+	op->o_hdr = &opbuf.ob_hdr;
+
+	rc = getrec_read( erec, &rec, &buf, &lmax );
+	if ( rc < 1 )
+		return rc;
+	rc = getrec_parse( op, erec, rec );
+	slap_tool_ldif_release( rec );
+	if ( rc == 1 )
+		getrec_finish( erec );
+	return rc;
 }
 
 static void *
-getrec_thr(void *ctx)
+getrec_reader(void *ctx)
 {
+	Erec erec;
+	Prec *p;
+	int rc;
+
+	erec.nextline = 0;
 	ldap_pvt_thread_mutex_lock( &add_mutex );
-	while (!add_stop) {
-		trec.rc = getrec0((Erec *)&trec);
-		trec.ready = 1;
-		while (trec.ready)
+	while ( !add_stop ) {
+		if ( add_nread == add_nwrite + nprec ) {
 			ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
-		/* eof or read failure */
-		if ( trec.rc == 0 || trec.rc == -1 )
+			continue;
+		}
+		p = &prec[add_nread % nprec];
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+
+		rc = getrec_read( &erec, &p->rec, &p->buf, &p->lmax );
+		p->erec.lineno = erec.lineno;
+		p->erec.nextline = erec.nextline;
+		p->erec.e = NULL;
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		if ( rc < 1 ) {
+			add_eof = 1;
+			add_eofrc = rc;
+			ldap_pvt_thread_cond_broadcast( &add_pcond );
+			ldap_pvt_thread_cond_signal( &add_wcond );
 			break;
+		}
+		add_nread++;
+		ldap_pvt_thread_cond_signal( &add_pcond );
 	}
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
 	return NULL;
 }
 
-static int ldif_threaded;
+static void *
+getrec_parser(void *ctx)
+{
+	OperationBuffer opb;
+	Operation *op = &opb.ob_op;
+	Prec *p;
+	int rc;
+
+	memset( &opb, 0, sizeof( opb ));
+	op->o_hdr = &opb.ob_hdr;
+
+	ldap_pvt_thread_mutex_lock( &add_mutex );
+	while ( !add_stop ) {
+		if ( add_nparse == add_nread ) {
+			if ( add_eof )
+				break;
+			ldap_pvt_thread_cond_wait( &add_pcond, &add_mutex );
+			continue;
+		}
+		p = &prec[add_nparse++ % nprec];
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+
+		rc = getrec_parse( op, &p->erec, p->rec );
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		p->rc = rc;
+		p->done = 1;
+		if ( p == &prec[add_nwrite % nprec] )
+			ldap_pvt_thread_cond_signal( &add_wcond );
+	}
+	ldap_pvt_thread_mutex_unlock( &add_mutex );
+	return NULL;
+}
 
 static int
 getrec(Erec *erec)
 {
+	Prec *p;
+	char *rec = NULL;
 	int rc;
+
 	if ( !ldif_threaded )
 		return getrec0(erec);
 
-	while (!trec.ready)
-		ldap_pvt_thread_yield();
-	erec->e = trec.e;
-	erec->lineno = trec.lineno;
-	erec->nextline = trec.nextline;
-	trec.ready = 0;
-	rc = trec.rc;
 	ldap_pvt_thread_mutex_lock( &add_mutex );
+	p = &prec[add_nwrite % nprec];
+	while ( !( add_nwrite < add_nread ? p->done : add_eof ))
+		ldap_pvt_thread_cond_wait( &add_wcond, &add_mutex );
+	if ( add_nwrite == add_nread ) {
+		rc = add_eofrc;
+	} else {
+		rc = p->rc;
+		if ( rc == 1 )
+			*erec = p->erec;
+		rec = p->rec;
+		p->done = 0;
+		add_nwrite++;
+		ldap_pvt_thread_cond_signal( &add_cond );
+	}
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
-	ldap_pvt_thread_cond_signal( &add_cond );
+
+	if ( rec )
+		slap_tool_ldif_release( rec );
+	if ( rc == 1 )
+		getrec_finish( erec );
 	return rc;
 }
 
+static void
+getrec_start(void)
+{
+	int i;
+
+	add_nthreads = slap_tool_thread_max - 1;
+	nprec = 32 * add_nthreads;
+	prec = ch_calloc( nprec, sizeof( Prec ));
+	add_threads = ch_malloc( ( add_nthreads + 1 ) * sizeof( ldap_pvt_thread_t ));
+
+	ldap_pvt_thread_mutex_init( &add_mutex );
+	ldap_pvt_thread_cond_init( &add_cond );
+	ldap_pvt_thread_cond_init( &add_pcond );
+	ldap_pvt_thread_cond_init( &add_wcond );
+	ldif_threaded = 1;
+	ldap_pvt_thread_create( &add_threads[0], 0, getrec_reader, NULL );
+	for ( i = 1; i <= add_nthreads; i++ )
+		ldap_pvt_thread_create( &add_threads[i], 0, getrec_parser, NULL );
+}
+
+static void
+getrec_stop(void)
+{
+	unsigned long n;
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &add_mutex );
+	add_stop = 1;
+	ldap_pvt_thread_cond_broadcast( &add_cond );
+	ldap_pvt_thread_cond_broadcast( &add_pcond );
+	ldap_pvt_thread_mutex_unlock( &add_mutex );
+	for ( i = 0; i <= add_nthreads; i++ )
+		ldap_pvt_thread_join( add_threads[i], NULL );
+
+	/* entries parsed but never added */
+	for ( n = add_nwrite; n < add_nread; n++ ) {
+		Prec *p = &prec[n % nprec];
+		if ( p->done && p->rc == 1 )
+			entry_free( p->erec.e );
+	}
+	for ( i = 0; i < nprec; i++ )
+		ch_free( prec[i].buf );
+	ch_free( prec );
+	ch_free( add_threads );
+	ldap_pvt_thread_cond_destroy( &add_wcond );
+	ldap_pvt_thread_cond_destroy( &add_pcond );
+	ldap_pvt_thread_cond_destroy( &add_cond );
+	ldap_pvt_thread_mutex_destroy( &add_mutex );
+}
+
 int
 slapadd( int argc, char **argv )
 {
@@ -355,7 +505,6 @@ slapadd( int argc, char **argv )
 	size_t textlen = sizeof textbuf;
 	Erec erec;
 	struct berval bvtext;
-	ldap_pvt_thread_t thr;
 	ID id;
 	Entry *prev = NULL;
 
@@ -427,12 +576,10 @@ slapadd( int argc, char **argv )
 		enable_meter = 0;
 	}
 
-	if ( slap_tool_thread_max > 1 ) {
-		ldap_pvt_thread_mutex_init( &add_mutex );
-		ldap_pvt_thread_cond_init( &add_cond );
-		ldap_pvt_thread_create( &thr, 0, getrec_thr, NULL );
-		ldif_threaded = 1;
-	}
+	/* getrec_parse() relaxes slap_DN_strict, which all threads share,
+	 * for the entries of the config database, so they go unthreaded */
+	if ( slap_tool_thread_max > 1 && dbnum )
+		getrec_start();
 
 	erec.nextline = 0;
 	erec.e = NULL;
@@ -479,14 +626,8 @@ slapadd( int argc, char **argv )
 		prev = erec.e;
 	}
 
-	if ( ldif_threaded ) {
-		ldap_pvt_thread_mutex_lock( &add_mutex );
-		add_stop = 1;
-		trec.ready = 0;
-		ldap_pvt_thread_cond_signal( &add_cond );
-		ldap_pvt_thread_mutex_unlock( &add_mutex );
-		ldap_pvt_thread_join( thr, NULL );
-	}
+	if ( ldif_threaded )
+		getrec_stop();
 	if ( erec.e ) entry_free( erec.e );
 
 	if ( ldifrc < 0 )
@@ -497,7 +638,7 @@ slapadd( int argc, char **argv )
 	bvtext.bv_val[0] = '\0';
 
 	if ( enable_meter ) {
-		lutil_meter_update( &meter, ftello( ldiffp->fp ), 1);
+		lutil_meter_update( &meter, slap_tool_ldif_tell(), 1);
 		lutil_meter_close( &meter );
 	}
 
@@ -23,6 +23,7 @@
 #include "portable.h"
 
 #include <stdio.h>
+#include <limits.h>
 
 #include <ac/stdlib.h>
 #include <ac/ctype.h>
@@ -40,6 +41,269 @@ slapcat_sig( int sig )
 	gotsig=1;
 }
 
+/* With tool-threads and a backend that reads ranges of entry IDs,
+ * each thread takes the next chunk of CAT_CHUNK_IDS IDs and formats
+ * its entries. The main thread writes the chunks in the order of the
+ * IDs through a ring of slots; with unordered=yes each thread writes
+ * its chunks itself as soon as they are done.
+ */
+#define CAT_CHUNK_IDS	1024
+
+typedef struct Cchunk {
+	struct berval buf;	/* bv_len is the size of bv_val */
+	ber_len_t len;
+	int done;	/* formatted, for the main thread to write */
+} Cchunk;
+
+typedef struct Carg {
+	int reader;
+	Operation *op;
+	Cchunk *c;
+	Cchunk chunk;	/* of an unordered thread */
+	struct berval ebuf;
+} Carg;
+
+static Cchunk *cchunk;
+static int ncchunk;
+static unsigned long cat_ntake;	/* chunks taken by a thread */
+static unsigned long cat_nwrite;	/* chunks written in order */
+static unsigned long cat_end;	/* the first chunk not to write */
+static int cat_nthreads;
+static int cat_stop;
+static int cat_rc;
+static ldap_pvt_thread_t *cat_threads;
+static Carg *cat_args;
+
+static ldap_pvt_thread_mutex_t cat_mutex;
+static ldap_pvt_thread_mutex_t cat_wmutex;	/* for direct writes */
+static ldap_pvt_thread_cond_t cat_cond;	/* for the threads */
+static ldap_pvt_thread_cond_t cat_wcond;	/* for the main thread */
+
+static void
+cat_put( Cchunk *c, const char *data, ber_len_t len )
+{
+	if ( c->len + len > c->buf.bv_len ) {
+		do {
+			c->buf.bv_len = c->buf.bv_len ? 2 * c->buf.bv_len : BUFSIZ;
+		} while ( c->len + len > c->buf.bv_len );
+		c->buf.bv_val = ch_realloc( c->buf.bv_val, c->buf.bv_len );
+	}
+	AC_MEMCPY( c->buf.bv_val + c->len, data, len );
+	c->len += len;
+}
+
+/* A comment goes to the chunk if the LDIF goes to stdout, as without
+ * threads, where it is printed there in the order of the entries.
+ */
+static void
+cat_note( Carg *ca, const char *fmt, ID id )
+{
+	char buf[64];
+	int len;
+
+	len = snprintf( buf, sizeof( buf ), fmt, (long) id );
+	if ( ldiffp->fp == stdout ) {
+		cat_put( ca->c, buf, len );
+	} else {
+		ldap_pvt_thread_mutex_lock( &cat_wmutex );
+		fputs( buf, stdout );
+		ldap_pvt_thread_mutex_unlock( &cat_wmutex );
+	}
+}
+
+static int
+cat_entry( BackendDB *bd, ID id, Entry *e, void *arg )
+{
+	Carg *ca = arg;
+	char *data;
+	int len;
+
+	if ( gotsig ) {
+		if ( e )
+			be_entry_release_r( ca->op, e );
+		return -1;
+	}
+
+	if ( e == NULL ) {
+		cat_note( ca, "# no data for entry id=%08lx\n\n", id );
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cat_rc = EXIT_FAILURE;
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+		return continuemode ? 0 : -1;
+	}
+
+	if ( ( sub_ndn.bv_len && !dnIsSuffixScope( &e->e_nname, &sub_ndn, scope )) ||
+		( filter != NULL && test_filter( NULL, e, filter ) != LDAP_COMPARE_TRUE ))
+	{
+		be_entry_release_r( ca->op, e );
+		return 0;
+	}
+
+	if ( verbose ) {
+		cat_note( ca, "# id=%08lx\n", id );
+	}
+
+	data = entry2str_wrap_r( e, &ca->ebuf, &len, ldif_wrap );
+	be_entry_release_r( ca->op, e );
+	cat_put( ca->c, data, len );
+	cat_put( ca->c, "\n", 1 );
+	return 0;
+}
+
+static void *
+cat_thread( void *ptr )
+{
+	Carg *ca = ptr;
+	OperationBuffer opb;
+	Cchunk *c;
+	unsigned long n;
+	ID id;
+	int rc;
+
+	memset( &opb, 0, sizeof( opb ));
+	ca->op = &opb.ob_op;
+	ca->op->o_hdr = &opb.ob_hdr;
+	ca->op->o_bd = be;
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	while ( !cat_stop && cat_ntake < cat_end ) {
+		if ( !unordered && cat_ntake - cat_nwrite >= ncchunk ) {
+			ldap_pvt_thread_cond_wait( &cat_cond, &cat_mutex );
+			continue;
+		}
+		n = cat_ntake++;
+		c = unordered ? &ca->chunk : &cchunk[n % ncchunk];
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		ca->c = c;
+		c->len = 0;
+		id = n * CAT_CHUNK_IDS;
+		rc = be->be_entry_range( be, ca->reader, &id,
+			id + CAT_CHUNK_IDS - 1, cat_entry, ca );
+		if ( rc > 0 ) {
+			fprintf( stderr, "slapcat: error reading entries %08lx to %08lx.\n",
+				n * CAT_CHUNK_IDS, n * CAT_CHUNK_IDS + CAT_CHUNK_IDS - 1 );
+		}
+		if ( unordered && c->len ) {
+			ldap_pvt_thread_mutex_lock( &cat_wmutex );
+			if ( fwrite( c->buf.bv_val, 1, c->len, ldiffp->fp ) != c->len ) {
+				fprintf( stderr, "slapcat: error writing output.\n" );
+				rc = -1;
+			}
+			ldap_pvt_thread_mutex_unlock( &cat_wmutex );
+		}
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		if ( rc && !gotsig )
+			cat_rc = EXIT_FAILURE;
+		if (( rc || id == NOID ) && cat_end > n + 1 ) {
+			/* nothing after this chunk is written */
+			cat_end = n + 1;
+			ldap_pvt_thread_cond_broadcast( &cat_cond );
+			ldap_pvt_thread_cond_signal( &cat_wcond );
+		}
+		c->done = 1;
+		if ( n == cat_nwrite )
+			ldap_pvt_thread_cond_signal( &cat_wcond );
+	}
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+	return NULL;
+}
+
+/* Dump the entries with threads; returns -1 if the backend cannot,
+ * or the threads cannot be started */
+static int
+cat_threaded( void )
+{
+	Cchunk *c;
+	ID id;
+	int i, n, rc;
+
+	cat_nthreads = slap_tool_thread_max;
+
+	/* an empty range, to see that every reader can be used */
+	for ( i = 0; i < cat_nthreads; i++ ) {
+		id = NOID;
+		if ( be->be_entry_range( be, i, &id, 0, cat_entry, NULL ))
+			return -1;
+	}
+
+	ncchunk = 4 * cat_nthreads;
+	cchunk = unordered ? NULL : ch_calloc( ncchunk, sizeof( Cchunk ));
+	cat_args = ch_calloc( cat_nthreads, sizeof( Carg ));
+	cat_threads = ch_malloc( cat_nthreads * sizeof( ldap_pvt_thread_t ));
+	cat_end = ULONG_MAX;
+	cat_rc = EXIT_SUCCESS;
+
+	ldap_pvt_thread_mutex_init( &cat_mutex );
+	ldap_pvt_thread_mutex_init( &cat_wmutex );
+	ldap_pvt_thread_cond_init( &cat_cond );
+	ldap_pvt_thread_cond_init( &cat_wcond );
+
+	/* the threads wait for the mutex before taking a chunk, so if one
+	 * cannot be started, the others are stopped before any output */
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	for ( n = 0; n < cat_nthreads; n++ ) {
+		cat_args[n].reader = n;
+		rc = ldap_pvt_thread_create( &cat_threads[n], 0, cat_thread,
+			&cat_args[n] );
+		if ( rc ) {
+			fprintf( stderr, "slapcat: could not start thread %d (%d), "
+				"dumping without threads.\n", n, rc );
+			cat_rc = -1;
+			cat_stop = 1;
+			break;
+		}
+	}
+
+	while ( !unordered && !cat_stop && cat_nwrite < cat_end ) {
+		c = &cchunk[cat_nwrite % ncchunk];
+		if ( !c->done ) {
+			ldap_pvt_thread_cond_wait( &cat_wcond, &cat_mutex );
+			continue;
+		}
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		rc = 0;
+		if ( c->len ) {
+			ldap_pvt_thread_mutex_lock( &cat_wmutex );
+			if ( fwrite( c->buf.bv_val, 1, c->len, ldiffp->fp ) != c->len )
+				rc = -1;
+			ldap_pvt_thread_mutex_unlock( &cat_wmutex );
+		}
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		if ( rc ) {
+			fprintf( stderr, "slapcat: error writing output.\n" );
+			cat_rc = EXIT_FAILURE;
+			cat_stop = 1;
+			break;
+		}
+		c->done = 0;
+		cat_nwrite++;
+		ldap_pvt_thread_cond_broadcast( &cat_cond );
+	}
+	ldap_pvt_thread_cond_broadcast( &cat_cond );
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+	for ( i = 0; i < n; i++ )
+		ldap_pvt_thread_join( cat_threads[i], NULL );
+
+	for ( i = 0; i < cat_nthreads; i++ ) {
+		ch_free( cat_args[i].chunk.buf.bv_val );
+		ch_free( cat_args[i].ebuf.bv_val );
+	}
+	for ( i = 0; i < ncchunk && cchunk; i++ )
+		ch_free( cchunk[i].buf.bv_val );
+	ch_free( cchunk );
+	ch_free( cat_args );
+	ch_free( cat_threads );
+	ldap_pvt_thread_cond_destroy( &cat_wcond );
+	ldap_pvt_thread_cond_destroy( &cat_cond );
+	ldap_pvt_thread_mutex_destroy( &cat_wmutex );
+	ldap_pvt_thread_mutex_destroy( &cat_mutex );
+	return cat_rc;
+}
+
 int
 slapcat( int argc, char **argv )
 {
@@ -81,6 +345,11 @@ slapcat( int argc, char **argv )
 	}
 
 	op.o_bd = be;
+	if ( slap_tool_thread_max > 1 && be->be_entry_range &&
+		( rc = cat_threaded()) >= 0 )
+		goto done;
+	rc = EXIT_SUCCESS;
+
 	if ( !requestBSF && be->be_entry_first ) {
 		id = be->be_entry_first( be );
 
@@ -167,6 +436,7 @@ slapcat( int argc, char **argv )
 		}
 	}
 
+done:
 	be->be_entry_close( be );
 
 	if ( slap_tool_destroy())
@@ -38,6 +38,32 @@
 #include "lutil.h"
 #include "ldif.h"
 
+#ifdef _WIN32
+# ifdef __WIN64__
+# define ftello(fp)	_ftelli64(fp)
+# else
+/* Ideally we would use _ftelli64 but that was only available
+ * starting in MSVCR80.DLL. The approach used here is inaccurate
+ * because returning the underlying file handle's file pointer
+ * doesn't take the stdio buffer offset into account. But, it
+ * works with all versions of MSVCRT.
+ */
+# define ftello(fp)	_telli64(fileno(fp))
+# endif
+#else
+#define SLAP_LDIF_MAP	1
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+#endif
+
+#if defined(__SSE2__) && ( defined(__GNUC__) || defined(__clang__) )
+#define SLAP_LDIF_SSE2	1
+#include <emmintrin.h>
+#endif
+
 tool_vars tool_globals;
 
 #ifdef CSRIMALLOC
@@ -47,6 +73,25 @@ static FILE *leakfile;
 
 static LDIFFP dummy;
 
+#ifdef SLAP_LDIF_MAP
+/* The LDIF input of slapadd and slapmodify, when it is a regular
+ * file, is mapped privately and its records are parsed where they
+ * are; the mapping is followed by at least a page of zeroes.
+ */
+static char *ldif_map;	/* start of the file */
+static char *ldif_mend;	/* end of the file */
+static char *ldif_mpos;	/* next line to read */
+static char *ldif_mfree;	/* pages below are released */
+static size_t ldif_mlen;
+static long ldif_mpage;
+static int ldif_mstate;	/* 0 until tried, 1 if mapped, -1 if read */
+
+/* released pages go back to the file by this much at a time */
+#ifndef LDIF_MAP_RELEASE
+#define LDIF_MAP_RELEASE	(4 * 1024 * 1024)
+#endif
+#endif
+
 #if defined(LDAP_SYSLOG) && defined(LDAP_DEBUG)
 int start_syslog;
 static char **syslog_unknowns;
@@ -228,6 +273,56 @@ parse_slapopt( int tool, int *mode )
 			break;
 		}
 
+	} else if ( strncasecmp( optarg, "bulk-load", len ) == 0 ) {
+		switch ( tool ) {
+		case SLAPADD:
+			if ( strcasecmp( p, "yes" ) == 0 ) {
+				*mode |= SLAP_TOOL_BULKLOAD;
+			} else if ( strcasecmp( p, "no" ) == 0 ) {
+				*mode &= ~SLAP_TOOL_BULKLOAD;
+			} else {
+				Debug( LDAP_DEBUG_ANY, "unable to parse bulk-load=\"%s\".\n", p, 0, 0 );
+				return -1;
+			}
+			break;
+
+		default:
+			Debug( LDAP_DEBUG_ANY, "bulk-load meaningless for tool.\n", 0, 0, 0 );
+			break;
+		}
+
+	} else if ( strncasecmp( optarg, "unordered", len ) == 0 ) {
+		switch ( tool ) {
+		case SLAPCAT:
+			if ( strcasecmp( p, "yes" ) == 0 ) {
+				unordered = 1;
+			} else if ( strcasecmp( p, "no" ) == 0 ) {
+				unordered = 0;
+			} else {
+				Debug( LDAP_DEBUG_ANY, "unable to parse unordered=\"%s\".\n", p, 0, 0 );
+				return -1;
+			}
+			break;
+
+		default:
+			Debug( LDAP_DEBUG_ANY, "unordered meaningless for tool.\n", 0, 0, 0 );
+			break;
+		}
+
+	} else if ( strncasecmp( optarg, "dnbench", len ) == 0 ) {
+		switch ( tool ) {
+		case SLAPDN:
+			if ( lutil_atou( &dnbench, p ) ) {
+				Debug( LDAP_DEBUG_ANY, "unable to parse dnbench=\"%s\".\n", p, 0, 0 );
+				return -1;
+			}
+			break;
+
+		default:
+			Debug( LDAP_DEBUG_ANY, "dnbench meaningless for tool.\n", 0, 0, 0 );
+			break;
+		}
+
 	} else if ( strncasecmp( optarg, "ldif-wrap", len ) == 0 ) {
 		switch ( tool ) {
 		case SLAPCAT:
@@ -963,6 +1058,12 @@ int slap_tool_destroy( void )
 		BER_BVZERO( &authcDN );
 	}
 
+#ifdef SLAP_LDIF_MAP
+	if ( ldif_map ) {
+		munmap( ldif_map, ldif_mlen );
+		ldif_map = NULL;
+	}
+#endif
 	if ( ldiffp && ldiffp != &dummy ) {
 		ldif_close( ldiffp );
 	}
@@ -1233,3 +1334,203 @@ slap_tool_entry_check(
 	return LDAP_SUCCESS;
 }
 
+#ifdef SLAP_LDIF_MAP
+static int
+ldif_map_open( void )
+{
+	struct stat st;
+	off_t off;
+	size_t len;
+	char *m;
+	int fd = fileno( ldiffp->fp );
+
+	if ( ldiffp->prev || fstat( fd, &st ) || !S_ISREG( st.st_mode ))
+		return -1;
+	off = ftello( ldiffp->fp );
+	len = st.st_size;
+	if ( off < 0 || off >= st.st_size || (off_t)len != st.st_size )
+		return -1;
+
+	ldif_mpage = sysconf( _SC_PAGESIZE );
+	ldif_mlen = ( len + 2 * ldif_mpage - 1 ) & ~( ldif_mpage - 1 );
+	if ( ldif_mlen < len )
+		return -1;
+	m = mmap( NULL, ldif_mlen, PROT_READ|PROT_WRITE,
+		MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+	if ( m == MAP_FAILED )
+		return -1;
+	if ( mmap( m, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED,
+			fd, 0 ) == MAP_FAILED ) {
+		munmap( m, ldif_mlen );
+		return -1;
+	}
+#ifdef MADV_SEQUENTIAL
+	madvise( m, len, MADV_SEQUENTIAL );
+#endif
+	ldif_map = ldif_mfree = m;
+	ldif_mend = m + len;
+	ldif_mpos = m + off;
+	return 0;
+}
+
+/* Find the blank line that ends the record whose first line starts
+ * at p, and count the newlines up to it; returns the blank line, or
+ * end. *oddp is set at a CR before a newline or at a NUL, which
+ * ldif_read_record() deals with.
+ */
+static char *
+ldif_map_scan( char *p, char *end, unsigned long *nlp, int *oddp )
+{
+	unsigned long nl = 0;
+
+	/* p[0] starts a line that is not empty */
+	p++;
+#ifdef SLAP_LDIF_SSE2
+	{
+		const __m128i lf = _mm_set1_epi8( '\n' ), cr = _mm_set1_epi8( '\r' );
+		__m128i cur, prev, eol;
+
+		for ( ; end - p >= 16; p += 16 ) {
+			cur = _mm_loadu_si128( (const __m128i *)p );
+			prev = _mm_loadu_si128( (const __m128i *)( p - 1 ));
+			eol = _mm_cmpeq_epi8( cur, lf );
+			prev = _mm_or_si128( _mm_cmpeq_epi8( prev, lf ),
+				_mm_cmpeq_epi8( prev, cr ));
+			if ( _mm_movemask_epi8( _mm_or_si128(
+					_mm_and_si128( eol, prev ),
+					_mm_cmpeq_epi8( cur, _mm_setzero_si128() ))))
+				break;
+			nl += __builtin_popcount( _mm_movemask_epi8( eol ));
+		}
+	}
+#endif
+	for ( ; p < end; p++ ) {
+		if ( *p == '\n' ) {
+			nl++;
+			if ( p[-1] == '\n' )
+				break;
+			if ( p[-1] == '\r' ) {
+				*oddp = 1;
+				break;
+			}
+		} else if ( *p == '\0' ) {
+			*oddp = 1;
+			break;
+		}
+	}
+	*nlp = nl;
+	return p;
+}
+#endif /* SLAP_LDIF_MAP */
+
+/*
+ * Read the next record of the LDIF input like ldif_read_record(),
+ * setting *recp to it. Records of a mapped file are terminated where
+ * they are; from the first include, index line, CR or NUL on, the
+ * file is read into *bufp instead.
+ */
+int
+slap_tool_ldif_read(
+	unsigned long *lno,
+	char **recp,
+	char **bufp,
+	int *lmaxp )
+{
+	int rc;
+#ifdef SLAP_LDIF_MAP
+	char *p, *eol, *rec = NULL;
+	unsigned long n, lno0 = 0;
+	int odd = 0;
+
+	if ( !ldif_mstate )
+		ldif_mstate = ldif_map_open() ? -1 : 1;
+	if ( ldif_mstate < 0 )
+		goto read;
+
+	/* skip the blank lines before the record, and keep the comments */
+	for ( p = ldif_mpos; ; p = eol + 1 ) {
+		if ( p >= ldif_mend ) {
+			ldif_mpos = ldif_mend;
+			return 0;
+		}
+		eol = memchr( p, '\n', ldif_mend - p );
+		if ( eol == NULL )
+			eol = ldif_mend;
+		if ( !rec ) {
+			rec = p;
+			lno0 = *lno;
+		}
+		if (( eol > p && eol[-1] == '\r' ) || memchr( p, '\0', eol - p ))
+			goto reread;
+		if ( *p == '\n' ) {
+			rec = NULL;
+		} else if ( *p != '#' && !( *p == ' ' && rec != p )) {
+			break;
+		}
+		(*lno)++;
+	}
+	if ( isdigit( (unsigned char) *p ) ||
+		!strncasecmp( p, "include:", STRLENOF("include:") ))
+		goto reread;
+
+	p = ldif_map_scan( p, ldif_mend, &n, &odd );
+	if ( odd )
+		goto reread;
+	*lno += n;
+	if ( p < ldif_mend ) {
+		/* the blank line ends it */
+		*p = '\0';
+		ldif_mpos = p + 1;
+	} else {
+		if ( p[-1] != '\n' ) {
+			*p++ = '\n';
+			(*lno)++;
+		}
+		*p = '\0';
+		ldif_mpos = ldif_mend;
+	}
+	*recp = rec;
+	return 1;
+
+reread:
+	ldif_mstate = -1;
+	*lno = lno0;
+	if ( fseeko( ldiffp->fp, rec - ldif_map, SEEK_SET )) {
+		perror( "fseeko" );
+		return -1;
+	}
+read:
+#endif /* SLAP_LDIF_MAP */
+	rc = ldif_read_record( ldiffp, lno, bufp, lmaxp );
+	*recp = *bufp;
+	return rc;
+}
+
+/* the offset reached in the LDIF input */
+off_t
+slap_tool_ldif_tell( void )
+{
+#ifdef SLAP_LDIF_MAP
+	if ( ldif_mstate > 0 )
+		return ldif_mpos - ldif_map;
+#endif
+	return ftello( ldiffp->fp );
+}
+
+/* a record from slap_tool_ldif_read() and those before it are done
+ * with; the pages of the mapped file below it are released */
+void
+slap_tool_ldif_release( char *rec )
+{
+#if defined(SLAP_LDIF_MAP) && defined(MADV_DONTNEED)
+	char *p;
+
+	if ( !ldif_map || rec < ldif_map || rec > ldif_mend )
+		return;
+	p = ldif_map + (( rec - ldif_map ) & ~( ldif_mpage - 1 ));
+	if ( p - ldif_mfree >= LDIF_MAP_RELEASE ) {
+		madvise( ldif_mfree, p - ldif_mfree, MADV_DONTNEED );
+		ldif_mfree = p;
+	}
+#endif
+}
@@ -66,6 +66,8 @@ typedef struct tool_vars {
 	unsigned tv_dn_mode;
 	unsigned int tv_csnsid;
 	ber_len_t tv_ldif_wrap;
+	int tv_unordered;
+	unsigned int tv_dnbench;
 	char tv_maxcsnbuf[ LDAP_PVT_CSNSTR_BUFSIZE * ( SLAP_SYNC_SID_MAX + 1 ) ];
 	struct berval tv_maxcsn[ SLAP_SYNC_SID_MAX + 1 ];
 } tool_vars;
@@ -103,6 +105,8 @@ extern tool_vars tool_globals;
 #define dn_mode tool_globals.tv_dn_mode
 #define csnsid tool_globals.tv_csnsid
 #define ldif_wrap tool_globals.tv_ldif_wrap
+#define unordered tool_globals.tv_unordered
+#define dnbench tool_globals.tv_dnbench
 #define maxcsn tool_globals.tv_maxcsn
 #define maxcsnbuf tool_globals.tv_maxcsnbuf
 
@@ -136,4 +140,14 @@ int slap_tool_entry_check LDAP_P((
 	char *textbuf,
 	size_t textlen ));
 
+int slap_tool_ldif_read LDAP_P((
+	unsigned long *lno,
+	char **recp,
+	char **bufp,
+	int *lmaxp ));
+
+off_t slap_tool_ldif_tell LDAP_P((void));
+
+void slap_tool_ldif_release LDAP_P(( char *rec ));
+
 #endif /* SLAPCOMMON_H_ */
@@ -28,6 +28,7 @@
 #include <ac/string.h>
 #include <ac/socket.h>
 #include <ac/unistd.h>
+#include <ac/time.h>
 
 #include <lber.h>
 #include <ldif.h>
@@ -35,6 +36,85 @@
 
 #include "slapcommon.h"
 
+static int
+slapdn_convert( struct berval *dn, struct berval *pdn, struct berval *ndn )
+{
+	switch ( dn_mode ) {
+	case SLAP_TOOL_LDAPDN_PRETTY:
+		return dnPretty( NULL, dn, pdn, NULL );
+
+	case SLAP_TOOL_LDAPDN_NORMAL:
+		return dnNormalize( 0, NULL, NULL, dn, ndn, NULL );
+
+	default:
+		return dnPrettyNormal( NULL, dn, pdn, ndn, NULL );
+	}
+}
+
+/*
+ * Convert the DNs dnbench times over, once with the DN cache off
+ * and once with it on, and report the cost per conversion and how
+ * often the cache answered.
+ */
+static int
+slapdn_bench( int argc, char **argv )
+{
+	unsigned int	size = slap_dncache_size;
+	int		pass, i;
+
+	if ( size == 0 )
+		size = argc;
+
+	for ( pass = 0; pass < 2; pass++ ) {
+		struct timeval	start, end;
+		unsigned long	calls = 0, hits, misses;
+		unsigned int	round;
+		double		usec;
+
+		dn_cache_resize( pass ? size : 0 );
+
+		gettimeofday( &start, NULL );
+		for ( round = 0; round < dnbench; round++ ) {
+			for ( i = 0; i < argc; i++ ) {
+				struct berval	dn,
+						pdn = BER_BVNULL,
+						ndn = BER_BVNULL;
+				int		rc;
+
+				ber_str2bv( argv[ i ], 0, 0, &dn );
+				rc = slapdn_convert( &dn, &pdn, &ndn );
+				if ( rc != LDAP_SUCCESS ) {
+					fprintf( stderr, "DN: <%s> check failed %d (%s)\n",
+							dn.bv_val, rc,
+							ldap_err2string( rc ) );
+					return -1;
+				}
+				ch_free( ndn.bv_val );
+				ch_free( pdn.bv_val );
+				calls++;
+			}
+		}
+		gettimeofday( &end, NULL );
+
+		usec = ( end.tv_sec - start.tv_sec ) * 1000000.0
+			+ ( end.tv_usec - start.tv_usec );
+		dn_cache_stats( &hits, &misses );
+
+		if ( pass == 0 ) {
+			printf( "cache off: %lu conversions, %.3f usec each\n",
+				calls, calls ? usec / calls : 0.0 );
+		} else {
+			printf( "cache on (size %u): %lu conversions, %.3f usec each, "
+				"%lu hits, %lu misses (%.1f%% hit rate)\n",
+				size, calls, calls ? usec / calls : 0.0,
+				hits, misses, hits + misses ?
+					100.0 * hits / ( hits + misses ) : 0.0 );
+		}
+	}
+
+	return 0;
+}
+
 int
 slapdn( int argc, char **argv )
 {
@@ -46,6 +126,11 @@ slapdn( int argc, char **argv )
 	argv = &argv[ optind ];
 	argc -= optind;
 
+	if ( dnbench ) {
+		rc = slapdn_bench( argc, argv );
+		argc = 0;
+	}
+
 	for ( ; argc--; argv++ ) {
 		struct berval	dn,
 				pdn = BER_BVNULL,
@@ -53,19 +138,7 @@ slapdn( int argc, char **argv )
 
 		ber_str2bv( argv[ 0 ], 0, 0, &dn );
 
-		switch ( dn_mode ) {
-		case SLAP_TOOL_LDAPDN_PRETTY:
-			rc = dnPretty( NULL, &dn, &pdn, NULL );
-			break;
-
-		case SLAP_TOOL_LDAPDN_NORMAL:
-			rc = dnNormalize( 0, NULL, NULL, &dn, &ndn, NULL );
-			break;
-
-		default:
-			rc = dnPrettyNormal( NULL, &dn, &pdn, &ndn, NULL );
-			break;
-		}
+		rc = slapdn_convert( &dn, &pdn, &ndn );
 
 		if ( rc != LDAP_SUCCESS ) {
 			fprintf( stderr, "DN: <%s> check failed %d (%s)\n",
@@ -45,7 +45,7 @@ static char csnbuf[ LDAP_PVT_CSNSTR_BUFSIZE ];
 int
 slapmodify( int argc, char **argv )
 {
-	char *buf = NULL;
+	char *buf = NULL, *rec;
 	const char *text;
 	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
 	size_t textlen = sizeof textbuf;
@@ -133,7 +133,7 @@ slapmodify( int argc, char **argv )
 	}
 
 	/* nextline is the line number of the end of the current entry */
-	for( lineno=1; ( ldifrc = ldif_read_record( ldiffp, &nextline, &buf, &lmax )) > 0;
+	for( lineno=1; ( ldifrc = slap_tool_ldif_read( &nextline, &rec, &buf, &lmax )) > 0;
 		lineno=nextline+1 )
 	{
 		BackendDB *bd;
@@ -147,14 +147,14 @@ slapmodify( int argc, char **argv )
 		int mod_err = 0;
 		char *request = "(unknown)";
 
-		ber_str2bv( buf, 0, 0, &rbuf );
+		ber_str2bv( rec, 0, 0, &rbuf );
 
 		if ( lineno < jumpline )
 			continue;
 
 		if ( enable_meter )
 			lutil_meter_update( &meter,
-					 ftell( ldiffp->fp ),
+					 slap_tool_ldif_tell(),
 					 0);
 
 		/*
@@ -590,6 +590,7 @@ slapmodify( int argc, char **argv )
 
 cleanup:;
 		ldap_ldif_record_done( &lr );
+		slap_tool_ldif_release( rec );
 		SLAP_FREE( ndn.bv_val );
 		if ( e ) entry_free( e );
 		if ( e_orig ) be_entry_release_w( op, e_orig );
@@ -604,7 +605,7 @@ cleanup:;
 	bvtext.bv_val[0] = '\0';
 
 	if ( enable_meter ) {
-		lutil_meter_update( &meter, ftell( ldiffp->fp ), 1);
+		lutil_meter_update( &meter, slap_tool_ldif_tell(), 1);
 		lutil_meter_close( &meter );
 	}
 